@@ -329,6 +329,9 @@ impl<T: Config> Module<T> {
 		// You can also wait idefinitely for the response, however you may still get a timeout
 		// coming from the host machine.
 		let deadline = sp_io::offchain::timestamp().add(Duration::from_millis(30_000));
+		// The service drops the request instead of verifying it once we stop waiting.
+		let mut deadline_buf = [0u8; 20];
+		let deadline_header = Self::format_decimal(deadline.unix_millis(), &mut deadline_buf);
 		// Initiate an external HTTP GET request.
 		// This is using high-level wrappers from `sp_runtime`, for the low-level calls that
 		// you can find in `sp_io`. The API is trying to be similar to `reqwest`, but
@@ -338,6 +341,7 @@ impl<T: Config> Module<T> {
 				.method(http::Method::Post)
 				.url("http://localhost:17777/entryNetwork")
 				.body(vec![evidence])
+				.add_header("X-Request-Deadline", deadline_header)
 				.deadline(deadline)
 				.send()
 				.map_err(|e| {
@@ -383,6 +387,20 @@ impl<T: Config> Module<T> {
 		Ok(message.clone())
 	}
 
+	/// Format `n` in decimal at the end of `buf`, for header values.
+	fn format_decimal(mut n: u64, buf: &mut [u8; 20]) -> &str {
+		let mut i = buf.len();
+		loop {
+			i -= 1;
+			buf[i] = b'0' + (n % 10) as u8;
+			n /= 10;
+			if n == 0 {
+				break;
+			}
+		}
+		str::from_utf8(&buf[i..]).unwrap_or("0")
+	}
+
 	/// Parse the price from the given JSON string using `lite-json`.
 	///
 	/// Returns `None` when parsing failed or `Some(price in cents)` when parsing is successful.
@@ -392,3 +392,19 @@ fn parse_price_works() {
 		assert_eq!(expected, Example::parse_price(json));
 	}
 }
+
+#[test]
+fn format_decimal_works() {
+	let test_data = vec![
+		(0, "0"),
+		(7, "7"),
+		(10, "10"),
+		(1_623_456_789_012, "1623456789012"),
+		(u64::MAX, "18446744073709551615"),
+	];
+
+	for (n, expected) in test_data {
+		let mut buf = [0u8; 20];
+		assert_eq!(expected, Example::format_decimal(n, &mut buf));
+	}
+}
@@ -241,7 +241,7 @@ sgxsdkdir=$inteldir/sgxsdk
 sgx_repo='deb [arch=amd64] https://download.01.org/intel-sgx/sgx_repo/ubuntu bionic main'  
 sgx_repo_file=/etc/apt/sources.list.d/intel-sgx.list
 sgx_apt_key=https://download.01.org/intel-sgx/sgx_repo/ubuntu/intel-sgx-deb.key
-basic_deps=(curl wget jq lsof build-essential python expect linux-headers-`uname -r`)
+basic_deps=(curl wget jq lsof build-essential g++-10 python expect linux-headers-`uname -r`)
 pccs_deps=(libsgx-urts libsgx-dcap-ql libsgx-dcap-default-qpl libsgx-dcap-quote-verify)
 ecdsa_dev_deps=(libsgx-enclave-common-dev libsgx-dcap-ql-dev libsgx-dcap-default-qpl-dev libsgx-dcap-quote-verify-dev)
 
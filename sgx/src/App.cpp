@@ -1,25 +1,52 @@
-#include "sgx_report.h"
-#include "sgx_dcap_ql_wrapper.h"
-#include "sgx_pce.h"
-#include "sgx_error.h"
-#include "sgx_quote_3.h"
-#include "sgx_ql_quote.h"
-#include "sgx_dcap_quoteverify.h"
-#include "sgx_utils.h"
-#include "sgx_urts.h"
-#include "sgx_tcrypto.h"
-#include <sgx_ecp_types.h>
-
 #include "httplib.h"
 #include "Json.h"
 #include "Log.h"
-#include "Defer.h"
+#include "Arena.h"
+#include "Metrics.h"
+#include "Supervisor.h"
+#include "ShmServer.h"
+#include "StreamVerifier.h"
+#include "H2Server.h"
+#include "FairScheduler.h"
+#include "CollateralCache.h"
+#include "CollateralStore.h"
+#include "CollateralDisk.h"
+#include "ResultLog.h"
+#include "SharedResultCache.h"
+#include "TokenSigner.h"
+#include "Policy.h"
+#include "IdentityRegistry.h"
+#include "Verifier.h"
 #include "Utils.h"
 
+#include <signal.h>
+#include <pthread.h>
+#include <chrono>
+#include <thread>
+
 using namespace httplib;
 
 std::string host = "0.0.0.0";
 int port = 1234;
+size_t worker_num = 0;
+bool local_keep_alive = false;
+std::vector<int> cpus;
+std::string unix_path;
+int unix_sock = -1;
+std::vector<uint32_t> unix_uids;
+std::vector<uint32_t> unix_gids;
+std::string shm_path;
+bool h2c = false;
+size_t max_queued = 0;
+uint64_t max_queue_wait_ms = 0;
+uint64_t collateral_grace_s = COLLATERAL_GRACE_S;
+std::string collateral_store_path;
+std::string collateral_cache_dir;
+std::string result_log_path;
+std::string shared_cache_path;
+std::string token_key_path;
+std::string policy_path;
+size_t identity_registry_capacity = 0;
 
 int show_help(const char *name)
 {
@@ -29,10 +56,392 @@ int show_help(const char *name)
     printf("           -h, --help: help information. \n");
     printf("           -t, --host: set server host, default is %s \n", host.c_str());
     printf("           -p, --port: set server port, default is %d \n", port);
+    printf("           -w, --workers: fork indicated number of worker processes sharing the port, default is single process \n");
+    printf("           -c, --cpus: cpu list like '0-3,6' shared out among workers, default is current affinity \n");
+    printf("           -l, --local-keep-alive: keep local clients' connections alive without limit and handle their pipelined requests concurrently \n");
+    printf("           -u, --unix: also serve on unix domain socket at indicated path, like /run/dcap.sock \n");
+    printf("           --unix-uids: uid list like '0,1000' allowed to connect to unix domain socket, default is root and current user \n");
+    printf("           --unix-gids: gid list allowed to connect to unix domain socket besides allowed uids, default is none \n");
+    printf("           -s, --shm: also serve binary requests on shared memory ring at indicated path, like /dev/shm/dcap-ring \n");
+    printf("           --max-queued: connections waiting for a thread beyond which new ones get 503, like 1024, default is 0 for no limit \n");
+    printf("           --max-queue-wait: queue wait in milliseconds beyond which new connections get 503, like 10000, default is 0 for no limit \n");
+    printf("           --collateral-grace: seconds collateral older than %d seconds is still used while collateral service is slow or down, default is %lu \n", COLLATERAL_REFRESH_S, collateral_grace_s);
+    printf("           --collateral-store: read collateral from indicated directory or tar bundle instead of collateral service, reloaded when it changes \n");
+    printf("           --collateral-cache: keep collateral fetched from collateral service in indicated directory, so that it is used at once after restart \n");
+    printf("           --result-log: keep accepted quotes in indicated file, so that their results are used at once after restart \n");
+    printf("           --shared-cache: share results of accepted quotes with all workers and service processes given the same file, like /dev/shm/dcap-results \n");
+    printf("           --token-key: issue tokens for accepted evidence, keyed by secret in indicated file, and accept those of all instances sharing it \n");
+    printf("           --policy: accept only enclaves and quote verification results allowed by indicated json file \n");
+    printf("           --identity-registry: keep identities of accepted evidence, up to indicated number, and answer them by GET /identity \n");
+    printf("           --h2c: also take HTTP/2 cleartext connections with prior knowledge, which multiplex /entryNetwork requests \n");
 
     return 1;
 }
 
+/**
+ * @description: Whether unix domain socket peer is allowed by its uid or gid
+ * @param sock -> Accepted unix domain socket
+ * @return: Allowed or not
+ */
+bool is_allowed_unix_peer(socket_t sock)
+{
+    uid_t uid = 0;
+    gid_t gid = 0;
+    if (!get_peer_cred(sock, &uid, &gid))
+    {
+        return false;
+    }
+
+    return std::find(unix_uids.begin(), unix_uids.end(), uid) != unix_uids.end()
+        || std::find(unix_gids.begin(), unix_gids.end(), gid) != unix_gids.end();
+}
+
+/**
+ * @description: Decode hex key of identity query
+ * @param hex -> Hex key
+ * @param key -> Decoded key
+ * @param key_len -> Key length
+ * @return: Whether hex holds exactly a key
+ */
+bool decode_key(const std::string &hex, uint8_t *key, size_t key_len)
+{
+    return hex.size() == key_len * 2 && hexstring_to_buffer(hex.c_str(), hex.size(), key) == key_len;
+}
+
+/**
+ * @description: Register routes, the same ones are served over TCP and unix domain socket
+ * @param svr -> Server to be set up
+ * @param stop_servers -> Stops all servers of this process
+ */
+void setup_server(Server &svr, std::function<void()> stop_servers)
+{
+    Log *p_log = Log::get_instance();
+    Metrics *p_metrics = Metrics::get_instance();
+    Supervisor *p_supervisor = Supervisor::get_instance();
+    Verifier *p_verifier = Verifier::get_instance();
+    StreamVerifier *p_stream_verifier = StreamVerifier::get_instance();
+    FairScheduler *p_fair_scheduler = FairScheduler::get_instance();
+    p_metrics->set(METRIC_QVL_LIMIT, ConcurrencyLimiter::get_instance()->get_limit());
+    CollateralCache::get_instance()->set_grace(collateral_grace_s);
+
+    // Requests waiting for their turn of quote verification hold their threads
+    svr.new_task_queue = [] { return new ThreadPool(FAIR_SCHEDULER_HTTP_THREAD_NUM); };
+
+    if (local_keep_alive)
+    {
+        svr.set_trusted_connection_checker([](socket_t sock) { return is_local_peer(sock); });
+    }
+
+    svr.set_payload_max_length(REQUEST_MAX_BODY_SIZE);
+
+    // Health probes and admin requests are answered even while shedding
+    svr.set_admission_control(max_queued, max_queue_wait_ms);
+    svr.set_admission_exempt_checker([](const Request& req) {
+        return req.path == "/hello" || req.path == "/metrics" || req.path == "/stop";
+    });
+    svr.set_admission_logger([p_metrics](bool shed, uint64_t wait_us) {
+        if (shed)
+        {
+            p_metrics->add(METRIC_SHED_TOTAL);
+            return;
+        }
+        p_metrics->add(METRIC_QUEUE_TOTAL);
+        p_metrics->add(METRIC_QUEUE_WAIT_US, wait_us);
+    });
+
+    svr.set_logger([p_metrics](const Request& req, const Response& /*res*/) {
+        p_metrics->add(METRIC_HTTP_REQUEST_TOTAL);
+        if (req.connection_request_index == 0)
+            p_metrics->add(METRIC_CONNECTION_TOTAL);
+    });
+
+    svr.Get("/hello", [](const Request& /*req*/, Response& res) {
+        res.set_content("Hello World!", "text/plain");
+    });
+
+    svr.Get("/stop", [p_supervisor, stop_servers](const Request& /*req*/, Response& /*res*/) {
+        if (p_supervisor->is_worker())
+            p_supervisor->stop();
+        else
+            stop_servers();
+    });
+
+    svr.Get("/metrics", [p_metrics](const Request& /*req*/, Response& res) {
+        res.set_content(p_metrics->to_json().dump(), "application/json");
+    });
+
+    // Look identities up by exactly one of pubkey, account or mrenclave, the last one lists them
+    svr.Get("/identity", [](const Request& req, Response& res) {
+        IdentityRegistry *p_identity_registry = IdentityRegistry::get_instance();
+        json::JSON ans;
+        identity_record_t record;
+        bool found = false;
+        if (!p_identity_registry->is_enabled())
+        {
+            res.status = 503;
+            ans["message"] = "Identity registry is not enabled!";
+        }
+        else if (req.has_param("pubkey") + req.has_param("account") + req.has_param("mrenclave") != 1)
+        {
+            res.status = 400;
+            ans["message"] = "Give one of pubkey, account or mrenclave!";
+        }
+        else if (req.has_param("pubkey"))
+        {
+            if (!decode_key(req.get_param_value("pubkey"), record.pubkey, sizeof(record.pubkey)))
+            {
+                res.status = 400;
+                ans["message"] = "Invalid pubkey!";
+            }
+            else
+            {
+                found = p_identity_registry->get_by_pubkey(record.pubkey, &record);
+                ans["attested"] = found && IdentityRegistry::is_attested(record);
+            }
+        }
+        else if (req.has_param("account"))
+        {
+            std::string account = req.get_param_value("account");
+            found = p_identity_registry->get_by_account(account.c_str(), account.size(), &record);
+            ans["attested"] = found && IdentityRegistry::is_attested(record);
+        }
+        else if (!decode_key(req.get_param_value("mrenclave"), record.mrenclave, sizeof(record.mrenclave)))
+        {
+            res.status = 400;
+            ans["message"] = "Invalid mrenclave!";
+        }
+        else
+        {
+            size_t limit = IDENTITY_QUERY_LIMIT;
+            if (req.has_param("limit"))
+                limit = std::min(limit, (size_t)std::strtoull(req.get_param_value("limit").c_str(), NULL, 10));
+            std::vector<identity_record_t> records;
+            ans["count"] = (long)p_identity_registry->get_by_mrenclave(record.mrenclave, limit, records);
+            ans["identities"] = json::Array();
+            for (auto &r : records)
+                ans["identities"].append(IdentityRegistry::to_json(r));
+        }
+        if (found)
+            ans["identity"] = IdentityRegistry::to_json(record);
+        res.set_content(ans.dump(), "application/json");
+    });
+
+    svr.Post("/entryNetwork", [p_log, p_metrics, p_verifier, p_fair_scheduler](const Request& req, Response& res, const ContentReader& content_reader) {
+        p_log->info("Dealing with new request...\n");
+        auto start_time = std::chrono::steady_clock::now();
+
+        // Everything of this request is drawn from arena, which is released after response is sent
+        Arena *arena = Arena::create();
+        if (arena == NULL)
+        {
+            res.status = 500;
+            return;
+        }
+
+        // Content-Length is only a hint, a client can't make us take more than a small block up front
+        size_t body_cap = std::min(req.get_header_value<uint64_t>("Content-Length"), (uint64_t)REQUEST_BODY_PREALLOC_SIZE);
+        size_t body_len = 0;
+        char *body = body_cap > 0 ? (char *)arena->alloc(body_cap, 1) : NULL;
+        // Bodies over payload limit are refused by reader with 413 in res.status
+        int read_status = 400;
+        if (body_cap > 0 && body == NULL)
+            body_cap = 0;
+        bool read_ok = content_reader([&](const char *data, size_t data_len) {
+            if (data_len > REQUEST_MAX_BODY_SIZE - body_len)
+            {
+                read_status = 413;
+                return false;
+            }
+            if (body_len + data_len > body_cap)
+            {
+                size_t new_cap = std::min(std::max(body_cap * 2, body_len + data_len), (size_t)REQUEST_MAX_BODY_SIZE);
+                body = (char *)arena->grow(body, body_len, new_cap);
+                if (body == NULL)
+                {
+                    read_status = 500;
+                    return false;
+                }
+                body_cap = new_cap;
+            }
+            memcpy(body + body_len, data, data_len);
+            body_len += data_len;
+            return true;
+        });
+
+        // Work is dropped at every stage once client's deadline passed or client has gone, nobody reads its result
+        uint64_t deadline_ms = parse_deadline_ms(req.get_header_value(REQUEST_DEADLINE_HEADER).c_str());
+        auto is_stale = [&req, deadline_ms] { return is_deadline_passed(deadline_ms) || req.is_connection_closed(); };
+        metric_t cancelled_stage = METRIC_NUM;
+
+        verify_result_t result;
+        verify_evidence_t evidence;
+        if (!read_ok)
+        {
+            if (res.status == 413)
+                read_status = 413;
+            memset(&result, 0, sizeof(result));
+            result.message = read_status == 413 ? "Request body is too large!" : "Unexpected error";
+            result.status_code = read_status;
+        }
+        else if (is_stale())
+        {
+            cancelled_stage = METRIC_CANCELLED_HTTP_QUEUE_TOTAL;
+        }
+        // Quote verification takes turns among accounts, so an account flooding requests only delays itself
+        else if (p_verifier->parse_request(arena, body, body_len, &evidence, &result)
+                && p_verifier->verify_policy(&evidence, &result)
+                && !p_verifier->verify_token(&evidence, &result)
+                && !p_verifier->verify_rejected(&evidence, &result)
+                && p_verifier->verify_signature(arena, &evidence, &result)
+                && !p_verifier->verify_cached(&evidence, &result)
+                && !p_fair_scheduler->run(evidence.account, evidence.account_len, [&] {
+                    if (is_stale())
+                        cancelled_stage = METRIC_CANCELLED_ACCOUNT_QUEUE_TOTAL;
+                    else
+                        p_verifier->verify_quote(arena, &evidence, &result);
+                }))
+        {
+            p_metrics->add(METRIC_ACCOUNT_REJECTED_TOTAL);
+            result.message = "Too many requests of this account!";
+            result.status_code = 429;
+            res.set_header("Retry-After", "1");
+        }
+
+        if (cancelled_stage != METRIC_NUM)
+        {
+            p_metrics->add(cancelled_stage);
+            memset(&result, 0, sizeof(result));
+            result.message = "Request deadline passed!";
+            result.status_code = 504;
+        }
+        else
+        {
+            // Only accepted results, whose evidence is parsed
+            p_verifier->issue_token(arena, &evidence, &result);
+            p_metrics->add(METRIC_REQUEST_TOTAL);
+            p_metrics->add(200 == result.status_code ? METRIC_VERIFY_SUCCESS : METRIC_VERIFY_FAILED);
+            p_metrics->add(METRIC_VERIFY_LATENCY_US, std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start_time).count());
+        }
+
+        size_t resp_len = 0;
+        char *resp = p_verifier->dump_result(arena, &result, &resp_len);
+        if (resp == NULL)
+        {
+            Arena::release(arena);
+            res.status = 500;
+            return;
+        }
+        res.status = result.status_code;
+        res.set_content_span(resp, resp_len, "application/json",
+            [arena](bool /*success*/) { Arena::release(arena); });
+    });
+
+    svr.Upgrade("/entryNetwork/stream", [p_stream_verifier](const Request& req, Stream& strm) {
+        return p_stream_verifier->serve(req, strm);
+    });
+
+    if (h2c)
+    {
+        H2Server *p_h2_server = H2Server::get_instance();
+        svr.set_prior_knowledge_handler([p_h2_server](const Request& req, Stream& strm) {
+            return p_h2_server->serve(req, strm);
+        });
+    }
+}
+
+/**
+ * @description: Serve requests until stopped, runs in every worker process
+ * @param worker_idx -> Worker index
+ * @return: Exit code
+ */
+int serve(size_t worker_idx)
+{
+    Log *p_log = Log::get_instance();
+
+    // Stop server gracefully on SIGTERM and SIGINT
+    sigset_t stop_sigs;
+    sigemptyset(&stop_sigs);
+    sigaddset(&stop_sigs, SIGTERM);
+    sigaddset(&stop_sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_sigs, NULL);
+
+    Server svr;
+    Server unix_svr;
+    std::function<void()> stop_servers = [&svr, &unix_svr](void) {
+        StreamVerifier::get_instance()->stop();
+        H2Server::get_instance()->stop();
+        svr.stop();
+        unix_svr.stop();
+    };
+    std::thread([stop_servers, stop_sigs](void) {
+        int sig = 0;
+        sigwait(&stop_sigs, &sig);
+        stop_servers();
+    }).detach();
+
+    // Every worker binds its own socket, kernel balances connections among them
+    svr.set_socket_options([](socket_t sock) {
+        int yes = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<void *>(&yes), sizeof(yes));
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<void *>(&yes), sizeof(yes));
+    });
+    setup_server(svr, stop_servers);
+
+    if (!svr.bind_to_port(host.c_str(), port))
+    {
+        p_log->err("Worker %lu listens at %s:%d failed!\n", worker_idx, host.c_str(), port);
+        return 1;
+    }
+
+    // Unix domain socket is created by main process and shared by all workers
+    std::thread unix_thread;
+    if (unix_sock != -1)
+    {
+        setup_server(unix_svr, stop_servers);
+        unix_svr.set_connection_filter(is_allowed_unix_peer);
+        unix_thread = std::thread([&unix_svr](void) {
+            unix_svr.listen_on_socket(unix_sock);
+        });
+        // Make sure a stop request reaches both servers
+        while (!unix_svr.is_running())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        p_log->info("Start dcap service at %s successfully!\n", unix_path.c_str());
+    }
+
+    CollateralStore *p_collateral_store = CollateralStore::get_instance();
+    if (p_collateral_store->is_enabled())
+    {
+        p_collateral_store->start();
+    }
+
+    // Each worker loads accepted quotes into its own result cache before taking requests
+    ResultLog *p_result_log = ResultLog::get_instance();
+    if (p_result_log->is_enabled())
+    {
+        p_result_log->start();
+    }
+
+    ShmServer *p_shm_server = ShmServer::get_instance();
+    if (p_shm_server->is_enabled())
+    {
+        p_shm_server->start();
+        p_log->info("Start dcap service at %s successfully!\n", shm_path.c_str());
+    }
+
+    p_log->info("Start dcap service at %s:%d successfully!\n", host.c_str(), port);
+    svr.listen_after_bind();
+    unix_svr.stop();
+    if (unix_thread.joinable())
+        unix_thread.join();
+    p_shm_server->stop();
+    CollateralCache::get_instance()->stop();
+    p_collateral_store->stop();
+    p_result_log->stop();
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     Log *p_log = Log::get_instance();
@@ -63,245 +472,262 @@ int main(int argc, char *argv[])
             i++;
             port = std::atoi(argv[i]);
         }
-        else
+        else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--workers") == 0)
         {
-            return show_help(argv[0]);
+            if (i + 1 >= argc)
+            {
+                p_log->err("-w,--workers option needs worker number as argument!\n");
+                return 1;
+            }
+            i++;
+            worker_num = std::atoi(argv[i]);
         }
-    }
-
-    p_log->info("Start dcap service at %s:%d successfully!\n", host.c_str(), port);
-    Server svr;
-
-    svr.Get("/hello", [](const Request& /*req*/, Response& res) {
-        res.set_content("Hello World!", "text/plain");
-    });
-
-    svr.Get("/stop", [&](const Request& /*req*/, Response& /*res*/) {
-        svr.stop();
-    });
-
-    svr.Post("/entryNetwork", [&](const Request& req, Response& res) {
-        //call DCAP quote verify library to get supplemental data size
-        p_log->info("Dealing with new request...\n");
-	    int ret = 0;
-        json::JSON ret_body;
-        sgx_ql_qv_result_t quote_verification_result = SGX_QL_QV_RESULT_UNSPECIFIED;
-	    uint32_t collateral_expiration_status = 1;
-        uint32_t supplemental_data_size = 0;
-        uint8_t *p_supplemental_data = NULL;
-        json::JSON id;
-
-        Defer def_ret([&res, &ret_body, &id](void) {
-            int status = ret_body["status_code"].ToInt();
-            if (200 == status)
-                ret_body["message"] = id;
-            res.status = status;
-            std::string body = ret_body.dump();
-            remove_char(body, '\\');
-            remove_char(body, '\n');
-            res.set_content(body, "application/json");
-        });
-
-        crust_status_t crust_status = CRUST_SUCCESS;
-        json::JSON ecdsa_identity = json::JSON::Load(&crust_status, req.body);
-        if (CRUST_SUCCESS != crust_status)
+        else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--local-keep-alive") == 0)
         {
-            p_log->err("Load ecdsa_identity failed! Error code:%x\n", crust_status);
-            ret_body["message"] = "Load ecdsa_identity failed!";
-            ret_body["status_code"] = 400;
-            return;
+            local_keep_alive = true;
         }
-
-        // ----- Verify signature ----- //
-        std::string sig = ecdsa_identity["sig"].ToString();
-        uint8_t *p_sig = hexstring_to_bytes(sig.c_str(), sig.size());
-        if (p_sig == NULL)
-        {
-            ret_body["message"] = "Unexpected error";
-            ret_body["status_code"] = 400;
-            return ;
-        }
-        Defer def_sig([&p_sig](void) { free(p_sig); });
-        uint8_t p_result;
-        // Get signature data
-        std::string quote_hexstr = ecdsa_identity["quote"].ToString();
-        uint8_t *p_quote = hexstring_to_bytes(quote_hexstr.c_str(), quote_hexstr.size());
-        uint32_t quote_sz = quote_hexstr.size() / 2;
-        std::string account_id = ecdsa_identity["account"].ToString();
-        uint32_t sig_data_sz = quote_sz + account_id.size();
-        uint8_t *p_sig_data = (uint8_t *)malloc(sig_data_sz);
-        Defer def_sig_data([&p_sig_data](void) { free(p_sig_data); });
-        memset(p_sig_data, 0, sig_data_sz);
-        memcpy(p_sig_data, p_quote, quote_sz);
-        memcpy(p_sig_data + quote_sz, account_id.c_str(), account_id.size());
-        _sgx_quote3_t *quote = (_sgx_quote3_t*)p_quote;
-        uint8_t *p_pub_key = reinterpret_cast<uint8_t *>(&quote->report_body.report_data);
-        uint8_t *p_mr_enclave = reinterpret_cast<uint8_t *>(&quote->report_body.mr_enclave);
-        uint32_t identity_sz = sizeof(sgx_report_data_t) + sizeof(sgx_measurement_t) + account_id.size();
-        // Get return message
-        id["pubkey"] = hexstring(p_pub_key, sizeof(sgx_report_data_t));
-        id["mrenclave"] = hexstring(p_mr_enclave, sizeof(sgx_measurement_t));
-        id["account"] = account_id;
-        // Verify signature
-        sgx_sha256_hash_t msg_hash;
-        sgx_sha256_msg(p_sig_data, sig_data_sz, &msg_hash);
-        EC_KEY *ec_pkey = key_from_sgx_ec256((sgx_ec256_public_t *)p_pub_key);
-        ret = ECDSA_verify(0, reinterpret_cast<const uint8_t *>(&msg_hash), sizeof(sgx_sha256_hash_t),
-                p_sig, sizeof(sgx_ec256_signature_t), ec_pkey);
-        if (0 == ret)
-        {
-            ret_body["message"] = "Verify identity signature failed!";
-            ret_body["status_code"] = 500;
-            return;
+        else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--unix") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("-u,--unix option needs socket file path as argument!\n");
+                return 1;
+            }
+            i++;
+            unix_path = argv[i];
         }
-
-        // ----- Verify qutoe ----- //
-        quote3_error_t dcap_ret = sgx_qv_get_quote_supplemental_data_size(&supplemental_data_size);
-        if (dcap_ret == SGX_QL_SUCCESS && supplemental_data_size == sizeof(sgx_ql_qv_supplemental_t)) 
+        else if (strcmp(argv[i], "--unix-uids") == 0 || strcmp(argv[i], "--unix-gids") == 0)
         {
-            p_log->info("sgx_qv_get_quote_supplemental_data_size successfully returned.\n");
-            p_supplemental_data = (uint8_t*)malloc(supplemental_data_size);
+            if (i + 1 >= argc)
+            {
+                p_log->err("%s option needs id list as argument!\n", argv[i]);
+                return 1;
+            }
+            i++;
+            if (!parse_id_list(argv[i], strcmp(argv[i - 1], "--unix-uids") == 0 ? unix_uids : unix_gids))
+            {
+                p_log->err("Invalid id list:%s\n", argv[i]);
+                return 1;
+            }
         }
-        else {
-            p_log->err("sgx_qv_get_quote_supplemental_data_size failed: 0x%04x\n", dcap_ret);
-            supplemental_data_size = 0;
+        else if (strcmp(argv[i], "--max-queued") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--max-queued option needs connection number as argument!\n");
+                return 1;
+            }
+            i++;
+            max_queued = std::strtoul(argv[i], NULL, 10);
         }
-
-        //set current time. This is only for sample purposes, in production mode a trusted time should be used.
-        time_t current_time = time(NULL);
-
-
-        //call DCAP quote verify library for quote verification
-        //here you can choose 'trusted' or 'untrusted' quote verification by specifying parameter '&qve_report_info'
-        //if '&qve_report_info' is NOT NULL, this API will call Intel QvE to verify quote
-        //if '&qve_report_info' is NULL, this API will call 'untrusted quote verify lib' to verify quote, this mode doesn't rely on SGX capable system, but the results can not be cryptographically authenticated
-        dcap_ret = sgx_qv_verify_quote(
-            p_quote, (uint32_t)quote_sz,
-            NULL,
-            current_time,
-            &collateral_expiration_status,
-            &quote_verification_result,
-            NULL,
-            supplemental_data_size,
-            p_supplemental_data);
-        if (p_supplemental_data != NULL)
-            free(p_supplemental_data);
-        if (dcap_ret == SGX_QL_SUCCESS)
+        else if (strcmp(argv[i], "--max-queue-wait") == 0)
         {
-            p_log->info("App: sgx_qv_verify_quote successfully returned.\n");
+            if (i + 1 >= argc)
+            {
+                p_log->err("--max-queue-wait option needs milliseconds as argument!\n");
+                return 1;
+            }
+            i++;
+            max_queue_wait_ms = std::strtoull(argv[i], NULL, 10);
         }
-        else
+        else if (strcmp(argv[i], "--collateral-grace") == 0)
         {
-            switch (dcap_ret)
+            if (i + 1 >= argc)
             {
-            case SGX_QL_QUOTE_FORMAT_UNSUPPORTED:
-                p_log->err("The inputted quote format is not supported. Either because the header information is not supported or the quote is malformed in some way.\n");
-                break;
-            case SGX_QL_QUOTE_CERTIFICATION_DATA_UNSUPPORTED:
-                p_log->err("The quote verifier doesn’t support the certification data in the Quote. Currently, the Intel QVE only supported CertType = 5.\n");
-                break;
-            case SGX_QL_QE_REPORT_UNSUPPORTED_FORMAT:
-                p_log->err("The quote verifier doesn’t support the format of the application REPORT the Quote.\n");
-                break;
-            case SGX_QL_QE_REPORT_INVALID_SIGNATURE:
-                p_log->err("The signature over the QE Report is invalid.\n");
-                break;
-            case SGX_QL_PCK_CERT_UNSUPPORTED_FORMAT:
-                p_log->err("The format of the PCK Cert is unsupported.\n");
-                break;
-            case SGX_QL_PCK_CERT_CHAIN_ERROR:
-                p_log->err("There was an error verifying the PCK Cert signature chain including PCK Cert revocation.\n");
-                break;
-            case SGX_QL_TCBINFO_UNSUPPORTED_FORMAT:
-                p_log->err("The format of the TCBInfo structure is unsupported.\n");
-                break;
-            case SGX_QL_TCBINFO_CHAIN_ERROR:
-                p_log->err("There was an error verifying the TCBInfo signature chain including TCBInfo revocation.\n");
-                break;
-            case SGX_QL_TCBINFO_MISMATCH:
-                p_log->err("PCK Cert FMSPc does not match the TCBInfo FMSPc.\n");
-                break;
-            case SGX_QL_QEIDENTITY_UNSUPPORTED_FORMAT:
-                p_log->err("The format of the QEIdentity structure is unsupported.\n");
-                break;
-            case SGX_QL_QEIDENTITY_MISMATCH:
-                p_log->err("The Quote’s QE doesn’t match the inputted expected QEIdentity.\n");
-                break;
-            case SGX_QL_QEIDENTITY_CHAIN_ERROR:
-                p_log->err("There was an error verifying the QEIdentity signature chain including QEIdentity revocation.\n");
-                break;
-            case SGX_QL_ENCLAVE_LOAD_ERROR:
-                p_log->err("Unable to load the enclaves required to initialize the attestation key. error, loading infrastructure error or insufficient enclave memory.\n");
-                break;
-            case SGX_QL_ENCLAVE_LOST:
-                p_log->err("Could be due to file I/O. Enclave lost after power transition or used in child process created by linux:fork().\n");
-                break;
-            case SGX_QL_INVALID_REPORT:
-                p_log->err("Report MAC check failed on application report.\n");
-                break;
-            case SGX_QL_PLATFORM_LIB_UNAVAILABLE:
-                p_log->err("The Quote Library could not locate the platform quote provider library or one of its required APIs.\n");
-                break;
-            case SGX_QL_UNABLE_TO_GENERATE_REPORT:
-                p_log->err("The QVE was unable to generate its own report targeting the application enclave because there is an enclave compatibility issue.\n");
-                break;
-            case SGX_QL_NETWORK_ERROR:
-                p_log->err("Network error when retrieving PCK certs.\n");
-                break;
-            case SGX_QL_NO_QUOTE_COLLATERAL_DATA :
-                p_log->err("The Quote Library was available, but the quote library could not retrieve the data.\n");
-                break;
-            case SGX_QL_ERROR_QVL_QVE_MISMATCH:
-                p_log->err("Only returned when the quote verification library supports both the untrusted mode of verification and the QvE backed mode of verification. This error indicates that the 2 versions of the verification modes are different. Most caused by using a QvE that does not match the version of the DCAP installed.\n");
-                break;
-            case SGX_QL_ERROR_UNEXPECTED:
-                p_log->err("An unexpected internal error occurred.\n");
-                break;
-            case SGX_QL_UNKNOWN_MESSAGE_RESPONSE:
-                p_log->err("Unexpected error from the attestation infrastructure while retrieving the platform data.\n");
-                break;
-            case SGX_QL_ERROR_MESSAGE_PARSING_ERROR:
-                p_log->err("Generic message parsing error from the attestation infrastructure while retrieving the platform data.\n");
-                break;
-            case SGX_QL_PLATFORM_UNKNOWN:
-                p_log->err("This platform is an unrecognized SGX platform.\n");
-                break;
-            default:
-                p_log->err("undefined error: sgx_qv_verify_quote failed: 0x%04x\n", dcap_ret);
+                p_log->err("--collateral-grace option needs seconds as argument!\n");
+                return 1;
             }
-            ret_body["message"] = "Verify quote failed!";
-            ret_body["status_code"] = 500;
-            return;
+            i++;
+            collateral_grace_s = std::strtoull(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--collateral-store") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--collateral-store option needs directory or bundle path as argument!\n");
+                return 1;
+            }
+            i++;
+            collateral_store_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--collateral-cache") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--collateral-cache option needs directory path as argument!\n");
+                return 1;
+            }
+            i++;
+            collateral_cache_dir = argv[i];
+        }
+        else if (strcmp(argv[i], "--result-log") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--result-log option needs file path as argument!\n");
+                return 1;
+            }
+            i++;
+            result_log_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--shared-cache") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--shared-cache option needs file path as argument!\n");
+                return 1;
+            }
+            i++;
+            shared_cache_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--token-key") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--token-key option needs file path as argument!\n");
+                return 1;
+            }
+            i++;
+            token_key_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--policy") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--policy option needs file path as argument!\n");
+                return 1;
+            }
+            i++;
+            policy_path = argv[i];
         }
+        else if (strcmp(argv[i], "--identity-registry") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("--identity-registry option needs identity number as argument!\n");
+                return 1;
+            }
+            i++;
+            identity_registry_capacity = std::strtoull(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--h2c") == 0)
+        {
+            h2c = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--shm") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("-s,--shm option needs ring file path as argument!\n");
+                return 1;
+            }
+            i++;
+            shm_path = argv[i];
+        }
+        else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--cpus") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                p_log->err("-c,--cpus option needs cpu list as argument!\n");
+                return 1;
+            }
+            i++;
+            if (!parse_cpu_list(argv[i], cpus))
+            {
+                p_log->err("Invalid cpu list:%s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            return show_help(argv[0]);
+        }
+    }
 
-        //check verification result
-        switch (quote_verification_result)
-        {
-        case SGX_QL_QV_RESULT_OK:
-            p_log->info("App: Verification completed successfully.\n");
-            //ret_body["message"] = "Verify quote successfully!";
-            ret_body["status_code"] = 200;
-            break;
-        case SGX_QL_QV_RESULT_CONFIG_NEEDED:
-        case SGX_QL_QV_RESULT_OUT_OF_DATE:
-        case SGX_QL_QV_RESULT_OUT_OF_DATE_CONFIG_NEEDED:
-        case SGX_QL_QV_RESULT_SW_HARDENING_NEEDED:
-        case SGX_QL_QV_RESULT_CONFIG_AND_SW_HARDENING_NEEDED:
-            //p_log->warn("App: Verification completed with Non-terminal result: %x\n", quote_verification_result);
-            p_log->info("App: Verify quote successfully in condition! Status code: %x\n", quote_verification_result);
-            //ret_body["message"] = "Verify quote successfully in condition!";
-            ret_body["status_code"] = 200;
-            break;
-        case SGX_QL_QV_RESULT_INVALID_SIGNATURE:
-        case SGX_QL_QV_RESULT_REVOKED:
-        case SGX_QL_QV_RESULT_UNSPECIFIED:
-        default:
-            p_log->err("App: Verification completed with Terminal result: %x\n", quote_verification_result);
-            ret_body["message"] = "Verify quote failed!";
-            ret_body["status_code"] = 500;
-            break;
+    // Create unix domain socket before forking, so that workers and restarted ones share it
+    if (!unix_path.empty())
+    {
+        if (unix_uids.empty())
+        {
+            unix_uids.push_back(0);
+            unix_uids.push_back(getuid());
         }
-    });
+        unix_sock = create_unix_listener(unix_path.c_str());
+        if (unix_sock == -1)
+        {
+            p_log->err("Create unix domain socket at %s failed!\n", unix_path.c_str());
+            return 1;
+        }
+    }
+
+    // Collateral store is loaded before forking, workers share its first load
+    if (!collateral_store_path.empty() && CRUST_SUCCESS != CollateralStore::get_instance()->init(collateral_store_path.c_str()))
+    {
+        p_log->err("Load collateral store at %s failed!\n", collateral_store_path.c_str());
+        return 1;
+    }
+
+    if (!collateral_cache_dir.empty() && CRUST_SUCCESS != CollateralDisk::get_instance()->init(collateral_cache_dir.c_str()))
+    {
+        p_log->err("Create collateral cache directory at %s failed!\n", collateral_cache_dir.c_str());
+        return 1;
+    }
+
+    if (!result_log_path.empty() && CRUST_SUCCESS != ResultLog::get_instance()->init(result_log_path.c_str()))
+    {
+        p_log->err("Open result log at %s failed!\n", result_log_path.c_str());
+        return 1;
+    }
+
+    // Shared result cache is mapped before forking, workers and other service processes attach to the same table
+    if (!shared_cache_path.empty() && CRUST_SUCCESS != SharedResultCache::get_instance()->init(shared_cache_path.c_str()))
+    {
+        p_log->err("Open shared result cache at %s failed!\n", shared_cache_path.c_str());
+        return 1;
+    }
+
+    if (!token_key_path.empty() && CRUST_SUCCESS != TokenSigner::get_instance()->init(token_key_path.c_str()))
+    {
+        p_log->err("Read token key at %s failed, it needs at least %d bytes!\n", token_key_path.c_str(), VERIFY_TOKEN_KEY_MIN_SIZE);
+        return 1;
+    }
+
+    if (!policy_path.empty() && CRUST_SUCCESS != Policy::get_instance()->init(policy_path.c_str()))
+    {
+        p_log->err("Load policy at %s failed!\n", policy_path.c_str());
+        return 1;
+    }
+
+    // Identity registry is mapped before forking, so that all workers answer queries alike
+    if (identity_registry_capacity != 0 && CRUST_SUCCESS != IdentityRegistry::get_instance()->init(identity_registry_capacity))
+    {
+        p_log->err("Create identity registry of %lu identities failed!\n", identity_registry_capacity);
+        return 1;
+    }
+
+    // Shared memory ring is created before forking as well
+    if (!shm_path.empty() && CRUST_SUCCESS != ShmServer::get_instance()->init(shm_path.c_str()))
+    {
+        p_log->err("Create shared memory ring at %s failed!\n", shm_path.c_str());
+        return 1;
+    }
+
+    int ret = 0;
+    if (worker_num > 0)
+    {
+        p_log->info("Start dcap service at %s:%d with %lu workers...\n", host.c_str(), port, worker_num);
+        ret = Supervisor::get_instance()->run(worker_num, cpus, serve);
+    }
+    else
+    {
+        ret = serve(0);
+    }
+
+    if (unix_sock != -1)
+    {
+        unlink(unix_path.c_str());
+    }
+    ShmServer::get_instance()->destroy();
 
-    svr.listen(host.c_str(), port);
+    return ret;
 }
@@ -0,0 +1,110 @@
+#include "Scheduler.h"
+#include "Task.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Simulated verification: decoding and signature check burn cpu, quote verification blocks
+#define BENCH_CPU_US 20
+#define BENCH_BLOCK_US 1000
+// Verifications kept in flight by the loop thread
+#define BENCH_IN_FLIGHT 256
+
+/**
+ * @description: Burn cpu for indicated time
+ * @param us -> Microseconds
+ */
+static void burn_cpu(long us)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end)
+        ;
+}
+
+/**
+ * @description: Thread per request, every thread runs whole verifications one by one
+ * @param thread_num -> Thread number
+ * @param round -> Verification number
+ * @return: Verifications per second
+ */
+static double run_threads(size_t thread_num, size_t round)
+{
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_num; i++)
+    {
+        threads.push_back(std::thread([&next, round] {
+            while (next++ < round)
+            {
+                burn_cpu(BENCH_CPU_US);
+                usleep(BENCH_BLOCK_US);
+            }
+        }));
+    }
+    for (auto &t : threads)
+        t.join();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return round / sec;
+}
+
+/**
+ * @description: One verification pipeline, keeps taking verifications until all are done
+ * @param scheduler -> Scheduler of loop thread
+ * @param pool -> Pool for blocking stage
+ * @param next -> Next verification index
+ * @param round -> Verification number
+ * @return: Task
+ */
+static Task<void> pipeline(Scheduler &scheduler, BlockingPool &pool, std::atomic<size_t> &next, size_t round)
+{
+    while (next++ < round)
+    {
+        burn_cpu(BENCH_CPU_US);
+        co_await pool.offload(scheduler, [] { usleep(BENCH_BLOCK_US); });
+    }
+}
+
+/**
+ * @description: One loop thread keeps verifications in flight, blocking stage runs on pool
+ * @param thread_num -> Thread number, including loop thread
+ * @param round -> Verification number
+ * @return: Verifications per second
+ */
+static double run_coro(size_t thread_num, size_t round)
+{
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+    {
+        Scheduler scheduler;
+        BlockingPool pool(thread_num - 1);
+        for (size_t i = 0; i < BENCH_IN_FLIGHT; i++)
+            scheduler.spawn(pipeline(scheduler, pool, next, round));
+        scheduler.run();
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return round / sec;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t round = argc > 1 ? atoi(argv[1]) : 5000;
+
+    printf("verification: %dus cpu + %dus blocking, %lu rounds\n", BENCH_CPU_US, BENCH_BLOCK_US, round);
+    printf("%8s %16s %16s\n", "threads", "thread/request", "coroutine");
+    for (size_t thread_num = 2; thread_num <= 64; thread_num *= 2)
+    {
+        double threads_qps = run_threads(thread_num, round);
+        double coro_qps = run_coro(thread_num, round);
+        printf("%8lu %14.0f/s %14.0f/s\n", thread_num, threads_qps, coro_qps);
+    }
+
+    return 0;
+}
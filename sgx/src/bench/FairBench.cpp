@@ -0,0 +1,102 @@
+#include "FairScheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Simulated quote verification, which blocks on quote library
+#define BENCH_BLOCK_US 1000
+// Threads of the flooding account, each one sends again as soon as it is answered
+#define BENCH_FLOOD_THREAD_NUM 64
+// Round trip of a rejected request before it is sent again
+#define BENCH_REJECTED_US 100
+
+/**
+ * @description: Latency of one well-behaved account sending requests one by one
+ * @param scheduler -> Scheduler
+ * @param round -> Request number
+ * @return: Sorted latencies in microseconds
+ */
+static std::vector<long> run_client(FairScheduler *scheduler, size_t round)
+{
+    std::vector<long> latencies;
+    for (size_t i = 0; i < round; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        scheduler->run("client", 6, [] { usleep(BENCH_BLOCK_US); });
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    return latencies;
+}
+
+/**
+ * @description: Print percentiles of sorted latencies
+ * @param name -> Case name
+ * @param latencies -> Sorted latencies in microseconds
+ */
+static void print_latencies(const char *name, const std::vector<long> &latencies)
+{
+    size_t n = latencies.size();
+    printf("%-20s p50 %6ldus  p99 %6ldus  max %6ldus\n", name,
+            latencies[n / 2], latencies[n * 99 / 100], latencies[n - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t round = argc > 1 ? atoi(argv[1]) : 1000;
+    FairScheduler *scheduler = FairScheduler::get_instance();
+
+    // Scheduling cost alone, jobs of many accounts doing nothing
+    std::vector<std::string> accounts;
+    for (size_t i = 0; i < 1024; i++)
+        accounts.push_back("cTGVGrejrMTPBX7KbzzCFEYmU4gFD8UvXYPdvfnL" + std::to_string(i));
+    std::atomic<size_t> done(0);
+    size_t job_num = round * 100;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < job_num; i++)
+    {
+        const std::string &account = accounts[i % accounts.size()];
+        while (!scheduler->submit(account.data(), account.size(), [&done] { done++; }))
+            std::this_thread::yield();
+    }
+    while (done < job_num)
+        std::this_thread::yield();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-20s %.0fns per job\n", "scheduling", ns / job_num);
+
+    printf("quote verification: %dus blocking, %d at a time, %lu rounds\n",
+            BENCH_BLOCK_US, LIMITER_INITIAL_LIMIT, round);
+    print_latencies("alone", run_client(scheduler, round));
+
+    std::atomic<bool> stopping(false);
+    std::atomic<size_t> flood_num(0);
+    std::vector<std::thread> flooders;
+    for (size_t i = 0; i < BENCH_FLOOD_THREAD_NUM; i++)
+    {
+        flooders.push_back(std::thread([scheduler, &stopping, &flood_num] {
+            while (!stopping)
+            {
+                if (scheduler->run("flood", 5, [] { usleep(BENCH_BLOCK_US); }))
+                    flood_num++;
+                else
+                    usleep(BENCH_REJECTED_US);
+            }
+        }));
+    }
+    print_latencies("with flood", run_client(scheduler, round));
+    stopping = true;
+    for (auto &t : flooders)
+        t.join();
+    printf("%-20s %lu requests verified\n", "flood", flood_num.load());
+
+    return 0;
+}
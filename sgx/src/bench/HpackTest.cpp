@@ -0,0 +1,281 @@
+#include "Hpack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Header block of RFC 7541 Appendix C, as hex, with the headers it decodes to
+typedef struct _hpack_vector_t
+{
+    const char *name;
+    const char *hex;
+    std::vector<hpack_header_t> headers;
+} hpack_vector_t;
+
+// Dynamic table size update to 256, what C.5 and C.6 get from SETTINGS_HEADER_TABLE_SIZE
+#define TEST_SIZE_UPDATE_256 "3fe101"
+
+static size_t g_failed = 0;
+
+/**
+ * @description: Report one check
+ * @param name -> Check name
+ * @param ok -> Whether it passed
+ */
+static void check(const std::string &name, bool ok)
+{
+    printf("%-4s %s\n", ok ? "ok" : "FAIL", name.c_str());
+    if (!ok)
+        g_failed++;
+}
+
+/**
+ * @description: Decode hex string
+ * @param hex -> Hex string
+ * @return: Bytes
+ */
+static std::string from_hex(const char *hex)
+{
+    std::string out;
+    for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2)
+    {
+        char byte[3] = {hex[i], hex[i + 1], '\0'};
+        out.push_back((char)strtoul(byte, NULL, 16));
+    }
+
+    return out;
+}
+
+/**
+ * @description: Decode one block
+ * @param decoder -> Decoder of the connection
+ * @param block -> Header block
+ * @param headers -> Decoded headers
+ * @return: Decoded or not
+ */
+static bool decode(HpackDecoder &decoder, const std::string &block, std::vector<hpack_header_t> &headers)
+{
+    headers.clear();
+    return decoder.decode(reinterpret_cast<const uint8_t *>(block.data()), block.size(), headers);
+}
+
+/**
+ * @description: Compare header lists
+ * @param a -> Headers
+ * @param b -> Headers
+ * @return: Equal or not
+ */
+static bool same_headers(const std::vector<hpack_header_t> &a, const std::vector<hpack_header_t> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].name != b[i].name || a[i].value != b[i].value)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @description: Replay blocks of one connection through a decoder, then check dynamic table holds the
+ * indicated entries, newest first, and nothing past them
+ * @param vectors -> Blocks in order
+ * @param prefix -> Bytes put in front of the first block
+ * @param table -> Expected dynamic table
+ */
+static void replay(const std::vector<hpack_vector_t> &vectors, const char *prefix, const std::vector<hpack_header_t> &table)
+{
+    HpackDecoder decoder;
+    std::vector<hpack_header_t> headers;
+    for (size_t i = 0; i < vectors.size(); i++)
+    {
+        std::string block = from_hex(vectors[i].hex);
+        if (i == 0)
+            block = from_hex(prefix) + block;
+        bool ok = decode(decoder, block, headers);
+        check(std::string("decode ") + vectors[i].name, ok && same_headers(headers, vectors[i].headers));
+    }
+
+    // Indexed fields read dynamic table without changing it
+    std::string refs;
+    for (size_t i = 0; i < table.size(); i++)
+        refs.push_back((char)(0x80 | (HPACK_STATIC_TABLE_NUM + 1 + i)));
+    bool ok = decode(decoder, refs, headers);
+    check(std::string("dynamic table after ") + vectors.back().name, ok && same_headers(headers, table));
+    std::string past(1, (char)(0x80 | (HPACK_STATIC_TABLE_NUM + 1 + table.size())));
+    check(std::string("index past dynamic table after ") + vectors.back().name, !decode(decoder, past, headers));
+}
+
+/**
+ * @description: Encode blocks of one connection, all literals indexed, and decode them back. Blocks must be
+ * no longer than those of Appendix C, which differ only where huffman coding saves nothing, like "307".
+ * @param vectors -> Blocks in order, with the headers encoded
+ * @param table_size -> Table size peer allows
+ * @param prefix -> Bytes expected in front of the first block
+ */
+static void encode(const std::vector<hpack_vector_t> &vectors, size_t table_size, const char *prefix)
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    std::vector<hpack_header_t> headers;
+    encoder.set_max_table_size(table_size);
+    for (size_t i = 0; i < vectors.size(); i++)
+    {
+        std::string block;
+        encoder.begin(block);
+        for (auto &h : vectors[i].headers)
+            encoder.encode(block, h.name.c_str(), h.value.c_str(), true);
+        std::string expected = from_hex(vectors[i].hex);
+        bool ok = true;
+        if (i == 0)
+        {
+            expected = from_hex(prefix) + expected;
+            ok = block.compare(0, strlen(prefix) / 2, from_hex(prefix)) == 0;
+        }
+        ok = ok && block.size() <= expected.size() && decode(decoder, block, headers)
+                && same_headers(headers, vectors[i].headers);
+        check(std::string("encode ") + vectors[i].name + (block == expected ? ", same bytes" : ""), ok);
+    }
+}
+
+/**
+ * @description: Encode blocks with table size changing between them, including to 0, and decode them back
+ */
+static void round_trip()
+{
+    std::vector<std::vector<hpack_header_t>> blocks = {
+        {{":status", "200"}, {"content-type", "application/json"}, {"content-length", "340"}, {"server", "dcap-service"}},
+        {{":status", "200"}, {"content-type", "application/json"}, {"content-length", "1024"}, {"server", "dcap-service"}},
+        {{":status", "429"}, {"retry-after", "1"}, {"content-type", "application/json"}, {"x-long", std::string(300, 'a')}},
+        {{":status", "200"}, {"content-type", "application/json"}, {"server", "dcap-service"}},
+        {{":status", "504"}, {"content-type", "application/json"}, {"content-length", "59"}},
+    };
+    // Table size peer allows before each block, -1 keeps it as is, larger than the default is capped
+    long sizes[] = {-1, 100, 0, 4096, 65536};
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    std::vector<hpack_header_t> headers;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (sizes[i] >= 0)
+            encoder.set_max_table_size(sizes[i]);
+        std::string block;
+        encoder.begin(block);
+        for (size_t j = 0; j < blocks[i].size(); j++)
+            encoder.encode(block, blocks[i][j].name.c_str(), blocks[i][j].value.c_str(), j != 2);
+        bool ok = decode(decoder, block, headers);
+        check("round trip block " + std::to_string(i + 1), ok && same_headers(headers, blocks[i]));
+    }
+
+    // Block sent again takes one byte a field, all of them indexed by now
+    std::string block;
+    encoder.begin(block);
+    for (auto &h : blocks[4])
+        encoder.encode(block, h.name.c_str(), h.value.c_str(), true);
+    bool ok = decode(decoder, block, headers) && same_headers(headers, blocks[4]);
+    block.clear();
+    encoder.begin(block);
+    for (auto &h : blocks[4])
+        encoder.encode(block, h.name.c_str(), h.value.c_str(), true);
+    ok = ok && block.size() == blocks[4].size() && decode(decoder, block, headers) && same_headers(headers, blocks[4]);
+    check("round trip repeated block", ok);
+}
+
+/**
+ * @description: Blocks every decoder must refuse
+ */
+static void refuse()
+{
+    std::vector<hpack_header_t> headers;
+    HpackDecoder decoder;
+    check("refuse size update after a field", !decode(decoder, from_hex("82" "3fe101"), headers));
+    HpackDecoder decoder2;
+    check("refuse size update above default", !decode(decoder2, from_hex("3fe21f"), headers));
+    HpackDecoder decoder3;
+    check("refuse index 0", !decode(decoder3, from_hex("80"), headers));
+    HpackDecoder decoder4;
+    check("refuse truncated integer", !decode(decoder4, from_hex("ff"), headers));
+    HpackDecoder decoder5;
+    check("refuse string past block", !decode(decoder5, from_hex("400a637573746f6d"), headers));
+    HpackDecoder decoder6;
+    // Padding longer than 7 bits
+    check("refuse long huffman padding", !decode(decoder6, from_hex("4082ffff0161"), headers));
+}
+
+int main()
+{
+    // C.2, literals of each kind
+    std::vector<hpack_vector_t> c2_1 = {{"C.2.1", "400a637573746f6d2d6b65790d637573746f6d2d686561646572",
+            {{"custom-key", "custom-header"}}}};
+    replay(c2_1, "", {{"custom-key", "custom-header"}});
+    std::vector<hpack_vector_t> c2_2 = {{"C.2.2", "040c2f73616d706c652f70617468", {{":path", "/sample/path"}}}};
+    replay(c2_2, "", {});
+    std::vector<hpack_vector_t> c2_3 = {{"C.2.3", "100870617373776f726406736563726574", {{"password", "secret"}}}};
+    replay(c2_3, "", {});
+    std::vector<hpack_vector_t> c2_4 = {{"C.2.4", "82", {{":method", "GET"}}}};
+    replay(c2_4, "", {});
+
+    // C.3 and C.4, requests without and with huffman coding
+    std::vector<hpack_header_t> req1 = {{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+            {":authority", "www.example.com"}};
+    std::vector<hpack_header_t> req2 = {{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+            {":authority", "www.example.com"}, {"cache-control", "no-cache"}};
+    std::vector<hpack_header_t> req3 = {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+            {":authority", "www.example.com"}, {"custom-key", "custom-value"}};
+    std::vector<hpack_header_t> req_table = {{"custom-key", "custom-value"}, {"cache-control", "no-cache"},
+            {":authority", "www.example.com"}};
+    std::vector<hpack_vector_t> c3 = {
+        {"C.3.1", "828684410f7777772e6578616d706c652e636f6d", req1},
+        {"C.3.2", "828684be58086e6f2d6361636865", req2},
+        {"C.3.3", "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565", req3},
+    };
+    replay(c3, "", req_table);
+    std::vector<hpack_vector_t> c4 = {
+        {"C.4.1", "828684418cf1e3c2e5f23a6ba0ab90f4ff", req1},
+        {"C.4.2", "828684be5886a8eb10649cbf", req2},
+        {"C.4.3", "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf", req3},
+    };
+    replay(c4, "", req_table);
+    encode(c4, HPACK_TABLE_SIZE, "");
+
+    // C.5 and C.6, responses evicting from a 256 byte table, which a size update at the start sets
+    std::vector<hpack_header_t> resp1 = {{":status", "302"}, {"cache-control", "private"},
+            {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"}};
+    std::vector<hpack_header_t> resp2 = {{":status", "307"}, {"cache-control", "private"},
+            {"date", "Mon, 21 Oct 2013 20:13:21 GMT"}, {"location", "https://www.example.com"}};
+    std::vector<hpack_header_t> resp3 = {{":status", "200"}, {"cache-control", "private"},
+            {"date", "Mon, 21 Oct 2013 20:13:22 GMT"}, {"location", "https://www.example.com"},
+            {"content-encoding", "gzip"}, {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+    std::vector<hpack_header_t> resp_table = {
+            {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"},
+            {"content-encoding", "gzip"}, {"date", "Mon, 21 Oct 2013 20:13:22 GMT"}};
+    std::vector<hpack_vector_t> c5 = {
+        {"C.5.1", "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d54"
+                "6e1768747470733a2f2f7777772e6578616d706c652e636f6d", resp1},
+        {"C.5.2", "4803333037c1c0bf", resp2},
+        {"C.5.3", "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a69707738666f6f3d"
+                "4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630303b2076657273696f6e3d31",
+                resp3},
+    };
+    replay(c5, TEST_SIZE_UPDATE_256, resp_table);
+    std::vector<hpack_vector_t> c6 = {
+        {"C.6.1", "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c78f0b97c8"
+                "e9ae82ae43d3", resp1},
+        {"C.6.2", "4883640effc1c0bf", resp2},
+        {"C.6.3", "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b"
+                "3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007", resp3},
+    };
+    replay(c6, TEST_SIZE_UPDATE_256, resp_table);
+    encode(c6, 256, TEST_SIZE_UPDATE_256);
+
+    round_trip();
+    refuse();
+
+    printf("%s, %lu failed\n", g_failed == 0 ? "PASS" : "FAIL", g_failed);
+
+    return g_failed == 0 ? 0 : 1;
+}
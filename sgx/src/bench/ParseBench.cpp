@@ -0,0 +1,116 @@
+#include "httplib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+// Count heap allocations made while the server parses and serves requests
+static std::atomic<size_t> g_alloc_count(0);
+static bool g_counting = false;
+
+void *operator new(size_t sz)
+{
+    if (g_counting)
+        g_alloc_count++;
+    void *p = malloc(sz == 0 ? 1 : sz);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * @description: Stream replaying one canned request over and over, responses are dropped
+ */
+class ReplayStream : public httplib::Stream
+{
+public:
+    ReplayStream(const std::string &data) : data(data), pos(0) {}
+    bool is_readable() const override { return true; }
+    bool is_writable() const override { return true; }
+    ssize_t read(char *ptr, size_t size) override
+    {
+        if (pos == data.size())
+            pos = 0;
+        size_t n = std::min(size, data.size() - pos);
+        memcpy(ptr, data.data() + pos, n);
+        pos += n;
+        return n;
+    }
+    ssize_t write(const char * /*ptr*/, size_t size) override { return size; }
+    void get_remote_ip_and_port(std::string &ip, int &port) const override
+    {
+        ip = "127.0.0.1";
+        port = 40000;
+    }
+    socket_t socket() const override { return 0; }
+
+private:
+    const std::string &data;
+    size_t pos;
+};
+
+class BenchServer : public httplib::Server
+{
+public:
+    bool serve_one(httplib::Stream &strm)
+    {
+        bool connection_closed = false;
+        return this->process_request(strm, false, connection_closed, nullptr);
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    size_t round = argc > 1 ? atoi(argv[1]) : 200000;
+    std::string body = "{\"sig\":\"00\",\"quote\":\"00\",\"account\":\"cTGVGrejrMTPBX7KbzzCFEYmU4gFD8UvXYPdvfnLH6MCfdXmd\"}";
+    std::string request = "POST /entryNetwork HTTP/1.1\r\n"
+                          "Host: localhost:17777\r\n"
+                          "User-Agent: substrate-offchain-worker/3.0\r\n"
+                          "Accept: */*\r\n"
+                          "Accept-Encoding: gzip, deflate\r\n"
+                          "Connection: keep-alive\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                          "\r\n" + body;
+
+    BenchServer svr;
+    svr.Post("/entryNetwork", [](const httplib::Request &req, httplib::Response &res) {
+        if (req.get_header_value("Content-Type") != "application/json")
+            res.status = 400;
+    });
+
+    ReplayStream strm(request);
+    svr.serve_one(strm);
+
+    g_counting = true;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < round; i++)
+    {
+        if (!svr.serve_one(strm))
+        {
+            printf("Serve request failed!\n");
+            return 1;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    g_counting = false;
+
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    printf("requests: %lu, allocations/request: %.2f, ns/request: %.0f\n",
+           round, (double)g_alloc_count / round, ns / round);
+
+    return 0;
+}
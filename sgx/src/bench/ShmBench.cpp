@@ -0,0 +1,128 @@
+#include "httplib.h"
+#include "ShmClient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+/**
+ * @description: Pick string field from flat request json, enough for canned requests
+ * @param body -> Request json
+ * @param key -> Field name
+ * @return: Field value, empty if not found
+ */
+static std::string pick_field(const std::string &body, const std::string &key)
+{
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos)
+        return "";
+    pos = body.find('\"', body.find(':', pos + key.size() + 2));
+    if (pos == std::string::npos)
+        return "";
+    size_t end = body.find('\"', pos + 1);
+    return end == std::string::npos ? "" : body.substr(pos + 1, end - pos - 1);
+}
+
+/**
+ * @description: Decode hex string
+ * @param hex -> Hex string
+ * @return: Bytes
+ */
+static std::vector<uint8_t> decode_hex(const std::string &hex)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        bytes.push_back((uint8_t)strtoul(hex.substr(i, 2).c_str(), NULL, 16));
+    return bytes;
+}
+
+/**
+ * @description: Print latency distribution
+ * @param name -> Path name
+ * @param lat -> Latencies in nanoseconds
+ */
+static void report(const char *name, std::vector<double> &lat)
+{
+    std::sort(lat.begin(), lat.end());
+    double sum = 0;
+    for (double l : lat)
+        sum += l;
+    printf("%-5s requests: %lu, mean: %.1fus, p50: %.1fus, p99: %.1fus, max: %.1fus\n",
+           name, lat.size(), sum / lat.size() / 1000, lat[lat.size() / 2] / 1000,
+           lat[lat.size() * 99 / 100] / 1000, lat.back() / 1000);
+}
+
+// Compare latency of shared memory ring against HTTP keep-alive, both against a running service:
+//   dcap-service -s /dev/shm/dcap-ring &
+//   ShmBench request.json /dev/shm/dcap-ring localhost 1234 [round]
+int main(int argc, char *argv[])
+{
+    if (argc < 5)
+    {
+        printf("Usage: %s <request json> <ring path> <http host> <http port> [round]\n", argv[0]);
+        return 1;
+    }
+    size_t round = argc > 5 ? atoi(argv[5]) : 10000;
+
+    std::ifstream in(argv[1]);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string body = ss.str();
+    std::vector<uint8_t> sig = decode_hex(pick_field(body, "sig"));
+    std::vector<uint8_t> quote = decode_hex(pick_field(body, "quote"));
+    std::string account = pick_field(body, "account");
+
+    ShmClient client;
+    if (CRUST_SUCCESS != client.attach(argv[2]))
+    {
+        printf("Attach ring %s failed!\n", argv[2]);
+        return 1;
+    }
+    std::vector<double> shm_lat;
+    int shm_status = 0;
+    for (size_t i = 0; i < round; i++)
+    {
+        shm_response_t response;
+        auto start = std::chrono::steady_clock::now();
+        crust_status_t status = client.verify(sig.data(), sig.size(), quote.data(), quote.size(),
+                account.data(), account.size(), &response);
+        shm_lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        if (CRUST_SUCCESS != status)
+        {
+            printf("Shared memory request failed! Error code:%x\n", status);
+            return 1;
+        }
+        shm_status = response.status_code;
+    }
+
+    httplib::Client http(argv[3], atoi(argv[4]));
+    http.set_keep_alive(true);
+    http.set_tcp_nodelay(true);
+    std::vector<double> http_lat;
+    int http_status = 0;
+    for (size_t i = 0; i < round; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto res = http.Post("/entryNetwork", body, "application/json");
+        http_lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        if (!res)
+        {
+            printf("HTTP request failed!\n");
+            return 1;
+        }
+        http_status = res->status;
+    }
+
+    report("shm", shm_lat);
+    report("http", http_lat);
+    printf("status code, shm: %d, http: %d\n", shm_status, http_status);
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "ShmClient.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+
+/**
+ * @description: constructor
+ */
+ShmClient::ShmClient()
+{
+    this->ring = NULL;
+}
+
+/**
+ * @description: destructor
+ */
+ShmClient::~ShmClient()
+{
+    this->detach();
+}
+
+/**
+ * @description: Map ring created by dcap service
+ * @param path -> Ring file path given to service by '-s'
+ * @return: Attach status
+ */
+crust_status_t ShmClient::attach(const char *path)
+{
+    this->detach();
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return CRUST_OPEN_FILE_FAILED;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(shm_ring_t))
+    {
+        close(fd);
+        return CRUST_SHM_INVALID_RING;
+    }
+    void *p_mem = mmap(NULL, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p_mem == MAP_FAILED)
+    {
+        return CRUST_MALLOC_FAILED;
+    }
+
+    shm_ring_t *ring = reinterpret_cast<shm_ring_t *>(p_mem);
+    if (ring->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC
+            || ring->version != SHM_RING_VERSION
+            || ring->slot_num != SHM_RING_SLOT_NUM
+            || ring->slot_data_size != SHM_RING_SLOT_DATA_SIZE)
+    {
+        munmap(p_mem, sizeof(shm_ring_t));
+        return CRUST_SHM_INVALID_RING;
+    }
+    this->ring = ring;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Unmap ring
+ */
+void ShmClient::detach()
+{
+    if (this->ring != NULL)
+    {
+        munmap(this->ring, sizeof(shm_ring_t));
+        this->ring = NULL;
+    }
+}
+
+/**
+ * @description: Verify evidence through the ring, same check as /entryNetwork with binary fields
+ * @param sig -> Identity signature
+ * @param sig_len -> Signature length
+ * @param quote -> Quote
+ * @param quote_len -> Quote length
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param response -> Verification response
+ * @param timeout_ms -> Time to wait for a free slot and then for the response
+ * @return: Whether response is got, verification result is in response
+ */
+crust_status_t ShmClient::verify(const uint8_t *sig, size_t sig_len, const uint8_t *quote, size_t quote_len,
+        const char *account, size_t account_len, shm_response_t *response, uint32_t timeout_ms)
+{
+    shm_ring_t *ring = this->ring;
+    if (ring == NULL || ring->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC)
+    {
+        return CRUST_SHM_INVALID_RING;
+    }
+    if (sig_len + quote_len + account_len > ring->slot_data_size)
+    {
+        return CRUST_SHM_EVIDENCE_TOO_LARGE;
+    }
+
+    const uint32_t mask = ring->slot_num - 1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    // Claim a free slot
+    uint32_t pos = ring->tail.load(std::memory_order_relaxed);
+    shm_slot_t *slot = NULL;
+    while (true)
+    {
+        slot = &ring->slots[pos & mask];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (ring->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Full, wait for consumers and the producers one lap earlier
+            if (std::chrono::steady_clock::now() >= deadline)
+                return CRUST_SHM_RING_FULL;
+            sched_yield();
+            pos = ring->tail.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            pos = ring->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Publish request and wake a consumer if all of them sleep
+    slot->request.sig_len = sig_len;
+    slot->request.quote_len = quote_len;
+    slot->request.account_len = account_len;
+    memcpy(slot->data, sig, sig_len);
+    memcpy(slot->data + sig_len, quote, quote_len);
+    memcpy(slot->data + sig_len + quote_len, account, account_len);
+    slot->producer_waiting.store(0, std::memory_order_relaxed);
+    slot->seq.store(pos + 1);
+    if (ring->sleepers.load() != 0)
+    {
+        ring->signal.fetch_add(1);
+        shm_futex_wake(&ring->signal, 1);
+    }
+
+    // Poll for response for a while and then sleep on slot sequence
+    for (size_t i = 0, n = shm_spin_num(); i < n && slot->seq.load(std::memory_order_acquire) != pos + 2; i++)
+    {
+        shm_cpu_relax();
+    }
+    while (slot->seq.load(std::memory_order_acquire) != pos + 2)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+        {
+            // Give the slot up, the consumer frees it
+            uint32_t expected = pos + 1;
+            if (slot->seq.compare_exchange_strong(expected, pos + 3))
+                return CRUST_SHM_TIMEOUT;
+            continue;
+        }
+        slot->producer_waiting.store(1);
+        if (slot->seq.load() == pos + 1)
+        {
+            uint32_t wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+            shm_futex_wait(&slot->seq, pos + 1, wait_ms);
+        }
+    }
+
+    memcpy(response, &slot->response, sizeof(shm_response_t));
+    slot->seq.store(pos + ring->slot_num, std::memory_order_release);
+
+    return CRUST_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#ifndef _CRUST_SHM_CLIENT_H_
+#define _CRUST_SHM_CLIENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ShmRing.h"
+#include "CrustStatus.h"
+
+// Default time to wait for a free slot and then for the response
+#define SHM_CLIENT_TIMEOUT_MS 30000
+
+// Client of dcap service's shared memory ring, for same-host callers which
+// verify at a high rate. One client may be used by several threads at once.
+class ShmClient
+{
+public:
+    ShmClient();
+    ~ShmClient();
+    crust_status_t attach(const char *path);
+    void detach();
+    crust_status_t verify(const uint8_t *sig, size_t sig_len, const uint8_t *quote, size_t quote_len,
+            const char *account, size_t account_len, shm_response_t *response,
+            uint32_t timeout_ms = SHM_CLIENT_TIMEOUT_MS);
+
+private:
+    shm_ring_t *ring;
+};
+
+#endif /* !_CRUST_SHM_CLIENT_H_ */
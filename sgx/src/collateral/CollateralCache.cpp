@@ -0,0 +1,528 @@
+#include "CollateralCache.h"
+#include "CollateralStore.h"
+#include "CollateralDisk.h"
+
+#include "sgx_quote_3.h"
+#include "sgx_default_quote_provider.h"
+
+#include "Log.h"
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+// Certification data type of quotes carrying whole PCK certificate chain
+#define COLLATERAL_PCK_CERT_CHAIN_TYPE 5
+// Fixed part of ECDSA signature data: signature, attestation key, QE report and its signature
+#define COLLATERAL_SIG_DATA_FIXED_SIZE (64 + 64 + sizeof(sgx_report_body_t) + 64)
+
+std::mutex collateral_cache_mutex;
+
+CollateralCache *CollateralCache::collateral_cache = NULL;
+
+static Log *p_log = Log::get_instance();
+
+// DER of FMSPC OID 1.2.840.113741.1.13.1.4 inside SGX extension of PCK certificate
+static const uint8_t fmspc_oid_der[] = {0x06, 0x0A, 0x2A, 0x86, 0x48, 0x86, 0xF8, 0x4D, 0x01, 0x0D, 0x01, 0x04};
+
+/**
+ * @description: single instance class function to get instance
+ * @return: collateral cache instance
+ */
+CollateralCache *CollateralCache::get_instance()
+{
+    if (CollateralCache::collateral_cache == NULL)
+    {
+        collateral_cache_mutex.lock();
+        if (CollateralCache::collateral_cache == NULL)
+        {
+            CollateralCache::collateral_cache = new CollateralCache();
+        }
+        collateral_cache_mutex.unlock();
+    }
+
+    return CollateralCache::collateral_cache;
+}
+
+/**
+ * @description: constructor
+ */
+CollateralCache::CollateralCache()
+{
+    this->grace = std::chrono::seconds(COLLATERAL_GRACE_S);
+    this->failures = 0;
+    this->open = false;
+    this->stopping = false;
+    this->worker = std::thread(&CollateralCache::work, this);
+    CollateralStore::get_instance()->set_reload_listener([this] { this->refresh_all(); });
+}
+
+/**
+ * @description: Set how long collateral older than refresh age may still be used
+ * @param grace_s -> Grace window in seconds, 0 to always wait for a newer one
+ */
+void CollateralCache::set_grace(uint64_t grace_s)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->grace = std::chrono::seconds(grace_s);
+}
+
+/**
+ * @description: Whether quote provider error means collateral service is down or slow, rather than lacking this collateral.
+ * Unknown FMSPC or CA, and requests collateral service refuses, don't count, whoever makes them up
+ * @param ret -> Error code returned by quote provider library
+ * @return: Whether it counts against circuit
+ */
+static bool is_service_error(quote3_error_t ret)
+{
+    switch (ret)
+    {
+    case SGX_QL_NETWORK_ERROR:
+    case SGX_QL_NETWORK_FAILURE:
+    case SGX_QL_SERVICE_UNAVAILABLE:
+    case SGX_QL_SERVICE_TIMEOUT:
+    case SGX_QL_ERROR_BUSY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @description: Get name of collateral key, like 00906ed50000:platform
+ * @param key -> Collateral key
+ * @return: Name
+ */
+std::string get_collateral_name(const collateral_key_t &key)
+{
+    char name[COLLATERAL_FMSPC_SIZE * 2 + 16];
+    char *p = name;
+    for (size_t i = 0; i < COLLATERAL_FMSPC_SIZE; i++)
+        p += sprintf(p, "%02x", key.fmspc[i]);
+    sprintf(p, ":%s", key.ca);
+
+    return name;
+}
+
+/**
+ * @description: Get digest of all collateral fields
+ * @param collateral -> Collateral
+ * @param digest -> SHA-256 digest
+ */
+static void digest_collateral(const sgx_ql_qve_collateral_t *collateral, uint8_t digest[32])
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(ctx, collateral->pck_crl_issuer_chain, collateral->pck_crl_issuer_chain_size);
+    EVP_DigestUpdate(ctx, collateral->root_ca_crl, collateral->root_ca_crl_size);
+    EVP_DigestUpdate(ctx, collateral->pck_crl, collateral->pck_crl_size);
+    EVP_DigestUpdate(ctx, collateral->tcb_info_issuer_chain, collateral->tcb_info_issuer_chain_size);
+    EVP_DigestUpdate(ctx, collateral->tcb_info, collateral->tcb_info_size);
+    EVP_DigestUpdate(ctx, collateral->qe_identity_issuer_chain, collateral->qe_identity_issuer_chain_size);
+    EVP_DigestUpdate(ctx, collateral->qe_identity, collateral->qe_identity_size);
+    EVP_DigestFinal_ex(ctx, digest, NULL);
+    EVP_MD_CTX_free(ctx);
+}
+
+/**
+ * @description: Get collateral of key, from cache or collateral service
+ * @param key -> Collateral key of quote
+ * @param collateral -> Collateral, left empty when quote library has to fetch it itself
+ * @param digest -> Digest of collateral, set only if collateral is
+ * @return: CRUST_SERVICE_UNAVAILABLE if collateral service is down and no collateral within grace window is cached
+ */
+crust_status_t CollateralCache::get(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral, uint8_t *digest)
+{
+    std::string name = get_collateral_name(key);
+    Metrics *p_metrics = Metrics::get_instance();
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto it = this->slots.find(name);
+    if (it == this->slots.end())
+    {
+        if (this->slots.size() >= COLLATERAL_CACHE_MAX_KEYS)
+            this->evict_lru();
+        it = this->slots.emplace(name, collateral_slot_t()).first;
+        it->second.key = key;
+        it->second.fetching = false;
+        it->second.waiters = 0;
+        it->second.has_digest = false;
+        // Collateral fetched before restart is used at once, at the age it has
+        int64_t fetched_at = 0;
+        std::shared_ptr<const sgx_ql_qve_collateral_t> loaded;
+        CollateralDisk *p_disk = CollateralDisk::get_instance();
+        if (p_disk->is_enabled() && !CollateralStore::get_instance()->is_enabled()
+                && p_disk->load(key, loaded, &fetched_at))
+        {
+            this->set_collateral(it->second, loaded);
+            int64_t age = std::max((int64_t)time(NULL) - fetched_at, (int64_t)0);
+            it->second.fetched_at = std::chrono::steady_clock::now() - std::chrono::seconds(age);
+            p_metrics->add(METRIC_COLLATERAL_DISK_LOAD_TOTAL);
+        }
+    }
+    collateral_slot_t &slot = it->second;
+    slot.used_at = std::chrono::steady_clock::now();
+    while (true)
+    {
+        if (slot.collateral)
+        {
+            auto age = std::chrono::steady_clock::now() - slot.fetched_at;
+            if (age < std::chrono::seconds(COLLATERAL_REFRESH_S))
+            {
+                collateral = slot.collateral;
+                memcpy(digest, slot.digest, sizeof(slot.digest));
+                return CRUST_SUCCESS;
+            }
+            if (age < std::chrono::seconds(COLLATERAL_REFRESH_S) + this->grace)
+            {
+                // Newer one is fetched in background, or by probe once circuit closes
+                if (!slot.fetching && !this->open)
+                {
+                    slot.fetching = true;
+                    this->refresh_keys.push_back(it->first);
+                    this->cond.notify_all();
+                }
+                p_metrics->add(METRIC_COLLATERAL_STALE_TOTAL);
+                collateral = slot.collateral;
+                memcpy(digest, slot.digest, sizeof(slot.digest));
+                return CRUST_SUCCESS;
+            }
+        }
+        if (this->open)
+        {
+            p_metrics->add(METRIC_COLLATERAL_UNAVAILABLE_TOTAL);
+            return CRUST_SERVICE_UNAVAILABLE;
+        }
+        if (!slot.fetching)
+            break;
+        // Another request fetches the same collateral, its result is shared
+        slot.waiters++;
+        this->fetch_cond.wait(lock);
+        slot.waiters--;
+    }
+
+    slot.fetching = true;
+    lock.unlock();
+    std::shared_ptr<const sgx_ql_qve_collateral_t> fetched;
+    quote3_error_t ret = this->fetch(slot.key, fetched);
+    lock.lock();
+    this->finish_fetch(it->first, slot, ret, fetched);
+    if (fetched)
+    {
+        collateral = fetched;
+        memcpy(digest, slot.digest, sizeof(slot.digest));
+        return CRUST_SUCCESS;
+    }
+    // Key which never got collateral takes no room, as most of them are made up
+    if (!slot.collateral && !slot.has_digest && this->is_evictable(it->first, slot))
+        this->slots.erase(it);
+    if (is_service_error(ret))
+    {
+        p_metrics->add(METRIC_COLLATERAL_UNAVAILABLE_TOTAL);
+        return CRUST_SERVICE_UNAVAILABLE;
+    }
+
+    // Collateral service answered without this collateral, quote library reports it by its own error
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Set function called when a key gets its first collateral or collateral differing from the old one,
+ * results verified with other collateral may differ
+ * @param listener -> Listener taking key and digest of new collateral, called with lock held so it must not use collateral cache
+ */
+void CollateralCache::set_change_listener(std::function<void(const collateral_key_t &, const uint8_t *)> listener)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->change_listener = listener;
+}
+
+/**
+ * @description: Put new collateral into slot, with lock held
+ * @param slot -> Cached collateral of a key
+ * @param collateral -> New collateral
+ */
+void CollateralCache::set_collateral(collateral_slot_t &slot, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral)
+{
+    uint8_t digest[32];
+    digest_collateral(collateral.get(), digest);
+    bool changed = slot.has_digest && memcmp(slot.digest, digest, sizeof(digest)) != 0;
+    if (changed)
+        p_log->info("Collateral of %s changed.\n", get_collateral_name(slot.key).c_str());
+    if ((changed || !slot.has_digest) && this->change_listener)
+        this->change_listener(slot.key, digest);
+    memcpy(slot.digest, digest, sizeof(digest));
+    slot.has_digest = true;
+    slot.collateral = collateral;
+}
+
+/**
+ * @description: Whether slot may be dropped, with lock held. Slots being fetched or waited for are referred to
+ * without lock, and probe slot is needed until circuit closes
+ * @param name -> Collateral name in cache
+ * @param slot -> Cached collateral of a key
+ * @return: Evictable or not
+ */
+bool CollateralCache::is_evictable(const std::string &name, const collateral_slot_t &slot)
+{
+    return !slot.fetching && slot.waiters == 0 && !(this->open && name == this->probe_key);
+}
+
+/**
+ * @description: Drop slot used least recently to make room for a new key, with lock held
+ */
+void CollateralCache::evict_lru()
+{
+    auto victim = this->slots.end();
+    for (auto it = this->slots.begin(); it != this->slots.end(); it++)
+    {
+        if (this->is_evictable(it->first, it->second)
+                && (victim == this->slots.end() || it->second.used_at < victim->second.used_at))
+            victim = it;
+    }
+    if (victim == this->slots.end())
+        return;
+    this->slots.erase(victim);
+    Metrics::get_instance()->add(METRIC_COLLATERAL_EVICTED_TOTAL);
+}
+
+/**
+ * @description: Fetch all cached collateral again in background, old collateral is used until then
+ */
+void CollateralCache::refresh_all()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto &it : this->slots)
+        {
+            if (it.second.collateral && !it.second.fetching)
+            {
+                it.second.fetching = true;
+                this->refresh_keys.push_back(it.first);
+            }
+        }
+    }
+    this->cond.notify_all();
+}
+
+/**
+ * @description: Stop background refresh and probe
+ */
+void CollateralCache::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->stopping)
+            return;
+        this->stopping = true;
+    }
+    this->cond.notify_all();
+    if (this->worker.joinable())
+        this->worker.join();
+}
+
+/**
+ * @description: Fetch collateral from local collateral store if there is one, otherwise from collateral service
+ * by quote provider library, without lock held
+ * @param key -> Collateral key
+ * @param collateral -> Fetched collateral, freed once the last user drops it
+ * @return: Error code of quote provider library
+ */
+quote3_error_t CollateralCache::fetch(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral)
+{
+    CollateralStore *p_store = CollateralStore::get_instance();
+    if (p_store->is_enabled())
+        return p_store->get(key, collateral);
+
+    sgx_ql_qve_collateral_t *p_collateral = NULL;
+    quote3_error_t ret = sgx_ql_get_quote_verification_collateral(key.fmspc, COLLATERAL_FMSPC_SIZE, key.ca, &p_collateral);
+    Metrics::get_instance()->add(METRIC_COLLATERAL_FETCH_TOTAL);
+    if (ret != SGX_QL_SUCCESS || p_collateral == NULL)
+    {
+        p_log->err("Get quote verification collateral failed: 0x%04x\n", ret);
+        return ret == SGX_QL_SUCCESS ? SGX_QL_NO_QUOTE_COLLATERAL_DATA : ret;
+    }
+    collateral.reset(p_collateral, [](const sgx_ql_qve_collateral_t *p) {
+        sgx_ql_free_quote_verification_collateral(const_cast<sgx_ql_qve_collateral_t *>(p));
+    });
+    CollateralDisk *p_disk = CollateralDisk::get_instance();
+    if (p_disk->is_enabled())
+        p_disk->save(key, p_collateral, time(NULL));
+
+    return ret;
+}
+
+/**
+ * @description: Store fetch result and update circuit, with lock held
+ * @param name -> Collateral name in cache
+ * @param slot -> Cached collateral of the fetched key
+ * @param ret -> Error code of fetch
+ * @param collateral -> Fetched collateral
+ */
+void CollateralCache::finish_fetch(const std::string &name, collateral_slot_t &slot, quote3_error_t ret, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral)
+{
+    Metrics *p_metrics = Metrics::get_instance();
+    slot.fetching = false;
+    if (ret == SGX_QL_SUCCESS)
+    {
+        this->set_collateral(slot, collateral);
+        slot.fetched_at = std::chrono::steady_clock::now();
+        this->failures = 0;
+        if (this->open)
+        {
+            this->open = false;
+            p_metrics->set(METRIC_COLLATERAL_BREAKER_OPEN, 0);
+            p_log->info("Collateral service is back, circuit closed.\n");
+        }
+    }
+    else if (is_service_error(ret))
+    {
+        p_metrics->add(METRIC_COLLATERAL_FETCH_FAILED);
+        this->failures++;
+        if (!this->open && this->failures >= COLLATERAL_BREAKER_THRESHOLD)
+        {
+            this->open = true;
+            this->probe_key = name;
+            p_metrics->set(METRIC_COLLATERAL_BREAKER_OPEN, 1);
+            p_log->warn("Collateral service failed %lu times in a row, circuit opened.\n", this->failures);
+            this->cond.notify_all();
+        }
+    }
+    this->fetch_cond.notify_all();
+}
+
+/**
+ * @description: Background thread, refreshes collateral due or asked for while circuit is closed and probes collateral service while it is open
+ */
+void CollateralCache::work()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopping)
+    {
+        std::string name;
+        if (this->open)
+        {
+            this->cond.wait_for(lock, std::chrono::seconds(COLLATERAL_PROBE_INTERVAL_S), [this] { return this->stopping; });
+            if (this->stopping || !this->open)
+                continue;
+            name = this->probe_key;
+        }
+        else if (this->refresh_keys.empty())
+        {
+            this->cond.wait_for(lock, std::chrono::seconds(COLLATERAL_REFRESH_CHECK_S), [this] {
+                return this->stopping || this->open || !this->refresh_keys.empty();
+            });
+            // Collateral is refreshed when due even if results cached with it keep requests away from it
+            auto now = std::chrono::steady_clock::now();
+            for (auto &it : this->slots)
+            {
+                collateral_slot_t &slot = it.second;
+                if (slot.collateral && !slot.fetching && now - slot.fetched_at >= std::chrono::seconds(COLLATERAL_REFRESH_S))
+                {
+                    slot.fetching = true;
+                    this->refresh_keys.push_back(it.first);
+                }
+            }
+            continue;
+        }
+        else
+        {
+            name = this->refresh_keys.front();
+            this->refresh_keys.pop_front();
+        }
+
+        auto it = this->slots.find(name);
+        if (it == this->slots.end())
+            continue;
+        collateral_slot_t &slot = it->second;
+        slot.fetching = true;
+        lock.unlock();
+        std::shared_ptr<const sgx_ql_qve_collateral_t> fetched;
+        quote3_error_t ret = this->fetch(slot.key, fetched);
+        lock.lock();
+        this->finish_fetch(name, slot, ret, fetched);
+    }
+}
+
+/**
+ * @description: Get FMSPC and CA type of the PCK certificate carried by quote
+ * @param quote -> Quote
+ * @param quote_sz -> Quote size
+ * @param key -> Collateral key
+ * @return: False if quote doesn't carry PCK certificate chain
+ */
+bool get_collateral_key(const uint8_t *quote, uint32_t quote_sz, collateral_key_t *key)
+{
+    if (quote_sz < sizeof(sgx_quote3_t))
+        return false;
+    const sgx_quote3_t *p_quote = (const sgx_quote3_t *)quote;
+    const uint8_t *p = quote + sizeof(sgx_quote3_t);
+    const uint8_t *end = p + p_quote->signature_data_len;
+    if (p_quote->signature_data_len > quote_sz - sizeof(sgx_quote3_t)
+            || p_quote->signature_data_len < COLLATERAL_SIG_DATA_FIXED_SIZE + sizeof(uint16_t))
+        return false;
+
+    // Skip fixed part and QE authentication data
+    p += COLLATERAL_SIG_DATA_FIXED_SIZE;
+    uint16_t auth_size = 0;
+    memcpy(&auth_size, p, sizeof(auth_size));
+    p += sizeof(auth_size) + auth_size;
+    if (end - p < (long)(sizeof(uint16_t) + sizeof(uint32_t)))
+        return false;
+    uint16_t cert_type = 0;
+    uint32_t cert_size = 0;
+    memcpy(&cert_type, p, sizeof(cert_type));
+    memcpy(&cert_size, p + sizeof(cert_type), sizeof(cert_size));
+    p += sizeof(cert_type) + sizeof(cert_size);
+    if (cert_type != COLLATERAL_PCK_CERT_CHAIN_TYPE || cert_size > (size_t)(end - p))
+        return false;
+
+    // PCK certificate comes first in chain
+    BIO *bio = BIO_new_mem_buf(p, cert_size);
+    if (bio == NULL)
+        return false;
+    X509 *cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    if (cert == NULL)
+        return false;
+
+    bool found = false;
+    char issuer[256];
+    key->ca = NULL;
+    if (X509_NAME_get_text_by_NID(X509_get_issuer_name(cert), NID_commonName, issuer, sizeof(issuer)) > 0)
+    {
+        if (strstr(issuer, "Platform") != NULL)
+            key->ca = "platform";
+        else if (strstr(issuer, "Processor") != NULL)
+            key->ca = "processor";
+    }
+    ASN1_OBJECT *sgx_oid = OBJ_txt2obj("1.2.840.113741.1.13.1", 1);
+    int idx = sgx_oid != NULL ? X509_get_ext_by_OBJ(cert, sgx_oid, -1) : -1;
+    if (key->ca != NULL && idx >= 0)
+    {
+        ASN1_OCTET_STRING *ext = X509_EXTENSION_get_data(X509_get_ext(cert, idx));
+        const uint8_t *data = ASN1_STRING_get0_data(ext);
+        size_t len = ASN1_STRING_length(ext);
+        size_t need = sizeof(fmspc_oid_der) + 2 + COLLATERAL_FMSPC_SIZE;
+        for (size_t i = 0; i + need <= len && !found; i++)
+        {
+            if (memcmp(data + i, fmspc_oid_der, sizeof(fmspc_oid_der)) == 0
+                    && data[i + sizeof(fmspc_oid_der)] == V_ASN1_OCTET_STRING
+                    && data[i + sizeof(fmspc_oid_der) + 1] == COLLATERAL_FMSPC_SIZE)
+            {
+                memcpy(key->fmspc, data + i + sizeof(fmspc_oid_der) + 2, COLLATERAL_FMSPC_SIZE);
+                found = true;
+            }
+        }
+    }
+    ASN1_OBJECT_free(sgx_oid);
+    X509_free(cert);
+
+    return found;
+}
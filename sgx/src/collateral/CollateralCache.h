@@ -0,0 +1,106 @@
+#ifndef _CRUST_COLLATERAL_CACHE_H_
+#define _CRUST_COLLATERAL_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "sgx_ql_quote.h"
+#include "sgx_qve_header.h"
+
+#include "CrustStatus.h"
+
+// Collateral is used as it is for this long after it is fetched, then it is fetched again
+#define COLLATERAL_REFRESH_S 300
+// Default of how long collateral older than refresh age may still be used while a newer one is fetched
+#define COLLATERAL_GRACE_S 3600
+// Consecutive failures of collateral service which open circuit
+#define COLLATERAL_BREAKER_THRESHOLD 5
+// How often background probe tries collateral service while circuit is open
+#define COLLATERAL_PROBE_INTERVAL_S 5
+// How often background thread looks for collateral due for refresh
+#define COLLATERAL_REFRESH_CHECK_S 5
+// Keys kept at most, least recently used one is dropped for a new key. Keys come from PCK certificates
+// not verified yet, so any number of them can be made up
+#define COLLATERAL_CACHE_MAX_KEYS 1024
+// FMSPC size, as in PCK certificate
+#define COLLATERAL_FMSPC_SIZE 6
+
+// Collateral is fetched per FMSPC and PCK CA, the same for all quotes of one platform kind
+typedef struct _collateral_key_t
+{
+    uint8_t fmspc[COLLATERAL_FMSPC_SIZE];
+    // "processor" or "platform"
+    const char *ca;
+} collateral_key_t;
+
+// Cached collateral of one key
+typedef struct _collateral_slot_t
+{
+    std::shared_ptr<const sgx_ql_qve_collateral_t> collateral;
+    std::chrono::steady_clock::time_point fetched_at;
+    std::chrono::steady_clock::time_point used_at;
+    collateral_key_t key;
+    // A fetch of this key is going on, others wait for it or use the old collateral
+    bool fetching;
+    // Requests waiting for that fetch, slot is kept while there are any
+    size_t waiters;
+    // Digest of last collateral, kept when collateral is dropped so that a change is still noticed
+    uint8_t digest[32];
+    bool has_digest;
+} collateral_slot_t;
+
+// Collateral fetched from quote provider library and kept between verifications, with a circuit
+// breaker around the collateral service. While circuit is open, nothing waits on collateral
+// service: requests use collateral within grace window or fail at once, and a background
+// probe closes circuit again once collateral service answers.
+class CollateralCache
+{
+public:
+    static CollateralCache *collateral_cache;
+    static CollateralCache *get_instance();
+    void set_grace(uint64_t grace_s);
+    void refresh_all();
+    crust_status_t get(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral, uint8_t *digest);
+    void set_change_listener(std::function<void(const collateral_key_t &, const uint8_t *)> listener);
+    void stop();
+
+private:
+    quote3_error_t fetch(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral);
+    void finish_fetch(const std::string &name, collateral_slot_t &slot, quote3_error_t ret, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral);
+    void set_collateral(collateral_slot_t &slot, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral);
+    bool is_evictable(const std::string &name, const collateral_slot_t &slot);
+    void evict_lru();
+    void work();
+    std::mutex mutex;
+    // Wakes background thread
+    std::condition_variable cond;
+    // Wakes requests waiting for a fetch of the same collateral
+    std::condition_variable fetch_cond;
+    std::map<std::string, collateral_slot_t> slots;
+    // Keys whose collateral is fetched again in background
+    std::deque<std::string> refresh_keys;
+    std::chrono::seconds grace;
+    size_t failures;
+    bool open;
+    // Key probed while circuit is open
+    std::string probe_key;
+    std::thread worker;
+    bool stopping;
+    // Called with lock held when a key gets its first collateral or one differing from the one it replaces
+    std::function<void(const collateral_key_t &, const uint8_t *)> change_listener;
+    CollateralCache(void);
+};
+
+bool get_collateral_key(const uint8_t *quote, uint32_t quote_sz, collateral_key_t *key);
+std::string get_collateral_name(const collateral_key_t &key);
+
+#endif /* !_CRUST_COLLATERAL_CACHE_H_ */
@@ -0,0 +1,258 @@
+#include "CollateralDisk.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+
+std::mutex collateral_disk_mutex;
+
+CollateralDisk *CollateralDisk::collateral_disk = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: collateral disk instance
+ */
+CollateralDisk *CollateralDisk::get_instance()
+{
+    if (CollateralDisk::collateral_disk == NULL)
+    {
+        collateral_disk_mutex.lock();
+        if (CollateralDisk::collateral_disk == NULL)
+        {
+            CollateralDisk::collateral_disk = new CollateralDisk();
+        }
+        collateral_disk_mutex.unlock();
+    }
+
+    return CollateralDisk::collateral_disk;
+}
+
+/**
+ * @description: constructor
+ */
+CollateralDisk::CollateralDisk()
+{
+}
+
+/**
+ * @description: Get fields of collateral in file order
+ * @param collateral -> Collateral
+ * @param fields -> Field pointers
+ * @param sizes -> Field sizes
+ */
+static void get_fields(const sgx_ql_qve_collateral_t *collateral, char **fields[], uint32_t *sizes[])
+{
+    sgx_ql_qve_collateral_t *p = const_cast<sgx_ql_qve_collateral_t *>(collateral);
+    char **f[COLLATERAL_DISK_FIELD_NUM] = {&p->pck_crl_issuer_chain, &p->root_ca_crl, &p->pck_crl,
+            &p->tcb_info_issuer_chain, &p->tcb_info, &p->qe_identity_issuer_chain, &p->qe_identity};
+    uint32_t *s[COLLATERAL_DISK_FIELD_NUM] = {&p->pck_crl_issuer_chain_size, &p->root_ca_crl_size, &p->pck_crl_size,
+            &p->tcb_info_issuer_chain_size, &p->tcb_info_size, &p->qe_identity_issuer_chain_size, &p->qe_identity_size};
+    memcpy(fields, f, sizeof(f));
+    memcpy(sizes, s, sizeof(s));
+}
+
+/**
+ * @description: Get nextUpdate of TCB info or QE identity json
+ * @param json -> Json, which may not be zero terminated
+ * @param len -> Json length
+ * @return: Unix time, 0 if it is not found
+ */
+static int64_t get_next_update(const char *json, size_t len)
+{
+    if (json == NULL)
+        return 0;
+    std::string_view sv(json, len);
+    size_t pos = sv.find("\"nextUpdate\"");
+    if (pos == std::string_view::npos)
+        return 0;
+    pos = sv.find('"', sv.find(':', pos));
+    if (pos == std::string_view::npos || len - pos < 21)
+        return 0;
+    // Like "2099-01-01T00:00:00Z"
+    char buf[21];
+    memcpy(buf, json + pos + 1, 20);
+    buf[20] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(buf, "%Y-%m-%dT%H:%M:%S", &tm) == NULL)
+        return 0;
+
+    return timegm(&tm);
+}
+
+/**
+ * @description: Create directory of collateral files if it doesn't exist, must be called before fork
+ * @param dir -> Directory path
+ * @return: Init status
+ */
+crust_status_t CollateralDisk::init(const char *dir)
+{
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+        return CRUST_MKDIR_FAILED;
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return CRUST_MKDIR_FAILED;
+    this->dir = dir;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether fetched collateral is kept on disk
+ * @return: Enabled or not
+ */
+bool CollateralDisk::is_enabled()
+{
+    return !this->dir.empty();
+}
+
+/**
+ * @description: Get file path of collateral key
+ * @param key -> Collateral key
+ * @return: File path
+ */
+std::string CollateralDisk::get_path(const collateral_key_t &key)
+{
+    char name[COLLATERAL_FMSPC_SIZE * 2 + 32];
+    char *p = name;
+    for (size_t i = 0; i < COLLATERAL_FMSPC_SIZE; i++)
+        p += sprintf(p, "%02x", key.fmspc[i]);
+    sprintf(p, "_%s.bin", key.ca);
+
+    return this->dir + "/" + name;
+}
+
+/**
+ * @description: Load collateral of key from its file
+ * @param key -> Collateral key
+ * @param collateral -> Collateral pointing into file mapping, which is unmapped once collateral is dropped
+ * @param fetched_at -> Unix time collateral was fetched from collateral service
+ * @return: False if there is no usable file, broken or outdated ones are removed
+ */
+bool CollateralDisk::load(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral, int64_t *fetched_at)
+{
+    std::string path = this->get_path(key);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(collateral_disk_header_t))
+    {
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    size_t size = st.st_size;
+    void *p_mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p_mem == MAP_FAILED)
+        return false;
+
+    const collateral_disk_header_t *header = (const collateral_disk_header_t *)p_mem;
+    const char *data = (const char *)p_mem + sizeof(collateral_disk_header_t);
+    size_t data_size = size - sizeof(collateral_disk_header_t);
+    size_t fields_size = 0;
+    for (size_t i = 0; i < COLLATERAL_DISK_FIELD_NUM; i++)
+        fields_size += header->sizes[i];
+    sgx_sha256_hash_t hash;
+    const char *reason = NULL;
+    if (header->magic != COLLATERAL_DISK_MAGIC || header->version != COLLATERAL_DISK_VERSION)
+        reason = "version";
+    else if (fields_size != data_size
+            || SGX_SUCCESS != sgx_sha256_msg((const uint8_t *)data, (uint32_t)data_size, &hash)
+            || memcmp(hash, header->hash, sizeof(hash)) != 0)
+        reason = "checksum";
+    else if (header->next_update <= time(NULL))
+        reason = "nextUpdate";
+    if (reason != NULL)
+    {
+        p_log->warn("Collateral file %s is dropped for its %s.\n", path.c_str(), reason);
+        munmap(p_mem, size);
+        unlink(path.c_str());
+        return false;
+    }
+
+    sgx_ql_qve_collateral_t *p_collateral = new sgx_ql_qve_collateral_t;
+    memset(p_collateral, 0, sizeof(sgx_ql_qve_collateral_t));
+    p_collateral->version = header->collateral_version;
+    char **fields[COLLATERAL_DISK_FIELD_NUM];
+    uint32_t *sizes[COLLATERAL_DISK_FIELD_NUM];
+    get_fields(p_collateral, fields, sizes);
+    for (size_t i = 0; i < COLLATERAL_DISK_FIELD_NUM; i++)
+    {
+        *fields[i] = const_cast<char *>(data);
+        *sizes[i] = header->sizes[i];
+        data += header->sizes[i];
+    }
+    *fetched_at = header->fetched_at;
+    collateral.reset(p_collateral, [p_mem, size](const sgx_ql_qve_collateral_t *p) {
+        delete p;
+        munmap(p_mem, size);
+    });
+
+    return true;
+}
+
+/**
+ * @description: Write collateral of key to its file, replacing the old one at once so that readers never see a partial file
+ * @param key -> Collateral key
+ * @param collateral -> Collateral fetched from collateral service
+ * @param fetched_at -> Unix time collateral was fetched
+ */
+void CollateralDisk::save(const collateral_key_t &key, const sgx_ql_qve_collateral_t *collateral, int64_t fetched_at)
+{
+    char **fields[COLLATERAL_DISK_FIELD_NUM];
+    uint32_t *sizes[COLLATERAL_DISK_FIELD_NUM];
+    get_fields(collateral, fields, sizes);
+    collateral_disk_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = COLLATERAL_DISK_MAGIC;
+    header.version = COLLATERAL_DISK_VERSION;
+    header.collateral_version = collateral->version;
+    header.fetched_at = fetched_at;
+    int64_t tcb_next_update = get_next_update(collateral->tcb_info, collateral->tcb_info_size);
+    int64_t qe_next_update = get_next_update(collateral->qe_identity, collateral->qe_identity_size);
+    header.next_update = std::min(tcb_next_update, qe_next_update);
+    // It could never be checked on load
+    if (header.next_update == 0)
+        return;
+
+    std::string data;
+    for (size_t i = 0; i < COLLATERAL_DISK_FIELD_NUM; i++)
+    {
+        header.sizes[i] = *sizes[i];
+        if (*sizes[i] != 0)
+            data.append(*fields[i], *sizes[i]);
+    }
+    sgx_sha256_msg((const uint8_t *)data.data(), (uint32_t)data.size(), &header.hash);
+
+    // Workers may write the same key at once, each through its own temporary file
+    std::string path = this->get_path(key);
+    std::string tmp_path = path + "." + std::to_string(getpid());
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        p_log->err("Save collateral to %s failed!\n", tmp_path.c_str());
+        return;
+    }
+    bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header)
+            && write(fd, data.data(), data.size()) == (ssize_t)data.size();
+    close(fd);
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        p_log->err("Save collateral to %s failed!\n", path.c_str());
+        unlink(tmp_path.c_str());
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef _CRUST_COLLATERAL_DISK_H_
+#define _CRUST_COLLATERAL_DISK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+#include "sgx_ql_quote.h"
+#include "sgx_qve_header.h"
+#include "sgx_tcrypto.h"
+
+#include "CollateralCache.h"
+#include "CrustStatus.h"
+
+#define COLLATERAL_DISK_MAGIC 0x4c4f4343
+// Bumped whenever file layout changes, files of other versions are fetched again
+#define COLLATERAL_DISK_VERSION 1
+// Collateral fields, in the order of sgx_ql_qve_collateral_t
+#define COLLATERAL_DISK_FIELD_NUM 7
+
+// Header of one collateral file, followed by its fields one after another
+typedef struct _collateral_disk_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    // Version of collateral structure returned by quote provider library
+    uint32_t collateral_version;
+    uint32_t reserved;
+    // Unix time collateral was fetched from collateral service
+    int64_t fetched_at;
+    // Earliest nextUpdate of TCB info and QE identity, file is not used after it
+    int64_t next_update;
+    uint32_t sizes[COLLATERAL_DISK_FIELD_NUM];
+    uint32_t reserved2;
+    // SHA-256 of everything after header
+    sgx_sha256_hash_t hash;
+} collateral_disk_header_t;
+
+// Collateral fetched from collateral service kept on disk, one memory mapped file per FMSPC and CA type,
+// so that a restarted service has collateral at once. A file is read the first time its collateral
+// is needed, and dropped if its version, checksum or nextUpdate doesn't hold.
+class CollateralDisk
+{
+public:
+    static CollateralDisk *collateral_disk;
+    static CollateralDisk *get_instance();
+    crust_status_t init(const char *dir);
+    bool is_enabled();
+    bool load(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral, int64_t *fetched_at);
+    void save(const collateral_key_t &key, const sgx_ql_qve_collateral_t *collateral, int64_t fetched_at);
+
+private:
+    std::string get_path(const collateral_key_t &key);
+    std::string dir;
+    CollateralDisk(void);
+};
+
+#endif /* !_CRUST_COLLATERAL_DISK_H_ */
@@ -0,0 +1,415 @@
+#include "CollateralStore.h"
+
+#include "Log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Tar bundle is made of 512 byte blocks, each file has one header block and data padded to whole blocks
+#define COLLATERAL_TAR_BLOCK_SIZE 512
+
+std::mutex collateral_store_mutex;
+
+CollateralStore *CollateralStore::collateral_store = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: collateral store instance
+ */
+CollateralStore *CollateralStore::get_instance()
+{
+    if (CollateralStore::collateral_store == NULL)
+    {
+        collateral_store_mutex.lock();
+        if (CollateralStore::collateral_store == NULL)
+        {
+            CollateralStore::collateral_store = new CollateralStore();
+        }
+        collateral_store_mutex.unlock();
+    }
+
+    return CollateralStore::collateral_store;
+}
+
+/**
+ * @description: constructor
+ */
+CollateralStore::CollateralStore()
+{
+    this->is_bundle = false;
+    this->running = false;
+}
+
+/**
+ * @description: Index one collateral file by its name, which tells what it is for
+ * @param index -> Index to add to
+ * @param name -> File name, directories in it are ignored
+ * @param data -> File data
+ * @param size -> File size
+ * @param terminated -> Whether a zero byte follows data
+ */
+static void index_file(collateral_index_t *index, const char *name, const char *data, size_t size, bool terminated)
+{
+    const char *base = strrchr(name, '/');
+    base = base != NULL ? base + 1 : name;
+    // Extension, if any, only tells format
+    std::string stem(base, strcspn(base, "."));
+    collateral_file_t *file = NULL;
+    if (stem == "root_ca_crl")
+        file = &index->root_ca_crl;
+    else if (stem == "tcb_info_issuer_chain")
+        file = &index->tcb_info_issuer_chain;
+    else if (stem == "qe_identity")
+        file = &index->qe_identity;
+    else if (stem == "qe_identity_issuer_chain")
+        file = &index->qe_identity_issuer_chain;
+    else if (stem.compare(0, 21, "pck_crl_issuer_chain_") == 0)
+        file = &index->pck_crl_issuer_chains[stem.substr(21)];
+    else if (stem.compare(0, 8, "pck_crl_") == 0)
+        file = &index->pck_crls[stem.substr(8)];
+    else if (stem.compare(0, 9, "tcb_info_") == 0 && stem.size() == 9 + COLLATERAL_FMSPC_SIZE * 2)
+    {
+        std::string fmspc = stem.substr(9);
+        for (auto &c : fmspc)
+            c = tolower(c);
+        file = &index->tcb_infos[fmspc];
+    }
+    if (file == NULL)
+    {
+        p_log->debug("Collateral store ignores unknown file %s\n", name);
+        return;
+    }
+
+    if (!terminated)
+    {
+        index->files.push_back(std::string(data, size));
+        data = index->files.back().c_str();
+    }
+    file->data = data;
+    file->size = (uint32_t)size + 1;
+}
+
+/**
+ * @description: Read whole file into index, up to where it ends while being read. A mapping would let a file
+ * rewritten or truncated in place change collateral already handed out, or fault on access
+ * @param path -> File path
+ * @param index -> Index owning the data
+ * @param data -> File data, followed by a zero byte
+ * @param size -> File size
+ * @return: Whether file is read
+ */
+static bool read_file(const char *path, collateral_index_t *index, const char **data, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+    std::string buf;
+    buf.resize(st.st_size + 1);
+    size_t len = 0;
+    for (;;)
+    {
+        if (len == buf.size())
+            buf.resize(buf.size() * 2);
+        ssize_t n = read(fd, &buf[len], buf.size() - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            close(fd);
+            return false;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    close(fd);
+    buf.resize(len);
+    index->files.push_back(std::move(buf));
+    *data = index->files.back().c_str();
+    *size = len;
+
+    return true;
+}
+
+/**
+ * @description: Load store into a new index
+ * @param index -> New index
+ * @return: Load status
+ */
+crust_status_t CollateralStore::load(std::shared_ptr<collateral_index_t> &index)
+{
+    index = std::make_shared<collateral_index_t>();
+    if (!this->is_bundle)
+    {
+        DIR *dir = opendir(this->path.c_str());
+        if (dir == NULL)
+            return CRUST_OPEN_FILE_FAILED;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL)
+        {
+            if (ent->d_name[0] == '.')
+                continue;
+            std::string file_path = this->path + "/" + ent->d_name;
+            const char *data;
+            size_t size;
+            if (!read_file(file_path.c_str(), index.get(), &data, &size))
+                continue;
+            index_file(index.get(), ent->d_name, data, size, true);
+        }
+        closedir(dir);
+    }
+    else
+    {
+        const char *data;
+        size_t size;
+        if (!read_file(this->path.c_str(), index.get(), &data, &size))
+            return CRUST_OPEN_FILE_FAILED;
+        size_t off = 0;
+        while (off + COLLATERAL_TAR_BLOCK_SIZE <= size && data[off] != '\0')
+        {
+            const char *header = data + off;
+            char name[101];
+            memcpy(name, header, 100);
+            name[100] = '\0';
+            char size_field[13];
+            memcpy(size_field, header + 124, 12);
+            size_field[12] = '\0';
+            char *end = NULL;
+            size_t file_size = strtoull(size_field, &end, 8);
+            char type = header[156];
+            off += COLLATERAL_TAR_BLOCK_SIZE;
+            if (end == size_field || file_size > size - off)
+                return CRUST_INVALID_META_DATA;
+            if (type == '0' || type == '\0')
+            {
+                // Padding of data block is zero filled
+                bool terminated = file_size % COLLATERAL_TAR_BLOCK_SIZE != 0 && off + file_size < size;
+                index_file(index.get(), name, data + off, file_size, terminated);
+            }
+            off += (file_size + COLLATERAL_TAR_BLOCK_SIZE - 1) / COLLATERAL_TAR_BLOCK_SIZE * COLLATERAL_TAR_BLOCK_SIZE;
+        }
+    }
+
+    if (index->root_ca_crl.data == NULL || index->tcb_info_issuer_chain.data == NULL
+            || index->qe_identity.data == NULL || index->qe_identity_issuer_chain.data == NULL)
+        return CRUST_INVALID_META_DATA;
+    p_log->info("Collateral store loaded %lu TCB infos and %lu PCK CRLs from %s\n",
+            index->tcb_infos.size(), index->pck_crls.size(), this->path.c_str());
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Load store at path, must be called before fork so that all workers share first load
+ * @param path -> Directory of collateral files, or tar bundle of them
+ * @return: Init status
+ */
+crust_status_t CollateralStore::init(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return CRUST_OPEN_FILE_FAILED;
+    this->path = path;
+    this->is_bundle = !S_ISDIR(st.st_mode);
+
+    std::shared_ptr<collateral_index_t> index;
+    crust_status_t crust_status = this->load(index);
+    if (CRUST_SUCCESS != crust_status)
+        return crust_status;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->index = index;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether collateral comes from store instead of collateral service
+ * @return: Enabled or not
+ */
+bool CollateralStore::is_enabled()
+{
+    return !this->path.empty();
+}
+
+/**
+ * @description: Get collateral of key from current load of store
+ * @param key -> Collateral key
+ * @param collateral -> Collateral, which keeps its load until dropped
+ * @return: SGX_QL_NO_QUOTE_COLLATERAL_DATA if store lacks some file of key
+ */
+quote3_error_t CollateralStore::get(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral)
+{
+    std::shared_ptr<collateral_index_t> index;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        index = this->index;
+    }
+    if (!index)
+        return SGX_QL_NO_QUOTE_COLLATERAL_DATA;
+
+    char fmspc[COLLATERAL_FMSPC_SIZE * 2 + 1];
+    for (size_t i = 0; i < COLLATERAL_FMSPC_SIZE; i++)
+        sprintf(fmspc + i * 2, "%02x", key.fmspc[i]);
+    auto tcb_info = index->tcb_infos.find(fmspc);
+    auto pck_crl = index->pck_crls.find(key.ca);
+    auto pck_crl_issuer_chain = index->pck_crl_issuer_chains.find(key.ca);
+    if (tcb_info == index->tcb_infos.end() || pck_crl == index->pck_crls.end()
+            || pck_crl_issuer_chain == index->pck_crl_issuer_chains.end())
+    {
+        p_log->err("Collateral store has no collateral for FMSPC %s and %s CA\n", fmspc, key.ca);
+        return SGX_QL_NO_QUOTE_COLLATERAL_DATA;
+    }
+
+    sgx_ql_qve_collateral_t *p_collateral = new sgx_ql_qve_collateral_t;
+    memset(p_collateral, 0, sizeof(sgx_ql_qve_collateral_t));
+    p_collateral->version = COLLATERAL_STORE_VERSION;
+    p_collateral->pck_crl_issuer_chain = const_cast<char *>(pck_crl_issuer_chain->second.data);
+    p_collateral->pck_crl_issuer_chain_size = pck_crl_issuer_chain->second.size;
+    p_collateral->root_ca_crl = const_cast<char *>(index->root_ca_crl.data);
+    p_collateral->root_ca_crl_size = index->root_ca_crl.size;
+    p_collateral->pck_crl = const_cast<char *>(pck_crl->second.data);
+    p_collateral->pck_crl_size = pck_crl->second.size;
+    p_collateral->tcb_info_issuer_chain = const_cast<char *>(index->tcb_info_issuer_chain.data);
+    p_collateral->tcb_info_issuer_chain_size = index->tcb_info_issuer_chain.size;
+    p_collateral->tcb_info = const_cast<char *>(tcb_info->second.data);
+    p_collateral->tcb_info_size = tcb_info->second.size;
+    p_collateral->qe_identity_issuer_chain = const_cast<char *>(index->qe_identity_issuer_chain.data);
+    p_collateral->qe_identity_issuer_chain_size = index->qe_identity_issuer_chain.size;
+    p_collateral->qe_identity = const_cast<char *>(index->qe_identity.data);
+    p_collateral->qe_identity_size = index->qe_identity.size;
+    collateral.reset(p_collateral, [index](const sgx_ql_qve_collateral_t *p) { delete p; });
+
+    return SGX_QL_SUCCESS;
+}
+
+/**
+ * @description: Set function called after store is loaded again
+ * @param listener -> Listener
+ */
+void CollateralStore::set_reload_listener(std::function<void()> listener)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->reload_listener = listener;
+}
+
+/**
+ * @description: Start watching store of current process for changes
+ */
+void CollateralStore::start()
+{
+    if (this->path.empty() || this->running)
+    {
+        return;
+    }
+
+    this->running = true;
+    this->thread = std::thread(&CollateralStore::watch, this);
+}
+
+/**
+ * @description: Stop watching store
+ */
+void CollateralStore::stop()
+{
+    if (!this->running)
+    {
+        return;
+    }
+
+    this->running = false;
+    this->thread.join();
+}
+
+/**
+ * @description: Read pending events of inotify descriptor
+ * @param fd -> Inotify descriptor
+ * @param name -> File name events are filtered by, NULL for any file
+ * @return: Whether any event is of interest
+ */
+static bool read_events(int fd, const char *name)
+{
+    alignas(struct inotify_event) char buf[4096];
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            if (name == NULL || (event->len != 0 && strcmp(name, event->name) == 0))
+                changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * @description: Load store again whenever a file of directory or bundle itself is written or replaced, last load is kept if new one fails
+ */
+void CollateralStore::watch()
+{
+    // Bundle is usually replaced by rename, so its directory is watched
+    std::string dir = this->path;
+    std::string name;
+    if (this->is_bundle)
+    {
+        size_t pos = dir.rfind('/');
+        name = pos == std::string::npos ? dir : dir.substr(pos + 1);
+        dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : dir.substr(0, pos));
+    }
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == -1)
+    {
+        p_log->err("Watch collateral store %s failed, it will not be reloaded!\n", this->path.c_str());
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+
+    const char *filter = this->is_bundle ? name.c_str() : NULL;
+    while (this->running)
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, COLLATERAL_STORE_POLL_MS) <= 0)
+            continue;
+        bool changed = read_events(fd, filter);
+        // Files of one update come in a row, load once after them
+        while (poll(&pfd, 1, COLLATERAL_STORE_SETTLE_MS) > 0)
+            changed = read_events(fd, filter) || changed;
+        if (!changed)
+            continue;
+
+        std::shared_ptr<collateral_index_t> index;
+        if (CRUST_SUCCESS != this->load(index))
+        {
+            p_log->err("Reload collateral store %s failed, last load is kept!\n", this->path.c_str());
+            continue;
+        }
+        std::function<void()> listener;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->index = index;
+            listener = this->reload_listener;
+        }
+        if (listener)
+            listener();
+    }
+    close(fd);
+}
@@ -0,0 +1,81 @@
+#ifndef _CRUST_COLLATERAL_STORE_H_
+#define _CRUST_COLLATERAL_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sgx_ql_quote.h"
+#include "sgx_qve_header.h"
+
+#include "CollateralCache.h"
+#include "CrustStatus.h"
+
+// Version of collateral structure passed to quote library
+#define COLLATERAL_STORE_VERSION 3
+// Longest wait for a change of store, bounds how long stop takes
+#define COLLATERAL_STORE_POLL_MS 1000
+// Quiet time after last change before store is loaded again
+#define COLLATERAL_STORE_SETTLE_MS 100
+
+// One collateral file, size counts terminating zero as quote provider library does
+typedef struct _collateral_file_t
+{
+    const char *data;
+    uint32_t size;
+} collateral_file_t;
+
+// Collateral files of one load of store, kept while any collateral handed out points into them
+typedef struct _collateral_index_t
+{
+    // Whole files read at load, and copies of bundle members with no room for terminating zero, so
+    // collateral handed out never changes however the store is written
+    std::deque<std::string> files;
+    collateral_file_t root_ca_crl;
+    collateral_file_t tcb_info_issuer_chain;
+    collateral_file_t qe_identity;
+    collateral_file_t qe_identity_issuer_chain;
+    // By CA type, processor or platform
+    std::map<std::string, collateral_file_t> pck_crls;
+    std::map<std::string, collateral_file_t> pck_crl_issuer_chains;
+    // By FMSPC in lower case hex
+    std::map<std::string, collateral_file_t> tcb_infos;
+} collateral_index_t;
+
+// Collateral read from a local directory or tar bundle instead of collateral service. Files are
+// read into memory and indexed by FMSPC and CA type, and loaded again when the store changes.
+class CollateralStore
+{
+public:
+    static CollateralStore *collateral_store;
+    static CollateralStore *get_instance();
+    crust_status_t init(const char *path);
+    bool is_enabled();
+    quote3_error_t get(const collateral_key_t &key, std::shared_ptr<const sgx_ql_qve_collateral_t> &collateral);
+    void set_reload_listener(std::function<void()> listener);
+    void start();
+    void stop();
+
+private:
+    crust_status_t load(std::shared_ptr<collateral_index_t> &index);
+    void watch();
+    std::mutex mutex;
+    std::shared_ptr<collateral_index_t> index;
+    std::string path;
+    bool is_bundle;
+    // Called after store is loaded again
+    std::function<void()> reload_listener;
+    std::atomic<bool> running;
+    std::thread thread;
+    CollateralStore(void);
+};
+
+#endif /* !_CRUST_COLLATERAL_STORE_H_ */
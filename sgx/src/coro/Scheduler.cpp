@@ -0,0 +1,195 @@
+#include "Scheduler.h"
+
+// Top level coroutine of a spawned task, frees itself when done
+struct SpawnedTask
+{
+    struct promise_type
+    {
+        SpawnedTask get_return_object() noexcept
+        {
+            return SpawnedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @description: Run task to its end and count it off scheduler
+ * @param scheduler -> Scheduler running the task
+ * @param task -> Task
+ * @return: Spawned coroutine, suspended before start
+ */
+SpawnedTask run_spawned(Scheduler *scheduler, Task<void> task)
+{
+    co_await task;
+    scheduler->finish_task();
+}
+
+/**
+ * @description: constructor
+ */
+Scheduler::Scheduler()
+{
+    this->task_num = 0;
+}
+
+/**
+ * @description: Start task on loop thread, run returns after all spawned tasks are done
+ * @param task -> Task
+ */
+void Scheduler::spawn(Task<void> task)
+{
+    this->task_num++;
+    this->post(run_spawned(this, std::move(task)).handle);
+}
+
+/**
+ * @description: Resume suspended coroutine on loop thread, may be called from any thread
+ * @param h -> Coroutine handle
+ */
+void Scheduler::post(std::coroutine_handle<> h)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->ready.push_back(h);
+    }
+    this->cond.notify_one();
+}
+
+/**
+ * @description: Awaitable which suspends current coroutine and queues it behind the ready ones
+ * @return: Awaiter
+ */
+Scheduler::ScheduleAwaiter Scheduler::schedule()
+{
+    return ScheduleAwaiter{this};
+}
+
+/**
+ * @description: Run ready coroutines on current thread until all spawned tasks are done
+ */
+void Scheduler::run()
+{
+    std::deque<std::coroutine_handle<>> batch;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond.wait(lock, [this] { return !this->ready.empty() || this->task_num == 0; });
+            if (this->ready.empty())
+                return;
+            batch.swap(this->ready);
+        }
+        for (auto h : batch)
+            h.resume();
+        batch.clear();
+    }
+}
+
+/**
+ * @description: Get number of spawned tasks which are not done
+ * @return: Task number
+ */
+size_t Scheduler::get_task_num()
+{
+    return this->task_num;
+}
+
+/**
+ * @description: Count off a spawned task, called on loop thread
+ */
+void Scheduler::finish_task()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->task_num--;
+}
+
+/**
+ * @description: constructor
+ * @param thread_num -> Thread number
+ */
+BlockingPool::BlockingPool(size_t thread_num)
+{
+    this->stopping = false;
+    for (size_t i = 0; i < thread_num; i++)
+    {
+        this->threads.push_back(std::thread(&BlockingPool::work, this));
+    }
+}
+
+/**
+ * @description: destructor, queued jobs are done before threads exit
+ */
+BlockingPool::~BlockingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->cond.notify_all();
+    for (auto &t : this->threads)
+    {
+        t.join();
+    }
+}
+
+/**
+ * @description: Awaitable which runs job on pool and then resumes current coroutine on scheduler
+ * @param scheduler -> Scheduler to resume on
+ * @param job -> Blocking job
+ * @return: Awaiter
+ */
+BlockingPool::OffloadAwaiter BlockingPool::offload(Scheduler &scheduler, std::function<void()> job)
+{
+    return OffloadAwaiter{this, &scheduler, std::move(job)};
+}
+
+/**
+ * @description: Queue job to pool
+ * @param job -> Job
+ */
+void BlockingPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->jobs.push_back(std::move(job));
+    }
+    this->cond.notify_one();
+}
+
+/**
+ * @description: Run queued jobs until pool is destroyed
+ */
+void BlockingPool::work()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+            if (this->jobs.empty())
+                return;
+            job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+        }
+        job();
+    }
+}
+
+/**
+ * @description: Hand job to pool, coroutine is posted back to scheduler when job is done
+ * @param h -> Suspended coroutine
+ */
+void BlockingPool::OffloadAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    this->pool->submit([this, h] {
+        this->job();
+        this->scheduler->post(h);
+    });
+}
@@ -0,0 +1,76 @@
+#ifndef _CRUST_SCHEDULER_H_
+#define _CRUST_SCHEDULER_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Task.h"
+
+struct SpawnedTask;
+
+// Single threaded event loop running coroutine tasks. Any thread may post
+// a suspended coroutine back to it, blocking calls are offloaded to a
+// BlockingPool so that the loop thread never waits on them.
+class Scheduler
+{
+public:
+    struct ScheduleAwaiter
+    {
+        Scheduler *scheduler;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { scheduler->post(h); }
+        void await_resume() const noexcept {}
+    };
+
+    Scheduler();
+    void spawn(Task<void> task);
+    void post(std::coroutine_handle<> h);
+    ScheduleAwaiter schedule();
+    void run();
+    size_t get_task_num();
+
+private:
+    void finish_task();
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::coroutine_handle<>> ready;
+    std::atomic<size_t> task_num;
+    friend SpawnedTask run_spawned(Scheduler *scheduler, Task<void> task);
+};
+
+// Fixed threads for blocking calls, like quote verification which may fetch collateral
+class BlockingPool
+{
+public:
+    struct OffloadAwaiter
+    {
+        BlockingPool *pool;
+        Scheduler *scheduler;
+        std::function<void()> job;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const noexcept {}
+    };
+
+    BlockingPool(size_t thread_num);
+    ~BlockingPool();
+    OffloadAwaiter offload(Scheduler &scheduler, std::function<void()> job);
+    void submit(std::function<void()> job);
+
+private:
+    void work();
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> threads;
+    bool stopping;
+};
+
+#endif /* !_CRUST_SCHEDULER_H_ */
@@ -0,0 +1,99 @@
+#ifndef _CRUST_TASK_H_
+#define _CRUST_TASK_H_
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+// Lazily started coroutine. It runs when awaited, and resumes its awaiter
+// through symmetric transfer when it finishes, so chains of stages neither
+// grow the stack nor go through the scheduler. Exceptions are not used.
+template <typename T>
+class Task;
+
+class TaskPromiseBase
+{
+public:
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            std::coroutine_handle<> continuation = h.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { std::terminate(); }
+
+    std::coroutine_handle<> continuation;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+    Task<T> get_return_object() noexcept;
+    void return_value(T v) { value = std::move(v); }
+
+    T value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+};
+
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    explicit Task(handle_type h) noexcept : handle(h) {}
+    Task(Task &&t) noexcept : handle(std::exchange(t.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+    {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+    T await_resume()
+    {
+        if constexpr (!std::is_void<T>::value)
+            return std::move(handle.promise().value);
+    }
+
+private:
+    handle_type handle;
+};
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() noexcept
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+#endif /* !_CRUST_TASK_H_ */
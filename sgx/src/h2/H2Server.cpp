@@ -0,0 +1,859 @@
+#include "H2Server.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Verifier.h"
+#include "Utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+std::mutex h2_server_mutex;
+
+H2Server *H2Server::h2_server = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: Read big endian integer
+ * @param p -> Bytes
+ * @param n -> Byte number
+ * @return: Integer
+ */
+static uint32_t get_be(const uint8_t *p, size_t n)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < n; i++)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+/**
+ * @description: Write big endian integer
+ * @param p -> Bytes
+ * @param n -> Byte number
+ * @param v -> Integer
+ */
+static void put_be(uint8_t *p, size_t n, uint32_t v)
+{
+    for (size_t i = 0; i < n; i++)
+        p[i] = (uint8_t)(v >> ((n - 1 - i) * 8));
+}
+
+/**
+ * @description: single instance class function to get instance
+ * @return: h2 server instance
+ */
+H2Server *H2Server::get_instance()
+{
+    if (H2Server::h2_server == NULL)
+    {
+        h2_server_mutex.lock();
+        if (H2Server::h2_server == NULL)
+        {
+            H2Server::h2_server = new H2Server();
+        }
+        h2_server_mutex.unlock();
+    }
+
+    return H2Server::h2_server;
+}
+
+/**
+ * @description: constructor
+ */
+H2Server::H2Server() : pool(H2_SERVER_THREAD_NUM)
+{
+    this->stopping = false;
+}
+
+/**
+ * @description: Stop all h2 connections, each one finishes its open streams first
+ */
+void H2Server::stop()
+{
+    this->stopping = true;
+}
+
+/**
+ * @description: Serve connection which opened with HTTP/2 preface until peer closes it
+ * @param req -> Head of preface
+ * @param strm -> Connection stream
+ * @return: Always false, connection is closed afterwards
+ */
+bool H2Server::serve(const httplib::Request & /*req*/, httplib::Stream &strm)
+{
+    Metrics::get_instance()->add(METRIC_H2_CONNECTION_TOTAL);
+    H2Connection conn(strm, this->pool, this->stopping);
+    conn.serve();
+
+    return false;
+}
+
+/**
+ * @description: constructor
+ * @param strm -> Connection stream
+ * @param pool -> Pool verifying requests
+ * @param stopping -> Set when service stops
+ */
+H2Connection::H2Connection(httplib::Stream &strm, BlockingPool &pool, std::atomic<bool> &stopping)
+    : strm(strm), pool(pool), stopping(stopping)
+{
+    this->in_flight = 0;
+    this->last_stream_id = 0;
+    this->send_window = H2_DEFAULT_WINDOW_SIZE;
+    this->recv_window = H2_DEFAULT_WINDOW_SIZE;
+    this->peer_initial_window = H2_DEFAULT_WINDOW_SIZE;
+    this->peer_max_frame_size = H2_DEFAULT_FRAME_SIZE;
+    this->goaway_sent = false;
+}
+
+/**
+ * @description: destructor, releases streams left open
+ */
+H2Connection::~H2Connection()
+{
+    for (auto &it : this->streams)
+    {
+        Arena::release(it.second->arena);
+    }
+}
+
+/**
+ * @description: Read exactly indicated bytes
+ * @param buf -> Buffer
+ * @param len -> Length
+ * @return: Read or not, false if peer went away or stalled for read timeout
+ */
+bool H2Connection::read_exact(char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = this->strm.read(buf, len);
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/**
+ * @description: Read and dispatch frames until peer closes connection, a connection error happens,
+ * or it has gone away and every stream is done. Streams in flight are waited for before return.
+ */
+void H2Connection::serve()
+{
+    // "PRI * HTTP/2.0\r\n\r\n" is read by httplib already
+    char preface[6];
+    if (!this->read_exact(preface, sizeof(preface)) || memcmp(preface, "SM\r\n\r\n", sizeof(preface)) != 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        uint8_t settings[18];
+        put_be(settings, 2, H2_SETTINGS_MAX_CONCURRENT_STREAMS);
+        put_be(settings + 2, 4, H2_MAX_CONCURRENT_STREAMS);
+        put_be(settings + 6, 2, H2_SETTINGS_INITIAL_WINDOW_SIZE);
+        put_be(settings + 8, 4, H2_STREAM_WINDOW_SIZE);
+        put_be(settings + 12, 2, H2_SETTINGS_MAX_HEADER_LIST_SIZE);
+        put_be(settings + 14, 4, HPACK_MAX_HEADER_LIST_SIZE);
+        this->send_frame(H2_FRAME_SETTINGS, 0, 0, (const char *)settings, sizeof(settings));
+        // Connection window only grows by WINDOW_UPDATE
+        uint8_t inc[4];
+        put_be(inc, 4, H2_CONNECTION_WINDOW_SIZE - H2_DEFAULT_WINDOW_SIZE);
+        this->send_frame(H2_FRAME_WINDOW_UPDATE, 0, 0, (const char *)inc, sizeof(inc));
+        this->recv_window = H2_CONNECTION_WINDOW_SIZE;
+    }
+
+    std::string payload;
+    std::string header_block;
+    uint32_t header_stream_id = 0;
+    bool header_end_stream = false;
+    uint32_t error = H2_NO_ERROR;
+    auto last_active = std::chrono::steady_clock::now();
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->stopping && !this->goaway_sent)
+                this->send_goaway(H2_NO_ERROR);
+            if (this->goaway_sent && this->streams.empty())
+                break;
+        }
+
+        // Only idle between frames, a stalled frame means a broken peer
+        if (!this->strm.is_readable())
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->goaway_sent)
+                break;
+            if (this->streams.empty() && std::chrono::steady_clock::now() - last_active
+                    > std::chrono::seconds(H2_IDLE_TIMEOUT_S))
+            {
+                this->send_goaway(H2_NO_ERROR);
+                break;
+            }
+            continue;
+        }
+
+        uint8_t head[H2_FRAME_HEAD_SIZE];
+        if (!this->read_exact((char *)head, sizeof(head)))
+            break;
+        uint32_t len = get_be(head, 3);
+        uint8_t type = head[3];
+        uint8_t flags = head[4];
+        uint32_t stream_id = get_be(head + 5, 4) & 0x7FFFFFFF;
+        if (len > H2_DEFAULT_FRAME_SIZE)
+        {
+            error = H2_FRAME_SIZE_ERROR;
+            break;
+        }
+        payload.resize(len);
+        if (!this->read_exact(&payload[0], len))
+            break;
+        last_active = std::chrono::steady_clock::now();
+
+        // Header block must not be interleaved with other frames
+        if (header_stream_id != 0 && (type != H2_FRAME_CONTINUATION || stream_id != header_stream_id))
+        {
+            error = H2_PROTOCOL_ERROR;
+            break;
+        }
+
+        const uint8_t *p = (const uint8_t *)payload.data();
+        switch (type)
+        {
+        case H2_FRAME_DATA:
+            error = this->on_data(stream_id, flags, p, len);
+            break;
+        case H2_FRAME_HEADERS:
+            if (stream_id == 0 || stream_id % 2 == 0)
+            {
+                error = H2_PROTOCOL_ERROR;
+                break;
+            }
+            if (flags & H2_FLAG_PADDED)
+            {
+                if (len < 1 || p[0] >= len)
+                {
+                    error = H2_PROTOCOL_ERROR;
+                    break;
+                }
+                len -= p[0] + 1;
+                p++;
+            }
+            if (flags & H2_FLAG_PRIORITY)
+            {
+                if (len < 5)
+                {
+                    error = H2_FRAME_SIZE_ERROR;
+                    break;
+                }
+                p += 5;
+                len -= 5;
+            }
+            header_block.assign((const char *)p, len);
+            header_end_stream = (flags & H2_FLAG_END_STREAM) != 0;
+            if (flags & H2_FLAG_END_HEADERS)
+                error = this->on_headers(stream_id, header_end_stream, header_block);
+            else
+                header_stream_id = stream_id;
+            break;
+        case H2_FRAME_CONTINUATION:
+            if (header_stream_id == 0)
+            {
+                error = H2_PROTOCOL_ERROR;
+                break;
+            }
+            if (header_block.size() + len > H2_MAX_HEADER_BLOCK_SIZE)
+            {
+                error = H2_ENHANCE_YOUR_CALM;
+                break;
+            }
+            header_block.append((const char *)p, len);
+            if (flags & H2_FLAG_END_HEADERS)
+            {
+                error = this->on_headers(header_stream_id, header_end_stream, header_block);
+                header_stream_id = 0;
+            }
+            break;
+        case H2_FRAME_SETTINGS:
+            error = stream_id != 0 ? H2_PROTOCOL_ERROR : this->on_settings(flags, p, len);
+            break;
+        case H2_FRAME_WINDOW_UPDATE:
+            error = this->on_window_update(stream_id, p, len);
+            break;
+        case H2_FRAME_PING:
+            if (stream_id != 0)
+            {
+                error = H2_PROTOCOL_ERROR;
+            }
+            else if (len != 8)
+            {
+                error = H2_FRAME_SIZE_ERROR;
+            }
+            else if ((flags & H2_FLAG_ACK) == 0)
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->send_frame(H2_FRAME_PING, H2_FLAG_ACK, 0, (const char *)p, len);
+            }
+            break;
+        case H2_FRAME_RST_STREAM:
+            if (stream_id == 0)
+                error = H2_PROTOCOL_ERROR;
+            else if (len != 4)
+                error = H2_FRAME_SIZE_ERROR;
+            else
+                this->on_rst_stream(stream_id);
+            break;
+        case H2_FRAME_GOAWAY:
+        {
+            // Peer opens no more streams, open ones are still answered
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!this->goaway_sent)
+                this->send_goaway(H2_NO_ERROR);
+            break;
+        }
+        case H2_FRAME_PUSH_PROMISE:
+            error = H2_PROTOCOL_ERROR;
+            break;
+        default:
+            // PRIORITY and unknown frames are ignored
+            break;
+        }
+        if (error != H2_NO_ERROR)
+            break;
+    }
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (error != H2_NO_ERROR)
+    {
+        p_log->err("h2 connection error: 0x%x\n", error);
+        this->send_goaway(error);
+    }
+    // Verifications in flight still hold their streams
+    this->cond.wait(lock, [this] { return this->in_flight == 0; });
+}
+
+/**
+ * @description: Open stream with decoded request head, or end request body with trailers
+ * @param stream_id -> Stream id
+ * @param end_stream -> Whether request ends with this header block
+ * @param block -> Whole header block
+ * @return: Connection error, H2_NO_ERROR if none
+ */
+uint32_t H2Connection::on_headers(uint32_t stream_id, bool end_stream, std::string &block)
+{
+    // Every block is decoded, even of refused streams, to keep dynamic table in step
+    std::vector<hpack_header_t> headers;
+    if (!this->decoder.decode((const uint8_t *)block.data(), block.size(), headers))
+    {
+        return H2_COMPRESSION_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->streams.find(stream_id);
+    if (it != this->streams.end())
+    {
+        if (it->second->state != H2_STREAM_RECEIVING || !end_stream)
+            return H2_PROTOCOL_ERROR;
+        this->finish_request(it->second);
+        return H2_NO_ERROR;
+    }
+    if (stream_id <= this->last_stream_id)
+    {
+        return H2_PROTOCOL_ERROR;
+    }
+    this->last_stream_id = stream_id;
+    if (this->goaway_sent || this->streams.size() >= H2_MAX_CONCURRENT_STREAMS)
+    {
+        this->send_rst_stream(stream_id, H2_REFUSED_STREAM);
+        return H2_NO_ERROR;
+    }
+
+    // Stream lives in its own arena, the same one request body and response are drawn from
+    Arena *arena = Arena::create();
+    h2_stream_t *stream = arena != NULL ? (h2_stream_t *)arena->alloc(sizeof(h2_stream_t)) : NULL;
+    if (stream == NULL)
+    {
+        if (arena != NULL)
+            Arena::release(arena);
+        this->send_rst_stream(stream_id, H2_INTERNAL_ERROR);
+        return H2_NO_ERROR;
+    }
+    memset(stream, 0, sizeof(h2_stream_t));
+    stream->id = stream_id;
+    stream->state = H2_STREAM_RECEIVING;
+    stream->arena = arena;
+    stream->send_window = this->peer_initial_window;
+    stream->recv_window = H2_STREAM_WINDOW_SIZE;
+
+    std::string method;
+    std::string path;
+    uint64_t content_length = 0;
+    for (auto &h : headers)
+    {
+        if (h.name == ":method")
+            method = h.value;
+        else if (h.name == ":path")
+            path = h.value.substr(0, h.value.find('?'));
+        else if (h.name == "content-length")
+            content_length = strtoull(h.value.c_str(), NULL, 10);
+        else if (h.name == "x-request-deadline")
+            stream->deadline_ms = parse_deadline_ms(h.value.c_str());
+    }
+    if (method != "POST" || path != "/entryNetwork")
+    {
+        stream->status = 404;
+    }
+    else if (content_length > H2_MAX_BODY_SIZE)
+    {
+        stream->status = 413;
+    }
+    else if (content_length > 0)
+    {
+        stream->body = (char *)arena->alloc(content_length, 1);
+        stream->body_cap = stream->body != NULL ? content_length : 0;
+    }
+    this->streams[stream_id] = stream;
+    Metrics::get_instance()->add(METRIC_H2_STREAM_TOTAL);
+
+    if (end_stream)
+    {
+        this->finish_request(stream);
+    }
+
+    return H2_NO_ERROR;
+}
+
+/**
+ * @description: Append request body. Receive windows are given back once half of them is used,
+ * so a client keeps sending while earlier streams are verified.
+ * @param stream_id -> Stream id
+ * @param flags -> Frame flags
+ * @param p -> Frame payload
+ * @param len -> Frame payload length
+ * @return: Connection error, H2_NO_ERROR if none
+ */
+uint32_t H2Connection::on_data(uint32_t stream_id, uint8_t flags, const uint8_t *p, size_t len)
+{
+    if (stream_id == 0)
+    {
+        return H2_PROTOCOL_ERROR;
+    }
+    // Padding counts against flow control as well
+    size_t frame_len = len;
+    if (flags & H2_FLAG_PADDED)
+    {
+        if (len < 1 || p[0] >= len)
+            return H2_PROTOCOL_ERROR;
+        len -= p[0] + 1;
+        p++;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->recv_window -= frame_len;
+    if (this->recv_window < 0)
+    {
+        return H2_FLOW_CONTROL_ERROR;
+    }
+    if (this->recv_window <= H2_CONNECTION_WINDOW_SIZE / 2)
+    {
+        uint8_t inc[4];
+        put_be(inc, 4, H2_CONNECTION_WINDOW_SIZE - this->recv_window);
+        this->send_frame(H2_FRAME_WINDOW_UPDATE, 0, 0, (const char *)inc, sizeof(inc));
+        this->recv_window = H2_CONNECTION_WINDOW_SIZE;
+    }
+
+    auto it = this->streams.find(stream_id);
+    if (it == this->streams.end())
+    {
+        // Frames may still come after stream is refused or reset
+        return stream_id > this->last_stream_id ? H2_PROTOCOL_ERROR : H2_NO_ERROR;
+    }
+    if (it->second->state != H2_STREAM_RECEIVING)
+    {
+        this->send_rst_stream(stream_id, H2_STREAM_CLOSED);
+        if (it->second->state == H2_STREAM_VERIFYING)
+            it->second->reset = true;
+        else
+            this->close_stream(it->second);
+        return H2_NO_ERROR;
+    }
+    h2_stream_t *stream = it->second;
+    stream->recv_window -= frame_len;
+    if (stream->recv_window < 0)
+    {
+        this->send_rst_stream(stream_id, H2_FLOW_CONTROL_ERROR);
+        this->close_stream(stream);
+        return H2_NO_ERROR;
+    }
+
+    if (stream->status == 0 && len > 0)
+    {
+        if (stream->body_len + len > H2_MAX_BODY_SIZE)
+        {
+            stream->status = 413;
+        }
+        else
+        {
+            if (stream->body_len + len > stream->body_cap)
+            {
+                size_t new_cap = std::max(stream->body_cap * 2, stream->body_len + len);
+                stream->body = (char *)stream->arena->grow(stream->body, stream->body_len, new_cap);
+                stream->body_cap = new_cap;
+            }
+            if (stream->body == NULL)
+            {
+                stream->status = 500;
+            }
+            else
+            {
+                memcpy(stream->body + stream->body_len, p, len);
+                stream->body_len += len;
+            }
+        }
+    }
+
+    if (flags & H2_FLAG_END_STREAM)
+    {
+        this->finish_request(stream);
+    }
+    else if (stream->recv_window <= H2_STREAM_WINDOW_SIZE / 2)
+    {
+        uint8_t inc[4];
+        put_be(inc, 4, H2_STREAM_WINDOW_SIZE - stream->recv_window);
+        this->send_frame(H2_FRAME_WINDOW_UPDATE, 0, stream_id, (const char *)inc, sizeof(inc));
+        stream->recv_window = H2_STREAM_WINDOW_SIZE;
+    }
+
+    return H2_NO_ERROR;
+}
+
+/**
+ * @description: Apply peer settings and acknowledge them
+ * @param flags -> Frame flags
+ * @param p -> Frame payload
+ * @param len -> Frame payload length
+ * @return: Connection error, H2_NO_ERROR if none
+ */
+uint32_t H2Connection::on_settings(uint8_t flags, const uint8_t *p, size_t len)
+{
+    if (flags & H2_FLAG_ACK)
+    {
+        return len == 0 ? H2_NO_ERROR : H2_FRAME_SIZE_ERROR;
+    }
+    if (len % 6 != 0)
+    {
+        return H2_FRAME_SIZE_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < len; i += 6)
+    {
+        uint32_t id = get_be(p + i, 2);
+        uint32_t value = get_be(p + i + 2, 4);
+        switch (id)
+        {
+        case H2_SETTINGS_HEADER_TABLE_SIZE:
+            this->encoder.set_max_table_size(value);
+            break;
+        case H2_SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return H2_PROTOCOL_ERROR;
+            break;
+        case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > H2_MAX_WINDOW_SIZE)
+                return H2_FLOW_CONTROL_ERROR;
+            // Applies to open streams as well
+            int64_t delta = (int64_t)value - this->peer_initial_window;
+            for (auto &it : this->streams)
+            {
+                it.second->send_window += delta;
+            }
+            this->peer_initial_window = value;
+            break;
+        }
+        case H2_SETTINGS_MAX_FRAME_SIZE:
+            if (value < H2_DEFAULT_FRAME_SIZE || value > H2_MAX_FRAME_SIZE)
+                return H2_PROTOCOL_ERROR;
+            this->peer_max_frame_size = value;
+            break;
+        default:
+            break;
+        }
+    }
+    this->send_frame(H2_FRAME_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+    this->flush_streams();
+
+    return H2_NO_ERROR;
+}
+
+/**
+ * @description: Grow send window and resume responses waiting for it
+ * @param stream_id -> Stream id, 0 for connection
+ * @param p -> Frame payload
+ * @param len -> Frame payload length
+ * @return: Connection error, H2_NO_ERROR if none
+ */
+uint32_t H2Connection::on_window_update(uint32_t stream_id, const uint8_t *p, size_t len)
+{
+    if (len != 4)
+    {
+        return H2_FRAME_SIZE_ERROR;
+    }
+    uint32_t inc = get_be(p, 4) & 0x7FFFFFFF;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (stream_id == 0)
+    {
+        if (inc == 0)
+            return H2_PROTOCOL_ERROR;
+        this->send_window += inc;
+        if (this->send_window > H2_MAX_WINDOW_SIZE)
+            return H2_FLOW_CONTROL_ERROR;
+        this->flush_streams();
+        return H2_NO_ERROR;
+    }
+
+    auto it = this->streams.find(stream_id);
+    if (it == this->streams.end())
+    {
+        return H2_NO_ERROR;
+    }
+    h2_stream_t *stream = it->second;
+    stream->send_window += inc;
+    if (inc == 0 || stream->send_window > H2_MAX_WINDOW_SIZE)
+    {
+        this->send_rst_stream(stream_id, inc == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+        if (stream->state == H2_STREAM_VERIFYING)
+            stream->reset = true;
+        else
+            this->close_stream(stream);
+        return H2_NO_ERROR;
+    }
+    if (stream->state == H2_STREAM_SENDING)
+    {
+        this->flush_stream(stream);
+    }
+
+    return H2_NO_ERROR;
+}
+
+/**
+ * @description: Drop stream reset by peer, one being verified is dropped when verification ends
+ * @param stream_id -> Stream id
+ */
+void H2Connection::on_rst_stream(uint32_t stream_id)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->streams.find(stream_id);
+    if (it == this->streams.end())
+    {
+        return;
+    }
+    if (it->second->state == H2_STREAM_VERIFYING)
+        it->second->reset = true;
+    else
+        this->close_stream(it->second);
+}
+
+/**
+ * @description: Whole request is received, verify it on pool or answer at once. Called under connection mutex.
+ * @param stream -> Stream
+ */
+void H2Connection::finish_request(h2_stream_t *stream)
+{
+    if (stream->status != 0)
+    {
+        this->send_response(stream);
+        return;
+    }
+
+    stream->state = H2_STREAM_VERIFYING;
+    this->in_flight++;
+    this->pool.submit([this, stream] { this->verify(stream); });
+}
+
+/**
+ * @description: Verify request body and send response, runs on pool
+ * @param stream -> Stream
+ */
+void H2Connection::verify(h2_stream_t *stream)
+{
+    Metrics *p_metrics = Metrics::get_instance();
+    Verifier *p_verifier = Verifier::get_instance();
+    auto start_time = std::chrono::steady_clock::now();
+
+    // Stream reset or past its deadline while it was queued is not verified, nobody reads its result
+    bool reset = false;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        reset = stream->reset;
+    }
+    verify_result_t result;
+    if (reset || is_deadline_passed(stream->deadline_ms))
+    {
+        p_metrics->add(METRIC_CANCELLED_H2_QUEUE_TOTAL);
+        memset(&result, 0, sizeof(result));
+        result.message = "Request deadline passed!";
+        result.status_code = 504;
+    }
+    else
+    {
+        p_log->info("Dealing with new h2 request...\n");
+        p_verifier->verify(stream->arena, stream->body, stream->body_len, &result, [this, stream] {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            return stream->reset || is_deadline_passed(stream->deadline_ms);
+        });
+
+        p_metrics->add(METRIC_REQUEST_TOTAL);
+        p_metrics->add(200 == result.status_code ? METRIC_VERIFY_SUCCESS : METRIC_VERIFY_FAILED);
+        p_metrics->add(METRIC_VERIFY_LATENCY_US, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time).count());
+    }
+
+    size_t resp_len = 0;
+    char *resp = p_verifier->dump_result(stream->arena, &result, &resp_len);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (stream->reset)
+    {
+        this->close_stream(stream);
+    }
+    else
+    {
+        stream->status = resp != NULL ? result.status_code : 500;
+        stream->resp = resp;
+        stream->resp_len = resp != NULL ? resp_len : 0;
+        this->send_response(stream);
+    }
+    this->in_flight--;
+    this->cond.notify_all();
+}
+
+/**
+ * @description: Send response head, and as much of body as windows allow. Called under connection mutex.
+ * @param stream -> Stream
+ */
+void H2Connection::send_response(h2_stream_t *stream)
+{
+    char status[16];
+    char content_length[24];
+    snprintf(status, sizeof(status), "%d", stream->status);
+    snprintf(content_length, sizeof(content_length), "%lu", stream->resp_len);
+
+    // Content type repeats in every response, so it is indexed and takes one byte after the first
+    std::string block;
+    this->encoder.begin(block);
+    this->encoder.encode(block, ":status", status, false);
+    if (stream->resp_len > 0)
+        this->encoder.encode(block, "content-type", "application/json", true);
+    this->encoder.encode(block, "content-length", content_length, false);
+
+    stream->state = H2_STREAM_SENDING;
+    uint8_t flags = H2_FLAG_END_HEADERS | (stream->resp_len == 0 ? H2_FLAG_END_STREAM : 0);
+    this->send_frame(H2_FRAME_HEADERS, flags, stream->id, block.data(), block.size());
+    this->flush_stream(stream);
+}
+
+/**
+ * @description: Send response body within connection and stream windows, stream is closed once all is sent.
+ * Called under connection mutex.
+ * @param stream -> Stream
+ */
+void H2Connection::flush_stream(h2_stream_t *stream)
+{
+    while (stream->resp_off < stream->resp_len)
+    {
+        int64_t n = std::min({(int64_t)(stream->resp_len - stream->resp_off), this->send_window,
+                stream->send_window, (int64_t)this->peer_max_frame_size});
+        if (n <= 0)
+            return;
+        bool last = stream->resp_off + n == stream->resp_len;
+        this->send_frame(H2_FRAME_DATA, last ? H2_FLAG_END_STREAM : 0, stream->id, stream->resp + stream->resp_off, n);
+        stream->resp_off += n;
+        this->send_window -= n;
+        stream->send_window -= n;
+    }
+    this->close_stream(stream);
+}
+
+/**
+ * @description: Resume all responses waiting for window. Called under connection mutex.
+ */
+void H2Connection::flush_streams()
+{
+    std::vector<h2_stream_t *> sending;
+    for (auto &it : this->streams)
+    {
+        if (it.second->state == H2_STREAM_SENDING)
+            sending.push_back(it.second);
+    }
+    for (auto stream : sending)
+    {
+        this->flush_stream(stream);
+    }
+}
+
+/**
+ * @description: Forget stream and release its arena, stream itself is in it. Called under connection mutex.
+ * @param stream -> Stream
+ */
+void H2Connection::close_stream(h2_stream_t *stream)
+{
+    this->streams.erase(stream->id);
+    Arena::release(stream->arena);
+}
+
+/**
+ * @description: Send frame, head and payload go out in one write. Called under connection mutex.
+ * @param type -> Frame type
+ * @param flags -> Frame flags
+ * @param stream_id -> Stream id
+ * @param payload -> Payload
+ * @param len -> Payload length
+ */
+void H2Connection::send_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, size_t len)
+{
+    uint8_t head[H2_FRAME_HEAD_SIZE];
+    put_be(head, 3, len);
+    head[3] = type;
+    head[4] = flags;
+    put_be(head + 5, 4, stream_id);
+    this->strm.write_gathered((const char *)head, sizeof(head), payload, len);
+}
+
+/**
+ * @description: Reset stream. Called under connection mutex.
+ * @param stream_id -> Stream id
+ * @param error -> Error code
+ */
+void H2Connection::send_rst_stream(uint32_t stream_id, uint32_t error)
+{
+    uint8_t payload[4];
+    put_be(payload, 4, error);
+    this->send_frame(H2_FRAME_RST_STREAM, 0, stream_id, (const char *)payload, sizeof(payload));
+}
+
+/**
+ * @description: Tell peer no more streams are taken, those up to last stream id are still answered.
+ * Called under connection mutex.
+ * @param error -> Error code
+ */
+void H2Connection::send_goaway(uint32_t error)
+{
+    uint8_t payload[8];
+    put_be(payload, 4, this->last_stream_id);
+    put_be(payload + 4, 4, error);
+    this->send_frame(H2_FRAME_GOAWAY, 0, 0, (const char *)payload, sizeof(payload));
+    this->goaway_sent = true;
+}
@@ -0,0 +1,159 @@
+#ifndef _CRUST_H2_SERVER_H_
+#define _CRUST_H2_SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "httplib.h"
+#include "Hpack.h"
+#include "Arena.h"
+#include "Scheduler.h"
+
+// Frame types of RFC 7540
+#define H2_FRAME_DATA 0x0
+#define H2_FRAME_HEADERS 0x1
+#define H2_FRAME_PRIORITY 0x2
+#define H2_FRAME_RST_STREAM 0x3
+#define H2_FRAME_SETTINGS 0x4
+#define H2_FRAME_PUSH_PROMISE 0x5
+#define H2_FRAME_PING 0x6
+#define H2_FRAME_GOAWAY 0x7
+#define H2_FRAME_WINDOW_UPDATE 0x8
+#define H2_FRAME_CONTINUATION 0x9
+// Frame flags
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+// Settings
+#define H2_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define H2_SETTINGS_ENABLE_PUSH 0x2
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE 0x5
+#define H2_SETTINGS_MAX_HEADER_LIST_SIZE 0x6
+// Error codes
+#define H2_NO_ERROR 0x0
+#define H2_PROTOCOL_ERROR 0x1
+#define H2_INTERNAL_ERROR 0x2
+#define H2_FLOW_CONTROL_ERROR 0x3
+#define H2_STREAM_CLOSED 0x5
+#define H2_FRAME_SIZE_ERROR 0x6
+#define H2_REFUSED_STREAM 0x7
+#define H2_COMPRESSION_ERROR 0x9
+#define H2_ENHANCE_YOUR_CALM 0xB
+// Sizes of RFC 7540
+#define H2_FRAME_HEAD_SIZE 9
+#define H2_DEFAULT_FRAME_SIZE 16384
+#define H2_DEFAULT_WINDOW_SIZE 65535
+#define H2_MAX_WINDOW_SIZE 0x7FFFFFFF
+#define H2_MAX_FRAME_SIZE 0xFFFFFF
+
+// Streams of one connection open at the same time, further ones are refused
+#define H2_MAX_CONCURRENT_STREAMS 128
+// Receive window of each stream, a whole request body fits in it
+#define H2_STREAM_WINDOW_SIZE (1024 * 1024)
+// Receive window of each connection
+#define H2_CONNECTION_WINDOW_SIZE (16 * 1024 * 1024)
+// Largest request body, larger ones get 413
+#define H2_MAX_BODY_SIZE (1024 * 1024)
+// Largest header block, larger ones close connection
+#define H2_MAX_HEADER_BLOCK_SIZE (64 * 1024)
+// Threads of each process verifying h2 streams, shared by all connections
+#define H2_SERVER_THREAD_NUM 16
+// Connection without open streams is closed after this long without a frame
+#define H2_IDLE_TIMEOUT_S 60
+
+enum h2_stream_state_t
+{
+    H2_STREAM_RECEIVING,
+    H2_STREAM_VERIFYING,
+    H2_STREAM_SENDING,
+};
+
+typedef struct _h2_stream_t
+{
+    uint32_t id;
+    h2_stream_state_t state;
+    // Request body and response are drawn from stream's arena
+    Arena *arena;
+    char *body;
+    size_t body_len;
+    size_t body_cap;
+    // Response status, preset for requests which are not verified
+    int status;
+    char *resp;
+    size_t resp_len;
+    size_t resp_off;
+    int64_t send_window;
+    int64_t recv_window;
+    // Peer reset stream while it was verified
+    bool reset;
+    // Client's deadline in Unix milliseconds, 0 for none
+    uint64_t deadline_ms;
+} h2_stream_t;
+
+// One h2c connection, frames are read on the serving thread and responses
+// are written by whichever thread finishes them, under connection mutex.
+class H2Connection
+{
+public:
+    H2Connection(httplib::Stream &strm, BlockingPool &pool, std::atomic<bool> &stopping);
+    ~H2Connection();
+    void serve();
+
+private:
+    bool read_exact(char *buf, size_t len);
+    uint32_t on_headers(uint32_t stream_id, bool end_stream, std::string &block);
+    uint32_t on_data(uint32_t stream_id, uint8_t flags, const uint8_t *p, size_t len);
+    uint32_t on_settings(uint8_t flags, const uint8_t *p, size_t len);
+    uint32_t on_window_update(uint32_t stream_id, const uint8_t *p, size_t len);
+    void on_rst_stream(uint32_t stream_id);
+    void finish_request(h2_stream_t *stream);
+    void verify(h2_stream_t *stream);
+    void send_response(h2_stream_t *stream);
+    void flush_stream(h2_stream_t *stream);
+    void flush_streams();
+    void close_stream(h2_stream_t *stream);
+    void send_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, size_t len);
+    void send_rst_stream(uint32_t stream_id, uint32_t error);
+    void send_goaway(uint32_t error);
+    httplib::Stream &strm;
+    BlockingPool &pool;
+    std::atomic<bool> &stopping;
+    std::mutex mutex;
+    std::condition_variable cond;
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    std::map<uint32_t, h2_stream_t *> streams;
+    // Streams being verified on pool
+    size_t in_flight;
+    uint32_t last_stream_id;
+    int64_t send_window;
+    int64_t recv_window;
+    int64_t peer_initial_window;
+    size_t peer_max_frame_size;
+    bool goaway_sent;
+};
+
+class H2Server
+{
+public:
+    static H2Server *h2_server;
+    static H2Server *get_instance();
+    bool serve(const httplib::Request &req, httplib::Stream &strm);
+    void stop();
+
+private:
+    BlockingPool pool;
+    std::atomic<bool> stopping;
+    H2Server(void);
+};
+
+#endif /* !_CRUST_H2_SERVER_H_ */
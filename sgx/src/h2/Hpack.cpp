@@ -0,0 +1,630 @@
+#include "Hpack.h"
+
+#include <string.h>
+#include <algorithm>
+
+typedef struct _hpack_huffman_code_t
+{
+    uint32_t code;
+    uint8_t len;
+} hpack_huffman_code_t;
+
+// Static table of RFC 7541 Appendix A
+static const char *hpack_static_table[HPACK_STATIC_TABLE_NUM][2] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// Huffman codes of RFC 7541 Appendix B, EOS is never sent
+static const hpack_huffman_code_t hpack_huffman_codes[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+// Binary tree of huffman codes, a node's child is another node or a leaf holding ~symbol
+struct HpackHuffmanTree
+{
+    int16_t nodes[256][2];
+
+    HpackHuffmanTree()
+    {
+        memset(this->nodes, 0, sizeof(this->nodes));
+        int16_t node_num = 1;
+        for (int sym = 0; sym < 256; sym++)
+        {
+            const hpack_huffman_code_t &c = hpack_huffman_codes[sym];
+            int16_t node = 0;
+            for (int i = c.len - 1; i > 0; i--)
+            {
+                int bit = (c.code >> i) & 1;
+                if (this->nodes[node][bit] == 0)
+                    this->nodes[node][bit] = node_num++;
+                node = this->nodes[node][bit];
+            }
+            this->nodes[node][c.code & 1] = ~sym;
+        }
+    }
+};
+
+static const HpackHuffmanTree hpack_huffman_tree;
+
+// Static table entries in the shape of dynamic ones
+struct HpackStaticHeaders
+{
+    hpack_header_t headers[HPACK_STATIC_TABLE_NUM];
+
+    HpackStaticHeaders()
+    {
+        for (size_t i = 0; i < HPACK_STATIC_TABLE_NUM; i++)
+        {
+            this->headers[i].name = hpack_static_table[i][0];
+            this->headers[i].value = hpack_static_table[i][1];
+        }
+    }
+};
+
+static const HpackStaticHeaders hpack_static_headers;
+
+/**
+ * @description: Decode huffman string, padding must be the most significant bits of EOS
+ * @param p -> Encoded string
+ * @param len -> Encoded length
+ * @param out -> Decoded string
+ * @return: Decoded or not
+ */
+static bool huffman_decode(const uint8_t *p, size_t len, std::string &out)
+{
+    int16_t node = 0;
+    // Bits since last symbol, and whether all of them are ones
+    size_t pending = 0;
+    bool all_ones = true;
+    for (size_t i = 0; i < len; i++)
+    {
+        for (int shift = 7; shift >= 0; shift--)
+        {
+            int bit = (p[i] >> shift) & 1;
+            int16_t next = hpack_huffman_tree.nodes[node][bit];
+            pending++;
+            all_ones = all_ones && bit == 1;
+            if (next < 0)
+            {
+                out.push_back((char)(uint8_t)~next);
+                node = 0;
+                pending = 0;
+                all_ones = true;
+            }
+            else if (next == 0)
+            {
+                // Only EOS is longer than every symbol code, and it must not be sent
+                return false;
+            }
+            else
+            {
+                node = next;
+            }
+        }
+    }
+
+    return pending < 8 && all_ones;
+}
+
+/**
+ * @description: Length of huffman string
+ * @param s -> String
+ * @param len -> String length
+ * @return: Encoded length
+ */
+static size_t huffman_length(const char *s, size_t len)
+{
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++)
+        bits += hpack_huffman_codes[(uint8_t)s[i]].len;
+
+    return (bits + 7) / 8;
+}
+
+/**
+ * @description: Append huffman string, padded with ones
+ * @param out -> Output
+ * @param s -> String
+ * @param len -> String length
+ */
+static void huffman_encode(std::string &out, const char *s, size_t len)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const hpack_huffman_code_t &c = hpack_huffman_codes[(uint8_t)s[i]];
+        acc = (acc << c.len) | c.code;
+        bits += c.len;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    if (bits > 0)
+        out.push_back((char)((acc << (8 - bits)) | (0xFF >> bits)));
+}
+
+/**
+ * @description: Decode integer with indicated prefix bits
+ * @param p -> Current position, at the byte holding prefix
+ * @param end -> End of block
+ * @param prefix -> Prefix bits
+ * @param value -> Decoded integer
+ * @return: Decoded or not
+ */
+static bool decode_int(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t *value)
+{
+    if (p == end)
+        return false;
+    uint64_t max = (1 << prefix) - 1;
+    *value = *(p++) & max;
+    if (*value < max)
+        return true;
+    for (int shift = 0; shift < 56; shift += 7)
+    {
+        if (p == end)
+            return false;
+        uint8_t b = *(p++);
+        *value += (uint64_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @description: Append integer with indicated prefix bits
+ * @param out -> Output
+ * @param flags -> High bits of the first byte
+ * @param prefix -> Prefix bits
+ * @param value -> Integer
+ */
+static void encode_int(std::string &out, uint8_t flags, int prefix, uint64_t value)
+{
+    uint64_t max = (1 << prefix) - 1;
+    if (value < max)
+    {
+        out.push_back((char)(flags | value));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    value -= max;
+    while (value >= 0x80)
+    {
+        out.push_back((char)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+/**
+ * @description: Decode string literal
+ * @param p -> Current position
+ * @param end -> End of block
+ * @param out -> Decoded string
+ * @return: Decoded or not
+ */
+static bool decode_string(const uint8_t *&p, const uint8_t *end, std::string &out)
+{
+    if (p == end)
+        return false;
+    bool huffman = (*p & 0x80) != 0;
+    uint64_t len = 0;
+    if (!decode_int(p, end, 7, &len) || len > (uint64_t)(end - p))
+        return false;
+    out.clear();
+    bool ok = true;
+    if (huffman)
+        ok = huffman_decode(p, len, out);
+    else
+        out.assign((const char *)p, len);
+    p += len;
+
+    return ok;
+}
+
+/**
+ * @description: Append string literal, huffman encoded if shorter
+ * @param out -> Output
+ * @param s -> String
+ */
+static void encode_string(std::string &out, const char *s)
+{
+    size_t len = strlen(s);
+    size_t huffman_len = huffman_length(s, len);
+    if (huffman_len < len)
+    {
+        encode_int(out, 0x80, 7, huffman_len);
+        huffman_encode(out, s, len);
+    }
+    else
+    {
+        encode_int(out, 0, 7, len);
+        out.append(s, len);
+    }
+}
+
+/**
+ * @description: constructor
+ */
+HpackTable::HpackTable()
+{
+    this->size = 0;
+    this->max_size = HPACK_TABLE_SIZE;
+}
+
+/**
+ * @description: Look up static or dynamic table
+ * @param idx -> Index, static entries first
+ * @param header -> Entry
+ * @return: Found or not
+ */
+bool HpackTable::get(uint64_t idx, const hpack_header_t **header)
+{
+    if (idx == 0)
+        return false;
+    if (idx <= HPACK_STATIC_TABLE_NUM)
+    {
+        *header = &hpack_static_headers.headers[idx - 1];
+        return true;
+    }
+    idx -= HPACK_STATIC_TABLE_NUM + 1;
+    if (idx >= this->entries.size())
+        return false;
+    *header = &this->entries[idx];
+
+    return true;
+}
+
+/**
+ * @description: Find entry with the same name, one with the same value as well is preferred
+ * @param name -> Header name
+ * @param value -> Header value
+ * @param value_matched -> Whether value of found entry matches
+ * @return: Index, 0 if name is not found
+ */
+size_t HpackTable::find(const char *name, const char *value, bool *value_matched)
+{
+    size_t name_idx = 0;
+    *value_matched = false;
+    for (size_t i = 0; i < HPACK_STATIC_TABLE_NUM; i++)
+    {
+        if (strcmp(hpack_static_table[i][0], name) != 0)
+            continue;
+        if (strcmp(hpack_static_table[i][1], value) == 0)
+        {
+            *value_matched = true;
+            return i + 1;
+        }
+        if (name_idx == 0)
+            name_idx = i + 1;
+    }
+    for (size_t i = 0; i < this->entries.size(); i++)
+    {
+        if (this->entries[i].name != name)
+            continue;
+        if (this->entries[i].value == value)
+        {
+            *value_matched = true;
+            return HPACK_STATIC_TABLE_NUM + 1 + i;
+        }
+        if (name_idx == 0)
+            name_idx = HPACK_STATIC_TABLE_NUM + 1 + i;
+    }
+
+    return name_idx;
+}
+
+/**
+ * @description: Add entry, an entry larger than the whole table just empties it
+ * @param name -> Header name
+ * @param value -> Header value
+ */
+void HpackTable::add(const std::string &name, const std::string &value)
+{
+    size_t entry_size = name.size() + value.size() + HPACK_ENTRY_OVERHEAD;
+    if (entry_size > this->max_size)
+    {
+        this->evict(0);
+        return;
+    }
+    this->evict(this->max_size - entry_size);
+    this->entries.push_front(hpack_header_t{name, value});
+    this->size += entry_size;
+}
+
+/**
+ * @description: Resize table, evicting oldest entries
+ * @param max_size -> Maximum size
+ */
+void HpackTable::set_max_size(size_t max_size)
+{
+    this->max_size = max_size;
+    this->evict(max_size);
+}
+
+/**
+ * @description: Get maximum size
+ * @return: Maximum size
+ */
+size_t HpackTable::get_max_size()
+{
+    return this->max_size;
+}
+
+/**
+ * @description: Evict oldest entries until table fits in limit
+ * @param limit -> Size limit
+ */
+void HpackTable::evict(size_t limit)
+{
+    while (this->size > limit && !this->entries.empty())
+    {
+        const hpack_header_t &h = this->entries.back();
+        this->size -= h.name.size() + h.value.size() + HPACK_ENTRY_OVERHEAD;
+        this->entries.pop_back();
+    }
+}
+
+/**
+ * @description: constructor
+ */
+HpackDecoder::HpackDecoder()
+{
+}
+
+/**
+ * @description: Decode a whole header block, any error is a connection error, so is a header list
+ * larger than HPACK_MAX_HEADER_LIST_SIZE however small the block is
+ * @param p -> Header block
+ * @param len -> Header block length
+ * @param headers -> Decoded headers, appended in order
+ * @return: Decoded or not
+ */
+bool HpackDecoder::decode(const uint8_t *p, size_t len, std::vector<hpack_header_t> &headers)
+{
+    const uint8_t *end = p + len;
+    bool first = true;
+    size_t list_size = 0;
+    while (p < end)
+    {
+        uint8_t b = *p;
+        uint64_t idx = 0;
+        const hpack_header_t *entry = NULL;
+        if (b & 0x80)
+        {
+            // Indexed header field
+            if (!decode_int(p, end, 7, &idx) || !this->table.get(idx, &entry))
+                return false;
+            list_size += entry->name.size() + entry->value.size() + HPACK_ENTRY_OVERHEAD;
+            if (list_size > HPACK_MAX_HEADER_LIST_SIZE)
+                return false;
+            headers.push_back(*entry);
+        }
+        else if ((b & 0xE0) == 0x20)
+        {
+            // Dynamic table size update, only at the start of a block
+            if (!first || !decode_int(p, end, 5, &idx) || idx > HPACK_TABLE_SIZE)
+                return false;
+            this->table.set_max_size(idx);
+            continue;
+        }
+        else
+        {
+            // Literal with incremental indexing, without indexing or never indexed
+            bool indexing = (b & 0xC0) == 0x40;
+            if (!decode_int(p, end, indexing ? 6 : 4, &idx))
+                return false;
+            hpack_header_t header;
+            if (idx != 0)
+            {
+                if (!this->table.get(idx, &entry) || list_size + entry->name.size() > HPACK_MAX_HEADER_LIST_SIZE)
+                    return false;
+                header.name = entry->name;
+            }
+            else if (!decode_string(p, end, header.name))
+            {
+                return false;
+            }
+            if (!decode_string(p, end, header.value))
+                return false;
+            list_size += header.name.size() + header.value.size() + HPACK_ENTRY_OVERHEAD;
+            if (list_size > HPACK_MAX_HEADER_LIST_SIZE)
+                return false;
+            if (indexing)
+                this->table.add(header.name, header.value);
+            headers.push_back(std::move(header));
+        }
+        first = false;
+    }
+
+    return true;
+}
+
+/**
+ * @description: constructor
+ */
+HpackEncoder::HpackEncoder()
+{
+    this->size_updated = false;
+}
+
+/**
+ * @description: Follow SETTINGS_HEADER_TABLE_SIZE of peer, never growing beyond the default
+ * @param max_size -> Table size peer allows
+ */
+void HpackEncoder::set_max_table_size(size_t max_size)
+{
+    max_size = std::min(max_size, (size_t)HPACK_TABLE_SIZE);
+    if (max_size != this->table.get_max_size())
+    {
+        this->table.set_max_size(max_size);
+        this->size_updated = true;
+    }
+}
+
+/**
+ * @description: Start a header block
+ * @param out -> Header block
+ */
+void HpackEncoder::begin(std::string &out)
+{
+    if (this->size_updated)
+    {
+        encode_int(out, 0x20, 5, this->table.get_max_size());
+        this->size_updated = false;
+    }
+}
+
+/**
+ * @description: Append header field, indexed if some table has it already
+ * @param out -> Header block
+ * @param name -> Header name, lower case
+ * @param value -> Header value
+ * @param indexing -> Whether to add it to dynamic table, for values repeated by most responses
+ */
+void HpackEncoder::encode(std::string &out, const char *name, const char *value, bool indexing)
+{
+    bool value_matched = false;
+    size_t idx = this->table.find(name, value, &value_matched);
+    if (value_matched)
+    {
+        encode_int(out, 0x80, 7, idx);
+        return;
+    }
+    if (indexing)
+        encode_int(out, 0x40, 6, idx);
+    else
+        encode_int(out, 0, 4, idx);
+    if (idx == 0)
+        encode_string(out, name);
+    encode_string(out, value);
+    if (indexing)
+        this->table.add(name, value);
+}
@@ -0,0 +1,69 @@
+#ifndef _CRUST_HPACK_H_
+#define _CRUST_HPACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Dynamic table size of both directions, the SETTINGS_HEADER_TABLE_SIZE default
+#define HPACK_TABLE_SIZE 4096
+// Overhead counted for every dynamic table entry besides its name and value
+#define HPACK_ENTRY_OVERHEAD 32
+// Largest decoded header list, counted like dynamic table entries, larger ones fail the block
+#define HPACK_MAX_HEADER_LIST_SIZE (64 * 1024)
+// Entries of static table
+#define HPACK_STATIC_TABLE_NUM 61
+
+typedef struct _hpack_header_t
+{
+    std::string name;
+    std::string value;
+} hpack_header_t;
+
+// Dynamic table of RFC 7541, newest entry first
+class HpackTable
+{
+public:
+    HpackTable();
+    bool get(uint64_t idx, const hpack_header_t **header);
+    size_t find(const char *name, const char *value, bool *value_matched);
+    void add(const std::string &name, const std::string &value);
+    void set_max_size(size_t max_size);
+    size_t get_max_size();
+
+private:
+    void evict(size_t limit);
+    std::deque<hpack_header_t> entries;
+    size_t size;
+    size_t max_size;
+};
+
+// Header block decoder of one connection
+class HpackDecoder
+{
+public:
+    HpackDecoder();
+    bool decode(const uint8_t *p, size_t len, std::vector<hpack_header_t> &headers);
+
+private:
+    HpackTable table;
+};
+
+// Header block encoder of one connection, blocks must be sent in the order they are encoded
+class HpackEncoder
+{
+public:
+    HpackEncoder();
+    void set_max_table_size(size_t max_size);
+    void begin(std::string &out);
+    void encode(std::string &out, const char *name, const char *value, bool indexing);
+
+private:
+    HpackTable table;
+    // Table size update announced at the start of next block
+    bool size_updated;
+};
+
+#endif /* !_CRUST_HPACK_H_ */
@@ -123,6 +123,12 @@ typedef enum _crust_status_t
 
     // For http
     CRUST_HTTP_INVALID_INPUT = CRUST_MK_ERROR(0x11001),
+
+    // Shared memory ring related
+    CRUST_SHM_INVALID_RING = CRUST_MK_ERROR(0x12001),
+    CRUST_SHM_RING_FULL = CRUST_MK_ERROR(0x12002),
+    CRUST_SHM_TIMEOUT = CRUST_MK_ERROR(0x12003),
+    CRUST_SHM_EVIDENCE_TOO_LARGE = CRUST_MK_ERROR(0x12004),
 } crust_status_t;
 
 #endif /* !_CRUST_CRUST_STATUS_H_ */
@@ -1321,7 +1321,7 @@ private:
     Class Type = Class::Null;
 };
 
-JSON Array()
+inline JSON Array()
 {
     return std::move(JSON::Make(JSON::Class::Array));
 }
@@ -1334,28 +1334,28 @@ JSON Array(T... args)
     return std::move(arr);
 }
 
-JSON Object()
+inline JSON Object()
 {
     return std::move(JSON::Make(JSON::Class::Object));
 }
 
 // First in order map
-JSON FIOObject()
+inline JSON FIOObject()
 {
     return std::move(JSON::Make(JSON::Class::FIOObject));
 }
 
-JSON FlatObject()
+inline JSON FlatObject()
 {
     return std::move(JSON::Make(JSON::Class::FlatObject));
 }
 
-JSON Pair()
+inline JSON Pair()
 {
     return std::move(JSON::Make(JSON::Class::Pair));
 }
 
-JSON Pair(string s, JSON j)
+inline JSON Pair(string s, JSON j)
 {
     JSON ans = std::move(JSON::Make(JSON::Class::Pair));
     ans.SetPair(s, j);
@@ -1997,26 +1997,26 @@ JSON parse_next(crust_status_t *status, const uint8_t *p_data, size_t &offset)
 }
 } // namespace
 
-JSON JSON::Load_unsafe(const string &str)
+inline JSON JSON::Load_unsafe(const string &str)
 {
     crust_status_t crust_status = CRUST_SUCCESS;
     return Load(&crust_status, str);
 }
 
-JSON JSON::Load_unsafe(const uint8_t *p_data, size_t data_size)
+inline JSON JSON::Load_unsafe(const uint8_t *p_data, size_t data_size)
 {
     crust_status_t crust_status = CRUST_SUCCESS;
     return Load(&crust_status, p_data, data_size);
 }
 
-JSON JSON::Load(crust_status_t *status, const string &str)
+inline JSON JSON::Load(crust_status_t *status, const string &str)
 {
     if (str.size() == 0) return json::JSON();
     size_t offset = 0;
     return std::move(parse_next(status, str, offset));
 }
 
-JSON JSON::Load(crust_status_t *status, const uint8_t *p_data, size_t data_size)
+inline JSON JSON::Load(crust_status_t *status, const uint8_t *p_data, size_t data_size)
 {
     if (data_size == 0) return json::JSON();
     size_t offset = 0;
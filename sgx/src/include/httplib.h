@@ -91,6 +91,50 @@
 #define CPPHTTPLIB_RECV_FLAGS 0
 #endif
 
+#ifndef CPPHTTPLIB_PATH_PARAMS_MAX_COUNT
+#define CPPHTTPLIB_PATH_PARAMS_MAX_COUNT 8
+#endif
+
+#ifndef CPPHTTPLIB_PIPELINING_MAX_COUNT
+#define CPPHTTPLIB_PIPELINING_MAX_COUNT 16
+#endif
+
+#ifndef CPPHTTPLIB_PIPELINING_THREAD_COUNT
+#define CPPHTTPLIB_PIPELINING_THREAD_COUNT CPPHTTPLIB_THREAD_POOL_COUNT
+#endif
+
+#ifndef CPPHTTPLIB_SHED_THREAD_COUNT
+#define CPPHTTPLIB_SHED_THREAD_COUNT 2
+#endif
+
+#ifndef CPPHTTPLIB_SHED_QUEUE_MAX
+#define CPPHTTPLIB_SHED_QUEUE_MAX 1024
+#endif
+
+#ifndef CPPHTTPLIB_SHED_READ_TIMEOUT_SECOND
+#define CPPHTTPLIB_SHED_READ_TIMEOUT_SECOND 1
+#endif
+
+#ifndef CPPHTTPLIB_INLINE_HEADERS_COUNT
+#define CPPHTTPLIB_INLINE_HEADERS_COUNT 16
+#endif
+
+#ifndef CPPHTTPLIB_REQUEST_HEAD_BUFSIZ
+#define CPPHTTPLIB_REQUEST_HEAD_BUFSIZ size_t(4096u)
+#endif
+
+#ifndef CPPHTTPLIB_SHARED_SOCKET_POLL_USECOND
+#define CPPHTTPLIB_SHARED_SOCKET_POLL_USECOND 100000
+#endif
+
+#ifndef CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH
+#define CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH size_t(65536u)
+#endif
+
+#ifndef CPPHTTPLIB_PIPELINING_PAYLOAD_MAX_LENGTH
+#define CPPHTTPLIB_PIPELINING_PAYLOAD_MAX_LENGTH size_t(1048576u)
+#endif
+
 #ifndef CPPHTTPLIB_SEND_FLAGS
 #define CPPHTTPLIB_SEND_FLAGS 0
 #endif
@@ -152,6 +196,10 @@ using ssize_t = int;
 #define strcasecmp _stricmp
 #endif // strcasecmp
 
+#ifndef strncasecmp
+#define strncasecmp _strnicmp
+#endif // strncasecmp
+
 using socket_t = SOCKET;
 #ifdef CPPHTTPLIB_USE_POLL
 #define poll(fds, nfds, timeout) WSAPoll(fds, nfds, timeout)
@@ -188,6 +236,7 @@ using socket_t = int;
 #include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
 #include <climits>
 #include <condition_variable>
 #include <errno.h>
@@ -280,13 +329,104 @@ struct ci {
   }
 };
 
+enum class HeaderId : uint8_t {
+  Unknown = 0,
+  Accept,
+  Accept_Encoding,
+  Authorization,
+  Connection,
+  Content_Encoding,
+  Content_Length,
+  Content_Type,
+  Expect,
+  Host,
+  Keep_Alive,
+  Range,
+  Transfer_Encoding,
+  User_Agent,
+};
+
+HeaderId to_header_id(const char *name, size_t len);
+
 } // namespace detail
 
 using Headers = std::multimap<std::string, std::string, detail::ci>;
 
+// Request headers parsed by the server. Names and values are NUL terminated
+// views into the buffer the request head was read into, and entries live in a
+// small inline array, so parsing a typical request allocates nothing.
+// Well-known names are interned so their lookups compare ids, not strings.
+class FlatHeaders {
+public:
+  struct Entry {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+    detail::HeaderId id;
+  };
+
+  void add(const char *name, size_t name_len, const char *value,
+           size_t value_len);
+  const Entry *find(const char *key, size_t id = 0) const;
+  size_t count(const char *key) const;
+  size_t size() const { return size_; }
+  const Entry &operator[](size_t i) const;
+  void clear();
+
+private:
+  std::array<Entry, CPPHTTPLIB_INLINE_HEADERS_COUNT> inline_;
+  std::vector<Entry> overflow_;
+  size_t size_ = 0;
+};
+
 using Params = std::multimap<std::string, std::string>;
 using Match = std::smatch;
 
+// Captured by `{name}` segments of static routes. Names point into the route
+// table and values are ranges of `Request::path`, so nothing is allocated.
+struct PathParam {
+  const std::string *name;
+  size_t offset;
+  size_t length;
+};
+
+struct PathParams {
+  std::array<PathParam, CPPHTTPLIB_PATH_PARAMS_MAX_COUNT> items;
+  size_t count = 0;
+};
+
+namespace detail {
+
+// Route table for patterns made only of literal and `{name}` segments, e.g.
+// "/entryNetwork" or "/identity/pubkey/{pubkey}". Patterns are compiled into
+// a trie of path segments at registration, so dispatching walks the path once
+// without regex or allocation. Literal segments take precedence over params.
+class PathTrie {
+public:
+  static bool is_static_pattern(const std::string &pattern);
+
+  bool add(const std::string &pattern, size_t value);
+  bool match(const std::string &path, size_t &value, PathParams &params) const;
+
+private:
+  struct Node {
+    std::vector<std::pair<std::string, size_t>> children;
+    std::string param_name;
+    size_t param_child = npos;
+    size_t value = npos;
+  };
+
+  static const size_t npos = static_cast<size_t>(-1);
+
+  bool match_core(const std::string &path, size_t pos, size_t node,
+                  size_t &value, PathParams &params) const;
+
+  std::vector<Node> nodes_;
+};
+
+} // namespace detail
+
 using Progress = std::function<bool(uint64_t current, uint64_t total)>;
 
 struct Response;
@@ -381,10 +521,22 @@ struct Request {
   std::string method;
   std::string path;
   Headers headers;
+  // for server, headers parsed off the wire, only valid until the handler
+  // returns. Use the accessors below to see them together with `headers`.
+  FlatHeaders flat_headers;
   std::string body;
 
   std::string remote_addr;
   int remote_port = -1;
+  // for server, number of requests served on the same connection before this
+  size_t connection_request_index = 0;
+  // for server, set if the request came while shedding load, seconds to send
+  // in Retry-After, and the queue wait which made it shed
+  size_t shed_retry_after_sec = 0;
+  uint64_t shed_wait_usec = 0;
+  // for server, whether client has gone, by closing or resetting connection,
+  // so that handlers may drop work nobody will read
+  std::function<bool()> is_connection_closed = []() { return false; };
 
   // for server
   std::string version;
@@ -393,6 +545,7 @@ struct Request {
   MultipartFormDataMap files;
   Ranges ranges;
   Match matches;
+  PathParams path_params;
 
   // for client
   ResponseHandler response_handler;
@@ -414,6 +567,9 @@ struct Request {
   std::string get_param_value(const char *key, size_t id = 0) const;
   size_t get_param_value_count(const char *key) const;
 
+  bool has_path_param(const char *key) const;
+  std::string get_path_param_value(const char *key) const;
+
   bool is_multipart_form_data() const;
 
   bool has_file(const char *key) const;
@@ -425,6 +581,7 @@ struct Request {
   ContentProvider content_provider_;
   bool is_chunked_content_provider_ = false;
   size_t authorization_count_ = 0;
+  std::array<char, 8> remote_port_buf_;
 };
 
 struct Response {
@@ -460,6 +617,13 @@ struct Response {
       const char *content_type, ContentProviderWithoutLength provider,
       ContentProviderResourceReleaser resource_releaser = nullptr);
 
+  // The body stays in the caller's memory, which must outlive the response
+  // (free it in `resource_releaser`). It is sent together with the status
+  // line and headers by a single gathered write, without being copied.
+  void set_content_span(
+      const char *s, size_t n, const char *content_type,
+      ContentProviderResourceReleaser resource_releaser = nullptr);
+
   Response() = default;
   Response(const Response &) = default;
   Response &operator=(const Response &) = default;
@@ -477,6 +641,7 @@ struct Response {
   ContentProviderResourceReleaser content_provider_resource_releaser_;
   bool is_chunked_content_provider_ = false;
   bool content_provider_success_ = false;
+  const char *content_span_ = nullptr;
 };
 
 class Stream {
@@ -491,6 +656,10 @@ public:
   virtual void get_remote_ip_and_port(std::string &ip, int &port) const = 0;
   virtual socket_t socket() const = 0;
 
+  // Writes both buffers completely, as if they were one.
+  virtual bool write_gathered(const char *ptr1, size_t size1, const char *ptr2,
+                              size_t size2);
+
   template <typename... Args>
   ssize_t write_format(const char *fmt, const Args &... args);
   ssize_t write(const char *ptr);
@@ -506,6 +675,10 @@ public:
   virtual void shutdown() = 0;
 
   virtual void on_idle(){};
+
+  // Jobs waiting for a thread, and how long the oldest of them has waited.
+  virtual size_t queued() { return 0; }
+  virtual uint64_t oldest_wait_usec() { return 0; }
 };
 
 class ThreadPool : public TaskQueue {
@@ -522,10 +695,24 @@ public:
 
   void enqueue(std::function<void()> fn) override {
     std::unique_lock<std::mutex> lock(mutex_);
-    jobs_.push_back(std::move(fn));
+    jobs_.push_back(Job{std::move(fn), std::chrono::steady_clock::now()});
     cond_.notify_one();
   }
 
+  size_t queued() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return jobs_.size();
+  }
+
+  uint64_t oldest_wait_usec() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.empty()) { return 0; }
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - jobs_.front().queued_at)
+            .count());
+  }
+
   void shutdown() override {
     // Stop all worker threads...
     {
@@ -556,7 +743,7 @@ private:
 
           if (pool_.shutdown_ && pool_.jobs_.empty()) { break; }
 
-          fn = pool_.jobs_.front();
+          fn = std::move(pool_.jobs_.front().fn);
           pool_.jobs_.pop_front();
         }
 
@@ -569,8 +756,13 @@ private:
   };
   friend struct worker;
 
+  struct Job {
+    std::function<void()> fn;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
   std::vector<std::thread> threads_;
-  std::list<std::function<void()>> jobs_;
+  std::list<Job> jobs_;
 
   bool shutdown_;
 
@@ -580,6 +772,14 @@ private:
 
 using Logger = std::function<void(const Request &, const Response &)>;
 
+using TrustedConnectionChecker = std::function<bool(socket_t sock)>;
+
+using ConnectionFilter = std::function<bool(socket_t sock)>;
+
+using AdmissionExemptChecker = std::function<bool(const Request &)>;
+
+using AdmissionLogger = std::function<void(bool shed, uint64_t wait_usec)>;
+
 using SocketOptions = std::function<void(socket_t sock)>;
 
 void default_socket_options(socket_t sock);
@@ -604,6 +804,9 @@ public:
   using Expect100ContinueHandler =
       std::function<int(const Request &, Response &)>;
 
+  // Owns the connection once called, and writes the status line itself.
+  using UpgradeHandler = std::function<bool(const Request &, Stream &)>;
+
   Server();
 
   virtual ~Server();
@@ -621,6 +824,14 @@ public:
   Server &Delete(const std::string &pattern, HandlerWithContentReader handler);
   Server &Options(const std::string &pattern, Handler handler);
 
+  // Requests to `path` with an Upgrade header are handed to the handler
+  // right after their head is read, the connection is closed after it.
+  Server &Upgrade(const std::string &path, UpgradeHandler handler);
+
+  // Connections opening with the HTTP/2 preface are handed to the handler
+  // after "PRI * HTTP/2.0", it reads the rest of the preface itself.
+  Server &set_prior_knowledge_handler(UpgradeHandler handler);
+
   bool set_base_dir(const std::string &dir,
                     const std::string &mount_point = nullptr);
   bool set_mount_point(const std::string &mount_point, const std::string &dir,
@@ -639,6 +850,25 @@ public:
   Server &set_expect_100_continue_handler(Expect100ContinueHandler handler);
   Server &set_logger(Logger logger);
 
+  // Connections the checker accepts are kept alive with no request count
+  // limit. Their pipelined requests are handled concurrently, and the
+  // responses are written back in request order.
+  Server &set_trusted_connection_checker(TrustedConnectionChecker checker);
+
+  // Accepted connections the filter rejects are closed without a response.
+  Server &set_connection_filter(ConnectionFilter filter);
+
+  // Connections accepted while `max_queued` connections wait for a thread,
+  // or while the oldest of them has waited `max_wait_msec`, are not queued.
+  // Their request is answered by a separate thread with 503 and Retry-After,
+  // unless the exempt checker takes it. 0 disables either limit.
+  Server &set_admission_control(size_t max_queued, uint64_t max_wait_msec);
+  Server &set_admission_exempt_checker(AdmissionExemptChecker checker);
+  // Called with the queue wait of every connection taken by a thread, and
+  // with the oldest queue wait of every request answered 503 by shedding or
+  // connection dropped unread while too many wait for that.
+  Server &set_admission_logger(AdmissionLogger logger);
+
   Server &set_address_family(int family);
   Server &set_tcp_nodelay(bool on);
   Server &set_socket_options(SocketOptions socket_options);
@@ -668,6 +898,12 @@ public:
 
   bool listen(const char *host, int port, int socket_flags = 0);
 
+  // Serves on a socket which is already bound and listening, e.g. a unix
+  // domain socket inherited from a parent process. The socket may be shared
+  // with other processes, so stop() only closes this process's descriptor,
+  // a shutdown would stop accept for all of them.
+  bool listen_on_socket(socket_t sock);
+
   bool is_running() const;
   void stop();
 
@@ -679,6 +915,8 @@ protected:
                        const std::function<void(Request &)> &setup_request);
 
   std::atomic<socket_t> svr_sock_;
+  // Whether svr_sock_ was created by listen rather than given
+  bool owns_svr_sock_ = true;
   size_t keep_alive_max_count_ = CPPHTTPLIB_KEEPALIVE_MAX_COUNT;
   time_t keep_alive_timeout_sec_ = CPPHTTPLIB_KEEPALIVE_TIMEOUT_SECOND;
   time_t read_timeout_sec_ = CPPHTTPLIB_READ_TIMEOUT_SECOND;
@@ -694,6 +932,17 @@ private:
   using HandlersForContentReader =
       std::vector<std::pair<std::regex, HandlerWithContentReader>>;
 
+  template <class T> struct StaticHandlers {
+    detail::PathTrie trie;
+    std::vector<T> handlers;
+  };
+
+  template <class T>
+  static void
+  add_handler(const std::string &pattern, T handler,
+              StaticHandlers<T> &static_handlers,
+              std::vector<std::pair<std::regex, T>> &regex_handlers);
+
   socket_t create_server_socket(const char *host, int port, int socket_flags,
                                 SocketOptions socket_options) const;
   int bind_internal(const char *host, int port, int socket_flags);
@@ -702,11 +951,13 @@ private:
   bool routing(Request &req, Response &res, Stream &strm);
   bool handle_file_request(const Request &req, Response &res,
                            bool head = false);
-  bool dispatch_request(Request &req, Response &res, const Handlers &handlers);
-  bool
-  dispatch_request_for_content_reader(Request &req, Response &res,
-                                      ContentReader content_reader,
-                                      const HandlersForContentReader &handlers);
+  bool dispatch_request(Request &req, Response &res,
+                        const StaticHandlers<Handler> &static_handlers,
+                        const Handlers &handlers);
+  bool dispatch_request_for_content_reader(
+      Request &req, Response &res, ContentReader content_reader,
+      const StaticHandlers<HandlerWithContentReader> &static_handlers,
+      const HandlersForContentReader &handlers);
 
   bool parse_request_line(const char *s, Request &req);
   void apply_ranges(const Request &req, Response &res,
@@ -733,6 +984,9 @@ private:
                          ContentReceiver multipart_receiver);
 
   virtual bool process_and_close_socket(socket_t sock);
+  bool process_pipelined_socket(socket_t sock);
+  bool shed_and_close_socket(socket_t sock, size_t retry_after_sec,
+                             uint64_t wait_usec);
 
   struct MountPointEntry {
     std::string mount_point;
@@ -742,23 +996,46 @@ private:
   std::vector<MountPointEntry> base_dirs_;
 
   std::atomic<bool> is_running_;
+  std::map<std::string, UpgradeHandler> upgrade_handlers_;
+  UpgradeHandler prior_knowledge_handler_;
   std::map<std::string, std::string> file_extension_and_mimetype_map_;
   Handler file_request_handler_;
+  StaticHandlers<Handler> get_static_handlers_;
   Handlers get_handlers_;
+  StaticHandlers<Handler> post_static_handlers_;
   Handlers post_handlers_;
+  StaticHandlers<HandlerWithContentReader>
+      post_static_handlers_for_content_reader_;
   HandlersForContentReader post_handlers_for_content_reader_;
+  StaticHandlers<Handler> put_static_handlers_;
   Handlers put_handlers_;
+  StaticHandlers<HandlerWithContentReader>
+      put_static_handlers_for_content_reader_;
   HandlersForContentReader put_handlers_for_content_reader_;
+  StaticHandlers<Handler> patch_static_handlers_;
   Handlers patch_handlers_;
+  StaticHandlers<HandlerWithContentReader>
+      patch_static_handlers_for_content_reader_;
   HandlersForContentReader patch_handlers_for_content_reader_;
+  StaticHandlers<Handler> delete_static_handlers_;
   Handlers delete_handlers_;
+  StaticHandlers<HandlerWithContentReader>
+      delete_static_handlers_for_content_reader_;
   HandlersForContentReader delete_handlers_for_content_reader_;
+  StaticHandlers<Handler> options_static_handlers_;
   Handlers options_handlers_;
   HandlerWithResponse error_handler_;
   ExceptionHandler exception_handler_;
   HandlerWithResponse pre_routing_handler_;
   Handler post_routing_handler_;
   Logger logger_;
+  TrustedConnectionChecker trusted_connection_checker_;
+  ConnectionFilter connection_filter_;
+  TaskQueue *pipelining_task_queue_ = nullptr;
+  size_t admission_max_queued_ = 0;
+  uint64_t admission_max_wait_usec_ = 0;
+  AdmissionExemptChecker admission_exempt_checker_;
+  AdmissionLogger admission_logger_;
   Expect100ContinueHandler expect_100_continue_handler_;
 
   int address_family_ = AF_UNSPEC;
@@ -1464,7 +1741,23 @@ inline uint64_t get_header_value<uint64_t>(const Headers &headers,
 
 template <typename T>
 inline T Request::get_header_value(const char *key, size_t id) const {
-  return detail::get_header_value<T>(headers, key, id, 0);
+  auto entry = flat_headers.find(key, id);
+  if (entry) {
+    Headers headers;
+    headers.emplace(entry->name, entry->value);
+    return detail::get_header_value<T>(headers, key, 0, 0);
+  }
+  return detail::get_header_value<T>(headers, key,
+                                     id - flat_headers.count(key), 0);
+}
+
+template <>
+inline uint64_t Request::get_header_value<uint64_t>(const char *key,
+                                                    size_t id) const {
+  auto entry = flat_headers.find(key, id);
+  if (entry) { return std::strtoull(entry->value, nullptr, 10); }
+  return detail::get_header_value<uint64_t>(
+      headers, key, id - flat_headers.count(key), 0);
 }
 
 template <typename T>
@@ -1675,6 +1968,33 @@ enum class EncodingType { None = 0, Gzip, Brotli };
 
 EncodingType encoding_type(const Request &req, const Response &res);
 
+// One request read ahead from a connection. A queued stream replays it and
+// keeps the response until the connection writes it out in order. A direct
+// stream continues reading from, and writes straight to, the connection.
+class PipelinedStream : public Stream {
+public:
+  PipelinedStream(Stream &conn, std::string &&request, bool direct);
+  ~PipelinedStream() override = default;
+
+  bool is_readable() const override;
+  bool is_writable() const override;
+  ssize_t read(char *ptr, size_t size) override;
+  ssize_t write(const char *ptr, size_t size) override;
+  bool write_gathered(const char *ptr1, size_t size1, const char *ptr2,
+                      size_t size2) override;
+  void get_remote_ip_and_port(std::string &ip, int &port) const override;
+  socket_t socket() const override;
+
+  const std::string &get_response() const;
+
+private:
+  Stream &conn_;
+  std::string request_;
+  size_t position_ = 0;
+  bool direct_;
+  std::string response_;
+};
+
 class BufferStream : public Stream {
 public:
   BufferStream() = default;
@@ -2150,6 +2470,7 @@ inline bool stream_line_reader::getline() {
       }
     }
 
+    if (size() >= CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) { return false; }
     append(byte);
 
     if (byte == '\n') { break; }
@@ -2304,15 +2625,25 @@ public:
   bool is_writable() const override;
   ssize_t read(char *ptr, size_t size) override;
   ssize_t write(const char *ptr, size_t size) override;
+  bool write_gathered(const char *ptr1, size_t size1, const char *ptr2,
+                      size_t size2) override;
   void get_remote_ip_and_port(std::string &ip, int &port) const override;
   socket_t socket() const override;
 
+  bool has_buffered_data() const;
+
 private:
   socket_t sock_;
   time_t read_timeout_sec_;
   time_t read_timeout_usec_;
   time_t write_timeout_sec_;
   time_t write_timeout_usec_;
+
+  // Lives as long as the connection, so pipelined bytes are not lost between
+  // requests and reading the head byte by byte does not cost a syscall each.
+  std::array<char, CPPHTTPLIB_RECV_BUFSIZ> read_buff_;
+  size_t read_buff_off_ = 0;
+  size_t read_buff_content_size_ = 0;
 };
 
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
@@ -2359,14 +2690,46 @@ inline bool keep_alive(socket_t sock, time_t keep_alive_timeout_sec) {
   }
 }
 
-template <typename T>
+inline bool is_socket_alive(socket_t sock) {
+  auto val = select_read(sock, 0, 0);
+  if (val == 0) {
+    return true;
+  } else if (val < 0 && errno == EBADF) {
+    return false;
+  }
+  char buf[1];
+  return handle_EINTR([&]() {
+           return recv(sock, &buf[0], sizeof(buf), MSG_PEEK);
+         }) > 0;
+}
+
+// Whether peer has gone, by a reset or by closing. Clients of HTTP/1.1
+// requests don't half-close, so end of peer's data means nobody reads the
+// response. Data peeked from a pipelined request keeps it alive.
+inline bool is_socket_broken(socket_t sock) {
+  auto val = select_read(sock, 0, 0);
+  if (val == 0) {
+    return false;
+  } else if (val < 0) {
+    return errno == EBADF;
+  }
+  char buf[1];
+  auto n = handle_EINTR([&]() {
+    return recv(sock, &buf[0], sizeof(buf), MSG_PEEK);
+  });
+  return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+template <typename T, typename U>
 inline bool
 process_server_socket_core(socket_t sock, size_t keep_alive_max_count,
-                           time_t keep_alive_timeout_sec, T callback) {
+                           time_t keep_alive_timeout_sec, T callback,
+                           U has_buffered_data) {
   assert(keep_alive_max_count > 0);
   auto ret = false;
   auto count = keep_alive_max_count;
-  while (count > 0 && keep_alive(sock, keep_alive_timeout_sec)) {
+  while (count > 0 &&
+         (has_buffered_data() || keep_alive(sock, keep_alive_timeout_sec))) {
     auto close_connection = count == 1;
     auto connection_closed = false;
     ret = callback(close_connection, connection_closed);
@@ -2382,13 +2745,14 @@ process_server_socket(socket_t sock, size_t keep_alive_max_count,
                       time_t keep_alive_timeout_sec, time_t read_timeout_sec,
                       time_t read_timeout_usec, time_t write_timeout_sec,
                       time_t write_timeout_usec, T callback) {
+  SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
+                    write_timeout_sec, write_timeout_usec);
   return process_server_socket_core(
       sock, keep_alive_max_count, keep_alive_timeout_sec,
       [&](bool close_connection, bool &connection_closed) {
-        SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
-                          write_timeout_sec, write_timeout_usec);
         return callback(strm, close_connection, connection_closed);
-      });
+      },
+      [&]() { return strm.has_buffered_data(); });
 }
 
 inline bool process_client_socket(socket_t sock, time_t read_timeout_sec,
@@ -3083,6 +3447,168 @@ inline bool parse_header(const char *beg, const char *end, T fn) {
   return false;
 }
 
+// Reads header lines up to the blank line into `buf`, moving over to `spill`
+// once they outgrow it, then parses them in place into `headers`.
+inline bool read_headers(Stream &strm, FlatHeaders &headers, char *buf,
+                         size_t bufsiz, std::string &spill) {
+  auto data = buf;
+  size_t len = 0;
+  size_t line_start = 0;
+  for (;;) {
+    char byte;
+    if (strm.read(&byte, 1) <= 0) { return false; }
+    if (len >= CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) { return false; }
+
+    if (data == buf && len + 1 >= bufsiz) {
+      spill.assign(buf, len);
+      data = nullptr;
+    }
+    if (data == buf) {
+      buf[len] = byte;
+    } else {
+      spill.push_back(byte);
+    }
+    len++;
+
+    if (byte == '\n') {
+      // Blank line indicates end of headers.
+      if (len - line_start == 2 &&
+          (data == buf ? buf[line_start] : spill[line_start]) == '\r') {
+        break;
+      }
+      line_start = len;
+    }
+  }
+  if (data != buf) { data = &spill[0]; }
+
+  auto p = data;
+  auto end = data + line_start;
+  while (p < end) {
+    auto line_end = static_cast<char *>(memchr(p, '\n', end - p));
+    auto next = line_end + 1;
+
+    // Skip invalid line.
+    if (line_end == p || line_end[-1] != '\r') {
+      p = next;
+      continue;
+    }
+
+    // Exclude CRLF and trailing spaces and tabs.
+    auto e = line_end - 1;
+    while (p < e && is_space_or_tab(e[-1])) {
+      e--;
+    }
+
+    auto key_end = p;
+    while (key_end < e && *key_end != ':') {
+      key_end++;
+    }
+
+    auto v = key_end + 1;
+    while (v < e && is_space_or_tab(*v)) {
+      v++;
+    }
+
+    if (key_end < e && v < e) {
+      *key_end = '\0';
+      *e = '\0';
+      auto value_len = static_cast<size_t>(e - v);
+      if (memchr(v, '%', value_len)) {
+        // Decoding never grows the value, so it fits where it was.
+        auto decoded = decode_url(std::string(v, e), false);
+        value_len = decoded.size();
+        memcpy(v, decoded.data(), value_len);
+        v[value_len] = '\0';
+      }
+      headers.add(p, static_cast<size_t>(key_end - p), v, value_len);
+    }
+    p = next;
+  }
+
+  return true;
+}
+
+// Reads a whole request with its Content-Length body into `raw`, so the next
+// pipelined request can be read while this one is handled. Requests whose
+// body can't be framed here (chunked, Expect, Upgrade) are left at the head
+// with `can_pipeline` false, and so are bodies too large to be held here.
+// Returns false if the head is malformed or too long, `raw` is empty if the
+// connection was closed before any byte of it. `closing` is set if the
+// connection ends with this request.
+inline bool read_pipelined_request(Stream &strm, size_t payload_max_length,
+                                   std::string &raw, bool &can_pipeline,
+                                   bool &closing) {
+  const auto bufsiz = 2048;
+  char buf[bufsiz];
+  uint64_t content_length = 0;
+  auto http_1_0 = false;
+  auto keep_alive = false;
+  can_pipeline = true;
+
+  for (auto first = true;; first = false) {
+    stream_line_reader line_reader(strm, buf, bufsiz);
+    if (!line_reader.getline()) { return false; }
+    auto line = line_reader.ptr();
+    auto len = line_reader.size();
+    if (raw.size() + len > CPPHTTPLIB_REQUEST_HEAD_MAX_LENGTH) { return false; }
+    raw.append(line, len);
+    if (line[len - 1] != '\n') { return false; }
+    if (first) {
+      // HTTP/2 preface, whatever follows is frames
+      if (len >= 4 && !memcmp(line, "PRI ", 4)) { can_pipeline = false; }
+      http_1_0 = len >= 10 && !memcmp(line + len - 10, "HTTP/1.0\r\n", 10);
+      continue;
+    }
+
+    // Blank line indicates end of headers.
+    if (len == 2 && line[0] == '\r') { break; }
+
+    auto colon = static_cast<const char *>(memchr(line, ':', len));
+    if (!colon) { continue; }
+    auto key_len = static_cast<size_t>(colon - line);
+    auto val = colon + 1;
+    while (is_space_or_tab(*val)) {
+      val++;
+    }
+
+    switch (to_header_id(line, key_len)) {
+    case HeaderId::Content_Length:
+      content_length = std::strtoull(val, nullptr, 10);
+      break;
+    case HeaderId::Connection:
+      if (!strncasecmp(val, "close", 5)) { closing = true; }
+      if (!strncasecmp(val, "keep-alive", 10)) { keep_alive = true; }
+      break;
+    case HeaderId::Transfer_Encoding:
+    case HeaderId::Expect: can_pipeline = false; break;
+    default:
+      if (key_len == 7 && !strncasecmp(line, "Upgrade", 7)) {
+        can_pipeline = false;
+      }
+      break;
+    }
+  }
+
+  if (http_1_0 && !keep_alive) { closing = true; }
+
+  if (!can_pipeline || content_length == 0) { return true; }
+  if (content_length > payload_max_length ||
+      content_length > CPPHTTPLIB_PIPELINING_PAYLOAD_MAX_LENGTH) {
+    can_pipeline = false;
+    return true;
+  }
+
+  auto head_len = raw.size();
+  raw.resize(head_len + static_cast<size_t>(content_length));
+  size_t offset = head_len;
+  while (offset < raw.size()) {
+    auto n = strm.read(&raw[offset], raw.size() - offset);
+    if (n <= 0) { return false; }
+    offset += static_cast<size_t>(n);
+  }
+  return true;
+}
+
 inline bool read_headers(Stream &strm, Headers &headers) {
   const auto bufsiz = 2048;
   char buf[bufsiz];
@@ -3266,12 +3792,13 @@ bool read_content(Stream &strm, T &x, size_t payload_max_length, int &status,
         auto ret = true;
         auto exceed_payload_max_length = false;
 
-        if (is_chunked_transfer_encoding(x.headers)) {
+        if (!strcasecmp(x.get_header_value("Transfer-Encoding").c_str(),
+                        "chunked")) {
           ret = read_content_chunked(strm, out);
-        } else if (!has_header(x.headers, "Content-Length")) {
+        } else if (!x.has_header("Content-Length")) {
           ret = read_content_without_length(strm, out);
         } else {
-          auto len = get_header_value<uint64_t>(x.headers, "Content-Length");
+          auto len = x.template get_header_value<uint64_t>("Content-Length");
           if (len > payload_max_length) {
             exceed_payload_max_length = true;
             skip_content_with_length(strm, len);
@@ -4182,17 +4709,99 @@ make_bearer_token_authentication_header(const std::string &token,
 }
 
 // Request implementation
+namespace detail {
+
+inline HeaderId to_header_id(const char *name, size_t len) {
+  struct KnownHeader {
+    const char *name;
+    HeaderId id;
+  };
+  static const KnownHeader known_headers[] = {
+      {"Accept", HeaderId::Accept},
+      {"Accept-Encoding", HeaderId::Accept_Encoding},
+      {"Authorization", HeaderId::Authorization},
+      {"Connection", HeaderId::Connection},
+      {"Content-Encoding", HeaderId::Content_Encoding},
+      {"Content-Length", HeaderId::Content_Length},
+      {"Content-Type", HeaderId::Content_Type},
+      {"Expect", HeaderId::Expect},
+      {"Host", HeaderId::Host},
+      {"Keep-Alive", HeaderId::Keep_Alive},
+      {"Range", HeaderId::Range},
+      {"Transfer-Encoding", HeaderId::Transfer_Encoding},
+      {"User-Agent", HeaderId::User_Agent},
+  };
+
+  for (const auto &x : known_headers) {
+    if (x.name[len] == '\0' && !strncasecmp(x.name, name, len)) {
+      return x.id;
+    }
+  }
+  return HeaderId::Unknown;
+}
+
+} // namespace detail
+
+inline void FlatHeaders::add(const char *name, size_t name_len,
+                             const char *value, size_t value_len) {
+  Entry entry{name, name_len, value, value_len,
+              detail::to_header_id(name, name_len)};
+  if (size_ < inline_.size()) {
+    inline_[size_] = entry;
+  } else {
+    overflow_.push_back(entry);
+  }
+  size_++;
+}
+
+inline const FlatHeaders::Entry *FlatHeaders::find(const char *key,
+                                                   size_t id) const {
+  auto len = strlen(key);
+  auto key_id = detail::to_header_id(key, len);
+  for (size_t i = 0; i < size_; i++) {
+    const auto &entry = (*this)[i];
+    auto matched = key_id != detail::HeaderId::Unknown
+                       ? entry.id == key_id
+                       : entry.id == detail::HeaderId::Unknown &&
+                             entry.name_len == len &&
+                             !strncasecmp(entry.name, key, len);
+    if (matched && id-- == 0) { return &entry; }
+  }
+  return nullptr;
+}
+
+inline size_t FlatHeaders::count(const char *key) const {
+  size_t n = 0;
+  while (find(key, n)) {
+    n++;
+  }
+  return n;
+}
+
+inline const FlatHeaders::Entry &FlatHeaders::operator[](size_t i) const {
+  return i < inline_.size() ? inline_[i] : overflow_[i - inline_.size()];
+}
+
+inline void FlatHeaders::clear() {
+  overflow_.clear();
+  size_ = 0;
+}
+
 inline bool Request::has_header(const char *key) const {
-  return detail::has_header(headers, key);
+  return flat_headers.find(key) || detail::has_header(headers, key);
 }
 
 inline std::string Request::get_header_value(const char *key, size_t id) const {
-  return detail::get_header_value(headers, key, id, "");
+  auto entry = flat_headers.find(key, id);
+  if (entry) { return std::string(entry->value, entry->value_len); }
+  return detail::get_header_value(headers, key, id - flat_headers.count(key),
+                                  "");
 }
 
 inline size_t Request::get_header_value_count(const char *key) const {
   auto r = headers.equal_range(key);
-  return static_cast<size_t>(std::distance(r.first, r.second));
+  return flat_headers.count(key) +
+         static_cast<size_t>(std::distance(r.first, r.second));
 }
 
 inline void Request::set_header(const char *key, const char *val) {
@@ -4224,6 +4833,21 @@ inline size_t Request::get_param_value_count(const char *key) const {
   return static_cast<size_t>(std::distance(r.first, r.second));
 }
 
+inline bool Request::has_path_param(const char *key) const {
+  for (size_t i = 0; i < path_params.count; i++) {
+    if (*path_params.items[i].name == key) { return true; }
+  }
+  return false;
+}
+
+inline std::string Request::get_path_param_value(const char *key) const {
+  for (size_t i = 0; i < path_params.count; i++) {
+    const auto &param = path_params.items[i];
+    if (*param.name == key) { return path.substr(param.offset, param.length); }
+  }
+  return std::string();
+}
+
 inline bool Request::is_multipart_form_data() const {
   const auto &content_type = get_header_value("Content-Type");
   return !content_type.find("multipart/form-data");
@@ -4316,6 +4940,19 @@ inline void Response::set_content_provider(
   is_chunked_content_provider_ = false;
 }
 
+inline void Response::set_content_span(
+    const char *s, size_t n, const char *content_type,
+    ContentProviderResourceReleaser resource_releaser) {
+  set_content_provider(
+      n, content_type,
+      [s](size_t offset, size_t length, DataSink &sink) {
+        sink.write(s + offset, length);
+        return true;
+      },
+      std::move(resource_releaser));
+  content_span_ = s;
+}
+
 inline void Response::set_chunked_content_provider(
     const char *content_type, ContentProviderWithoutLength provider,
     ContentProviderResourceReleaser resource_releaser) {
@@ -4342,6 +4979,12 @@ inline size_t Result::get_request_header_value_count(const char *key) const {
 }
 
 // Stream implementation
+inline bool Stream::write_gathered(const char *ptr1, size_t size1,
+                                   const char *ptr2, size_t size2) {
+  return detail::write_data(*this, ptr1, size1) &&
+         detail::write_data(*this, ptr2, size2);
+}
+
 inline ssize_t Stream::write(const char *ptr) {
   return write(ptr, strlen(ptr));
 }
@@ -4365,7 +5008,8 @@ inline SocketStream::SocketStream(socket_t sock, time_t read_timeout_sec,
 inline SocketStream::~SocketStream() {}
 
 inline bool SocketStream::is_readable() const {
-  return select_read(sock_, read_timeout_sec_, read_timeout_usec_) > 0;
+  return has_buffered_data() ||
+         select_read(sock_, read_timeout_sec_, read_timeout_usec_) > 0;
 }
 
 inline bool SocketStream::is_writable() const {
@@ -4373,17 +5017,55 @@ inline bool SocketStream::is_writable() const {
 }
 
 inline ssize_t SocketStream::read(char *ptr, size_t size) {
+#ifdef _WIN32
+  size = (std::min)(size,
+                    static_cast<size_t>((std::numeric_limits<int>::max)()));
+#else
+  size = (std::min)(size,
+                    static_cast<size_t>((std::numeric_limits<ssize_t>::max)()));
+#endif
+
+  if (read_buff_off_ < read_buff_content_size_) {
+    auto n = (std::min)(size, read_buff_content_size_ - read_buff_off_);
+    memcpy(ptr, read_buff_.data() + read_buff_off_, n);
+    read_buff_off_ += n;
+    return static_cast<ssize_t>(n);
+  }
+
   if (!is_readable()) { return -1; }
 
+  read_buff_off_ = 0;
+  read_buff_content_size_ = 0;
+
+  if (size >= read_buff_.size()) {
 #ifdef _WIN32
-  if (size > static_cast<size_t>((std::numeric_limits<int>::max)())) {
-    return -1;
+    return recv(sock_, ptr, static_cast<int>(size), CPPHTTPLIB_RECV_FLAGS);
+#else
+    return handle_EINTR(
+        [&]() { return recv(sock_, ptr, size, CPPHTTPLIB_RECV_FLAGS); });
+#endif
   }
-  return recv(sock_, ptr, static_cast<int>(size), CPPHTTPLIB_RECV_FLAGS);
+
+#ifdef _WIN32
+  auto n = recv(sock_, read_buff_.data(), static_cast<int>(read_buff_.size()),
+                CPPHTTPLIB_RECV_FLAGS);
 #else
-  return handle_EINTR(
-      [&]() { return recv(sock_, ptr, size, CPPHTTPLIB_RECV_FLAGS); });
+  auto n = handle_EINTR([&]() {
+    return recv(sock_, read_buff_.data(), read_buff_.size(),
+                CPPHTTPLIB_RECV_FLAGS);
+  });
 #endif
+  if (n <= 0) { return n; }
+
+  auto len = (std::min)(size, static_cast<size_t>(n));
+  memcpy(ptr, read_buff_.data(), len);
+  read_buff_off_ = len;
+  read_buff_content_size_ = static_cast<size_t>(n);
+  return static_cast<ssize_t>(len);
+}
+
+inline bool SocketStream::has_buffered_data() const {
+  return read_buff_off_ < read_buff_content_size_;
 }
 
 inline ssize_t SocketStream::write(const char *ptr, size_t size) {
@@ -4400,6 +5082,44 @@ inline ssize_t SocketStream::write(const char *ptr, size_t size) {
 #endif
 }
 
+inline bool SocketStream::write_gathered(const char *ptr1, size_t size1,
+                                         const char *ptr2, size_t size2) {
+#ifdef _WIN32
+  return Stream::write_gathered(ptr1, size1, ptr2, size2);
+#else
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char *>(ptr1);
+  iov[0].iov_len = size1;
+  iov[1].iov_base = const_cast<char *>(ptr2);
+  iov[1].iov_len = size2;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  while (msg.msg_iovlen > 0) {
+    if (!is_writable()) { return false; }
+    auto n = handle_EINTR(
+        [&]() { return sendmsg(sock_, &msg, CPPHTTPLIB_SEND_FLAGS); });
+    if (n < 0) { return false; }
+
+    // Skip what was sent, partially sent buffer is resumed where it stopped
+    auto sent = static_cast<size_t>(n);
+    while (msg.msg_iovlen > 0 && sent >= msg.msg_iov->iov_len) {
+      sent -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = static_cast<char *>(msg.msg_iov->iov_base) + sent;
+      msg.msg_iov->iov_len -= sent;
+    }
+  }
+  return true;
+#endif
+}
+
 inline void SocketStream::get_remote_ip_and_port(std::string &ip,
                                                  int &port) const {
   return detail::get_remote_ip_and_port(sock_, ip, port);
@@ -4434,6 +5154,164 @@ inline socket_t BufferStream::socket() const { return 0; }
 
 inline const std::string &BufferStream::get_buffer() const { return buffer; }
 
+// Pipelined stream implementation
+inline PipelinedStream::PipelinedStream(Stream &conn, std::string &&request,
+                                        bool direct)
+    : conn_(conn), request_(std::move(request)), direct_(direct) {}
+
+inline bool PipelinedStream::is_readable() const {
+  return position_ < request_.size() || (direct_ && conn_.is_readable());
+}
+
+inline bool PipelinedStream::is_writable() const {
+  return !direct_ || conn_.is_writable();
+}
+
+inline ssize_t PipelinedStream::read(char *ptr, size_t size) {
+  if (position_ < request_.size()) {
+    auto len_read = (std::min)(size, request_.size() - position_);
+    memcpy(ptr, request_.data() + position_, len_read);
+    position_ += len_read;
+    return static_cast<ssize_t>(len_read);
+  }
+  return direct_ ? conn_.read(ptr, size) : 0;
+}
+
+inline ssize_t PipelinedStream::write(const char *ptr, size_t size) {
+  if (direct_) { return conn_.write(ptr, size); }
+  response_.append(ptr, size);
+  return static_cast<ssize_t>(size);
+}
+
+inline bool PipelinedStream::write_gathered(const char *ptr1, size_t size1,
+                                            const char *ptr2, size_t size2) {
+  if (direct_) { return conn_.write_gathered(ptr1, size1, ptr2, size2); }
+  return Stream::write_gathered(ptr1, size1, ptr2, size2);
+}
+
+inline void PipelinedStream::get_remote_ip_and_port(std::string &ip,
+                                                    int &port) const {
+  conn_.get_remote_ip_and_port(ip, port);
+}
+
+inline socket_t PipelinedStream::socket() const { return conn_.socket(); }
+
+inline const std::string &PipelinedStream::get_response() const {
+  return response_;
+}
+
+inline bool PathTrie::is_static_pattern(const std::string &pattern) {
+  if (pattern.empty() || pattern[0] != '/') { return false; }
+
+  auto in_param = false;
+  for (size_t i = 1; i < pattern.size(); i++) {
+    auto c = pattern[i];
+    if (in_param) {
+      if (c == '}') {
+        // `{name}` must be a whole non-empty segment
+        if (pattern[i - 1] == '{') { return false; }
+        if (i + 1 < pattern.size() && pattern[i + 1] != '/') { return false; }
+        in_param = false;
+      } else if (!isalnum(static_cast<unsigned char>(c)) && c != '_') {
+        return false;
+      }
+    } else if (c == '{') {
+      if (pattern[i - 1] != '/') { return false; }
+      in_param = true;
+    } else if (!isalnum(static_cast<unsigned char>(c)) && c != '/' &&
+               c != '_' && c != '-' && c != '~') {
+      return false;
+    }
+  }
+  return !in_param;
+}
+
+inline bool PathTrie::add(const std::string &pattern, size_t value) {
+  if (nodes_.empty()) { nodes_.emplace_back(); }
+
+  size_t node = 0;
+  auto pos = size_t(1);
+  while (pos < pattern.size() + 1 && pattern.size() > 1) {
+    auto end = pattern.find('/', pos);
+    if (end == std::string::npos) { end = pattern.size(); }
+
+    if (pattern[pos] == '{') {
+      if (nodes_[node].param_child == npos) {
+        auto child = nodes_.size();
+        nodes_.emplace_back();
+        nodes_[node].param_child = child;
+        nodes_[node].param_name = pattern.substr(pos + 1, end - pos - 2);
+      }
+      node = nodes_[node].param_child;
+    } else {
+      auto seg = pattern.substr(pos, end - pos);
+      auto child = npos;
+      for (const auto &x : nodes_[node].children) {
+        if (x.first == seg) {
+          child = x.second;
+          break;
+        }
+      }
+      if (child == npos) {
+        child = nodes_.size();
+        nodes_.emplace_back();
+        nodes_[node].children.emplace_back(std::move(seg), child);
+      }
+      node = child;
+    }
+    pos = end + 1;
+  }
+
+  // The first registered handler wins as with regex patterns
+  if (nodes_[node].value != npos) { return false; }
+  nodes_[node].value = value;
+  return true;
+}
+
+inline bool PathTrie::match(const std::string &path, size_t &value,
+                            PathParams &params) const {
+  params.count = 0;
+  if (nodes_.empty() || path.empty() || path[0] != '/') { return false; }
+  if (path.size() == 1) {
+    value = nodes_[0].value;
+    return value != npos;
+  }
+  return match_core(path, 1, 0, value, params);
+}
+
+inline bool PathTrie::match_core(const std::string &path, size_t pos,
+                                 size_t node, size_t &value,
+                                 PathParams &params) const {
+  if (pos > path.size()) {
+    value = nodes_[node].value;
+    return value != npos;
+  }
+
+  auto end = path.find('/', pos);
+  if (end == std::string::npos) { end = path.size(); }
+  auto len = end - pos;
+
+  // Fan-out is small, a linear scan beats anything fancier here
+  for (const auto &x : nodes_[node].children) {
+    if (x.first.size() == len && !path.compare(pos, len, x.first) &&
+        match_core(path, end + 1, x.second, value, params)) {
+      return true;
+    }
+  }
+
+  const auto &n = nodes_[node];
+  if (n.param_child != npos && len > 0 &&
+      params.count < params.items.size()) {
+    auto count = params.count;
+    params.items[params.count++] = PathParam{&n.param_name, pos, len};
+    if (match_core(path, end + 1, n.param_child, value, params)) {
+      return true;
+    }
+    params.count = count;
+  }
+  return false;
+}
+
 } // namespace detail
 
 // HTTP server implementation
@@ -4448,67 +5326,94 @@ inline Server::Server()
 
 inline Server::~Server() {}
 
-inline Server &Server::Get(const std::string &pattern, Handler handler) {
-  get_handlers_.push_back(
+// Patterns made of literal and `{name}` segments go to the static route
+// table, anything else is treated as a regex and matched one by one.
+template <class T>
+inline void
+Server::add_handler(const std::string &pattern, T handler,
+                    StaticHandlers<T> &static_handlers,
+                    std::vector<std::pair<std::regex, T>> &regex_handlers) {
+  if (detail::PathTrie::is_static_pattern(pattern)) {
+    if (static_handlers.trie.add(pattern, static_handlers.handlers.size())) {
+      static_handlers.handlers.push_back(std::move(handler));
+    }
+    return;
+  }
+  regex_handlers.push_back(
       std::make_pair(std::regex(pattern), std::move(handler)));
+}
+
+inline Server &Server::Get(const std::string &pattern, Handler handler) {
+  add_handler(pattern, std::move(handler), get_static_handlers_, get_handlers_);
   return *this;
 }
 
 inline Server &Server::Post(const std::string &pattern, Handler handler) {
-  post_handlers_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler), post_static_handlers_, post_handlers_);
   return *this;
 }
 
 inline Server &Server::Post(const std::string &pattern,
                             HandlerWithContentReader handler) {
-  post_handlers_for_content_reader_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler),
+              post_static_handlers_for_content_reader_,
+              post_handlers_for_content_reader_);
+  return *this;
+}
+
+inline Server &Server::Upgrade(const std::string &path,
+                               UpgradeHandler handler) {
+  upgrade_handlers_[path] = std::move(handler);
+  return *this;
+}
+
+inline Server &
+Server::set_prior_knowledge_handler(UpgradeHandler handler) {
+  prior_knowledge_handler_ = std::move(handler);
   return *this;
 }
 
 inline Server &Server::Put(const std::string &pattern, Handler handler) {
-  put_handlers_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler), put_static_handlers_, put_handlers_);
   return *this;
 }
 
 inline Server &Server::Put(const std::string &pattern,
                            HandlerWithContentReader handler) {
-  put_handlers_for_content_reader_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler),
+              put_static_handlers_for_content_reader_,
+              put_handlers_for_content_reader_);
   return *this;
 }
 
 inline Server &Server::Patch(const std::string &pattern, Handler handler) {
-  patch_handlers_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler), patch_static_handlers_, patch_handlers_);
   return *this;
 }
 
 inline Server &Server::Patch(const std::string &pattern,
                              HandlerWithContentReader handler) {
-  patch_handlers_for_content_reader_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler),
+              patch_static_handlers_for_content_reader_,
+              patch_handlers_for_content_reader_);
   return *this;
 }
 
 inline Server &Server::Delete(const std::string &pattern, Handler handler) {
-  delete_handlers_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler), delete_static_handlers_, delete_handlers_);
   return *this;
 }
 
 inline Server &Server::Delete(const std::string &pattern,
                               HandlerWithContentReader handler) {
-  delete_handlers_for_content_reader_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler),
+              delete_static_handlers_for_content_reader_,
+              delete_handlers_for_content_reader_);
   return *this;
 }
 
 inline Server &Server::Options(const std::string &pattern, Handler handler) {
-  options_handlers_.push_back(
-      std::make_pair(std::regex(pattern), std::move(handler)));
+  add_handler(pattern, std::move(handler), options_static_handlers_, options_handlers_);
   return *this;
 }
 
@@ -4584,6 +5489,35 @@ inline Server &Server::set_logger(Logger logger) {
   return *this;
 }
 
+inline Server &
+Server::set_trusted_connection_checker(TrustedConnectionChecker checker) {
+  trusted_connection_checker_ = std::move(checker);
+  return *this;
+}
+
+inline Server &Server::set_connection_filter(ConnectionFilter filter) {
+  connection_filter_ = std::move(filter);
+  return *this;
+}
+
+inline Server &Server::set_admission_control(size_t max_queued,
+                                             uint64_t max_wait_msec) {
+  admission_max_queued_ = max_queued;
+  admission_max_wait_usec_ = max_wait_msec * 1000;
+  return *this;
+}
+
+inline Server &
+Server::set_admission_exempt_checker(AdmissionExemptChecker checker) {
+  admission_exempt_checker_ = std::move(checker);
+  return *this;
+}
+
+inline Server &Server::set_admission_logger(AdmissionLogger logger) {
+  admission_logger_ = std::move(logger);
+  return *this;
+}
+
 inline Server &
 Server::set_expect_100_continue_handler(Expect100ContinueHandler handler) {
   expect_100_continue_handler_ = std::move(handler);
@@ -4658,12 +5592,25 @@ inline bool Server::listen(const char *host, int port, int socket_flags) {
   return bind_to_port(host, port, socket_flags) && listen_internal();
 }
 
+inline bool Server::listen_on_socket(socket_t sock) {
+  if (!is_valid() || sock == INVALID_SOCKET) { return false; }
+  // Other processes may accept the connection a wakeup was for, so accept
+  // must not block, or stop() would wait for the next connection
+  detail::set_nonblocking(sock, true);
+  owns_svr_sock_ = false;
+  svr_sock_ = sock;
+  return listen_internal();
+}
+
 inline bool Server::is_running() const { return is_running_; }
 
 inline void Server::stop() {
   if (is_running_) {
-    assert(svr_sock_ != INVALID_SOCKET);
+    // Several stop requests may race, only the first one closes the socket
     std::atomic<socket_t> sock(svr_sock_.exchange(INVALID_SOCKET));
+    if (sock == INVALID_SOCKET) { return; }
+    // Given socket is closed by the accept loop once it sees the stop
+    if (!owns_svr_sock_) { return; }
     detail::shutdown_socket(sock);
     detail::close_socket(sock);
   }
@@ -4696,7 +5643,11 @@ inline bool Server::parse_request_line(const char *s, Request &req) {
 
   if (methods.find(req.method) == methods.end()) { return false; }
 
-  if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0") { return false; }
+  if (req.version != "HTTP/1.1" && req.version != "HTTP/1.0" &&
+      !(req.method == "PRI" && req.version == "HTTP/2.0" &&
+        prior_knowledge_handler_)) {
+    return false;
+  }
 
   {
     size_t count = 0;
@@ -4754,10 +5705,11 @@ inline bool Server::write_response_core(Stream &strm, bool close_connection,
   if (close_connection || req.get_header_value("Connection") == "close") {
     res.set_header("Connection", "close");
   } else {
-    std::stringstream ss;
-    ss << "timeout=" << keep_alive_timeout_sec_
-       << ", max=" << keep_alive_max_count_;
-    res.set_header("Keep-Alive", ss.str());
+    char keep_alive[64];
+    snprintf(keep_alive, sizeof(keep_alive), "timeout=%ld, max=%zu",
+             static_cast<long>(keep_alive_timeout_sec_),
+             keep_alive_max_count_);
+    res.set_header("Keep-Alive", keep_alive);
   }
 
   if (!res.has_header("Content-Type") &&
@@ -4777,23 +5729,30 @@ inline bool Server::write_response_core(Stream &strm, bool close_connection,
   if (post_routing_handler_) { post_routing_handler_(req, res); }
 
   // Response line and headers
-  {
-    detail::BufferStream bstrm;
+  detail::BufferStream bstrm;
 
-    if (!bstrm.write_format("HTTP/1.1 %d %s\r\n", res.status,
-                            detail::status_message(res.status))) {
-      return false;
-    }
+  if (!bstrm.write_format("HTTP/1.1 %d %s\r\n", res.status,
+                          detail::status_message(res.status))) {
+    return false;
+  }
 
-    if (!detail::write_headers(bstrm, res.headers)) { return false; }
+  if (!detail::write_headers(bstrm, res.headers)) { return false; }
 
-    // Flush buffer
-    auto &data = bstrm.get_buffer();
-    strm.write(data.data(), data.size());
+  auto &head = bstrm.get_buffer();
+  auto ret = true;
+  if (res.content_span_ && req.ranges.empty() && req.method != "HEAD") {
+    // Head and body leave in one gathered write
+    ret = strm.write_gathered(head.data(), head.size(), res.content_span_,
+                              res.content_length_);
+    res.content_provider_success_ = ret;
+    if (logger_) { logger_(req, res); }
+    return ret;
   }
 
+  // Flush buffer
+  strm.write(head.data(), head.size());
+
   // Body
-  auto ret = true;
   if (req.method != "HEAD") {
     if (!res.body.empty()) {
       if (!strm.write(res.body)) { ret = false; }
@@ -5035,10 +5994,33 @@ inline bool Server::listen_internal() {
 
   {
     std::unique_ptr<TaskQueue> task_queue(new_task_queue());
+    std::unique_ptr<TaskQueue> pipelining_task_queue;
+    std::unique_ptr<TaskQueue> shed_task_queue;
+    if (admission_max_queued_ > 0 || admission_max_wait_usec_ > 0) {
+      shed_task_queue.reset(new ThreadPool(CPPHTTPLIB_SHED_THREAD_COUNT));
+    }
+    if (trusted_connection_checker_) {
+      pipelining_task_queue.reset(
+          new ThreadPool(CPPHTTPLIB_PIPELINING_THREAD_COUNT));
+      pipelining_task_queue_ = pipelining_task_queue.get();
+    }
 
+    // Given socket isn't shut down by stop(), so it is waited on for a while
+    // at a time to notice the stop
+    socket_t listen_sock = svr_sock_;
     while (svr_sock_ != INVALID_SOCKET) {
+      if (!owns_svr_sock_) {
+        auto val = detail::select_read(listen_sock, 0,
+                                       CPPHTTPLIB_SHARED_SOCKET_POLL_USECOND);
+        if (val == 0) {
+          task_queue->on_idle();
+          continue;
+        }
+      }
 #ifndef _WIN32
-      if (idle_interval_sec_ > 0 || idle_interval_usec_ > 0) {
+      else if (idle_interval_sec_ > 0 || idle_interval_usec_ > 0) {
+#else
+      else {
 #endif
         auto val = detail::select_read(svr_sock_, idle_interval_sec_,
                                        idle_interval_usec_);
@@ -5046,20 +6028,22 @@ inline bool Server::listen_internal() {
           task_queue->on_idle();
           continue;
         }
-#ifndef _WIN32
       }
-#endif
-      socket_t sock = accept(svr_sock_, nullptr, nullptr);
+      socket_t sock = accept(listen_sock, nullptr, nullptr);
 
       if (sock == INVALID_SOCKET) {
+        if (!owns_svr_sock_ && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                                errno == EINTR)) {
+          continue;
+        }
         if (errno == EMFILE) {
           // The per-process limit of open file descriptors has been reached.
           // Try to accept new connections after a short sleep.
           std::this_thread::sleep_for(std::chrono::milliseconds(1));
           continue;
         }
-        if (svr_sock_ != INVALID_SOCKET) {
-          detail::close_socket(svr_sock_);
+        if (svr_sock_.exchange(INVALID_SOCKET) != INVALID_SOCKET) {
+          if (owns_svr_sock_) { detail::close_socket(listen_sock); }
           ret = false;
         } else {
           ; // The server socket was closed by user.
@@ -5080,14 +6064,60 @@ inline bool Server::listen_internal() {
         setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv, sizeof(tv));
       }
 
+      if (shed_task_queue) {
+        auto wait_usec = task_queue->oldest_wait_usec();
+        if ((admission_max_queued_ > 0 &&
+             task_queue->queued() >= admission_max_queued_) ||
+            (admission_max_wait_usec_ > 0 &&
+             wait_usec >= admission_max_wait_usec_)) {
+          // Beyond what even shedding keeps up with, drop at once
+          if (shed_task_queue->queued() >= CPPHTTPLIB_SHED_QUEUE_MAX) {
+            if (admission_logger_) { admission_logger_(true, wait_usec); }
+            detail::close_socket(sock);
+            continue;
+          }
+          // Come back once the current backlog should be gone
+          auto retry_after_sec =
+              (std::max)(static_cast<size_t>(1),
+                         static_cast<size_t>((wait_usec + 999999) / 1000000));
+#if __cplusplus > 201703L
+          shed_task_queue->enqueue([=, this]() {
+            shed_and_close_socket(sock, retry_after_sec, wait_usec);
+          });
+#else
+          shed_task_queue->enqueue([=]() {
+            shed_and_close_socket(sock, retry_after_sec, wait_usec);
+          });
+#endif
+          continue;
+        }
+      }
+
+      auto queued_at = std::chrono::steady_clock::now();
 #if __cplusplus > 201703L
-      task_queue->enqueue([=, this]() { process_and_close_socket(sock); });
+      task_queue->enqueue([=, this]() {
 #else
-      task_queue->enqueue([=]() { process_and_close_socket(sock); });
+      task_queue->enqueue([=]() {
 #endif
+        if (admission_logger_) {
+          admission_logger_(
+              false, static_cast<uint64_t>(
+                         std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - queued_at)
+                             .count()));
+        }
+        process_and_close_socket(sock);
+      });
     }
 
+    if (!owns_svr_sock_) { detail::close_socket(listen_sock); }
     task_queue->shutdown();
+    if (shed_task_queue) { shed_task_queue->shutdown(); }
+    // Connections wait for their pipelined requests, so nothing is queued now
+    if (pipelining_task_queue) {
+      pipelining_task_queue->shutdown();
+      pipelining_task_queue_ = nullptr;
+    }
   }
 
   is_running_ = false;
@@ -5124,24 +6154,28 @@ inline bool Server::routing(Request &req, Response &res, Stream &strm) {
       if (req.method == "POST") {
         if (dispatch_request_for_content_reader(
                 req, res, std::move(reader),
+                post_static_handlers_for_content_reader_,
                 post_handlers_for_content_reader_)) {
           return true;
         }
       } else if (req.method == "PUT") {
         if (dispatch_request_for_content_reader(
                 req, res, std::move(reader),
+                put_static_handlers_for_content_reader_,
                 put_handlers_for_content_reader_)) {
           return true;
         }
       } else if (req.method == "PATCH") {
         if (dispatch_request_for_content_reader(
                 req, res, std::move(reader),
+                patch_static_handlers_for_content_reader_,
                 patch_handlers_for_content_reader_)) {
           return true;
         }
       } else if (req.method == "DELETE") {
         if (dispatch_request_for_content_reader(
                 req, res, std::move(reader),
+                delete_static_handlers_for_content_reader_,
                 delete_handlers_for_content_reader_)) {
           return true;
         }
@@ -5154,25 +6188,33 @@ inline bool Server::routing(Request &req, Response &res, Stream &strm) {
 
   // Regular handler
   if (req.method == "GET" || req.method == "HEAD") {
-    return dispatch_request(req, res, get_handlers_);
+    return dispatch_request(req, res, get_static_handlers_, get_handlers_);
   } else if (req.method == "POST") {
-    return dispatch_request(req, res, post_handlers_);
+    return dispatch_request(req, res, post_static_handlers_, post_handlers_);
   } else if (req.method == "PUT") {
-    return dispatch_request(req, res, put_handlers_);
+    return dispatch_request(req, res, put_static_handlers_, put_handlers_);
   } else if (req.method == "DELETE") {
-    return dispatch_request(req, res, delete_handlers_);
+    return dispatch_request(req, res, delete_static_handlers_, delete_handlers_);
   } else if (req.method == "OPTIONS") {
-    return dispatch_request(req, res, options_handlers_);
+    return dispatch_request(req, res, options_static_handlers_, options_handlers_);
   } else if (req.method == "PATCH") {
-    return dispatch_request(req, res, patch_handlers_);
+    return dispatch_request(req, res, patch_static_handlers_, patch_handlers_);
   }
 
   res.status = 400;
   return false;
 }
 
-inline bool Server::dispatch_request(Request &req, Response &res,
-                                     const Handlers &handlers) {
+inline bool
+Server::dispatch_request(Request &req, Response &res,
+                         const StaticHandlers<Handler> &static_handlers,
+                         const Handlers &handlers) {
+  size_t idx;
+  if (static_handlers.trie.match(req.path, idx, req.path_params)) {
+    static_handlers.handlers[idx](req, res);
+    return true;
+  }
+
   for (const auto &x : handlers) {
     const auto &pattern = x.first;
     const auto &handler = x.second;
@@ -5297,7 +6339,14 @@ inline void Server::apply_ranges(const Request &req, Response &res,
 
 inline bool Server::dispatch_request_for_content_reader(
     Request &req, Response &res, ContentReader content_reader,
+    const StaticHandlers<HandlerWithContentReader> &static_handlers,
     const HandlersForContentReader &handlers) {
+  size_t idx;
+  if (static_handlers.trie.match(req.path, idx, req.path_params)) {
+    static_handlers.handlers[idx](req, res, content_reader);
+    return true;
+  }
+
   for (const auto &x : handlers) {
     const auto &pattern = x.first;
     const auto &handler = x.second;
@@ -5355,8 +6404,11 @@ Server::process_request(Stream &strm, bool close_connection,
   }
 
   // Request line and headers
+  std::array<char, CPPHTTPLIB_REQUEST_HEAD_BUFSIZ> head_buf;
+  std::string head_spill;
   if (!parse_request_line(line_reader.ptr(), req) ||
-      !detail::read_headers(strm, req.headers)) {
+      !detail::read_headers(strm, req.flat_headers, head_buf.data(),
+                            head_buf.size(), head_spill)) {
     res.status = 400;
     return write_response(strm, close_connection, req, res);
   }
@@ -5371,8 +6423,14 @@ Server::process_request(Stream &strm, bool close_connection,
   }
 
   strm.get_remote_ip_and_port(req.remote_addr, req.remote_port);
-  req.set_header("REMOTE_ADDR", req.remote_addr);
-  req.set_header("REMOTE_PORT", std::to_string(req.remote_port));
+  {
+    auto n = snprintf(req.remote_port_buf_.data(), req.remote_port_buf_.size(),
+                      "%d", req.remote_port);
+    req.flat_headers.add("REMOTE_ADDR", 11, req.remote_addr.c_str(),
+                         req.remote_addr.size());
+    req.flat_headers.add("REMOTE_PORT", 11, req.remote_port_buf_.data(),
+                         static_cast<size_t>(n));
+  }
 
   if (req.has_header("Range")) {
     const auto &range_header_value = req.get_header_value("Range");
@@ -5384,6 +6442,33 @@ Server::process_request(Stream &strm, bool close_connection,
 
   if (setup_request) { setup_request(req); }
 
+  req.is_connection_closed = [&strm]() {
+    return detail::is_socket_broken(strm.socket());
+  };
+
+  if (req.shed_retry_after_sec > 0 &&
+      !(admission_exempt_checker_ && admission_exempt_checker_(req))) {
+    // Exempt requests are served as usual, only those answered here count
+    if (admission_logger_) { admission_logger_(true, req.shed_wait_usec); }
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(req.shed_retry_after_sec));
+    connection_closed = true;
+    return write_response(strm, true, req, res);
+  }
+
+  if (req.version == "HTTP/2.0") {
+    connection_closed = true;
+    return prior_knowledge_handler_(req, strm);
+  }
+
+  if (!upgrade_handlers_.empty() && req.has_header("Upgrade")) {
+    auto it = upgrade_handlers_.find(req.path);
+    if (it != upgrade_handlers_.end()) {
+      connection_closed = true;
+      return it->second(req, strm);
+    }
+  }
+
   if (req.get_header_value("Expect") == "100-continue") {
     auto status = 100;
     if (expect_100_continue_handler_) {
@@ -5428,12 +6513,51 @@ Server::process_request(Stream &strm, bool close_connection,
 inline bool Server::is_valid() const { return true; }
 
 inline bool Server::process_and_close_socket(socket_t sock) {
+  auto ret = false;
+  if (connection_filter_ && !connection_filter_(sock)) {
+    ;
+  } else if (pipelining_task_queue_ && trusted_connection_checker_(sock)) {
+    ret = process_pipelined_socket(sock);
+  } else {
+    size_t request_index = 0;
+    ret = detail::process_server_socket(
+        sock, keep_alive_max_count_, keep_alive_timeout_sec_,
+        read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
+        write_timeout_usec_,
+        [&](Stream &strm, bool close_connection, bool &connection_closed) {
+          auto index = request_index++;
+          return process_request(
+              strm, close_connection, connection_closed,
+              [index](Request &req) { req.connection_request_index = index; });
+        });
+  }
+
+  detail::shutdown_socket(sock);
+  detail::close_socket(sock);
+  return ret;
+}
+
+inline bool Server::shed_and_close_socket(socket_t sock,
+                                          size_t retry_after_sec,
+                                          uint64_t wait_usec) {
+  // Peers the filter rejects get no answer, not even 503
+  if (connection_filter_ && !connection_filter_(sock)) {
+    detail::shutdown_socket(sock);
+    detail::close_socket(sock);
+    return false;
+  }
+
+  // Only one request is read, and a slow client is not waited for long
   auto ret = detail::process_server_socket(
-      sock, keep_alive_max_count_, keep_alive_timeout_sec_, read_timeout_sec_,
-      read_timeout_usec_, write_timeout_sec_, write_timeout_usec_,
-      [this](Stream &strm, bool close_connection, bool &connection_closed) {
+      sock, 1, CPPHTTPLIB_SHED_READ_TIMEOUT_SECOND,
+      CPPHTTPLIB_SHED_READ_TIMEOUT_SECOND, 0, write_timeout_sec_,
+      write_timeout_usec_,
+      [&](Stream &strm, bool close_connection, bool &connection_closed) {
         return process_request(strm, close_connection, connection_closed,
-                               nullptr);
+                               [retry_after_sec, wait_usec](Request &req) {
+                                 req.shed_retry_after_sec = retry_after_sec;
+                                 req.shed_wait_usec = wait_usec;
+                               });
       });
 
   detail::shutdown_socket(sock);
@@ -5441,6 +6565,102 @@ inline bool Server::process_and_close_socket(socket_t sock) {
   return ret;
 }
 
+inline bool Server::process_pipelined_socket(socket_t sock) {
+  struct PipelinedRequest {
+    PipelinedRequest(Stream &strm, std::string &&head)
+        : strm(strm, std::move(head), false) {}
+    detail::PipelinedStream strm;
+    bool done = false;
+    bool ret = false;
+    bool connection_closed = false;
+  };
+
+  detail::SocketStream strm(sock, read_timeout_sec_, read_timeout_usec_,
+                            write_timeout_sec_, write_timeout_usec_);
+  std::deque<std::shared_ptr<PipelinedRequest>> in_flight;
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  // Waits for the oldest request and writes its response.
+  auto flush_oldest = [&]() {
+    auto req = in_flight.front();
+    in_flight.pop_front();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&] { return req->done; });
+    }
+    const auto &data = req->strm.get_response();
+    return detail::write_data(strm, data.data(), data.size()) && req->ret &&
+           !req->connection_closed;
+  };
+
+  auto ret = true;
+  auto closing = false;
+  size_t request_index = 0;
+  while (ret && !closing && svr_sock_ != INVALID_SOCKET) {
+    auto readable =
+        strm.has_buffered_data() || detail::select_read(sock, 0, 0) > 0;
+    if (!readable && !in_flight.empty()) {
+      ret = flush_oldest();
+      continue;
+    }
+    if (!readable && !detail::keep_alive(sock, keep_alive_timeout_sec_)) {
+      break;
+    }
+    if (in_flight.size() >= CPPHTTPLIB_PIPELINING_MAX_COUNT) {
+      ret = flush_oldest();
+      continue;
+    }
+
+    std::string raw;
+    auto can_pipeline = false;
+    auto ok = detail::read_pipelined_request(strm, payload_max_length_, raw,
+                                             can_pipeline, closing);
+    if (raw.empty()) { break; }
+    auto close_connection = closing;
+    auto index = request_index++;
+    auto setup_request = [index](Request &req) {
+      req.connection_request_index = index;
+    };
+
+    if (ok && can_pipeline) {
+      auto req = std::make_shared<PipelinedRequest>(strm, std::move(raw));
+      in_flight.push_back(req);
+      pipelining_task_queue_->enqueue([this, req, close_connection,
+                                       setup_request, &mutex, &cond]() {
+        auto connection_closed = false;
+        auto ret = process_request(req->strm, close_connection,
+                                   connection_closed, setup_request);
+        std::unique_lock<std::mutex> lock(mutex);
+        req->ret = ret;
+        req->connection_closed = connection_closed;
+        req->done = true;
+        cond.notify_all();
+      });
+      continue;
+    }
+
+    // Requests whose body can't be read ahead, or malformed ones, are handled
+    // in place once the responses before them are out.
+    while (ret && !in_flight.empty()) {
+      ret = flush_oldest();
+    }
+    if (!ret) { break; }
+    detail::PipelinedStream direct_strm(strm, std::move(raw), true);
+    auto connection_closed = false;
+    ret = process_request(direct_strm, !ok || close_connection,
+                          connection_closed, setup_request) &&
+          ok;
+    if (connection_closed) { break; }
+  }
+
+  // Pipelined tasks refer to this frame, wait for all of them
+  while (!in_flight.empty()) {
+    flush_oldest();
+  }
+  return ret;
+}
+
 // HTTP client implementation
 inline ClientImpl::ClientImpl(const std::string &host)
     : ClientImpl(host, 80, std::string(), std::string()) {}
@@ -6795,7 +8015,8 @@ process_server_socket_ssl(SSL *ssl, socket_t sock, size_t keep_alive_max_count,
         SSLSocketStream strm(sock, ssl, read_timeout_sec, read_timeout_usec,
                              write_timeout_sec, write_timeout_usec);
         return callback(strm, close_connection, connection_closed);
-      });
+      },
+      [&]() { return SSL_pending(ssl) > 0; });
 }
 
 template <typename T>
@@ -50,10 +50,9 @@ void Log::info(const char *format, ...)
     log_mutex.lock();
     va_list va;
     va_start(va, format);
-    int n = vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
+    vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
     va_end(va);
-    std::string log_str(this->log_buf, n);
-    this->base_log(log_str, CRUST_LOG_INFO_TAG);
+    this->base_log(this->log_buf, CRUST_LOG_INFO_TAG);
     log_mutex.unlock();
 }
 
@@ -66,10 +65,9 @@ void Log::warn(const char *format, ...)
     log_mutex.lock();
     va_list va;
     va_start(va, format);
-    int n = vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
+    vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
     va_end(va);
-    std::string log_str(this->log_buf, n);
-    this->base_log(log_str, CRUST_LOG_WARN_TAG);
+    this->base_log(this->log_buf, CRUST_LOG_WARN_TAG);
     log_mutex.unlock();
 }
 
@@ -82,10 +80,9 @@ void Log::err(const char *format, ...)
     log_mutex.lock();
     va_list va;
     va_start(va, format);
-    int n = vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
+    vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
     va_end(va);
-    std::string log_str(this->log_buf, n);
-    this->base_log(log_str, CRUST_LOG_ERR_TAG);
+    this->base_log(this->log_buf, CRUST_LOG_ERR_TAG);
     log_mutex.unlock();
 }
 
@@ -104,10 +101,9 @@ void Log::debug(const char *format, ...)
         log_mutex.lock();
         va_list va;
         va_start(va, format);
-        int n = vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
+        vsnprintf(this->log_buf, CRUST_LOG_BUF_SIZE, format, va);
         va_end(va);
-        std::string log_str(this->log_buf, n);
-        this->base_log(log_str, CRUST_LOG_DEBUG_TAG);
+        this->base_log(this->log_buf, CRUST_LOG_DEBUG_TAG);
         log_mutex.unlock();
     }
 }
@@ -117,7 +113,7 @@ void Log::debug(const char *format, ...)
  * @param log_str -> data for logging
  * @param tag -> log tag
  */
-void Log::base_log(std::string log_str, std::string tag)
+void Log::base_log(const char *log_str, const char *tag)
 {
     // Get timestamp
     struct timeval cur_time;
@@ -132,7 +128,7 @@ void Log::base_log(std::string log_str, std::string tag)
         time_str[0] = 0;
     }
     
-     printf("[%s.%03d] [%s] %s", time_str, milli_sec, tag.c_str(), log_str.c_str());
+     printf("[%s.%03d] [%s] %s", time_str, milli_sec, tag, log_str);
 
      fflush(stdout);
 }
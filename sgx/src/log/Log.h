@@ -29,7 +29,7 @@ public:
     void restore_debug_flag();
 
 private:
-    void base_log(std::string log_data, std::string tag);
+    void base_log(const char *log_data, const char *tag);
     bool debug_flag;
     std::mutex debug_flag_mutex;
     char log_buf[CRUST_LOG_BUF_SIZE];
@@ -0,0 +1,258 @@
+#include "Metrics.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+#include <mutex>
+
+std::mutex metrics_mutex;
+
+Metrics *Metrics::metrics = NULL;
+
+// Keep in the same order as metric_t
+static const char *metric_names[METRIC_NUM] = {
+    "request_total",
+    "verify_success",
+    "verify_failed",
+    "verify_latency_us",
+    "shed_total",
+    "queue_total",
+    "queue_wait_us",
+    "account_rejected_total",
+    "cancelled_http_queue_total",
+    "cancelled_account_queue_total",
+    "cancelled_h2_queue_total",
+    "cancelled_stream_queue_total",
+    "qvl_limit",
+    "qvl_latency_target_us",
+    "collateral_fetch_total",
+    "collateral_fetch_failed",
+    "collateral_stale_total",
+    "collateral_unavailable_total",
+    "collateral_breaker_open",
+    "collateral_disk_load_total",
+    "collateral_evicted_total",
+    "result_cache_hit_total",
+    "result_cache_miss_total",
+    "result_cache_invalidated_total",
+    "result_cache_entries",
+    "negative_cache_hit_total",
+    "negative_bloom_false_positive_total",
+    "negative_cache_entries",
+    "result_log_loaded_total",
+    "result_log_append_total",
+    "result_log_compact_total",
+    "shared_result_cache_hit_total",
+    "shared_result_cache_miss_total",
+    "verify_token_issued_total",
+    "verify_token_hit_total",
+    "verify_token_invalid_total",
+    "policy_enclave_rejected_total",
+    "policy_qv_result_rejected_total",
+    "identity_registry_evicted_total",
+    "http_request_total",
+    "connection_total",
+    "shm_request_total",
+    "stream_request_total",
+    "h2_connection_total",
+    "h2_stream_total",
+    "worker_restarts",
+};
+
+/**
+ * @description: Whether metric is a gauge, which holds a current value of its process rather than counts
+ * @param metric -> Metric type
+ * @return: Gauge or not
+ */
+static bool is_gauge(metric_t metric)
+{
+    switch (metric)
+    {
+    case METRIC_QVL_LIMIT:
+    case METRIC_QVL_LATENCY_TARGET_US:
+    case METRIC_COLLATERAL_BREAKER_OPEN:
+    case METRIC_RESULT_CACHE_ENTRIES:
+    case METRIC_NEGATIVE_CACHE_ENTRIES:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @description: single instance class function to get instance
+ * @return: metrics instance
+ */
+Metrics *Metrics::get_instance()
+{
+    if (Metrics::metrics == NULL)
+    {
+        metrics_mutex.lock();
+        if (Metrics::metrics == NULL)
+        {
+            Metrics *p_metrics = new Metrics();
+            p_metrics->init(1);
+            Metrics::metrics = p_metrics;
+        }
+        metrics_mutex.unlock();
+    }
+
+    return Metrics::metrics;
+}
+
+/**
+ * @description: constructor
+ */
+Metrics::Metrics()
+{
+    this->slots = NULL;
+    this->slot_num = 0;
+    this->slot_idx = 0;
+}
+
+/**
+ * @description: Map metrics slots in memory shared with forked children, must be called before fork
+ * @param slot_num -> One slot per process which reports metrics
+ * @return: Init status
+ */
+crust_status_t Metrics::init(size_t slot_num)
+{
+    size_t sz = sizeof(metrics_slot_t) * slot_num;
+    void *p_mem = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p_mem == MAP_FAILED)
+    {
+        return CRUST_MALLOC_FAILED;
+    }
+
+    metrics_slot_t *slots = reinterpret_cast<metrics_slot_t *>(p_mem);
+    for (size_t i = 0; i < slot_num; i++)
+    {
+        new (&slots[i]) metrics_slot_t();
+        slots[i].pid = 0;
+        for (size_t j = 0; j < METRIC_NUM; j++)
+        {
+            slots[i].values[j] = 0;
+        }
+    }
+    slots[0].pid = getpid();
+
+    if (this->slots != NULL)
+    {
+        munmap(this->slots, sizeof(metrics_slot_t) * this->slot_num);
+    }
+    this->slots = slots;
+    this->slot_num = slot_num;
+    this->slot_idx = 0;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Select the slot current process reports to
+ * @param slot_idx -> Slot index
+ */
+void Metrics::set_slot(size_t slot_idx)
+{
+    if (slot_idx >= this->slot_num)
+    {
+        return;
+    }
+
+    this->slot_idx = slot_idx;
+    this->slots[slot_idx].pid = getpid();
+}
+
+/**
+ * @description: Get slot number
+ * @return: Slot number
+ */
+size_t Metrics::get_slot_num()
+{
+    return this->slot_num;
+}
+
+/**
+ * @description: Add value to indicated counter of current process
+ * @param metric -> Metric type
+ * @param value -> Value to be added
+ */
+void Metrics::add(metric_t metric, uint64_t value)
+{
+    this->slots[this->slot_idx].values[metric].fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+ * @description: Set indicated gauge of current process
+ * @param metric -> Metric type
+ * @param value -> New value
+ */
+void Metrics::set(metric_t metric, uint64_t value)
+{
+    this->slots[this->slot_idx].values[metric].store(value, std::memory_order_relaxed);
+}
+
+/**
+ * @description: Get indicated counter summed over all processes, gauges of processes don't add up
+ * @param metric -> Metric type
+ * @return: Sum
+ */
+uint64_t Metrics::get(metric_t metric)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < this->slot_num; i++)
+    {
+        total += this->slots[i].values[metric].load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+/**
+ * @description: Share of requests which are served on a reused connection
+ * @param requests -> Http request number
+ * @param connections -> Connection number
+ * @return: Reuse ratio
+ */
+static double reuse_ratio(uint64_t requests, uint64_t connections)
+{
+    if (requests == 0 || connections >= requests)
+    {
+        return 0;
+    }
+
+    return (double)(requests - connections) / requests;
+}
+
+/**
+ * @description: Dump metrics of all processes, and sum of counters over them. Gauges are only given per process
+ * @return: Metrics json
+ */
+json::JSON Metrics::to_json()
+{
+    json::JSON ans;
+    for (size_t j = 0; j < METRIC_NUM; j++)
+    {
+        if (is_gauge(static_cast<metric_t>(j)))
+            continue;
+        ans["total"][metric_names[j]] = (long)this->get(static_cast<metric_t>(j));
+    }
+    ans["total"]["connection_reuse_ratio"] = reuse_ratio(this->get(METRIC_HTTP_REQUEST_TOTAL), this->get(METRIC_CONNECTION_TOTAL));
+    for (size_t i = 0; i < this->slot_num; i++)
+    {
+        if (this->slots[i].pid == 0)
+        {
+            continue;
+        }
+        json::JSON slot;
+        slot["pid"] = (long)this->slots[i].pid;
+        for (size_t j = 0; j < METRIC_NUM; j++)
+        {
+            slot[metric_names[j]] = (long)this->slots[i].values[j].load(std::memory_order_relaxed);
+        }
+        slot["connection_reuse_ratio"] = reuse_ratio(this->slots[i].values[METRIC_HTTP_REQUEST_TOTAL].load(std::memory_order_relaxed),
+                this->slots[i].values[METRIC_CONNECTION_TOTAL].load(std::memory_order_relaxed));
+        ans["processes"].append(slot);
+    }
+
+    return ans;
+}
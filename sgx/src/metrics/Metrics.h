@@ -0,0 +1,105 @@
+#ifndef _CRUST_METRICS_H_
+#define _CRUST_METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+
+#include "Json.h"
+#include "CrustStatus.h"
+
+// Counters are summed over processes, gauges, listed by is_gauge, are reported per process
+typedef enum _metric_t
+{
+    // Requests
+    METRIC_REQUEST_TOTAL,
+    METRIC_VERIFY_SUCCESS,
+    METRIC_VERIFY_FAILED,
+    METRIC_VERIFY_LATENCY_US,
+    // Admission
+    METRIC_SHED_TOTAL,
+    METRIC_QUEUE_TOTAL,
+    METRIC_QUEUE_WAIT_US,
+    METRIC_ACCOUNT_REJECTED_TOTAL,
+    // Cancellations, counted by the stage where work was dropped
+    METRIC_CANCELLED_HTTP_QUEUE_TOTAL,
+    METRIC_CANCELLED_ACCOUNT_QUEUE_TOTAL,
+    METRIC_CANCELLED_H2_QUEUE_TOTAL,
+    METRIC_CANCELLED_STREAM_QUEUE_TOTAL,
+    // Quote verification concurrency, limit and target are gauges
+    METRIC_QVL_LIMIT,
+    METRIC_QVL_LATENCY_TARGET_US,
+    // Collateral cache and circuit breaker of collateral service, breaker open is a gauge
+    METRIC_COLLATERAL_FETCH_TOTAL,
+    METRIC_COLLATERAL_FETCH_FAILED,
+    METRIC_COLLATERAL_STALE_TOTAL,
+    METRIC_COLLATERAL_UNAVAILABLE_TOTAL,
+    METRIC_COLLATERAL_BREAKER_OPEN,
+    METRIC_COLLATERAL_DISK_LOAD_TOTAL,
+    METRIC_COLLATERAL_EVICTED_TOTAL,
+    // Quote stage results, entries is a gauge
+    METRIC_RESULT_CACHE_HIT_TOTAL,
+    METRIC_RESULT_CACHE_MISS_TOTAL,
+    METRIC_RESULT_CACHE_INVALIDATED_TOTAL,
+    METRIC_RESULT_CACHE_ENTRIES,
+    // Rejected evidence, entries is a gauge
+    METRIC_NEGATIVE_CACHE_HIT_TOTAL,
+    METRIC_NEGATIVE_BLOOM_FALSE_POSITIVE_TOTAL,
+    METRIC_NEGATIVE_CACHE_ENTRIES,
+    // Accepted quotes kept on disk
+    METRIC_RESULT_LOG_LOADED_TOTAL,
+    METRIC_RESULT_LOG_APPEND_TOTAL,
+    METRIC_RESULT_LOG_COMPACT_TOTAL,
+    // Results shared among processes on the host, counted by each process
+    METRIC_SHARED_RESULT_CACHE_HIT_TOTAL,
+    METRIC_SHARED_RESULT_CACHE_MISS_TOTAL,
+    // Verification tokens
+    METRIC_VERIFY_TOKEN_ISSUED_TOTAL,
+    METRIC_VERIFY_TOKEN_HIT_TOTAL,
+    METRIC_VERIFY_TOKEN_INVALID_TOTAL,
+    // Policy rejections
+    METRIC_POLICY_ENCLAVE_REJECTED_TOTAL,
+    METRIC_POLICY_QV_RESULT_REJECTED_TOTAL,
+    // Identities replaced once registry is full
+    METRIC_IDENTITY_REGISTRY_EVICTED_TOTAL,
+    // Connections
+    METRIC_HTTP_REQUEST_TOTAL,
+    METRIC_CONNECTION_TOTAL,
+    METRIC_SHM_REQUEST_TOTAL,
+    METRIC_STREAM_REQUEST_TOTAL,
+    METRIC_H2_CONNECTION_TOTAL,
+    METRIC_H2_STREAM_TOTAL,
+    // Processes
+    METRIC_WORKER_RESTARTS,
+    METRIC_NUM,
+} metric_t;
+
+typedef struct _metrics_slot_t
+{
+    pid_t pid;
+    std::atomic<uint64_t> values[METRIC_NUM];
+} metrics_slot_t;
+
+class Metrics
+{
+public:
+    static Metrics *metrics;
+    static Metrics *get_instance();
+    crust_status_t init(size_t slot_num);
+    void set_slot(size_t slot_idx);
+    size_t get_slot_num();
+    void add(metric_t metric, uint64_t value = 1);
+    void set(metric_t metric, uint64_t value);
+    uint64_t get(metric_t metric);
+    json::JSON to_json();
+
+private:
+    metrics_slot_t *slots;
+    size_t slot_num;
+    size_t slot_idx;
+    Metrics(void);
+};
+
+#endif /* !_CRUST_METRICS_H_ */
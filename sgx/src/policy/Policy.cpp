@@ -0,0 +1,392 @@
+#include "Policy.h"
+
+#include "Json.h"
+#include "Log.h"
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+std::mutex policy_mutex;
+
+Policy *Policy::policy = NULL;
+
+static Log *p_log = Log::get_instance();
+
+// Quote verification results a policy may accept, the others are never accepted
+static const struct
+{
+    const char *name;
+    sgx_ql_qv_result_t qv_result;
+} acceptable_qv_results[] = {
+    {"OK", SGX_QL_QV_RESULT_OK},
+    {"CONFIG_NEEDED", SGX_QL_QV_RESULT_CONFIG_NEEDED},
+    {"OUT_OF_DATE", SGX_QL_QV_RESULT_OUT_OF_DATE},
+    {"OUT_OF_DATE_CONFIG_NEEDED", SGX_QL_QV_RESULT_OUT_OF_DATE_CONFIG_NEEDED},
+    {"SW_HARDENING_NEEDED", SGX_QL_QV_RESULT_SW_HARDENING_NEEDED},
+    {"CONFIG_AND_SW_HARDENING_NEEDED", SGX_QL_QV_RESULT_CONFIG_AND_SW_HARDENING_NEEDED},
+};
+
+/**
+ * @description: Finalizer of splitmix64
+ * @param x -> Value to mix
+ * @return: Mixed value
+ */
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/**
+ * @description: Hash measurement twice, first hash picks bucket and second one slot
+ * @param key -> Measurement
+ * @param h0 -> Bucket hash
+ * @param h1 -> Slot hash
+ */
+static inline void hash_measurement(const sgx_measurement_t *key, uint64_t *h0, uint64_t *h1)
+{
+    uint64_t w[4];
+    memcpy(w, key->m, sizeof(w));
+    *h0 = mix64(w[0] ^ w[2]);
+    *h1 = mix64(w[1] ^ w[3]);
+}
+
+/**
+ * @description: Get slot of slot hash under displacement
+ * @param h1 -> Slot hash
+ * @param displacement -> Displacement of key's bucket
+ * @param slot_mask -> Slot number minus one
+ * @return: Slot index
+ */
+static inline uint64_t get_slot(uint64_t h1, uint32_t displacement, uint64_t slot_mask)
+{
+    return mix64(h1 + displacement * 0x9e3779b97f4a7c15ULL) & slot_mask;
+}
+
+/**
+ * @description: constructor
+ */
+MeasurementSet::MeasurementSet()
+{
+    this->bucket_num = 0;
+    this->slot_mask = 0;
+    this->key_num = 0;
+}
+
+/**
+ * @description: Compile keys into perfect hash table. Buckets are placed largest first, each taking the first
+ * displacement which sends all its keys to free slots. Slot table has at least twice as many slots as keys.
+ * @param keys -> Measurements, duplicates are dropped
+ * @return: False if some bucket found no displacement even in the largest slot table
+ */
+bool MeasurementSet::build(std::vector<sgx_measurement_t> keys)
+{
+    auto less = [](const sgx_measurement_t &a, const sgx_measurement_t &b) { return memcmp(a.m, b.m, sizeof(a.m)) < 0; };
+    auto equal = [](const sgx_measurement_t &a, const sgx_measurement_t &b) { return memcmp(a.m, b.m, sizeof(a.m)) == 0; };
+    std::sort(keys.begin(), keys.end(), less);
+    keys.erase(std::unique(keys.begin(), keys.end(), equal), keys.end());
+    this->key_num = keys.size();
+    this->displacements.clear();
+    this->slots.clear();
+    if (keys.empty())
+        return true;
+
+    this->bucket_num = keys.size() / POLICY_HASH_BUCKET_KEYS + 1;
+    std::vector<std::vector<size_t>> buckets(this->bucket_num);
+    std::vector<uint64_t> slot_hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        uint64_t h0;
+        hash_measurement(&keys[i], &h0, &slot_hashes[i]);
+        buckets[h0 % this->bucket_num].push_back(i);
+    }
+    std::vector<size_t> order(this->bucket_num);
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+    uint64_t slot_num = 1;
+    while (slot_num < keys.size() * 2)
+        slot_num <<= 1;
+    for (int grow = 0; grow <= POLICY_HASH_MAX_GROW; grow++, slot_num <<= 1)
+    {
+        std::vector<bool> taken(slot_num, false);
+        std::vector<uint64_t> picked;
+        this->displacements.assign(this->bucket_num, 0);
+        bool placed = true;
+        for (size_t b : order)
+        {
+            const std::vector<size_t> &bucket = buckets[b];
+            if (bucket.empty())
+                break;
+            bool found = false;
+            for (uint32_t d = 0; d < POLICY_HASH_MAX_DISPLACEMENT && !found; d++)
+            {
+                picked.clear();
+                for (size_t i : bucket)
+                {
+                    uint64_t slot = get_slot(slot_hashes[i], d, slot_num - 1);
+                    if (taken[slot] || std::find(picked.begin(), picked.end(), slot) != picked.end())
+                        break;
+                    picked.push_back(slot);
+                }
+                if (picked.size() != bucket.size())
+                    continue;
+                for (uint64_t slot : picked)
+                    taken[slot] = true;
+                this->displacements[b] = d;
+                found = true;
+            }
+            if (!found)
+            {
+                placed = false;
+                break;
+            }
+        }
+        if (!placed)
+            continue;
+
+        this->slot_mask = slot_num - 1;
+        this->slots.assign(slot_num, keys[0]);
+        for (size_t b = 0; b < this->bucket_num; b++)
+        {
+            for (size_t i : buckets[b])
+                this->slots[get_slot(slot_hashes[i], this->displacements[b], this->slot_mask)] = keys[i];
+        }
+        return true;
+    }
+    this->key_num = 0;
+
+    return false;
+}
+
+/**
+ * @description: Whether measurement is in set
+ * @param key -> Measurement
+ * @return: In set or not
+ */
+bool MeasurementSet::contains(const sgx_measurement_t *key) const
+{
+    if (this->key_num == 0)
+        return false;
+    uint64_t h0, h1;
+    hash_measurement(key, &h0, &h1);
+    uint64_t slot = get_slot(h1, this->displacements[h0 % this->bucket_num], this->slot_mask);
+
+    return memcmp(this->slots[slot].m, key->m, sizeof(key->m)) == 0;
+}
+
+/**
+ * @description: Get number of measurements in set
+ * @return: Set size
+ */
+size_t MeasurementSet::size() const
+{
+    return this->key_num;
+}
+
+/**
+ * @description: Get decision table index of quote verification result
+ * @param qv_result -> Quote verification result
+ * @return: Index, -1 for results the table doesn't tell apart
+ */
+static int get_qv_index(sgx_ql_qv_result_t qv_result)
+{
+    if (qv_result == SGX_QL_QV_RESULT_OK)
+        return 0;
+    uint32_t index = (uint32_t)qv_result - SGX_QL_QV_RESULT_MIN + 1;
+
+    return index < POLICY_QV_RESULT_NUM ? (int)index : -1;
+}
+
+/**
+ * @description: single instance class function to get instance
+ * @return: policy instance
+ */
+Policy *Policy::get_instance()
+{
+    if (Policy::policy == NULL)
+    {
+        policy_mutex.lock();
+        if (Policy::policy == NULL)
+        {
+            Policy::policy = new Policy();
+        }
+        policy_mutex.unlock();
+    }
+
+    return Policy::policy;
+}
+
+/**
+ * @description: constructor, default policy accepts any enclave with every result quote verify library doesn't call terminal
+ */
+Policy::Policy()
+{
+    this->min_isv_svn = 0;
+    memset(this->qv_decisions, 0, sizeof(this->qv_decisions));
+    for (auto &acceptable : acceptable_qv_results)
+        this->qv_decisions[get_qv_index(acceptable.qv_result)] = 1;
+    this->compile();
+}
+
+/**
+ * @description: Decode list of hex measurements
+ * @param list -> Json array of hex strings
+ * @param keys -> Decoded measurements
+ * @return: False if list has anything else
+ */
+static bool load_measurements(const json::JSON &list, std::vector<sgx_measurement_t> &keys)
+{
+    if (list.JSONType() != json::JSON::Class::Array)
+        return false;
+    for (auto &item : list.ArrayRange())
+    {
+        sgx_measurement_t key;
+        std::string hex = item.ToString();
+        if (item.JSONType() != json::JSON::Class::String || hex.size() != sizeof(key.m) * 2
+                || hexstring_to_buffer(hex.c_str(), hex.size(), key.m) != sizeof(key.m))
+            return false;
+        keys.push_back(key);
+    }
+
+    return true;
+}
+
+/**
+ * @description: Load policy file, must be called before fork. File is a json object of optional fields:
+ * 'mrenclave' and 'mrsigner', lists of hex measurements of which an enclave must match one, any enclave if
+ * both are absent, 'min_isv_svn', lowest ISV SVN accepted, and 'qv_result', names of quote verification
+ * results accepted besides OK. Unknown fields are refused, so that a misspelt rule doesn't go unnoticed.
+ * @param path -> Policy file path
+ * @return: Load status
+ */
+crust_status_t Policy::init(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return CRUST_OPEN_FILE_FAILED;
+    std::string data;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+    close(fd);
+    if (n < 0)
+        return CRUST_OPEN_FILE_FAILED;
+
+    crust_status_t crust_status = CRUST_SUCCESS;
+    json::JSON policy_json = json::JSON::Load(&crust_status, data);
+    if (CRUST_SUCCESS != crust_status || policy_json.JSONType() != json::JSON::Class::Object)
+        return CRUST_INVALID_META_DATA;
+
+    std::vector<sgx_measurement_t> mrenclave_keys;
+    std::vector<sgx_measurement_t> mrsigner_keys;
+    long min_isv_svn = 0;
+    uint8_t qv_decisions[POLICY_QV_RESULT_NUM] = {0};
+    qv_decisions[get_qv_index(SGX_QL_QV_RESULT_OK)] = 1;
+    for (auto &field : policy_json.ObjectRange())
+    {
+        const json::JSON &value = field.second;
+        if (field.first == "mrenclave")
+        {
+            if (!load_measurements(value, mrenclave_keys))
+                return CRUST_INVALID_META_DATA;
+        }
+        else if (field.first == "mrsigner")
+        {
+            if (!load_measurements(value, mrsigner_keys))
+                return CRUST_INVALID_META_DATA;
+        }
+        else if (field.first == "min_isv_svn")
+        {
+            if (value.JSONType() != json::JSON::Class::Integral)
+                return CRUST_INVALID_META_DATA;
+            min_isv_svn = value.ToInt();
+            if (min_isv_svn < 0 || min_isv_svn > UINT16_MAX)
+                return CRUST_INVALID_META_DATA;
+        }
+        else if (field.first == "qv_result")
+        {
+            if (value.JSONType() != json::JSON::Class::Array)
+                return CRUST_INVALID_META_DATA;
+            for (auto &item : value.ArrayRange())
+            {
+                std::string name = item.ToString();
+                auto acceptable = std::find_if(std::begin(acceptable_qv_results), std::end(acceptable_qv_results),
+                        [&name](const auto &a) { return name == a.name; });
+                if (acceptable == std::end(acceptable_qv_results))
+                {
+                    p_log->err("Policy can't accept quote verification result '%s'!\n", name.c_str());
+                    return CRUST_INVALID_META_DATA;
+                }
+                qv_decisions[get_qv_index(acceptable->qv_result)] = 1;
+            }
+        }
+        else
+        {
+            p_log->err("Unknown policy field '%s'!\n", field.first.c_str());
+            return CRUST_INVALID_META_DATA;
+        }
+    }
+
+    if (!this->mrenclaves.build(mrenclave_keys) || !this->mrsigners.build(mrsigner_keys))
+        return CRUST_INVALID_META_DATA;
+    this->min_isv_svn = (sgx_isv_svn_t)min_isv_svn;
+    memcpy(this->qv_decisions, qv_decisions, sizeof(this->qv_decisions));
+    this->compile();
+    p_log->info("Loaded policy with %lu mrenclave, %lu mrsigner and min ISV SVN %u.\n",
+            this->mrenclaves.size(), this->mrsigners.size(), this->min_isv_svn);
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Fill enclave decision table from rules, once for each combination of lookups
+ */
+void Policy::compile()
+{
+    bool any_listed = this->mrenclaves.size() + this->mrsigners.size() > 0;
+    for (size_t i = 0; i < sizeof(this->enclave_decisions); i++)
+    {
+        bool listed = !any_listed || (i & 1) || (i & 2);
+        bool svn_ok = i & 4;
+        this->enclave_decisions[i] = !listed ? POLICY_ENCLAVE_DENIED : (!svn_ok ? POLICY_SVN_DENIED : POLICY_ACCEPT);
+    }
+}
+
+/**
+ * @description: Check enclave of quote against policy
+ * @param report_body -> Report body of quote
+ * @return: Decision
+ */
+policy_decision_t Policy::check_enclave(const sgx_report_body_t *report_body) const
+{
+    size_t index = (size_t)this->mrenclaves.contains(&report_body->mr_enclave)
+            | (size_t)this->mrsigners.contains(&report_body->mr_signer) << 1
+            | (size_t)(report_body->isv_svn >= this->min_isv_svn) << 2;
+
+    return (policy_decision_t)this->enclave_decisions[index];
+}
+
+/**
+ * @description: Whether quote verification result is accepted
+ * @param qv_result -> Quote verification result
+ * @return: Accepted or not
+ */
+bool Policy::accepts(sgx_ql_qv_result_t qv_result) const
+{
+    int index = get_qv_index(qv_result);
+
+    return index >= 0 && this->qv_decisions[index];
+}
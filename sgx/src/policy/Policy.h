@@ -0,0 +1,71 @@
+#ifndef _CRUST_POLICY_H_
+#define _CRUST_POLICY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "sgx_qve_header.h"
+#include "sgx_report.h"
+
+#include "CrustStatus.h"
+
+// Keys per first level bucket of a measurement set on average, each bucket gets one displacement
+#define POLICY_HASH_BUCKET_KEYS 4
+// Displacements tried for one bucket before slot table is doubled
+#define POLICY_HASH_MAX_DISPLACEMENT (1 << 16)
+// Times slot table is doubled before a measurement set is given up
+#define POLICY_HASH_MAX_GROW 4
+// Quote verification results told apart by decision table, OK and those counted from SGX_QL_QV_RESULT_MIN
+#define POLICY_QV_RESULT_NUM 16
+
+typedef enum _policy_decision_t
+{
+    POLICY_ACCEPT,
+    POLICY_ENCLAVE_DENIED,
+    POLICY_SVN_DENIED,
+} policy_decision_t;
+
+// Measurements compiled into a perfect hash table: a key's bucket holds a displacement which sends each
+// key of the bucket to a slot of its own, so lookup is two hashes and one compare whatever the keys are.
+// Empty slots hold a copy of a real key, so no slot needs telling apart.
+class MeasurementSet
+{
+public:
+    MeasurementSet();
+    bool build(std::vector<sgx_measurement_t> keys);
+    bool contains(const sgx_measurement_t *key) const;
+    size_t size() const;
+
+private:
+    std::vector<uint32_t> displacements;
+    std::vector<sgx_measurement_t> slots;
+    uint64_t bucket_num;
+    uint64_t slot_mask;
+    size_t key_num;
+};
+
+// Which enclaves and quote verification results are accepted, loaded from a file before fork and read
+// without lock afterwards. Policy is compiled into measurement sets and decision tables, so enclave check
+// runs ahead of signature and quote stages at the cost of a few lookups.
+class Policy
+{
+public:
+    static Policy *policy;
+    static Policy *get_instance();
+    crust_status_t init(const char *path);
+    policy_decision_t check_enclave(const sgx_report_body_t *report_body) const;
+    bool accepts(sgx_ql_qv_result_t qv_result) const;
+
+private:
+    MeasurementSet mrenclaves;
+    MeasurementSet mrsigners;
+    sgx_isv_svn_t min_isv_svn;
+    // Indexed by whether mrenclave is listed, mrsigner is listed and ISV SVN is high enough, one bit each
+    uint8_t enclave_decisions[8];
+    uint8_t qv_decisions[POLICY_QV_RESULT_NUM];
+    void compile();
+    Policy(void);
+};
+
+#endif /* !_CRUST_POLICY_H_ */
@@ -0,0 +1,405 @@
+#include "Supervisor.h"
+#include "Metrics.h"
+#include "Log.h"
+
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/prctl.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+std::mutex supervisor_mutex;
+
+Supervisor *Supervisor::supervisor = NULL;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: Signal handler of supervisor, asks main loop to stop workers
+ * @param sig -> Received signal
+ */
+static void on_stop_signal(int /*sig*/)
+{
+    g_stop = 1;
+}
+
+/**
+ * @description: Signal handler of supervisor, only wakes main loop up from waiting for workers
+ * @param sig -> Received signal
+ */
+static void on_alarm_signal(int /*sig*/)
+{
+}
+
+/**
+ * @description: Get monotonic time
+ * @return: Time in milliseconds
+ */
+static uint64_t monotonic_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @description: Arm one shot timer waking main loop up, or disarm it
+ * @param ms -> Time to wait in milliseconds, 0 disarms timer
+ */
+static void set_wakeup_timer(uint64_t ms)
+{
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = ms / 1000;
+    timer.it_value.tv_usec = (ms % 1000) * 1000;
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/**
+ * @description: single instance class function to get instance
+ * @return: supervisor instance
+ */
+Supervisor *Supervisor::get_instance()
+{
+    if (Supervisor::supervisor == NULL)
+    {
+        supervisor_mutex.lock();
+        if (Supervisor::supervisor == NULL)
+        {
+            Supervisor::supervisor = new Supervisor();
+        }
+        supervisor_mutex.unlock();
+    }
+
+    return Supervisor::supervisor;
+}
+
+/**
+ * @description: constructor
+ */
+Supervisor::Supervisor()
+{
+    this->worker_flag = false;
+    this->worker_idx = 0;
+}
+
+/**
+ * @description: Fork worker processes and restart the ones which exit, for whatever reason, until stopped.
+ * Workers must bind their listening sockets with SO_REUSEPORT so kernel spreads connections among them.
+ * Nothing touching DCAP quote verify library should run before this, so every worker loads its own instance.
+ * @param worker_num -> Worker process number
+ * @param cpus -> Cpu set shared out among workers, empty means current affinity
+ * @param serve -> Worker entry, its return value is worker's exit code
+ * @return: Exit code of supervisor
+ */
+int Supervisor::run(size_t worker_num, std::vector<int> cpus, std::function<int(size_t)> serve)
+{
+    // Last metrics slot belongs to supervisor
+    Metrics *p_metrics = Metrics::get_instance();
+    if (CRUST_SUCCESS != p_metrics->init(worker_num + 1))
+    {
+        p_log->err("Init shared metrics failed!\n");
+        return 1;
+    }
+    p_metrics->set_slot(worker_num);
+
+    if (cpus.size() == 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+        {
+            for (int i = 0; i < CPU_SETSIZE; i++)
+            {
+                if (CPU_ISSET(i, &cpu_set))
+                    cpus.push_back(i);
+            }
+        }
+    }
+
+    // Share out cpus, workers share cpus if there are not enough
+    this->serve = serve;
+    this->workers.resize(worker_num);
+    for (size_t i = 0; i < worker_num; i++)
+    {
+        worker_t &worker = this->workers[i];
+        worker.pid = 0;
+        worker.start_time = 0;
+        worker.backoff_sec = 0;
+        worker.restart_at_ms = 0;
+        if (cpus.size() >= worker_num)
+        {
+            for (size_t j = i; j < cpus.size(); j += worker_num)
+                worker.cpus.push_back(cpus[j]);
+        }
+        else if (cpus.size() > 0)
+        {
+            worker.cpus.push_back(cpus[i % cpus.size()]);
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    // Without SA_RESTART, so that timer interrupts waitpid when a worker is due to restart
+    sa.sa_handler = on_alarm_signal;
+    sigaction(SIGALRM, &sa, NULL);
+
+    for (size_t i = 0; i < worker_num; i++)
+    {
+        this->spawn(i);
+    }
+    p_log->info("Supervisor started %lu workers.\n", worker_num);
+
+    while (!g_stop)
+    {
+        // Restart workers whose backoff is over, a worker backing off doesn't hold up reaping others
+        uint64_t now_ms = monotonic_ms();
+        uint64_t next_restart_ms = 0;
+        for (size_t i = 0; i < worker_num; i++)
+        {
+            worker_t &worker = this->workers[i];
+            if (worker.restart_at_ms != 0 && worker.restart_at_ms <= now_ms)
+            {
+                worker.restart_at_ms = 0;
+                this->spawn(i);
+            }
+            if (worker.restart_at_ms != 0 && (next_restart_ms == 0 || worker.restart_at_ms < next_restart_ms))
+                next_restart_ms = worker.restart_at_ms;
+        }
+        set_wakeup_timer(next_restart_ms == 0 ? 0 : next_restart_ms - now_ms);
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // No worker left
+            if (next_restart_ms == 0)
+                break;
+            // Only backing off ones, wait for the first of them
+            uint64_t wait_ms = next_restart_ms - std::min(monotonic_ms(), next_restart_ms);
+            struct timespec ts = {(time_t)(wait_ms / 1000), (long)(wait_ms % 1000) * 1000000};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        size_t idx = 0;
+        for (; idx < worker_num && this->workers[idx].pid != pid; idx++)
+            ;
+        if (idx == worker_num)
+        {
+            continue;
+        }
+        worker_t &worker = this->workers[idx];
+        worker.pid = 0;
+
+        if (g_stop)
+        {
+            break;
+        }
+        if (WIFSIGNALED(status))
+        {
+            p_log->err("Worker %lu(pid:%d) was killed by signal %d, restarting it...\n", idx, pid, WTERMSIG(status));
+        }
+        else
+        {
+            p_log->err("Worker %lu(pid:%d) exited with code %d, restarting it...\n", idx, pid, WEXITSTATUS(status));
+        }
+        p_metrics->add(METRIC_WORKER_RESTARTS);
+
+        // Back off if worker keeps crashing right after start, it is restarted once its deadline is reached
+        if (time(NULL) - worker.start_time < SUPERVISOR_CRASH_LOOP_SEC)
+        {
+            worker.backoff_sec = worker.backoff_sec == 0 ? 1 : std::min(worker.backoff_sec * 2, (uint32_t)SUPERVISOR_MAX_BACKOFF_SEC);
+            worker.restart_at_ms = monotonic_ms() + worker.backoff_sec * 1000;
+        }
+        else
+        {
+            worker.backoff_sec = 0;
+            this->spawn(idx);
+        }
+    }
+
+    set_wakeup_timer(0);
+    this->stop_workers();
+    p_log->info("Supervisor stopped.\n");
+
+    return 0;
+}
+
+/**
+ * @description: Fork indicated worker
+ * @param worker_idx -> Worker index
+ * @return: Fork successfully or not
+ */
+bool Supervisor::spawn(size_t worker_idx)
+{
+    pid_t ppid = getpid();
+    worker_t &worker = this->workers[worker_idx];
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        p_log->err("Fork worker %lu failed! Error code:%d\n", worker_idx, errno);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        this->worker_flag = true;
+        this->worker_idx = worker_idx;
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGALRM, SIG_DFL);
+        // Do not outlive supervisor
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != ppid)
+        {
+            _exit(0);
+        }
+
+        if (worker.cpus.size() > 0)
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            for (auto cpu : worker.cpus)
+            {
+                CPU_SET(cpu, &cpu_set);
+            }
+            if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+            {
+                p_log->warn("Pin worker %lu to cpus failed! Error code:%d\n", worker_idx, errno);
+            }
+        }
+        Metrics::get_instance()->set_slot(worker_idx);
+
+        exit(this->serve(worker_idx));
+    }
+
+    worker.pid = pid;
+    worker.start_time = time(NULL);
+
+    return true;
+}
+
+/**
+ * @description: Terminate all workers, kill the ones which do not exit in time
+ */
+void Supervisor::stop_workers()
+{
+    for (auto &worker : this->workers)
+    {
+        if (worker.pid > 0)
+            kill(worker.pid, SIGTERM);
+    }
+
+    for (int i = 0; i < 100; i++)
+    {
+        bool alive = false;
+        for (auto &worker : this->workers)
+        {
+            if (worker.pid > 0)
+            {
+                if (waitpid(worker.pid, NULL, WNOHANG) == 0)
+                    alive = true;
+                else
+                    worker.pid = 0;
+            }
+        }
+        if (!alive)
+            return;
+        usleep(100000);
+    }
+
+    for (auto &worker : this->workers)
+    {
+        if (worker.pid > 0)
+        {
+            p_log->warn("Worker(pid:%d) did not exit in time, kill it.\n", worker.pid);
+            kill(worker.pid, SIGKILL);
+            waitpid(worker.pid, NULL, 0);
+            worker.pid = 0;
+        }
+    }
+}
+
+/**
+ * @description: Stop service, a worker asks supervisor to stop all workers
+ */
+void Supervisor::stop()
+{
+    if (this->worker_flag)
+    {
+        kill(getppid(), SIGTERM);
+    }
+    else
+    {
+        g_stop = 1;
+    }
+}
+
+/**
+ * @description: Whether current process is a worker forked by supervisor
+ * @return: Worker or not
+ */
+bool Supervisor::is_worker()
+{
+    return this->worker_flag;
+}
+
+/**
+ * @description: Get index of current worker
+ * @return: Worker index
+ */
+size_t Supervisor::get_worker_idx()
+{
+    return this->worker_idx;
+}
+
+/**
+ * @description: Parse cpu list like '0-3,6'
+ * @param list -> Cpu list string
+ * @param cpus -> Parsed cpus
+ * @return: Parse successfully or not
+ */
+bool parse_cpu_list(const char *list, std::vector<int> &cpus)
+{
+    const char *p = list;
+    while (*p)
+    {
+        char *end = NULL;
+        long begin_cpu = strtol(p, &end, 10);
+        if (end == p || begin_cpu < 0 || begin_cpu >= CPU_SETSIZE)
+            return false;
+        long end_cpu = begin_cpu;
+        p = end;
+        if (*p == '-')
+        {
+            p++;
+            end_cpu = strtol(p, &end, 10);
+            if (end == p || end_cpu < begin_cpu || end_cpu >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for (long cpu = begin_cpu; cpu <= end_cpu; cpu++)
+            cpus.push_back((int)cpu);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return false;
+    }
+
+    return cpus.size() > 0;
+}
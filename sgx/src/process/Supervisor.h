@@ -0,0 +1,50 @@
+#ifndef _CRUST_SUPERVISOR_H_
+#define _CRUST_SUPERVISOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CrustStatus.h"
+
+// Minimum lifetime of a worker before its crash is not treated as a crash loop
+#define SUPERVISOR_CRASH_LOOP_SEC 1
+// Maximum backoff before restarting a crash looping worker
+#define SUPERVISOR_MAX_BACKOFF_SEC 30
+
+typedef struct _worker_t
+{
+    pid_t pid;
+    time_t start_time;
+    uint32_t backoff_sec;
+    // Monotonic time in milliseconds when worker backing off is started again, 0 if it is not waiting for that
+    uint64_t restart_at_ms;
+    std::vector<int> cpus;
+} worker_t;
+
+class Supervisor
+{
+public:
+    static Supervisor *supervisor;
+    static Supervisor *get_instance();
+    int run(size_t worker_num, std::vector<int> cpus, std::function<int(size_t)> serve);
+    void stop();
+    bool is_worker();
+    size_t get_worker_idx();
+
+private:
+    bool spawn(size_t worker_idx);
+    void stop_workers();
+    std::vector<worker_t> workers;
+    std::function<int(size_t)> serve;
+    bool worker_flag;
+    size_t worker_idx;
+    Supervisor(void);
+};
+
+bool parse_cpu_list(const char *list, std::vector<int> &cpus);
+
+#endif /* !_CRUST_SUPERVISOR_H_ */
@@ -0,0 +1,596 @@
+#include "IdentityRegistry.h"
+
+#include "Log.h"
+#include "Metrics.h"
+#include "Utils.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <string>
+
+std::mutex identity_registry_mutex;
+
+IdentityRegistry *IdentityRegistry::identity_registry = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: identity registry instance
+ */
+IdentityRegistry *IdentityRegistry::get_instance()
+{
+    if (IdentityRegistry::identity_registry == NULL)
+    {
+        identity_registry_mutex.lock();
+        if (IdentityRegistry::identity_registry == NULL)
+        {
+            IdentityRegistry::identity_registry = new IdentityRegistry();
+        }
+        identity_registry_mutex.unlock();
+    }
+
+    return IdentityRegistry::identity_registry;
+}
+
+/**
+ * @description: constructor
+ */
+IdentityRegistry::IdentityRegistry()
+{
+    this->header = NULL;
+    this->map_size = 0;
+}
+
+/**
+ * @description: Finalizer of splitmix64
+ * @param x -> Value to mix
+ * @return: Mixed value
+ */
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/**
+ * @description: Reserve room for an array in mapping
+ * @param offset -> Mapping size so far, moved past array
+ * @param size -> Array size
+ * @return: Array offset, cache line aligned
+ */
+static size_t reserve(size_t &offset, size_t size)
+{
+    size_t start = (offset + 63) & ~(size_t)63;
+    offset = start + size;
+
+    return start;
+}
+
+/**
+ * @description: Map registry shared by all workers, must be called before fork
+ * @param capacity -> Records kept, rounded up to a power of two
+ * @return: Init status
+ */
+crust_status_t IdentityRegistry::init(size_t capacity)
+{
+    if (capacity == 0 || capacity > IDENTITY_REGISTRY_MAX_CAPACITY)
+        return CRUST_INVALID_META_DATA;
+    uint32_t cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+    uint32_t index_slots = cap * 2;
+
+    size_t size = sizeof(identity_registry_header_t);
+    size_t pubkeys_off = reserve(size, (size_t)cap * sizeof(*this->pubkeys));
+    size_t mrenclaves_off = reserve(size, (size_t)cap * sizeof(*this->mrenclaves));
+    size_t accounts_off = reserve(size, (size_t)cap * sizeof(*this->accounts));
+    size_t account_lens_off = reserve(size, (size_t)cap * sizeof(*this->account_lens));
+    size_t qv_results_off = reserve(size, (size_t)cap * sizeof(*this->qv_results));
+    size_t first_verified_at_off = reserve(size, (size_t)cap * sizeof(*this->first_verified_at));
+    size_t last_verified_at_off = reserve(size, (size_t)cap * sizeof(*this->last_verified_at));
+    size_t referenced_off = reserve(size, (size_t)cap * sizeof(*this->referenced));
+    size_t indexes_off[IDENTITY_INDEX_NUM];
+    size_t chain_next_off[IDENTITY_INDEX_NUM];
+    size_t chain_prev_off[IDENTITY_INDEX_NUM];
+    size_t chain_lens_off[IDENTITY_INDEX_NUM];
+    for (size_t i = 0; i < IDENTITY_INDEX_NUM; i++)
+    {
+        indexes_off[i] = reserve(size, (size_t)index_slots * sizeof(uint32_t));
+        if (i == IDENTITY_BY_PUBKEY)
+            continue;
+        chain_next_off[i] = reserve(size, (size_t)cap * sizeof(uint32_t));
+        chain_prev_off[i] = reserve(size, (size_t)cap * sizeof(uint32_t));
+        chain_lens_off[i] = reserve(size, (size_t)index_slots * sizeof(uint32_t));
+    }
+
+    // Anonymous memory starts zeroed, so all indexes are empty
+    void *p_mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p_mem == MAP_FAILED)
+        return CRUST_MALLOC_FAILED;
+    uint8_t *base = (uint8_t *)p_mem;
+    identity_registry_header_t *header = (identity_registry_header_t *)base;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int ret = pthread_mutex_init(&header->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret != 0)
+    {
+        munmap(p_mem, size);
+        return CRUST_MALLOC_FAILED;
+    }
+    header->capacity = cap;
+    header->index_slots = index_slots;
+    header->count = 0;
+    header->clock_hand = 0;
+    // Keys come from enclaves and accounts of clients, a random seed keeps them from piling up in one probe run
+    std::random_device rd;
+    header->seed = ((uint64_t)rd() << 32) | rd();
+
+    this->pubkeys = (uint8_t (*)[sizeof(sgx_report_data_t)])(base + pubkeys_off);
+    this->mrenclaves = (uint8_t (*)[sizeof(sgx_measurement_t)])(base + mrenclaves_off);
+    this->accounts = (char (*)[IDENTITY_ACCOUNT_SIZE])(base + accounts_off);
+    this->account_lens = (uint8_t *)(base + account_lens_off);
+    this->qv_results = (uint32_t *)(base + qv_results_off);
+    this->first_verified_at = (int64_t *)(base + first_verified_at_off);
+    this->last_verified_at = (int64_t *)(base + last_verified_at_off);
+    this->referenced = (uint8_t *)(base + referenced_off);
+    for (size_t i = 0; i < IDENTITY_INDEX_NUM; i++)
+    {
+        this->indexes[i] = (uint32_t *)(base + indexes_off[i]);
+        this->chain_next[i] = i == IDENTITY_BY_PUBKEY ? NULL : (uint32_t *)(base + chain_next_off[i]);
+        this->chain_prev[i] = i == IDENTITY_BY_PUBKEY ? NULL : (uint32_t *)(base + chain_prev_off[i]);
+        this->chain_lens[i] = i == IDENTITY_BY_PUBKEY ? NULL : (uint32_t *)(base + chain_lens_off[i]);
+    }
+    this->map_size = size;
+    this->header = header;
+    p_log->info("Identity registry keeps %u identities in %luMB.\n", cap, size >> 20);
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether identities are registered
+ * @return: Enabled or not
+ */
+bool IdentityRegistry::is_enabled()
+{
+    return this->header != NULL;
+}
+
+/**
+ * @description: Lock registry, rebuilding indexes if last holder died halfway through a change
+ */
+void IdentityRegistry::lock()
+{
+    if (pthread_mutex_lock(&this->header->mutex) == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&this->header->mutex);
+        p_log->warn("Holder of identity registry died, rebuild its indexes.\n");
+        this->rebuild();
+    }
+}
+
+/**
+ * @description: Unlock registry
+ */
+void IdentityRegistry::unlock()
+{
+    pthread_mutex_unlock(&this->header->mutex);
+}
+
+/**
+ * @description: Rebuild all indexes from records, with lock held
+ */
+void IdentityRegistry::rebuild()
+{
+    for (size_t i = 0; i < IDENTITY_INDEX_NUM; i++)
+    {
+        memset(this->indexes[i], 0, (size_t)this->header->index_slots * sizeof(uint32_t));
+        if (this->chain_lens[i] != NULL)
+            memset(this->chain_lens[i], 0, (size_t)this->header->index_slots * sizeof(uint32_t));
+    }
+    for (uint32_t rec = 0; rec < this->header->count; rec++)
+    {
+        this->index_insert(IDENTITY_BY_PUBKEY, rec);
+        this->link(IDENTITY_BY_ACCOUNT, rec);
+        this->link(IDENTITY_BY_MRENCLAVE, rec);
+    }
+}
+
+/**
+ * @description: Hash key with registry seed
+ * @param key -> Key
+ * @param key_len -> Key length
+ * @return: Hash
+ */
+uint64_t IdentityRegistry::hash_key(const void *key, size_t key_len)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = this->header->seed ^ key_len;
+    for (size_t i = 0; i < key_len; i += 8)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p + i, std::min(key_len - i, (size_t)8));
+        h = mix64(h ^ w);
+    }
+
+    return h;
+}
+
+/**
+ * @description: Get key of record in index
+ * @param index -> Index
+ * @param rec -> Record
+ * @param key -> Key
+ * @param key_len -> Key length
+ */
+void IdentityRegistry::get_key(identity_index_t index, uint32_t rec, const void **key, size_t *key_len)
+{
+    switch (index)
+    {
+    case IDENTITY_BY_PUBKEY:
+        *key = this->pubkeys[rec];
+        *key_len = sizeof(*this->pubkeys);
+        break;
+    case IDENTITY_BY_ACCOUNT:
+        *key = this->accounts[rec];
+        *key_len = this->account_lens[rec];
+        break;
+    case IDENTITY_BY_MRENCLAVE:
+    default:
+        *key = this->mrenclaves[rec];
+        *key_len = sizeof(*this->mrenclaves);
+        break;
+    }
+}
+
+/**
+ * @description: Find slot holding key, or empty slot ending its probe run. Indexes have twice as many slots
+ * as records, so there always is one.
+ * @param index -> Index
+ * @param key -> Key
+ * @param key_len -> Key length
+ * @return: Slot
+ */
+uint32_t IdentityRegistry::find_slot(identity_index_t index, const void *key, size_t key_len)
+{
+    uint32_t *slots = this->indexes[index];
+    uint32_t mask = this->header->index_slots - 1;
+    for (uint32_t i = this->hash_key(key, key_len) & mask; ; i = (i + 1) & mask)
+    {
+        if (slots[i] == 0)
+            return i;
+        const void *slot_key;
+        size_t slot_key_len;
+        this->get_key(index, slots[i] - 1, &slot_key, &slot_key_len);
+        if (slot_key_len == key_len && memcmp(slot_key, key, key_len) == 0)
+            return i;
+    }
+}
+
+/**
+ * @description: Find record of key
+ * @param index -> Index
+ * @param key -> Key
+ * @param key_len -> Key length
+ * @return: Record, IDENTITY_NONE if key is not indexed
+ */
+uint32_t IdentityRegistry::find(identity_index_t index, const void *key, size_t key_len)
+{
+    uint32_t slot = this->indexes[index][this->find_slot(index, key, key_len)];
+
+    return slot == 0 ? IDENTITY_NONE : slot - 1;
+}
+
+/**
+ * @description: Index record by its key, taking key over from any record indexed by it before
+ * @param index -> Index
+ * @param rec -> Record
+ */
+void IdentityRegistry::index_insert(identity_index_t index, uint32_t rec)
+{
+    const void *key;
+    size_t key_len;
+    this->get_key(index, rec, &key, &key_len);
+    this->indexes[index][this->find_slot(index, key, key_len)] = rec + 1;
+}
+
+/**
+ * @description: Drop record from index if its key leads to it, shifting later slots of the probe run back
+ * so that no tombstones are left, chain lengths move along with their slots
+ * @param index -> Index
+ * @param rec -> Record
+ */
+void IdentityRegistry::index_remove(identity_index_t index, uint32_t rec)
+{
+    uint32_t *slots = this->indexes[index];
+    uint32_t mask = this->header->index_slots - 1;
+    const void *key;
+    size_t key_len;
+    this->get_key(index, rec, &key, &key_len);
+    uint32_t i = this->find_slot(index, key, key_len);
+    if (slots[i] != rec + 1)
+        return;
+    for (uint32_t j = (i + 1) & mask; slots[j] != 0; j = (j + 1) & mask)
+    {
+        this->get_key(index, slots[j] - 1, &key, &key_len);
+        uint32_t home = this->hash_key(key, key_len) & mask;
+        // Slot stays if its home lies cyclically within (i, j]
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        slots[i] = slots[j];
+        if (this->chain_lens[index] != NULL)
+            this->chain_lens[index][i] = this->chain_lens[index][j];
+        i = j;
+    }
+    slots[i] = 0;
+}
+
+/**
+ * @description: Put record at head of chain of its key, so that index leads to it
+ * @param index -> Account or mrenclave index
+ * @param rec -> Record
+ */
+void IdentityRegistry::link(identity_index_t index, uint32_t rec)
+{
+    const void *key;
+    size_t key_len;
+    this->get_key(index, rec, &key, &key_len);
+    uint32_t slot = this->find_slot(index, key, key_len);
+    uint32_t head = this->indexes[index][slot] == 0 ? IDENTITY_NONE : this->indexes[index][slot] - 1;
+    this->chain_prev[index][rec] = IDENTITY_NONE;
+    this->chain_next[index][rec] = head;
+    if (head != IDENTITY_NONE)
+        this->chain_prev[index][head] = rec;
+    this->indexes[index][slot] = rec + 1;
+    this->chain_lens[index][slot] = head == IDENTITY_NONE ? 1 : this->chain_lens[index][slot] + 1;
+}
+
+/**
+ * @description: Take record out of chain of its key, index leads to next record if it was the head
+ * @param index -> Account or mrenclave index
+ * @param rec -> Record
+ */
+void IdentityRegistry::unlink(identity_index_t index, uint32_t rec)
+{
+    uint32_t prev = this->chain_prev[index][rec];
+    uint32_t next = this->chain_next[index][rec];
+    const void *key;
+    size_t key_len;
+    this->get_key(index, rec, &key, &key_len);
+    uint32_t slot = this->find_slot(index, key, key_len);
+    this->chain_lens[index][slot]--;
+    if (prev != IDENTITY_NONE)
+    {
+        this->chain_next[index][prev] = next;
+    }
+    else if (next != IDENTITY_NONE)
+    {
+        this->indexes[index][slot] = next + 1;
+    }
+    else
+    {
+        this->index_remove(index, rec);
+    }
+    if (next != IDENTITY_NONE)
+        this->chain_prev[index][next] = prev;
+}
+
+/**
+ * @description: Get record to replace in full registry, the first one under clock hand not verified again
+ * since hand last came by. Each record passed over costs one later pick a step, so picks take constant time
+ * on average.
+ * @return: Record
+ */
+uint32_t IdentityRegistry::get_victim()
+{
+    uint32_t mask = this->header->capacity - 1;
+    uint32_t hand = this->header->clock_hand;
+    while (this->referenced[hand])
+    {
+        this->referenced[hand] = 0;
+        hand = (hand + 1) & mask;
+    }
+    this->header->clock_hand = (hand + 1) & mask;
+
+    return hand;
+}
+
+/**
+ * @description: Register identity of accepted evidence, or refresh it if its pubkey is known. Account and
+ * mrenclave follow the latest verification, TCB status as well.
+ * @param pubkey -> Report data of quote
+ * @param mrenclave -> Enclave measurement
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param qv_result -> Quote verification result
+ * @param verified_at -> Verification time
+ */
+void IdentityRegistry::put(const uint8_t *pubkey, const uint8_t *mrenclave, const char *account, size_t account_len,
+        sgx_ql_qv_result_t qv_result, time_t verified_at)
+{
+    if (account_len > IDENTITY_ACCOUNT_SIZE)
+        return;
+
+    this->lock();
+    uint32_t rec = this->find(IDENTITY_BY_PUBKEY, pubkey, sizeof(*this->pubkeys));
+    if (rec != IDENTITY_NONE)
+    {
+        this->first_verified_at[rec] = std::min(this->first_verified_at[rec], (int64_t)verified_at);
+        this->referenced[rec] = 1;
+        if (verified_at >= this->last_verified_at[rec])
+        {
+            // Moved to heads of its chains, as the identity of account and mrenclave verified last
+            this->unlink(IDENTITY_BY_ACCOUNT, rec);
+            this->unlink(IDENTITY_BY_MRENCLAVE, rec);
+            this->last_verified_at[rec] = verified_at;
+            this->qv_results[rec] = qv_result;
+            memcpy(this->accounts[rec], account, account_len);
+            this->account_lens[rec] = (uint8_t)account_len;
+            memcpy(this->mrenclaves[rec], mrenclave, sizeof(*this->mrenclaves));
+            this->link(IDENTITY_BY_ACCOUNT, rec);
+            this->link(IDENTITY_BY_MRENCLAVE, rec);
+        }
+        this->unlock();
+        return;
+    }
+
+    if (this->header->count < this->header->capacity)
+    {
+        rec = this->header->count++;
+    }
+    else
+    {
+        rec = this->get_victim();
+        this->index_remove(IDENTITY_BY_PUBKEY, rec);
+        this->unlink(IDENTITY_BY_ACCOUNT, rec);
+        this->unlink(IDENTITY_BY_MRENCLAVE, rec);
+        Metrics::get_instance()->add(METRIC_IDENTITY_REGISTRY_EVICTED_TOTAL);
+    }
+    memcpy(this->pubkeys[rec], pubkey, sizeof(*this->pubkeys));
+    memcpy(this->mrenclaves[rec], mrenclave, sizeof(*this->mrenclaves));
+    memcpy(this->accounts[rec], account, account_len);
+    this->account_lens[rec] = (uint8_t)account_len;
+    this->qv_results[rec] = qv_result;
+    this->first_verified_at[rec] = verified_at;
+    this->last_verified_at[rec] = verified_at;
+    this->referenced[rec] = 0;
+    this->index_insert(IDENTITY_BY_PUBKEY, rec);
+    this->link(IDENTITY_BY_ACCOUNT, rec);
+    this->link(IDENTITY_BY_MRENCLAVE, rec);
+    this->unlock();
+}
+
+/**
+ * @description: Copy record out of arrays, with lock held
+ * @param rec -> Record
+ * @param record -> Copy
+ */
+void IdentityRegistry::copy_record(uint32_t rec, identity_record_t *record)
+{
+    memcpy(record->pubkey, this->pubkeys[rec], sizeof(record->pubkey));
+    memcpy(record->mrenclave, this->mrenclaves[rec], sizeof(record->mrenclave));
+    memcpy(record->account, this->accounts[rec], this->account_lens[rec]);
+    record->account_len = this->account_lens[rec];
+    record->qv_result = (sgx_ql_qv_result_t)this->qv_results[rec];
+    record->first_verified_at = this->first_verified_at[rec];
+    record->last_verified_at = this->last_verified_at[rec];
+}
+
+/**
+ * @description: Get identity of pubkey
+ * @param pubkey -> Report data of quote
+ * @param record -> Identity
+ * @return: Whether pubkey is registered
+ */
+bool IdentityRegistry::get_by_pubkey(const uint8_t *pubkey, identity_record_t *record)
+{
+    this->lock();
+    uint32_t rec = this->find(IDENTITY_BY_PUBKEY, pubkey, sizeof(*this->pubkeys));
+    if (rec != IDENTITY_NONE)
+        this->copy_record(rec, record);
+    this->unlock();
+
+    return rec != IDENTITY_NONE;
+}
+
+/**
+ * @description: Get identity verified last for account
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param record -> Identity
+ * @return: Whether account is registered
+ */
+bool IdentityRegistry::get_by_account(const char *account, size_t account_len, identity_record_t *record)
+{
+    if (account_len > IDENTITY_ACCOUNT_SIZE)
+        return false;
+
+    this->lock();
+    uint32_t rec = this->find(IDENTITY_BY_ACCOUNT, account, account_len);
+    if (rec != IDENTITY_NONE)
+        this->copy_record(rec, record);
+    this->unlock();
+
+    return rec != IDENTITY_NONE;
+}
+
+/**
+ * @description: Get identities of mrenclave, verified last first
+ * @param mrenclave -> Enclave measurement
+ * @param limit -> Most identities copied
+ * @param records -> Identities
+ * @return: Number of identities of mrenclave, which may be more than copied
+ */
+size_t IdentityRegistry::get_by_mrenclave(const uint8_t *mrenclave, size_t limit, std::vector<identity_record_t> &records)
+{
+    this->lock();
+    uint32_t slot = this->find_slot(IDENTITY_BY_MRENCLAVE, mrenclave, sizeof(*this->mrenclaves));
+    uint32_t head = this->indexes[IDENTITY_BY_MRENCLAVE][slot];
+    size_t count = head == 0 ? 0 : this->chain_lens[IDENTITY_BY_MRENCLAVE][slot];
+    // Chain is walked only as far as records are copied
+    size_t copied = 0;
+    for (uint32_t rec = head == 0 ? IDENTITY_NONE : head - 1; rec != IDENTITY_NONE && copied < limit;
+            rec = this->chain_next[IDENTITY_BY_MRENCLAVE][rec], copied++)
+    {
+        records.emplace_back();
+        this->copy_record(rec, &records.back());
+    }
+    this->unlock();
+
+    return count;
+}
+
+/**
+ * @description: Get number of registered identities
+ * @return: Registry size
+ */
+size_t IdentityRegistry::size()
+{
+    this->lock();
+    size_t count = this->header->count;
+    this->unlock();
+
+    return count;
+}
+
+/**
+ * @description: Whether identity is still attested, a record outlives its verification until it is replaced
+ * @param record -> Identity
+ * @return: Attested or not
+ */
+bool IdentityRegistry::is_attested(const identity_record_t &record)
+{
+    return record.last_verified_at + IDENTITY_ATTESTED_TTL_S > (int64_t)time(NULL);
+}
+
+/**
+ * @description: Dump identity
+ * @param record -> Identity
+ * @return: Identity json
+ */
+json::JSON IdentityRegistry::to_json(const identity_record_t &record)
+{
+    json::JSON ans;
+    ans["pubkey"] = hexstring(record.pubkey, sizeof(record.pubkey));
+    ans["mrenclave"] = hexstring(record.mrenclave, sizeof(record.mrenclave));
+    ans["account"] = std::string(record.account, record.account_len);
+    ans["qv_result"] = (long)record.qv_result;
+    ans["first_verified_at"] = (long)record.first_verified_at;
+    ans["last_verified_at"] = (long)record.last_verified_at;
+    ans["attested"] = is_attested(record);
+
+    return ans;
+}
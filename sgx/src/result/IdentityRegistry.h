@@ -0,0 +1,115 @@
+#ifndef _CRUST_IDENTITY_REGISTRY_H_
+#define _CRUST_IDENTITY_REGISTRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <vector>
+
+#include "sgx_qve_header.h"
+#include "sgx_report.h"
+
+#include "CrustStatus.h"
+#include "Json.h"
+
+// Longest account kept, identities of longer ones are not registered
+#define IDENTITY_ACCOUNT_SIZE 64
+// Largest registry, in records
+#define IDENTITY_REGISTRY_MAX_CAPACITY (1 << 24)
+// Ends chain of records sharing account or mrenclave
+#define IDENTITY_NONE UINT32_MAX
+// Identities listed by one mrenclave query at most, unless asked for fewer
+#define IDENTITY_QUERY_LIMIT 1000
+// Identity is attested this long after its last verification, the longest a quote result is reused
+#define IDENTITY_ATTESTED_TTL_S 86400
+
+typedef enum _identity_index_t
+{
+    IDENTITY_BY_PUBKEY,
+    // Account and mrenclave lead to the identity verified last, others sharing them are chained from it
+    IDENTITY_BY_ACCOUNT,
+    IDENTITY_BY_MRENCLAVE,
+    IDENTITY_INDEX_NUM,
+} identity_index_t;
+
+// Copy of one record handed to callers
+typedef struct _identity_record_t
+{
+    uint8_t pubkey[sizeof(sgx_report_data_t)];
+    uint8_t mrenclave[sizeof(sgx_measurement_t)];
+    char account[IDENTITY_ACCOUNT_SIZE];
+    size_t account_len;
+    sgx_ql_qv_result_t qv_result;
+    int64_t first_verified_at;
+    int64_t last_verified_at;
+} identity_record_t;
+
+typedef struct _identity_registry_header_t
+{
+    // Robust and shared among processes, indexes are rebuilt when a holder dies
+    pthread_mutex_t mutex;
+    uint32_t capacity;
+    uint32_t index_slots;
+    uint32_t count;
+    // Next record looked at for replacement
+    uint32_t clock_hand;
+    uint64_t seed;
+} identity_registry_header_t;
+
+// Identities of accepted evidence, kept in one memory mapping shared by all workers. Records are fixed
+// size and stored field by field in arrays. Once registry is full, a clock hand picks the record replaced,
+// passing over and clearing records verified again since it last came by, so identities verified least
+// recently go first. Open addressing indexes map pubkey, account and mrenclave to records, holding record
+// number plus one and 0 for an empty slot.
+class IdentityRegistry
+{
+public:
+    static IdentityRegistry *identity_registry;
+    static IdentityRegistry *get_instance();
+    crust_status_t init(size_t capacity);
+    bool is_enabled();
+    void put(const uint8_t *pubkey, const uint8_t *mrenclave, const char *account, size_t account_len,
+            sgx_ql_qv_result_t qv_result, time_t verified_at);
+    bool get_by_pubkey(const uint8_t *pubkey, identity_record_t *record);
+    bool get_by_account(const char *account, size_t account_len, identity_record_t *record);
+    size_t get_by_mrenclave(const uint8_t *mrenclave, size_t limit, std::vector<identity_record_t> &records);
+    size_t size();
+    static bool is_attested(const identity_record_t &record);
+    static json::JSON to_json(const identity_record_t &record);
+
+private:
+    void lock();
+    void unlock();
+    void rebuild();
+    uint64_t hash_key(const void *key, size_t key_len);
+    void get_key(identity_index_t index, uint32_t rec, const void **key, size_t *key_len);
+    uint32_t find_slot(identity_index_t index, const void *key, size_t key_len);
+    uint32_t find(identity_index_t index, const void *key, size_t key_len);
+    void index_insert(identity_index_t index, uint32_t rec);
+    void index_remove(identity_index_t index, uint32_t rec);
+    void link(identity_index_t index, uint32_t rec);
+    void unlink(identity_index_t index, uint32_t rec);
+    uint32_t get_victim();
+    void copy_record(uint32_t rec, identity_record_t *record);
+    identity_registry_header_t *header;
+    size_t map_size;
+    uint8_t (*pubkeys)[sizeof(sgx_report_data_t)];
+    uint8_t (*mrenclaves)[sizeof(sgx_measurement_t)];
+    char (*accounts)[IDENTITY_ACCOUNT_SIZE];
+    uint8_t *account_lens;
+    uint32_t *qv_results;
+    int64_t *first_verified_at;
+    int64_t *last_verified_at;
+    // Set when record is verified again, cleared as clock hand passes
+    uint8_t *referenced;
+    uint32_t *indexes[IDENTITY_INDEX_NUM];
+    // Chains of records sharing account or mrenclave, ended by IDENTITY_NONE, NULL for pubkey
+    uint32_t *chain_next[IDENTITY_INDEX_NUM];
+    uint32_t *chain_prev[IDENTITY_INDEX_NUM];
+    // Length of chain by index slot of its key, so that counting takes no walk, NULL for pubkey
+    uint32_t *chain_lens[IDENTITY_INDEX_NUM];
+    IdentityRegistry(void);
+};
+
+#endif /* !_CRUST_IDENTITY_REGISTRY_H_ */
@@ -0,0 +1,196 @@
+#include "NegativeCache.h"
+
+#include "Metrics.h"
+
+std::mutex negative_cache_mutex;
+
+NegativeCache *NegativeCache::negative_cache = NULL;
+
+/**
+ * @description: single instance class function to get instance
+ * @return: negative cache instance
+ */
+NegativeCache *NegativeCache::get_instance()
+{
+    if (NegativeCache::negative_cache == NULL)
+    {
+        negative_cache_mutex.lock();
+        if (NegativeCache::negative_cache == NULL)
+        {
+            NegativeCache::negative_cache = new NegativeCache();
+        }
+        negative_cache_mutex.unlock();
+    }
+
+    return NegativeCache::negative_cache;
+}
+
+/**
+ * @description: constructor
+ */
+NegativeCache::NegativeCache()
+{
+    this->bloom = new std::atomic<uint64_t>[NEGATIVE_BLOOM_BITS / 64];
+    for (size_t i = 0; i < NEGATIVE_BLOOM_BITS / 64; i++)
+        this->bloom[i].store(0, std::memory_order_relaxed);
+    this->bloom_added = 0;
+}
+
+/**
+ * @description: Get bit positions of digest in Bloom filter, digest is uniformly distributed so its words serve as hashes
+ * @param digest -> Digest
+ * @param bits -> Bit positions
+ */
+static void bloom_bits(const result_digest_t &digest, uint32_t bits[NEGATIVE_BLOOM_PROBES])
+{
+    // First word is taken by hash table
+    for (size_t i = 0; i < NEGATIVE_BLOOM_PROBES; i++)
+    {
+        memcpy(&bits[i], digest.data() + sizeof(uint64_t) + i * sizeof(uint32_t), sizeof(uint32_t));
+        bits[i] &= NEGATIVE_BLOOM_BITS - 1;
+    }
+}
+
+/**
+ * @description: Whether digest may have been added, never false for an added one until filter is built again
+ * @param digest -> Digest
+ * @return: Possibly added or not
+ */
+bool NegativeCache::bloom_test(const result_digest_t &digest)
+{
+    uint32_t bits[NEGATIVE_BLOOM_PROBES];
+    bloom_bits(digest, bits);
+    for (size_t i = 0; i < NEGATIVE_BLOOM_PROBES; i++)
+    {
+        if ((this->bloom[bits[i] / 64].load(std::memory_order_relaxed) & (1ULL << (bits[i] % 64))) == 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @description: Add digest to Bloom filter, with lock held
+ * @param digest -> Digest
+ */
+void NegativeCache::bloom_add(const result_digest_t &digest)
+{
+    uint32_t bits[NEGATIVE_BLOOM_PROBES];
+    bloom_bits(digest, bits);
+    for (size_t i = 0; i < NEGATIVE_BLOOM_PROBES; i++)
+        this->bloom[bits[i] / 64].fetch_or(1ULL << (bits[i] % 64), std::memory_order_relaxed);
+    this->bloom_added++;
+}
+
+/**
+ * @description: Pop item expiring first of all expiry queues, its entry is dropped unless it was put again since, with lock held
+ * @return: False if queues are empty
+ */
+bool NegativeCache::pop_expiring()
+{
+    std::deque<std::pair<time_t, result_digest_t>> *first = NULL;
+    for (size_t i = 0; i < NEGATIVE_TYPE_NUM; i++)
+    {
+        if (!this->expiry_queues[i].empty()
+                && (first == NULL || this->expiry_queues[i].front().first < first->front().first))
+            first = &this->expiry_queues[i];
+    }
+    if (first == NULL)
+        return false;
+    auto it = this->entries.find(first->front().second);
+    if (it != this->entries.end() && it->second.expires_at == first->front().first)
+        this->entries.erase(it);
+    first->pop_front();
+
+    return true;
+}
+
+/**
+ * @description: Build Bloom filter again from current entries, so bits of dropped ones are cleared, with lock held.
+ * Readers may miss an entry while filter is built, which only costs them a full verification.
+ */
+void NegativeCache::rebuild()
+{
+    for (size_t i = 0; i < NEGATIVE_BLOOM_BITS / 64; i++)
+        this->bloom[i].store(0, std::memory_order_relaxed);
+    this->bloom_added = 0;
+    for (auto &it : this->entries)
+        this->bloom_add(it.first);
+    Metrics::get_instance()->set(METRIC_NEGATIVE_CACHE_ENTRIES, this->entries.size());
+}
+
+/**
+ * @description: Get rejection of evidence
+ * @param digest -> Digest of quote or of whole evidence
+ * @param entry -> Rejection
+ * @return: Whether evidence was rejected and its rejection hasn't expired
+ */
+bool NegativeCache::get(const result_digest_t &digest, negative_entry_t *entry)
+{
+    if (!this->bloom_test(digest))
+        return false;
+
+    Metrics *p_metrics = Metrics::get_instance();
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->entries.find(digest);
+    if (it == this->entries.end() || it->second.expires_at <= time(NULL))
+    {
+        p_metrics->add(METRIC_NEGATIVE_BLOOM_FALSE_POSITIVE_TOTAL);
+        return false;
+    }
+    *entry = it->second;
+    p_metrics->add(METRIC_NEGATIVE_CACHE_HIT_TOTAL);
+
+    return true;
+}
+
+/**
+ * @description: Keep rejection of evidence for as long as its kind allows
+ * @param digest -> Digest of quote or of whole evidence
+ * @param type -> Kind of rejection
+ * @param status_code -> Status code of rejection
+ * @param message -> Static message of rejection
+ * @param qv_result -> Quote verification result
+ */
+void NegativeCache::put(const result_digest_t &digest, negative_type_t type, int status_code, const char *message, sgx_ql_qv_result_t qv_result)
+{
+    time_t ttl = NEGATIVE_TTL_TERMINAL_S;
+    switch (type)
+    {
+    case NEGATIVE_SIGNATURE:
+        ttl = NEGATIVE_TTL_SIGNATURE_S;
+        break;
+    case NEGATIVE_MALFORMED:
+        ttl = NEGATIVE_TTL_MALFORMED_S;
+        break;
+    case NEGATIVE_REVOKED:
+        ttl = NEGATIVE_TTL_REVOKED_S;
+        break;
+    default:
+        break;
+    }
+    negative_entry_t entry;
+    entry.expires_at = time(NULL) + ttl;
+    entry.status_code = status_code;
+    entry.message = message;
+    entry.qv_result = qv_result;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // Expired entries go first, then the ones expiring soonest while cache is full
+    time_t now = time(NULL);
+    while (true)
+    {
+        bool expired = false;
+        for (size_t i = 0; i < NEGATIVE_TYPE_NUM && !expired; i++)
+            expired = !this->expiry_queues[i].empty() && this->expiry_queues[i].front().first <= now;
+        if ((!expired && this->entries.size() < NEGATIVE_CACHE_MAX_ENTRIES) || !this->pop_expiring())
+            break;
+    }
+    // Filter is built again once per filter's worth of puts, not per put
+    if (this->bloom_added >= NEGATIVE_CACHE_MAX_ENTRIES * 2)
+        this->rebuild();
+    this->entries[digest] = entry;
+    this->expiry_queues[type].push_back(std::make_pair(entry.expires_at, digest));
+    this->bloom_add(digest);
+    Metrics::get_instance()->set(METRIC_NEGATIVE_CACHE_ENTRIES, this->entries.size());
+}
@@ -0,0 +1,76 @@
+#ifndef _CRUST_NEGATIVE_CACHE_H_
+#define _CRUST_NEGATIVE_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "sgx_qve_header.h"
+
+#include "ResultCache.h"
+
+// Rejections kept by each process, beyond it the one expiring first is dropped
+#define NEGATIVE_CACHE_MAX_ENTRIES 65536
+// Bloom filter size in bits, a power of two. With 4 probes it has about 0.25% false positives when full.
+#define NEGATIVE_BLOOM_BITS (1 << 20)
+#define NEGATIVE_BLOOM_PROBES 4
+// How long each kind of rejection is kept
+#define NEGATIVE_TTL_SIGNATURE_S 3600
+#define NEGATIVE_TTL_MALFORMED_S 86400
+#define NEGATIVE_TTL_REVOKED_S 86400
+#define NEGATIVE_TTL_TERMINAL_S 60
+
+// Kinds of rejection, which decide how long it is kept
+typedef enum _negative_type_t
+{
+    // Identity signature doesn't match quote and account
+    NEGATIVE_SIGNATURE,
+    // Quote library can't parse quote, or quote's own signature is invalid
+    NEGATIVE_MALFORMED,
+    NEGATIVE_REVOKED,
+    // Other terminal quote verification results
+    NEGATIVE_TERMINAL,
+    NEGATIVE_TYPE_NUM,
+} negative_type_t;
+
+typedef struct _negative_entry_t
+{
+    time_t expires_at;
+    int status_code;
+    // Static message of the rejection
+    const char *message;
+    sgx_ql_qv_result_t qv_result;
+} negative_entry_t;
+
+// Recently rejected evidence by digest, fronted by a Bloom filter which is read without lock, so that
+// evidence never rejected costs a few memory reads and replays of rejected evidence are answered
+// before any signature check or quote library call.
+class NegativeCache
+{
+public:
+    static NegativeCache *negative_cache;
+    static NegativeCache *get_instance();
+    bool get(const result_digest_t &digest, negative_entry_t *entry);
+    void put(const result_digest_t &digest, negative_type_t type, int status_code, const char *message, sgx_ql_qv_result_t qv_result);
+
+private:
+    bool bloom_test(const result_digest_t &digest);
+    void bloom_add(const result_digest_t &digest);
+    void rebuild();
+    bool pop_expiring();
+    std::mutex mutex;
+    std::unordered_map<result_digest_t, negative_entry_t, ResultDigestHash> entries;
+    // Entries in the order they were put, per kind. All of a kind live equally long, so each queue
+    // is in expiry order. Items of entries put again or already dropped are skipped when popped.
+    std::deque<std::pair<time_t, result_digest_t>> expiry_queues[NEGATIVE_TYPE_NUM];
+    std::atomic<uint64_t> *bloom;
+    // Entries added since filter was last built, bits of dropped ones stay set until next build
+    size_t bloom_added;
+    NegativeCache(void);
+};
+
+#endif /* !_CRUST_NEGATIVE_CACHE_H_ */
@@ -0,0 +1,226 @@
+#include "ResultCache.h"
+#include "SharedResultCache.h"
+
+#include "Log.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <iterator>
+
+std::mutex result_cache_mutex;
+
+ResultCache *ResultCache::result_cache = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: result cache instance
+ */
+ResultCache *ResultCache::get_instance()
+{
+    if (ResultCache::result_cache == NULL)
+    {
+        result_cache_mutex.lock();
+        if (ResultCache::result_cache == NULL)
+        {
+            ResultCache::result_cache = new ResultCache();
+        }
+        result_cache_mutex.unlock();
+    }
+
+    return ResultCache::result_cache;
+}
+
+/**
+ * @description: constructor
+ */
+ResultCache::ResultCache()
+{
+    CollateralCache::get_instance()->set_change_listener([this](const collateral_key_t &key, const uint8_t *digest) {
+        result_digest_t collateral_digest;
+        memcpy(collateral_digest.data(), digest, collateral_digest.size());
+        this->invalidate(key, collateral_digest);
+    });
+}
+
+/**
+ * @description: Whether result was verified with current collateral of its key, with lock held
+ * @param entry -> Result
+ * @return: Current or not
+ */
+bool ResultCache::is_current(const result_entry_t &entry)
+{
+    auto current = this->collateral_digests.find(entry.collateral_name);
+    return current != this->collateral_digests.end() && current->second == entry.collateral_digest;
+}
+
+/**
+ * @description: Get result of quote, from this process or else from results shared by other processes
+ * @param digest -> Quote digest
+ * @param qv_result -> Quote verification result
+ * @return: False if quote has no result, its result expired or its collateral is not known to be current
+ */
+bool ResultCache::get(const result_digest_t &digest, sgx_ql_qv_result_t *qv_result)
+{
+    Metrics *p_metrics = Metrics::get_instance();
+    std::unique_lock<std::mutex> lock(this->mutex);
+    auto it = this->entries.find(digest);
+    if (it != this->entries.end() && it->second->expires_at <= time(NULL))
+    {
+        this->erase(it->second);
+    }
+    else if (it != this->entries.end() && this->is_current(*it->second))
+    {
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        *qv_result = it->second->qv_result;
+        p_metrics->add(METRIC_RESULT_CACHE_HIT_TOTAL);
+        return true;
+    }
+
+    SharedResultCache *p_shared = SharedResultCache::get_instance();
+    if (p_shared->is_enabled())
+    {
+        result_entry_t entry;
+        collateral_key_t key;
+        bool found = p_shared->get(digest, &entry, &key);
+        // Result of another process verified with collateral this process has yet to get, which is cheaper than verifying
+        if (found && this->collateral_digests.find(entry.collateral_name) == this->collateral_digests.end())
+        {
+            lock.unlock();
+            std::shared_ptr<const sgx_ql_qve_collateral_t> collateral;
+            uint8_t collateral_digest[32];
+            CollateralCache::get_instance()->get(key, collateral, collateral_digest);
+            lock.lock();
+        }
+        if (found && this->is_current(entry))
+        {
+            *qv_result = entry.qv_result;
+            this->insert(entry);
+            p_metrics->set(METRIC_RESULT_CACHE_ENTRIES, this->lru.size());
+            p_metrics->add(METRIC_SHARED_RESULT_CACHE_HIT_TOTAL);
+            p_metrics->add(METRIC_RESULT_CACHE_HIT_TOTAL);
+            return true;
+        }
+        p_metrics->add(METRIC_SHARED_RESULT_CACHE_MISS_TOTAL);
+    }
+    p_metrics->add(METRIC_RESULT_CACHE_MISS_TOTAL);
+
+    return false;
+}
+
+/**
+ * @description: Keep result of quote verified with collateral of key, and share it with other processes
+ * @param digest -> Quote digest
+ * @param key -> Collateral key the quote was verified with
+ * @param collateral_digest -> Digest of collateral the quote was verified with
+ * @param qv_result -> Quote verification result
+ * @param expires_at -> Time result is no longer used
+ */
+void ResultCache::put(const result_digest_t &digest, const collateral_key_t &key, const result_digest_t &collateral_digest,
+        sgx_ql_qv_result_t qv_result, time_t expires_at)
+{
+    expires_at = std::min(expires_at, time(NULL) + RESULT_CACHE_MAX_TTL_S);
+    result_entry_t entry;
+    entry.digest = digest;
+    entry.qv_result = qv_result;
+    entry.expires_at = expires_at;
+    entry.collateral_name = get_collateral_name(key);
+    entry.collateral_digest = collateral_digest;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // Collateral changed while quote was verified
+    auto current = this->collateral_digests.find(entry.collateral_name);
+    if (current != this->collateral_digests.end() && current->second != collateral_digest)
+        return;
+    SharedResultCache *p_shared = SharedResultCache::get_instance();
+    if (p_shared->is_enabled())
+        p_shared->put(entry, key);
+    this->insert(entry);
+    Metrics::get_instance()->set(METRIC_RESULT_CACHE_ENTRIES, this->lru.size());
+}
+
+/**
+ * @description: Put results loaded from disk under one lock, later ones of a quote win
+ * @param loaded -> Results in the order they were verified, moved from
+ */
+void ResultCache::load(std::vector<result_entry_t> &loaded)
+{
+    time_t max_expires_at = time(NULL) + RESULT_CACHE_MAX_TTL_S;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.reserve(std::min(this->entries.size() + loaded.size(), (size_t)RESULT_CACHE_MAX_ENTRIES));
+    // Only the last ones fit
+    size_t skipped = loaded.size() > RESULT_CACHE_MAX_ENTRIES ? loaded.size() - RESULT_CACHE_MAX_ENTRIES : 0;
+    for (size_t i = skipped; i < loaded.size(); i++)
+    {
+        loaded[i].expires_at = std::min(loaded[i].expires_at, max_expires_at);
+        this->insert(loaded[i]);
+    }
+    Metrics::get_instance()->set(METRIC_RESULT_CACHE_ENTRIES, this->lru.size());
+}
+
+/**
+ * @description: Put result in front of all indexes, replacing the old one of its quote, with lock held
+ * @param entry -> Result, moved from
+ */
+void ResultCache::insert(result_entry_t &entry)
+{
+    auto it = this->entries.find(entry.digest);
+    if (it != this->entries.end())
+        this->erase(it->second);
+    while (this->lru.size() >= RESULT_CACHE_MAX_ENTRIES)
+        this->erase(std::prev(this->lru.end()));
+
+    this->lru.push_front(std::move(entry));
+    auto front = this->lru.begin();
+    this->entries[front->digest] = front;
+    this->by_collateral[front->collateral_name].insert(front->digest);
+}
+
+/**
+ * @description: Take new current collateral of key and drop results verified with other collateral of it, other results stay
+ * @param key -> Collateral key whose collateral is new or changed
+ * @param collateral_digest -> Digest of current collateral
+ */
+void ResultCache::invalidate(const collateral_key_t &key, const result_digest_t &collateral_digest)
+{
+    std::string name = get_collateral_name(key);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->collateral_digests[name] = collateral_digest;
+    auto it = this->by_collateral.find(name);
+    if (it == this->by_collateral.end())
+        return;
+
+    // Collected first, erase drops digests from the set being walked
+    std::vector<result_digest_t> digests;
+    for (auto &digest : it->second)
+    {
+        auto entry = this->entries.find(digest);
+        if (entry != this->entries.end() && entry->second->collateral_digest != collateral_digest)
+            digests.push_back(digest);
+    }
+    if (digests.empty())
+        return;
+    for (auto &digest : digests)
+        this->erase(this->entries[digest]);
+    Metrics *p_metrics = Metrics::get_instance();
+    p_metrics->add(METRIC_RESULT_CACHE_INVALIDATED_TOTAL, digests.size());
+    p_metrics->set(METRIC_RESULT_CACHE_ENTRIES, this->lru.size());
+    p_log->info("Dropped %lu cached results verified with other collateral of %s.\n", digests.size(), name.c_str());
+}
+
+/**
+ * @description: Remove one result from all indexes, with lock held
+ * @param it -> Result
+ */
+void ResultCache::erase(std::list<result_entry_t>::iterator it)
+{
+    auto by = this->by_collateral.find(it->collateral_name);
+    if (by != this->by_collateral.end())
+    {
+        by->second.erase(it->digest);
+        if (by->second.empty())
+            this->by_collateral.erase(by);
+    }
+    this->entries.erase(it->digest);
+    this->lru.erase(it);
+}
@@ -0,0 +1,79 @@
+#ifndef _CRUST_RESULT_CACHE_H_
+#define _CRUST_RESULT_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <array>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sgx_qve_header.h"
+
+#include "CollateralCache.h"
+
+// Results kept by each process, least recently used ones are dropped beyond it
+#define RESULT_CACHE_MAX_ENTRIES 65536
+// Longest time a result is kept, even if its collateral expires later
+#define RESULT_CACHE_MAX_TTL_S 86400
+
+typedef std::array<uint8_t, 32> result_digest_t;
+
+// Digest is uniformly distributed already, its first bytes are a good hash
+struct ResultDigestHash
+{
+    size_t operator()(const result_digest_t &digest) const
+    {
+        size_t h;
+        memcpy(&h, digest.data(), sizeof(h));
+        return h;
+    }
+};
+
+// Outcome of quote stage for one quote
+typedef struct _result_entry_t
+{
+    result_digest_t digest;
+    sgx_ql_qv_result_t qv_result;
+    time_t expires_at;
+    // Collateral the quote was verified with, as FMSPC and CA type
+    std::string collateral_name;
+    result_digest_t collateral_digest;
+} result_entry_t;
+
+// Quote stage results of accepted quotes by quote digest, kept until their collateral expires. Results
+// are indexed by the collateral they were verified with, so that when collateral of one FMSPC and CA
+// type changes only the results of those platforms are dropped. A result is only used while its
+// collateral digest is the current one of its key, so results put before that collateral is known,
+// like ones reloaded after restart, wait until it is.
+class ResultCache
+{
+public:
+    static ResultCache *result_cache;
+    static ResultCache *get_instance();
+    bool get(const result_digest_t &digest, sgx_ql_qv_result_t *qv_result);
+    void put(const result_digest_t &digest, const collateral_key_t &key, const result_digest_t &collateral_digest,
+            sgx_ql_qv_result_t qv_result, time_t expires_at);
+    void invalidate(const collateral_key_t &key, const result_digest_t &collateral_digest);
+    void load(std::vector<result_entry_t> &loaded);
+
+private:
+    bool is_current(const result_entry_t &entry);
+    void insert(result_entry_t &entry);
+    void erase(std::list<result_entry_t>::iterator it);
+    std::mutex mutex;
+    // Most recently used first
+    std::list<result_entry_t> lru;
+    std::unordered_map<result_digest_t, std::list<result_entry_t>::iterator, ResultDigestHash> entries;
+    std::unordered_map<std::string, std::unordered_set<result_digest_t, ResultDigestHash>> by_collateral;
+    // Digest of current collateral by FMSPC and CA type
+    std::unordered_map<std::string, result_digest_t> collateral_digests;
+    ResultCache(void);
+};
+
+#endif /* !_CRUST_RESULT_CACHE_H_ */
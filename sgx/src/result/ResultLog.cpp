@@ -0,0 +1,444 @@
+#include "ResultLog.h"
+
+#include "Log.h"
+#include "Metrics.h"
+#include "IdentityRegistry.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+std::mutex result_log_mutex;
+
+ResultLog *ResultLog::result_log = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: result log instance
+ */
+ResultLog *ResultLog::get_instance()
+{
+    if (ResultLog::result_log == NULL)
+    {
+        result_log_mutex.lock();
+        if (ResultLog::result_log == NULL)
+        {
+            ResultLog::result_log = new ResultLog();
+        }
+        result_log_mutex.unlock();
+    }
+
+    return ResultLog::result_log;
+}
+
+/**
+ * @description: constructor
+ */
+ResultLog::ResultLog()
+{
+    this->fd = -1;
+    this->stopping = false;
+}
+
+/**
+ * @description: Get checksum of record, CRC32C is enough against torn writes and bit rot and costs far less than a digest
+ * @param record -> Record
+ * @return: Checksum
+ */
+static uint32_t get_checksum(const result_log_record_t *record)
+{
+    static uint32_t table[256];
+    static std::once_flag table_flag;
+    std::call_once(table_flag, [] {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+            table[i] = c;
+        }
+    });
+
+    const uint8_t *p = (const uint8_t *)record;
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < offsetof(result_log_record_t, checksum); i++)
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+
+    return crc ^ 0xffffffff;
+}
+
+/**
+ * @description: Whether record is whole and still in use
+ * @param record -> Record
+ * @param now -> Current time
+ * @return: Usable or not
+ */
+static bool is_live(const result_log_record_t *record, time_t now)
+{
+    if (record->magic != RESULT_LOG_MAGIC || record->version != RESULT_LOG_VERSION
+            || record->ca > 1 || record->account_len > RESULT_LOG_ACCOUNT_SIZE || record->expires_at <= now)
+        return false;
+
+    return get_checksum(record) == record->checksum;
+}
+
+/**
+ * @description: Whether fd is still the file at path, compaction renames a new one over it
+ * @param fd -> Opened log
+ * @param path -> Log path
+ * @return: Current or not
+ */
+static bool is_current(int fd, const std::string &path)
+{
+    struct stat fd_st;
+    struct stat path_st;
+    return fstat(fd, &fd_st) == 0 && stat(path.c_str(), &path_st) == 0
+            && fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino;
+}
+
+/**
+ * @description: Create log if it doesn't exist, must be called before fork
+ * @param path -> Log path
+ * @return: Init status
+ */
+crust_status_t ResultLog::init(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return CRUST_OPEN_FILE_FAILED;
+    close(fd);
+    this->path = path;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether accepted quotes are logged
+ * @return: Enabled or not
+ */
+bool ResultLog::is_enabled()
+{
+    return !this->path.empty();
+}
+
+/**
+ * @description: Load log into result cache and start compaction thread, called by each worker
+ */
+void ResultLog::start()
+{
+    // Drop a record torn by a crash, appends after it would never line up
+    int rfd = open(this->path.c_str(), O_RDWR | O_CLOEXEC);
+    if (rfd != -1)
+    {
+        struct stat st;
+        if (flock(rfd, LOCK_EX) == 0 && is_current(rfd, this->path) && fstat(rfd, &st) == 0
+                && st.st_size % sizeof(result_log_record_t) != 0)
+        {
+            p_log->warn("Result log %s ends with a torn record, which is dropped.\n", this->path.c_str());
+            if (ftruncate(rfd, st.st_size - st.st_size % sizeof(result_log_record_t)) != 0)
+                p_log->err("Truncate result log %s failed!\n", this->path.c_str());
+        }
+        close(rfd);
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    size_t loaded = this->load();
+    p_log->info("Loaded %lu results from %s in %ldms.\n", loaded, this->path.c_str(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count());
+
+    this->stopping = false;
+    this->worker = std::thread(&ResultLog::work, this);
+}
+
+/**
+ * @description: Stop compaction thread and close log
+ */
+void ResultLog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+        this->cond.notify_all();
+    }
+    if (this->worker.joinable())
+        this->worker.join();
+    if (this->fd != -1)
+    {
+        close(this->fd);
+        this->fd = -1;
+    }
+}
+
+/**
+ * @description: Put live records of log into result cache. Records are checked and decoded by several threads
+ * in chunks, then put at once in file order so that later records of a quote win.
+ * @return: Number of records loaded
+ */
+size_t ResultLog::load()
+{
+    int rfd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (rfd == -1)
+        return 0;
+    struct stat st;
+    if (fstat(rfd, &st) != 0 || (size_t)st.st_size < sizeof(result_log_record_t))
+    {
+        close(rfd);
+        return 0;
+    }
+    size_t size = st.st_size;
+    void *p_mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, rfd, 0);
+    close(rfd);
+    if (p_mem == MAP_FAILED)
+        return 0;
+    madvise(p_mem, size, MADV_SEQUENTIAL);
+
+    const result_log_record_t *records = (const result_log_record_t *)p_mem;
+    size_t record_num = size / sizeof(result_log_record_t);
+    size_t chunk_num = (record_num + RESULT_LOG_LOAD_CHUNK - 1) / RESULT_LOG_LOAD_CHUNK;
+    size_t thread_num = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1U), chunk_num);
+    std::vector<std::vector<result_entry_t>> live(chunk_num);
+    std::vector<std::map<std::string, collateral_key_t>> chunk_keys(chunk_num);
+    std::atomic<size_t> next_chunk(0);
+    time_t now = time(NULL);
+    // Shared by all workers, each of which registers the same identities again without harm
+    IdentityRegistry *p_identity_registry = IdentityRegistry::get_instance();
+    auto check = [&] {
+        for (size_t c = next_chunk++; c < chunk_num; c = next_chunk++)
+        {
+            size_t end = std::min((c + 1) * RESULT_LOG_LOAD_CHUNK, record_num);
+            for (size_t i = c * RESULT_LOG_LOAD_CHUNK; i < end; i++)
+            {
+                const result_log_record_t *record = &records[i];
+                if (!is_live(record, now))
+                    continue;
+                collateral_key_t key;
+                memcpy(key.fmspc, record->fmspc, sizeof(key.fmspc));
+                key.ca = record->ca ? "platform" : "processor";
+                result_entry_t entry;
+                memcpy(entry.digest.data(), record->quote_digest, entry.digest.size());
+                memcpy(entry.collateral_digest.data(), record->collateral_digest, entry.collateral_digest.size());
+                entry.qv_result = (sgx_ql_qv_result_t)record->qv_result;
+                entry.expires_at = record->expires_at;
+                entry.collateral_name = get_collateral_name(key);
+                chunk_keys[c].emplace(entry.collateral_name, key);
+                live[c].push_back(std::move(entry));
+                if (p_identity_registry->is_enabled())
+                {
+                    p_identity_registry->put(record->pubkey, record->mrenclave, record->account, record->account_len,
+                            (sgx_ql_qv_result_t)record->qv_result, record->verified_at);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_num; i++)
+        threads.emplace_back(check);
+    check();
+    for (auto &t : threads)
+        t.join();
+
+    munmap(p_mem, size);
+
+    std::vector<result_entry_t> entries;
+    std::map<std::string, collateral_key_t> keys;
+    for (size_t c = 0; c < chunk_num; c++)
+    {
+        std::move(live[c].begin(), live[c].end(), std::back_inserter(entries));
+        keys.insert(chunk_keys[c].begin(), chunk_keys[c].end());
+    }
+    size_t loaded = entries.size();
+    ResultCache::get_instance()->load(entries);
+    for (auto &it : keys)
+        this->loaded_keys.push_back(it.second);
+    Metrics::get_instance()->add(METRIC_RESULT_LOG_LOADED_TOTAL, loaded);
+
+    return loaded;
+}
+
+/**
+ * @description: Open current log for appending under shared lock, with mutex held. Log compacted by another
+ * worker is reopened.
+ * @return: Whether log is opened and locked
+ */
+bool ResultLog::open_current()
+{
+    while (true)
+    {
+        if (this->fd == -1)
+        {
+            this->fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+            if (this->fd == -1)
+                return false;
+        }
+        if (flock(this->fd, LOCK_SH) != 0)
+            return false;
+        if (is_current(this->fd, this->path))
+            return true;
+        flock(this->fd, LOCK_UN);
+        close(this->fd);
+        this->fd = -1;
+    }
+}
+
+/**
+ * @description: Append accepted quote and identity it carries
+ * @param quote_digest -> Quote digest
+ * @param key -> Collateral key the quote was verified with
+ * @param collateral_digest -> Digest of collateral the quote was verified with
+ * @param qv_result -> Quote verification result
+ * @param expires_at -> Time result is no longer used
+ * @param report_body -> Report body of quote
+ * @param account -> Account
+ * @param account_len -> Account length
+ */
+void ResultLog::append(const result_digest_t &quote_digest, const collateral_key_t &key, const result_digest_t &collateral_digest,
+        sgx_ql_qv_result_t qv_result, time_t expires_at, const sgx_report_body_t *report_body, const char *account, size_t account_len)
+{
+    if (account_len > RESULT_LOG_ACCOUNT_SIZE)
+        return;
+
+    result_log_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = RESULT_LOG_MAGIC;
+    record.version = RESULT_LOG_VERSION;
+    record.ca = strcmp(key.ca, "platform") == 0 ? 1 : 0;
+    record.account_len = account_len;
+    record.qv_result = qv_result;
+    record.verified_at = time(NULL);
+    record.expires_at = std::min(expires_at, record.verified_at + RESULT_CACHE_MAX_TTL_S);
+    memcpy(record.quote_digest, quote_digest.data(), sizeof(record.quote_digest));
+    memcpy(record.collateral_digest, collateral_digest.data(), sizeof(record.collateral_digest));
+    memcpy(record.fmspc, key.fmspc, sizeof(record.fmspc));
+    memcpy(record.pubkey, &report_body->report_data, sizeof(record.pubkey));
+    memcpy(record.mrenclave, &report_body->mr_enclave, sizeof(record.mrenclave));
+    memcpy(record.account, account, account_len);
+    record.checksum = get_checksum(&record);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->open_current())
+    {
+        p_log->err("Open result log %s failed!\n", this->path.c_str());
+        return;
+    }
+    // Appends of a whole record at once don't interleave among workers
+    if (write(this->fd, &record, sizeof(record)) != (ssize_t)sizeof(record))
+        p_log->err("Append to result log %s failed!\n", this->path.c_str());
+    else
+        Metrics::get_instance()->add(METRIC_RESULT_LOG_APPEND_TOTAL);
+    flock(this->fd, LOCK_UN);
+}
+
+/**
+ * @description: Write live records to a new log and rename it over the old one once old one is mostly dead records.
+ * Only one worker compacts at a time, others skip.
+ */
+void ResultLog::compact()
+{
+    int rfd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (rfd == -1)
+        return;
+    struct stat st;
+    if (flock(rfd, LOCK_EX | LOCK_NB) != 0 || !is_current(rfd, this->path) || fstat(rfd, &st) != 0
+            || (size_t)st.st_size < RESULT_LOG_COMPACT_MIN_RECORDS * sizeof(result_log_record_t))
+    {
+        close(rfd);
+        return;
+    }
+    size_t size = st.st_size;
+    void *p_mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, rfd, 0);
+    if (p_mem == MAP_FAILED)
+    {
+        close(rfd);
+        return;
+    }
+
+    // Only the last record of a quote is kept
+    const result_log_record_t *records = (const result_log_record_t *)p_mem;
+    size_t record_num = size / sizeof(result_log_record_t);
+    std::unordered_map<result_digest_t, size_t, ResultDigestHash> last;
+    time_t now = time(NULL);
+    for (size_t i = 0; i < record_num; i++)
+    {
+        if (!is_live(&records[i], now))
+            continue;
+        result_digest_t digest;
+        memcpy(digest.data(), records[i].quote_digest, digest.size());
+        last[digest] = i;
+    }
+    if (record_num <= last.size() * RESULT_LOG_COMPACT_RATIO)
+    {
+        munmap(p_mem, size);
+        close(rfd);
+        return;
+    }
+
+    std::vector<size_t> live;
+    live.reserve(last.size());
+    for (auto &it : last)
+        live.push_back(it.second);
+    std::sort(live.begin(), live.end());
+    std::string data;
+    data.reserve(live.size() * sizeof(result_log_record_t));
+    for (size_t i : live)
+        data.append((const char *)&records[i], sizeof(result_log_record_t));
+    munmap(p_mem, size);
+
+    std::string tmp_path = this->path + ".compact";
+    int wfd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = wfd != -1 && write(wfd, data.data(), data.size()) == (ssize_t)data.size() && fsync(wfd) == 0;
+    if (wfd != -1)
+        close(wfd);
+    if (!ok || rename(tmp_path.c_str(), this->path.c_str()) != 0)
+    {
+        p_log->err("Compact result log %s failed!\n", this->path.c_str());
+        unlink(tmp_path.c_str());
+    }
+    else
+    {
+        Metrics::get_instance()->add(METRIC_RESULT_LOG_COMPACT_TOTAL);
+        p_log->info("Compacted result log %s from %lu to %lu records.\n", this->path.c_str(), record_num, live.size());
+    }
+    // Appenders waiting on old log reopen the new one
+    close(rfd);
+}
+
+/**
+ * @description: Compaction thread, which first gets collateral of loaded results. Results are only used once
+ * collateral they were verified with is known to be current, getting it takes the place of the first request of each key.
+ */
+void ResultLog::work()
+{
+    CollateralCache *p_collateral_cache = CollateralCache::get_instance();
+    for (auto &key : this->loaded_keys)
+    {
+        std::shared_ptr<const sgx_ql_qve_collateral_t> collateral;
+        uint8_t digest[32];
+        if (this->stopping)
+            break;
+        p_collateral_cache->get(key, collateral, digest);
+    }
+    this->loaded_keys.clear();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopping)
+    {
+        this->cond.wait_for(lock, std::chrono::seconds(RESULT_LOG_COMPACT_INTERVAL_S));
+        if (this->stopping)
+            break;
+        lock.unlock();
+        this->compact();
+        lock.lock();
+    }
+}
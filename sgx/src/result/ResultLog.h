@@ -0,0 +1,91 @@
+#ifndef _CRUST_RESULT_LOG_H_
+#define _CRUST_RESULT_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sgx_qve_header.h"
+#include "sgx_report.h"
+
+#include "CrustStatus.h"
+#include "ResultCache.h"
+
+#define RESULT_LOG_MAGIC 0x474c5352
+// Bumped whenever record layout changes, records of other versions are skipped
+#define RESULT_LOG_VERSION 1
+// Longest account kept, results of longer ones are not logged
+#define RESULT_LOG_ACCOUNT_SIZE 64
+// How often each worker checks whether log needs compaction
+#define RESULT_LOG_COMPACT_INTERVAL_S 600
+// Log is compacted once it has this many records and more than this many times its live records
+#define RESULT_LOG_COMPACT_MIN_RECORDS 4096
+#define RESULT_LOG_COMPACT_RATIO 2
+// Records checked by one thread while loading
+#define RESULT_LOG_LOAD_CHUNK 8192
+
+// One accepted quote and the identity it carries. Records are fixed size, so a log is read in
+// parallel chunks and a record torn by a crash only ever sits at its end.
+typedef struct _result_log_record_t
+{
+    uint32_t magic;
+    uint16_t version;
+    // 0 for processor CA, 1 for platform CA
+    uint8_t ca;
+    uint8_t account_len;
+    // TCB status
+    uint32_t qv_result;
+    uint32_t reserved;
+    int64_t verified_at;
+    int64_t expires_at;
+    uint8_t quote_digest[32];
+    uint8_t collateral_digest[32];
+    uint8_t fmspc[COLLATERAL_FMSPC_SIZE];
+    uint8_t reserved2[2];
+    uint8_t pubkey[sizeof(sgx_report_data_t)];
+    uint8_t mrenclave[sizeof(sgx_measurement_t)];
+    char account[RESULT_LOG_ACCOUNT_SIZE];
+    uint32_t reserved3;
+    // CRC32C of everything before it
+    uint32_t checksum;
+} result_log_record_t;
+
+// Accepted quotes appended to a file shared by all workers, so that a restarted service loads them
+// into result cache and answers known quotes at once. Workers append under a shared file lock and
+// the one which compacts holds it exclusively while it writes live records to a new file and
+// renames it over the old one, after which appenders reopen the log.
+class ResultLog
+{
+public:
+    static ResultLog *result_log;
+    static ResultLog *get_instance();
+    crust_status_t init(const char *path);
+    bool is_enabled();
+    void start();
+    void stop();
+    void append(const result_digest_t &quote_digest, const collateral_key_t &key, const result_digest_t &collateral_digest,
+            sgx_ql_qv_result_t qv_result, time_t expires_at, const sgx_report_body_t *report_body, const char *account, size_t account_len);
+
+private:
+    size_t load();
+    bool open_current();
+    void compact();
+    void work();
+    std::string path;
+    // Collateral keys of loaded results, whose collateral is got in background so that results are used at once
+    std::vector<collateral_key_t> loaded_keys;
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Appended to, reopened once log is compacted by any worker
+    int fd;
+    std::thread worker;
+    bool stopping;
+    ResultLog(void);
+};
+
+#endif /* !_CRUST_RESULT_LOG_H_ */
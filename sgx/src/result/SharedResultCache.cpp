@@ -0,0 +1,276 @@
+#include "SharedResultCache.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <new>
+
+std::mutex shared_result_cache_mutex;
+
+SharedResultCache *SharedResultCache::shared_result_cache = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: shared result cache instance
+ */
+SharedResultCache *SharedResultCache::get_instance()
+{
+    if (SharedResultCache::shared_result_cache == NULL)
+    {
+        shared_result_cache_mutex.lock();
+        if (SharedResultCache::shared_result_cache == NULL)
+        {
+            SharedResultCache::shared_result_cache = new SharedResultCache();
+        }
+        shared_result_cache_mutex.unlock();
+    }
+
+    return SharedResultCache::shared_result_cache;
+}
+
+/**
+ * @description: constructor
+ */
+SharedResultCache::SharedResultCache()
+{
+    this->table = NULL;
+}
+
+/**
+ * @description: Whether table was created completely with current layout
+ * @param table -> Mapped table
+ * @return: Usable or not
+ */
+static bool is_valid(const shared_result_table_t *table)
+{
+    return table->header.magic.load(std::memory_order_acquire) == SHARED_RESULT_CACHE_MAGIC
+            && table->header.version == SHARED_RESULT_CACHE_VERSION
+            && table->header.slot_num == SHARED_RESULT_CACHE_SLOTS
+            && table->header.slot_size == sizeof(shared_result_slot_t);
+}
+
+/**
+ * @description: Attach to table at path, creating it if it doesn't exist or can't be used, must be called before fork
+ * @param path -> Table file path, like /dev/shm/dcap-results
+ * @return: Init status
+ */
+crust_status_t SharedResultCache::init(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return CRUST_OPEN_FILE_FAILED;
+    // Other processes attaching now wait until table is created, lock goes away with a crashed holder
+    if (flock(fd, LOCK_EX) != 0)
+    {
+        close(fd);
+        return CRUST_OPEN_FILE_FAILED;
+    }
+
+    crust_status_t crust_status = CRUST_SUCCESS;
+    shared_result_table_t *table = NULL;
+    struct stat st;
+    bool created = false;
+    if (fstat(fd, &st) != 0)
+    {
+        crust_status = CRUST_OPEN_FILE_FAILED;
+    }
+    else if ((size_t)st.st_size != sizeof(shared_result_table_t)
+            && (ftruncate(fd, 0) != 0 || ftruncate(fd, sizeof(shared_result_table_t)) != 0))
+    {
+        crust_status = CRUST_WRITE_FILE_FAILED;
+    }
+    else
+    {
+        void *p_mem = mmap(NULL, sizeof(shared_result_table_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p_mem == MAP_FAILED)
+        {
+            crust_status = CRUST_MALLOC_FAILED;
+        }
+        else
+        {
+            table = reinterpret_cast<shared_result_table_t *>(p_mem);
+            if (!is_valid(table))
+            {
+                table->header.magic.store(0, std::memory_order_relaxed);
+                for (size_t i = 0; i < SHARED_RESULT_CACHE_SLOTS; i++)
+                {
+                    shared_result_slot_t *slot = new (&table->slots[i]) shared_result_slot_t();
+                    slot->seq.store(0, std::memory_order_relaxed);
+                    slot->writer.store(0, std::memory_order_relaxed);
+                    slot->expires_at = 0;
+                }
+                table->header.version = SHARED_RESULT_CACHE_VERSION;
+                table->header.slot_num = SHARED_RESULT_CACHE_SLOTS;
+                table->header.slot_size = sizeof(shared_result_slot_t);
+                table->header.magic.store(SHARED_RESULT_CACHE_MAGIC, std::memory_order_release);
+                created = true;
+            }
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (CRUST_SUCCESS != crust_status)
+        return crust_status;
+
+    p_log->info("%s shared result cache at %s.\n", created ? "Created" : "Attached to", path);
+    this->table = table;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether results are shared with other processes
+ * @return: Enabled or not
+ */
+bool SharedResultCache::is_enabled()
+{
+    return this->table != NULL;
+}
+
+/**
+ * @description: Get home slot of digest
+ * @param digest -> Quote digest
+ * @return: Slot index
+ */
+static size_t get_home(const result_digest_t &digest)
+{
+    return ResultDigestHash()(digest) & (SHARED_RESULT_CACHE_SLOTS - 1);
+}
+
+/**
+ * @description: Copy slot without lock
+ * @param slot -> Slot
+ * @param copy -> Copy of slot fields
+ * @return: False if a writer owned or changed slot every time it was copied
+ */
+static bool read_slot(const shared_result_slot_t *slot, shared_result_slot_t *copy)
+{
+    for (int i = 0; i < SHARED_RESULT_CACHE_READ_RETRIES; i++)
+    {
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq & 1)
+            continue;
+        copy->expires_at = slot->expires_at;
+        copy->qv_result = slot->qv_result;
+        copy->ca = slot->ca;
+        memcpy(copy->fmspc, slot->fmspc, sizeof(copy->fmspc));
+        memcpy(copy->digest, slot->digest, sizeof(copy->digest));
+        memcpy(copy->collateral_digest, slot->collateral_digest, sizeof(copy->collateral_digest));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == seq)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @description: Lock slot for writing, taking it back from a writer which died owning it
+ * @param slot -> Slot
+ * @param seq -> Sequence while locked, passed to unlock
+ * @return: False if another writer owns slot
+ */
+static bool lock_slot(shared_result_slot_t *slot, uint32_t *seq)
+{
+    uint32_t cur = slot->seq.load(std::memory_order_relaxed);
+    if (cur & 1)
+    {
+        pid_t writer = slot->writer.load(std::memory_order_relaxed);
+        if (writer <= 0 || kill(writer, 0) == 0 || errno != ESRCH)
+            return false;
+    }
+    // Stays odd when taken back, readers never see what the dead writer left
+    uint32_t next = (cur & 1) ? cur + 2 : cur + 1;
+    if (!slot->seq.compare_exchange_strong(cur, next, std::memory_order_acquire, std::memory_order_relaxed))
+        return false;
+    slot->writer.store(getpid(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    *seq = next;
+
+    return true;
+}
+
+/**
+ * @description: Get result of quote
+ * @param digest -> Quote digest
+ * @param entry -> Result, whose collateral digest callers check against the current one
+ * @param key -> Collateral key the quote was verified with
+ * @return: False if quote has no result or its result expired
+ */
+bool SharedResultCache::get(const result_digest_t &digest, result_entry_t *entry, collateral_key_t *key)
+{
+    size_t home = get_home(digest);
+    time_t now = time(NULL);
+    for (size_t i = 0; i < SHARED_RESULT_CACHE_PROBES; i++)
+    {
+        shared_result_slot_t copy;
+        const shared_result_slot_t *slot = &this->table->slots[(home + i) & (SHARED_RESULT_CACHE_SLOTS - 1)];
+        if (!read_slot(slot, &copy) || copy.expires_at <= now || memcmp(copy.digest, digest.data(), digest.size()) != 0)
+            continue;
+
+        memcpy(key->fmspc, copy.fmspc, sizeof(key->fmspc));
+        key->ca = copy.ca ? "platform" : "processor";
+        entry->digest = digest;
+        entry->qv_result = (sgx_ql_qv_result_t)copy.qv_result;
+        entry->expires_at = copy.expires_at;
+        entry->collateral_name = get_collateral_name(*key);
+        memcpy(entry->collateral_digest.data(), copy.collateral_digest, entry->collateral_digest.size());
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @description: Put result of quote into the slot holding its old result, an empty or expired slot, or else
+ * the slot expiring first. Result is dropped if a writer owns that slot.
+ * @param entry -> Result
+ * @param key -> Collateral key the quote was verified with
+ */
+void SharedResultCache::put(const result_entry_t &entry, const collateral_key_t &key)
+{
+    size_t home = get_home(entry.digest);
+    time_t now = time(NULL);
+    shared_result_slot_t *victim = NULL;
+    int64_t victim_expires_at = INT64_MAX;
+    for (size_t i = 0; i < SHARED_RESULT_CACHE_PROBES; i++)
+    {
+        shared_result_slot_t copy;
+        shared_result_slot_t *slot = &this->table->slots[(home + i) & (SHARED_RESULT_CACHE_SLOTS - 1)];
+        if (!read_slot(slot, &copy))
+            continue;
+        if (memcmp(copy.digest, entry.digest.data(), entry.digest.size()) == 0)
+        {
+            victim = slot;
+            break;
+        }
+        int64_t expires_at = copy.expires_at <= now ? 0 : copy.expires_at;
+        if (expires_at < victim_expires_at)
+        {
+            victim = slot;
+            victim_expires_at = expires_at;
+        }
+    }
+    uint32_t seq;
+    if (victim == NULL || !lock_slot(victim, &seq))
+        return;
+
+    victim->expires_at = entry.expires_at;
+    victim->qv_result = entry.qv_result;
+    victim->ca = strcmp(key.ca, "platform") == 0 ? 1 : 0;
+    memcpy(victim->fmspc, key.fmspc, sizeof(victim->fmspc));
+    memcpy(victim->digest, entry.digest.data(), sizeof(victim->digest));
+    memcpy(victim->collateral_digest, entry.collateral_digest.data(), sizeof(victim->collateral_digest));
+    victim->seq.store(seq + 1, std::memory_order_release);
+}
@@ -0,0 +1,76 @@
+#ifndef _CRUST_SHARED_RESULT_CACHE_H_
+#define _CRUST_SHARED_RESULT_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+
+#include "CrustStatus.h"
+#include "ResultCache.h"
+
+#define SHARED_RESULT_CACHE_MAGIC 0x43525348
+// Bumped whenever table layout changes, tables of other versions are created again
+#define SHARED_RESULT_CACHE_VERSION 1
+// Slots in table, a power of two. Table takes 128 bytes per slot whatever is kept in it.
+#define SHARED_RESULT_CACHE_SLOTS (1 << 16)
+// Slots looked at from the home slot of a digest, the one expiring first is replaced when all are taken
+#define SHARED_RESULT_CACHE_PROBES 8
+// Times a reader copies a slot again when a writer changes it meanwhile
+#define SHARED_RESULT_CACHE_READ_RETRIES 4
+
+// One result, guarded by a sequence lock: odd sequence means a writer owns the slot, readers copy
+// it and check sequence didn't move.
+typedef struct alignas(64) _shared_result_slot_t
+{
+    std::atomic<uint32_t> seq;
+    // Process which last locked slot, so that a slot left locked by a crashed writer is taken back
+    std::atomic<pid_t> writer;
+    // 0 if slot is empty
+    int64_t expires_at;
+    uint32_t qv_result;
+    // 0 for processor CA, 1 for platform CA
+    uint8_t ca;
+    uint8_t fmspc[COLLATERAL_FMSPC_SIZE];
+    uint8_t reserved;
+    uint8_t digest[32];
+    uint8_t collateral_digest[32];
+} shared_result_slot_t;
+
+typedef struct alignas(64) _shared_result_header_t
+{
+    // Set last by the process which creates table
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t slot_size;
+} shared_result_header_t;
+
+typedef struct _shared_result_table_t
+{
+    shared_result_header_t header;
+    shared_result_slot_t slots[SHARED_RESULT_CACHE_SLOTS];
+} shared_result_table_t;
+
+// Quote stage results in a memory mapped file, shared by all workers and all service processes on
+// the host which are given the same path, so that a quote verified by one is not verified again by
+// others. Table is an open addressing hash table of fixed size, readers take no lock. Table is
+// created under a file lock with its magic set last, so a process crashing while it creates the
+// table leaves it to be created again by the next one.
+class SharedResultCache
+{
+public:
+    static SharedResultCache *shared_result_cache;
+    static SharedResultCache *get_instance();
+    crust_status_t init(const char *path);
+    bool is_enabled();
+    bool get(const result_digest_t &digest, result_entry_t *entry, collateral_key_t *key);
+    void put(const result_entry_t &entry, const collateral_key_t &key);
+
+private:
+    shared_result_table_t *table;
+    SharedResultCache(void);
+};
+
+#endif /* !_CRUST_SHARED_RESULT_CACHE_H_ */
@@ -0,0 +1,156 @@
+#include "ConcurrencyLimiter.h"
+
+#include <algorithm>
+
+std::mutex concurrency_limiter_mutex;
+
+ConcurrencyLimiter *ConcurrencyLimiter::concurrency_limiter = NULL;
+
+/**
+ * @description: single instance class function to get instance
+ * @return: concurrency limiter instance
+ */
+ConcurrencyLimiter *ConcurrencyLimiter::get_instance()
+{
+    if (ConcurrencyLimiter::concurrency_limiter == NULL)
+    {
+        concurrency_limiter_mutex.lock();
+        if (ConcurrencyLimiter::concurrency_limiter == NULL)
+        {
+            ConcurrencyLimiter::concurrency_limiter = new ConcurrencyLimiter();
+        }
+        concurrency_limiter_mutex.unlock();
+    }
+
+    return ConcurrencyLimiter::concurrency_limiter;
+}
+
+/**
+ * @description: constructor
+ */
+ConcurrencyLimiter::ConcurrencyLimiter()
+{
+    this->limit = LIMITER_INITIAL_LIMIT;
+    this->in_flight = 0;
+    this->saturated = false;
+    this->overload_seen = false;
+    this->samples_since_change = 0;
+    this->short_us = 0;
+    this->long_us = 0;
+}
+
+/**
+ * @description: Take a slot if limit is not reached
+ * @return: Whether slot is taken, it must be released afterwards
+ */
+bool ConcurrencyLimiter::try_acquire()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->in_flight >= this->limit)
+    {
+        this->saturated = true;
+        return false;
+    }
+    this->in_flight++;
+    if (this->in_flight == this->limit)
+        this->saturated = true;
+
+    return true;
+}
+
+/**
+ * @description: Give back a slot taken by try_acquire
+ */
+void ConcurrencyLimiter::release()
+{
+    std::function<void()> listener;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->in_flight--;
+        listener = this->release_listener;
+    }
+    if (listener)
+        listener();
+}
+
+/**
+ * @description: Adjust limit by latency of one quote verification
+ * @param latency_us -> Latency of quote library call
+ * @param overloaded -> Quote library failed for lack of collateral service or resources
+ */
+void ConcurrencyLimiter::record(uint64_t latency_us, bool overloaded)
+{
+    std::function<void()> listener;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        // Failed calls end at a timeout rather than with real latency
+        if (!overloaded)
+        {
+            if (this->long_us == 0)
+            {
+                this->short_us = latency_us;
+                this->long_us = latency_us;
+            }
+            this->short_us += (latency_us - this->short_us) / LIMITER_SHORT_SAMPLES;
+            this->long_us += (latency_us - this->long_us) / LIMITER_LONG_SAMPLES;
+        }
+        else
+        {
+            this->overload_seen = true;
+        }
+        double target_us = std::max(this->long_us * LIMITER_TOLERANCE, (double)LIMITER_MIN_TARGET_US);
+
+        this->samples_since_change++;
+        if (this->samples_since_change < this->limit)
+            return;
+        if (this->overload_seen || this->short_us > target_us)
+        {
+            this->limit = std::max(this->limit - std::max(this->limit / 4, (size_t)1), (size_t)LIMITER_MIN_LIMIT);
+            this->samples_since_change = 0;
+            this->saturated = false;
+            this->overload_seen = false;
+        }
+        else if (this->saturated && this->limit < LIMITER_MAX_LIMIT)
+        {
+            this->limit++;
+            this->samples_since_change = 0;
+            this->saturated = false;
+            listener = this->release_listener;
+        }
+    }
+    if (listener)
+        listener();
+}
+
+/**
+ * @description: Set function called whenever a slot may have become free
+ * @param listener -> Listener, which must not take a slot itself
+ */
+void ConcurrencyLimiter::set_release_listener(std::function<void()> listener)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->release_listener = listener;
+}
+
+/**
+ * @description: Get current limit
+ * @return: Limit
+ */
+size_t ConcurrencyLimiter::get_limit()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->limit;
+}
+
+/**
+ * @description: Get latency beyond which limit is lowered
+ * @return: Target in microseconds, 0 before any latency is seen
+ */
+uint64_t ConcurrencyLimiter::get_target_us()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->long_us == 0)
+        return 0;
+
+    return std::max((uint64_t)(this->long_us * LIMITER_TOLERANCE), (uint64_t)LIMITER_MIN_TARGET_US);
+}
@@ -0,0 +1,55 @@
+#ifndef _CRUST_CONCURRENCY_LIMITER_H_
+#define _CRUST_CONCURRENCY_LIMITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <mutex>
+
+// Quote verifications of each process running at the same time, before any latency is seen
+#define LIMITER_INITIAL_LIMIT 8
+#define LIMITER_MIN_LIMIT 1
+#define LIMITER_MAX_LIMIT 64
+// Samples averaged by recent latency, which is compared with target
+#define LIMITER_SHORT_SAMPLES 8
+// Samples averaged by baseline latency, so target follows lasting changes of collateral service
+#define LIMITER_LONG_SAMPLES 512
+// Recent latency beyond baseline times this is taken as overload
+#define LIMITER_TOLERANCE 2
+// Target is never below this, shorter latency is noise rather than overload
+#define LIMITER_MIN_TARGET_US 10000
+
+// Adaptive limit of quote verifications running at the same time, by additive increase
+// and multiplicative decrease. Limit grows by one after a limit's worth of samples while
+// it was reached, and drops by a quarter when recent latency exceeds target or quote
+// library fails for lack of resources. It changes at most once per limit's worth of
+// samples, so that one burst of slow calls counts once.
+class ConcurrencyLimiter
+{
+public:
+    static ConcurrencyLimiter *concurrency_limiter;
+    static ConcurrencyLimiter *get_instance();
+    bool try_acquire();
+    void release();
+    void record(uint64_t latency_us, bool overloaded);
+    void set_release_listener(std::function<void()> listener);
+    size_t get_limit();
+    uint64_t get_target_us();
+
+private:
+    std::mutex mutex;
+    size_t limit;
+    size_t in_flight;
+    // Limit was reached since it last changed
+    bool saturated;
+    // Quote library failed for lack of resources since limit last changed
+    bool overload_seen;
+    size_t samples_since_change;
+    double short_us;
+    double long_us;
+    // Called whenever a slot may have become free
+    std::function<void()> release_listener;
+    ConcurrencyLimiter(void);
+};
+
+#endif /* !_CRUST_CONCURRENCY_LIMITER_H_ */
@@ -0,0 +1,158 @@
+#include "FairScheduler.h"
+
+std::mutex fair_scheduler_mutex;
+
+FairScheduler *FairScheduler::fair_scheduler = NULL;
+
+/**
+ * @description: single instance class function to get instance
+ * @return: fair scheduler instance
+ */
+FairScheduler *FairScheduler::get_instance()
+{
+    if (FairScheduler::fair_scheduler == NULL)
+    {
+        fair_scheduler_mutex.lock();
+        if (FairScheduler::fair_scheduler == NULL)
+        {
+            FairScheduler::fair_scheduler = new FairScheduler();
+        }
+        fair_scheduler_mutex.unlock();
+    }
+
+    return FairScheduler::fair_scheduler;
+}
+
+/**
+ * @description: constructor
+ */
+FairScheduler::FairScheduler()
+{
+    this->stopping = false;
+    this->limiter = ConcurrencyLimiter::get_instance();
+    // Lock makes sure a waiting thread doesn't miss the slot between its check and its wait
+    this->limiter->set_release_listener([this] {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->active.empty())
+            this->cond.notify_one();
+    });
+    for (size_t i = 0; i < FAIR_SCHEDULER_THREAD_NUM; i++)
+    {
+        this->threads.push_back(std::thread(&FairScheduler::work, this));
+    }
+}
+
+/**
+ * @description: destructor, waiting jobs are run before threads exit
+ */
+FairScheduler::~FairScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->cond.notify_all();
+    for (auto &t : this->threads)
+        t.join();
+    for (auto &it : this->queues)
+        delete it.second;
+}
+
+/**
+ * @description: Queue job behind the other ones of the same account
+ * @param account -> Account the job is done for
+ * @param account_len -> Account length
+ * @param job -> Job
+ * @return: False if account already has too many jobs waiting, job is not run then
+ */
+bool FairScheduler::submit(const char *account, size_t account_len, std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        std::string_view key(account, account_len);
+        auto it = this->queues.find(key);
+        fair_queue_t *queue = NULL;
+        if (it != this->queues.end())
+        {
+            queue = it->second;
+            if (queue->jobs.size() >= FAIR_SCHEDULER_ACCOUNT_QUEUE_MAX)
+                return false;
+        }
+        else
+        {
+            queue = new fair_queue_t;
+            queue->account.assign(account, account_len);
+            this->queues[std::string_view(queue->account)] = queue;
+            this->active.push_back(queue);
+        }
+        queue->jobs.push_back(std::move(job));
+    }
+    this->cond.notify_one();
+
+    return true;
+}
+
+/**
+ * @description: Queue job like submit and wait until it is done
+ * @param account -> Account the job is done for
+ * @param account_len -> Account length
+ * @param job -> Job
+ * @return: False if account already has too many jobs waiting, job is not run then
+ */
+bool FairScheduler::run(const char *account, size_t account_len, std::function<void()> job)
+{
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    bool done = false;
+    bool queued = this->submit(account, account_len, [&job, &done_mutex, &done_cond, &done] {
+        job();
+        // Notified under lock, waiter's stack is gone as soon as it sees done
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done = true;
+        done_cond.notify_one();
+    });
+    if (!queued)
+        return false;
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cond.wait(lock, [&done] { return done; });
+
+    return true;
+}
+
+/**
+ * @description: Take one job of front account at a time once a limiter slot is free, then move that account to the back
+ */
+void FairScheduler::work()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        bool acquired = false;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            // Waiting jobs still run while stopping, whether a slot is free or not
+            this->cond.wait(lock, [this, &acquired] {
+                return this->stopping || (!this->active.empty() && (acquired = this->limiter->try_acquire()));
+            });
+            if (this->active.empty())
+                return;
+            fair_queue_t *queue = this->active.front();
+            this->active.pop_front();
+            job = std::move(queue->jobs.front());
+            queue->jobs.pop_front();
+            if (queue->jobs.empty())
+            {
+                this->queues.erase(std::string_view(queue->account));
+                delete queue;
+            }
+            else
+            {
+                this->active.push_back(queue);
+            }
+        }
+        job();
+        if (acquired)
+            this->limiter->release();
+    }
+}
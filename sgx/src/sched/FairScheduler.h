@@ -0,0 +1,59 @@
+#ifndef _CRUST_FAIR_SCHEDULER_H_
+#define _CRUST_FAIR_SCHEDULER_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ConcurrencyLimiter.h"
+
+// Threads of each process verifying quotes, as many as concurrency limit may grow to.
+// Limit decides how many of them take jobs, further requests wait in their account's queue.
+#define FAIR_SCHEDULER_THREAD_NUM LIMITER_MAX_LIMIT
+// Requests of one account waiting at the same time, further ones are rejected at once
+#define FAIR_SCHEDULER_ACCOUNT_QUEUE_MAX 8
+// Threads of each http server, enough that requests waiting for their turn don't hold all of them
+#define FAIR_SCHEDULER_HTTP_THREAD_NUM 128
+
+// Waiting jobs of one account
+typedef struct _fair_queue_t
+{
+    std::string account;
+    std::deque<std::function<void()>> jobs;
+} fair_queue_t;
+
+// Fixed threads taking jobs from per account queues in turn, so that an account
+// flooding requests only delays its own ones. This is deficit round robin where
+// every job costs the same, an account queue is dropped as soon as it is empty.
+// Each job holds a concurrency limiter slot while it runs.
+class FairScheduler
+{
+public:
+    static FairScheduler *fair_scheduler;
+    static FairScheduler *get_instance();
+    ~FairScheduler();
+    bool submit(const char *account, size_t account_len, std::function<void()> job);
+    bool run(const char *account, size_t account_len, std::function<void()> job);
+
+private:
+    void work();
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Keys point into account of their queue
+    std::unordered_map<std::string_view, fair_queue_t *> queues;
+    // Accounts with waiting jobs, front one is served next
+    std::deque<fair_queue_t *> active;
+    std::vector<std::thread> threads;
+    ConcurrencyLimiter *limiter;
+    bool stopping;
+    FairScheduler(void);
+};
+
+#endif /* !_CRUST_FAIR_SCHEDULER_H_ */
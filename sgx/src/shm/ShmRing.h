@@ -0,0 +1,125 @@
+#ifndef _CRUST_SHM_RING_H_
+#define _CRUST_SHM_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+
+// Layout of the shared memory request ring, used by both the service and its clients.
+//
+// Producers (clients) claim ring positions from tail, consumers (service threads
+// of every worker) take them from head. A slot carries one request and then its
+// response, its sequence tells the stage relative to the position p claiming it:
+//   p      free, the producer of position p may write its request
+//   p + 1  request published, waiting for a consumer
+//   p + 2  response published, waiting for the producer to read it
+//   p + 3  abandoned by a timed out producer, the consumer frees it
+//   p + N  freed for the producer one lap later
+// Data path is syscall free, futexes are only touched by sleeping sides.
+
+#define SHM_RING_MAGIC 0x50414344
+#define SHM_RING_VERSION 1
+// Slot number, bounds requests in flight. Must be a power of 2 no less than 4
+#define SHM_RING_SLOT_NUM 256
+// Room for signature, quote and account of one request
+#define SHM_RING_SLOT_DATA_SIZE (16 * 1024)
+#define SHM_RING_MESSAGE_SIZE 64
+// Busy polls before sleeping on futex, if there are other cpus to run the other side
+#define SHM_RING_SPIN_NUM 2000
+
+typedef struct _shm_request_t
+{
+    // Data holds signature, quote and account in order
+    uint32_t sig_len;
+    uint32_t quote_len;
+    uint32_t account_len;
+} shm_request_t;
+
+typedef struct _shm_response_t
+{
+    // Same status code as /entryNetwork
+    int32_t status_code;
+    // sgx_ql_qv_result_t
+    uint32_t qv_result;
+    // Error message, empty if verified
+    char message[SHM_RING_MESSAGE_SIZE];
+    // Identity in hex, valid if verified
+    char pubkey[129];
+    char mrenclave[65];
+} shm_response_t;
+
+typedef struct _shm_slot_t
+{
+    alignas(64) std::atomic<uint32_t> seq;
+    // Set by producer sleeping on seq for response
+    std::atomic<uint32_t> producer_waiting;
+    shm_request_t request;
+    shm_response_t response;
+    uint8_t data[SHM_RING_SLOT_DATA_SIZE];
+} shm_slot_t;
+
+typedef struct _shm_ring_t
+{
+    // Set last by service when ring is ready
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t slot_data_size;
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) std::atomic<uint32_t> head;
+    // Bumped by producers to wake sleeping consumers
+    alignas(64) std::atomic<uint32_t> signal;
+    std::atomic<uint32_t> sleepers;
+    shm_slot_t slots[SHM_RING_SLOT_NUM];
+} shm_ring_t;
+
+/**
+ * @description: Sleep while value at address is unchanged, works across processes
+ * @param addr -> Futex word in shared memory
+ * @param val -> Expected value
+ * @param timeout_ms -> Timeout in milliseconds
+ */
+static inline void shm_futex_wait(std::atomic<uint32_t> *addr, uint32_t val, uint32_t timeout_ms)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+/**
+ * @description: Wake sleepers on address
+ * @param addr -> Futex word in shared memory
+ * @param num -> Number of sleepers to wake
+ */
+static inline void shm_futex_wake(std::atomic<uint32_t> *addr, int num)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE, num, NULL, NULL, 0);
+}
+
+/**
+ * @description: Hint cpu that current thread is busy polling
+ */
+static inline void shm_cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * @description: Get busy poll number, polling is pointless when the other side waits for the only cpu
+ * @return: Poll number
+ */
+static inline size_t shm_spin_num()
+{
+    static const size_t spin_num = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_RING_SPIN_NUM : 0;
+    return spin_num;
+}
+
+#endif /* !_CRUST_SHM_RING_H_ */
@@ -0,0 +1,333 @@
+#include "ShmServer.h"
+#include "Arena.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Verifier.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <mutex>
+#include <new>
+
+std::mutex shm_server_mutex;
+
+ShmServer *ShmServer::shm_server = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: shm server instance
+ */
+ShmServer *ShmServer::get_instance()
+{
+    if (ShmServer::shm_server == NULL)
+    {
+        shm_server_mutex.lock();
+        if (ShmServer::shm_server == NULL)
+        {
+            ShmServer::shm_server = new ShmServer();
+        }
+        shm_server_mutex.unlock();
+    }
+
+    return ShmServer::shm_server;
+}
+
+/**
+ * @description: constructor
+ */
+ShmServer::ShmServer()
+{
+    this->ring = NULL;
+    this->running = false;
+}
+
+/**
+ * @description: Create ring file and map it, must be called before fork so that all workers share it.
+ * Ring left by last run is replaced, clients attached to it have to attach again.
+ * @param path -> Ring file path, like /dev/shm/dcap-ring
+ * @return: Init status
+ */
+crust_status_t ShmServer::init(const char *path)
+{
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISREG(st.st_mode))
+        {
+            return CRUST_OPEN_FILE_FAILED;
+        }
+        unlink(path);
+    }
+
+    // Clients in the same group may attach
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+    if (fd == -1)
+    {
+        return CRUST_OPEN_FILE_FAILED;
+    }
+    fchmod(fd, 0660);
+    if (ftruncate(fd, sizeof(shm_ring_t)) != 0)
+    {
+        close(fd);
+        unlink(path);
+        return CRUST_WRITE_FILE_FAILED;
+    }
+    void *p_mem = mmap(NULL, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p_mem == MAP_FAILED)
+    {
+        unlink(path);
+        return CRUST_MALLOC_FAILED;
+    }
+
+    shm_ring_t *ring = reinterpret_cast<shm_ring_t *>(p_mem);
+    new (ring) shm_ring_t();
+    ring->version = SHM_RING_VERSION;
+    ring->slot_num = SHM_RING_SLOT_NUM;
+    ring->slot_data_size = SHM_RING_SLOT_DATA_SIZE;
+    ring->tail = 0;
+    ring->head = 0;
+    ring->signal = 0;
+    ring->sleepers = 0;
+    for (uint32_t i = 0; i < SHM_RING_SLOT_NUM; i++)
+    {
+        ring->slots[i].seq = i;
+        ring->slots[i].producer_waiting = 0;
+    }
+    ring->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+
+    this->ring = ring;
+    this->path = path;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Unmap and remove ring file, called by the process which inited it on exit
+ */
+void ShmServer::destroy()
+{
+    if (this->ring == NULL)
+    {
+        return;
+    }
+
+    this->ring->magic = 0;
+    munmap(this->ring, sizeof(shm_ring_t));
+    unlink(this->path.c_str());
+    this->ring = NULL;
+}
+
+/**
+ * @description: Whether shared memory ring is served
+ * @return: Enabled or not
+ */
+bool ShmServer::is_enabled()
+{
+    return this->ring != NULL;
+}
+
+/**
+ * @description: Start consumer of current process, which keeps requests of the whole ring in flight on one loop thread
+ */
+void ShmServer::start()
+{
+    if (this->ring == NULL || this->running)
+    {
+        return;
+    }
+
+    this->running = true;
+    this->thread = std::thread(&ShmServer::consume, this);
+}
+
+/**
+ * @description: Stop consumer of current process, requests in flight are finished first
+ */
+void ShmServer::stop()
+{
+    if (!this->running)
+    {
+        return;
+    }
+
+    this->running = false;
+    this->thread.join();
+}
+
+/**
+ * @description: Run ring poller and request handlers until stopped
+ */
+void ShmServer::consume()
+{
+    Scheduler scheduler;
+    BlockingPool pool(SHM_SERVER_BLOCKING_THREAD_NUM);
+    scheduler.spawn(this->poll_ring(scheduler, pool));
+    scheduler.run();
+}
+
+/**
+ * @description: Take published requests from ring head and start a handler for each until stopped
+ * @param scheduler -> Scheduler of loop thread
+ * @param pool -> Pool for blocking calls
+ * @return: Task
+ */
+Task<void> ShmServer::poll_ring(Scheduler &scheduler, BlockingPool &pool)
+{
+    shm_ring_t *ring = this->ring;
+    const uint32_t mask = ring->slot_num - 1;
+    size_t idle = 0;
+    size_t claimed = 0;
+    while (this->running)
+    {
+        uint32_t pos = ring->head.load(std::memory_order_acquire);
+        shm_slot_t *slot = &ring->slots[pos & mask];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 1 || diff == 3)
+        {
+            idle = 0;
+            if (ring->head.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel))
+            {
+                if (diff == 3)
+                {
+                    slot->seq.store(pos + ring->slot_num, std::memory_order_release);
+                    continue;
+                }
+                scheduler.spawn(this->handle(scheduler, pool, slot, pos));
+                if (++claimed % SHM_SERVER_CLAIM_BATCH == 0)
+                    co_await scheduler.schedule();
+            }
+            continue;
+        }
+        if (diff != 0)
+        {
+            // Head moved on already
+            continue;
+        }
+
+        // Ring is empty, poll for a while letting handlers run, and then sleep until a producer signals
+        if (++idle < shm_spin_num())
+        {
+            co_await scheduler.schedule();
+            continue;
+        }
+        co_await pool.offload(scheduler, [this, pos] { this->wait_request(pos); });
+        idle = 0;
+    }
+}
+
+/**
+ * @description: Sleep until a producer signals or timeout, runs on blocking pool
+ * @param pos -> Empty position at ring head
+ */
+void ShmServer::wait_request(uint32_t pos)
+{
+    shm_ring_t *ring = this->ring;
+    shm_slot_t *slot = &ring->slots[pos & (ring->slot_num - 1)];
+    uint32_t signal = ring->signal.load();
+    ring->sleepers.fetch_add(1);
+    if (ring->head.load() == pos && slot->seq.load() == pos)
+    {
+        shm_futex_wait(&ring->signal, signal, SHM_SERVER_SLEEP_MS);
+    }
+    ring->sleepers.fetch_sub(1);
+}
+
+/**
+ * @description: Publish response, producer may have given up in the meantime
+ * @param slot -> Slot with response written
+ * @param pos -> Position of slot
+ */
+void ShmServer::publish(shm_slot_t *slot, uint32_t pos)
+{
+    uint32_t seq = slot->seq.exchange(pos + 2);
+    if (seq == pos + 3)
+    {
+        slot->seq.store(pos + this->ring->slot_num, std::memory_order_release);
+    }
+    else if (slot->producer_waiting.load() != 0)
+    {
+        shm_futex_wake(&slot->seq, INT_MAX);
+    }
+}
+
+/**
+ * @description: Verify request in slot and publish response. Decoding and signature run on loop thread,
+ * quote verification is offloaded to blocking pool.
+ * @param scheduler -> Scheduler of loop thread
+ * @param pool -> Pool for blocking calls
+ * @param slot -> Claimed slot with published request
+ * @param pos -> Position of slot
+ * @return: Task
+ */
+Task<void> ShmServer::handle(Scheduler &scheduler, BlockingPool &pool, shm_slot_t *slot, uint32_t pos)
+{
+    shm_response_t *response = &slot->response;
+    memset(response, 0, sizeof(shm_response_t));
+    response->status_code = 500;
+
+    Metrics *p_metrics = Metrics::get_instance();
+    Verifier *p_verifier = Verifier::get_instance();
+    auto start_time = std::chrono::steady_clock::now();
+
+    shm_request_t request = slot->request;
+    if ((uint64_t)request.sig_len + request.quote_len + request.account_len > SHM_RING_SLOT_DATA_SIZE)
+    {
+        response->status_code = 400;
+        strncpy(response->message, "Unexpected error", SHM_RING_MESSAGE_SIZE - 1);
+        this->publish(slot, pos);
+        co_return;
+    }
+
+    Arena *arena = Arena::create();
+    if (arena == NULL)
+    {
+        strncpy(response->message, "Unexpected error", SHM_RING_MESSAGE_SIZE - 1);
+        this->publish(slot, pos);
+        co_return;
+    }
+
+    p_log->info("Dealing with new shared memory request...\n");
+    verify_result_t result;
+    verify_evidence_t evidence;
+    const uint8_t *data = slot->data;
+    if (p_verifier->load_evidence(arena,
+                data, request.sig_len,
+                data + request.sig_len, request.quote_len,
+                reinterpret_cast<const char *>(data + request.sig_len + request.quote_len), request.account_len,
+                &evidence, &result)
+            && p_verifier->verify_policy(&evidence, &result)
+            && !p_verifier->verify_rejected(&evidence, &result)
+            && p_verifier->verify_signature(arena, &evidence, &result))
+    {
+        // Shared memory requests carry no deadline, they are always verified
+        co_await pool.offload(scheduler, [&] {
+            p_verifier->verify_quote_limited(arena, &evidence, &result, [] { return false; });
+        });
+    }
+
+    response->status_code = result.status_code;
+    response->qv_result = result.qv_result;
+    if (result.message != NULL)
+    {
+        strncpy(response->message, result.message, SHM_RING_MESSAGE_SIZE - 1);
+    }
+    if (result.status_code == 200)
+    {
+        memcpy(response->pubkey, result.pubkey, sizeof(response->pubkey));
+        memcpy(response->mrenclave, result.mrenclave, sizeof(response->mrenclave));
+    }
+    Arena::release(arena);
+    this->publish(slot, pos);
+
+    p_metrics->add(METRIC_REQUEST_TOTAL);
+    p_metrics->add(METRIC_SHM_REQUEST_TOTAL);
+    p_metrics->add(200 == result.status_code ? METRIC_VERIFY_SUCCESS : METRIC_VERIFY_FAILED);
+    p_metrics->add(METRIC_VERIFY_LATENCY_US, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_time).count());
+}
@@ -0,0 +1,47 @@
+#ifndef _CRUST_SHM_SERVER_H_
+#define _CRUST_SHM_SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShmRing.h"
+#include "Scheduler.h"
+#include "Task.h"
+#include "CrustStatus.h"
+
+// Threads of each process running quote verification, which may block on collateral
+#define SHM_SERVER_BLOCKING_THREAD_NUM 16
+// Requests claimed in a row before started ones get a turn on loop thread
+#define SHM_SERVER_CLAIM_BATCH 16
+// Longest sleep of an idle consumer, bounds how long stop takes
+#define SHM_SERVER_SLEEP_MS 100
+
+class ShmServer
+{
+public:
+    static ShmServer *shm_server;
+    static ShmServer *get_instance();
+    crust_status_t init(const char *path);
+    void destroy();
+    bool is_enabled();
+    void start();
+    void stop();
+
+private:
+    void consume();
+    Task<void> poll_ring(Scheduler &scheduler, BlockingPool &pool);
+    Task<void> handle(Scheduler &scheduler, BlockingPool &pool, shm_slot_t *slot, uint32_t pos);
+    void wait_request(uint32_t pos);
+    void publish(shm_slot_t *slot, uint32_t pos);
+    shm_ring_t *ring;
+    std::string path;
+    std::atomic<bool> running;
+    std::thread thread;
+    ShmServer(void);
+};
+
+#endif /* !_CRUST_SHM_SERVER_H_ */
@@ -0,0 +1,226 @@
+#include "Arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+
+// Free blocks cached by current thread
+struct ArenaPool
+{
+    arena_block_t *blocks = NULL;
+    size_t block_num = 0;
+
+    ~ArenaPool()
+    {
+        while (this->blocks != NULL)
+        {
+            arena_block_t *next = this->blocks->next;
+            free(this->blocks);
+            this->blocks = next;
+        }
+    }
+};
+
+static thread_local ArenaPool arena_pool;
+
+/**
+ * @description: Get a block with at least indicated capacity, pooled blocks are reused first
+ * @param capacity -> Needed capacity after block header
+ * @return: Block, NULL if out of memory
+ */
+static arena_block_t *get_block(size_t capacity)
+{
+    if (capacity <= ARENA_BLOCK_SIZE - sizeof(arena_block_t) && arena_pool.blocks != NULL)
+    {
+        arena_block_t *block = arena_pool.blocks;
+        arena_pool.blocks = block->next;
+        arena_pool.block_num--;
+        block->next = NULL;
+        block->used = sizeof(arena_block_t);
+        return block;
+    }
+
+    if (capacity > SIZE_MAX - sizeof(arena_block_t))
+    {
+        return NULL;
+    }
+
+    size_t size = capacity + sizeof(arena_block_t);
+    if (size < ARENA_BLOCK_SIZE)
+    {
+        size = ARENA_BLOCK_SIZE;
+    }
+    arena_block_t *block = (arena_block_t *)malloc(size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = sizeof(arena_block_t);
+
+    return block;
+}
+
+/**
+ * @description: Give block back to current thread's pool, oversized blocks and the ones beyond pool limit are freed
+ * @param block -> Block to be put back
+ */
+static void put_block(arena_block_t *block)
+{
+    if (block->size != ARENA_BLOCK_SIZE || arena_pool.block_num >= ARENA_POOL_MAX_BLOCKS)
+    {
+        free(block);
+        return;
+    }
+
+    block->next = arena_pool.blocks;
+    arena_pool.blocks = block;
+    arena_pool.block_num++;
+}
+
+/**
+ * @description: Create an arena
+ * @return: Arena, NULL if out of memory
+ */
+Arena *Arena::create()
+{
+    arena_block_t *block = get_block(sizeof(Arena));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    Arena *arena = new (reinterpret_cast<uint8_t *>(block) + block->used) Arena(block);
+    block->used += sizeof(Arena);
+
+    return arena;
+}
+
+/**
+ * @description: Release all memory allocated from arena and the arena itself
+ * @param arena -> Arena to be released
+ */
+void Arena::release(Arena *arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    arena_block_t *block = arena->head;
+    arena->~Arena();
+    while (block != NULL)
+    {
+        arena_block_t *next = block->next;
+        put_block(block);
+        block = next;
+    }
+}
+
+/**
+ * @description: constructor
+ * @param block -> First block, which holds the arena
+ */
+Arena::Arena(arena_block_t *block)
+{
+    this->head = block;
+    this->last = NULL;
+}
+
+/**
+ * @description: Allocate memory from arena
+ * @param size -> Memory size
+ * @param align -> Alignment, must be power of 2
+ * @return: Allocated memory, NULL if out of memory
+ */
+void *Arena::alloc(size_t size, size_t align)
+{
+    if (size > SIZE_MAX - align)
+    {
+        return NULL;
+    }
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(this->head);
+    size_t offset = ((base + this->head->used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+    if (offset > this->head->size || size > this->head->size - offset)
+    {
+        arena_block_t *block = get_block(size + align);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = this->head;
+        this->head = block;
+        base = reinterpret_cast<uintptr_t>(block);
+        offset = ((base + block->used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+    }
+
+    this->head->used = offset + size;
+    this->last = reinterpret_cast<uint8_t *>(this->head) + offset;
+
+    return this->last;
+}
+
+/**
+ * @description: Resize memory allocated from arena, the last allocation is extended in place if possible
+ * @param p -> Memory to be resized, NULL means a new allocation
+ * @param old_size -> Current size
+ * @param new_size -> New size
+ * @return: Resized memory with old content kept, NULL if out of memory
+ */
+void *Arena::grow(void *p, size_t old_size, size_t new_size)
+{
+    if (p != NULL && p == this->last)
+    {
+        size_t offset = reinterpret_cast<uint8_t *>(p) - reinterpret_cast<uint8_t *>(this->head);
+        if (new_size <= this->head->size - offset)
+        {
+            this->head->used = offset + new_size;
+            return p;
+        }
+    }
+
+    void *q = this->alloc(new_size);
+    if (q != NULL && p != NULL)
+    {
+        memcpy(q, p, old_size < new_size ? old_size : new_size);
+    }
+
+    return q;
+}
+
+/**
+ * @description: Copy string into arena
+ * @param src -> Source string
+ * @param len -> Source string length
+ * @return: NUL terminated copy, NULL if out of memory
+ */
+char *Arena::strndup(const char *src, size_t len)
+{
+    char *dst = (char *)this->alloc(len + 1, 1);
+    if (dst == NULL)
+    {
+        return NULL;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+
+    return dst;
+}
+
+/**
+ * @description: Get memory size taken from blocks, including headers and padding
+ * @return: Used size
+ */
+size_t Arena::get_used()
+{
+    size_t used = 0;
+    for (arena_block_t *block = this->head; block != NULL; block = block->next)
+    {
+        used += block->used;
+    }
+
+    return used;
+}
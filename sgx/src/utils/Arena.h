@@ -0,0 +1,38 @@
+#ifndef _CRUST_ARENA_H_
+#define _CRUST_ARENA_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Size of pooled arena blocks, enough for a whole /entryNetwork request
+#define ARENA_BLOCK_SIZE (64 * 1024)
+// Maximum free blocks cached by each thread
+#define ARENA_POOL_MAX_BLOCKS 8
+
+typedef struct _arena_block_t
+{
+    struct _arena_block_t *next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+// Monotonic allocator, memory is only given back all at once by release.
+// The arena itself lives at the head of its first block, so creating and
+// releasing it reaches malloc only when the thread's block pool is empty.
+class Arena
+{
+public:
+    static Arena *create();
+    static void release(Arena *arena);
+    void *alloc(size_t size, size_t align = sizeof(void *));
+    void *grow(void *p, size_t old_size, size_t new_size);
+    char *strndup(const char *src, size_t len);
+    size_t get_used();
+
+private:
+    arena_block_t *head;
+    void *last;
+    Arena(arena_block_t *block);
+};
+
+#endif /* !_CRUST_ARENA_H_ */
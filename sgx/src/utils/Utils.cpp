@@ -1,5 +1,12 @@
 #include "Utils.h"
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <chrono>
+
 static char *_hex_buffer = NULL;
 static size_t _hex_buffer_size = 0;
 const char _hextable[] = "0123456789abcdef";
@@ -56,6 +63,24 @@ uint8_t *hexstring_to_bytes(const char *src, size_t len)
     return p_target;
 }
 
+/**
+ * @description: Convert hexstring to bytes into caller's buffer, stops at NUL like hexstring_to_bytes
+ * @param src -> Source char*
+ * @param len -> Source char* length
+ * @param dest -> Destination buffer, at least len/2 bytes
+ * @return: Converted bytes number
+ */
+size_t hexstring_to_buffer(const char *src, size_t len, uint8_t *dest)
+{
+    size_t i = 0;
+    for (; i + 1 < len && src[i] && src[i + 1]; i += 2)
+    {
+        *(dest++) = (uint8_t)(char_to_int(src[i]) * 16 + char_to_int(src[i + 1]));
+    }
+
+    return i / 2;
+}
+
 /**
  * @description: Print hexstring
  * @param vsrc -> Pointer to source data
@@ -131,6 +156,23 @@ std::string hexstring(const void *vsrc, size_t len)
     return ret;
 }
 
+/**
+ * @description: Transform data to hexstring into caller's buffer
+ * @param vsrc -> Pointer to original data buffer
+ * @param len -> Original data buffer length
+ * @param dest -> Destination buffer, at least len*2+1 chars, NUL terminated
+ */
+void hexstring_to_chars(const void *vsrc, size_t len, char *dest)
+{
+    const unsigned char *src = (const unsigned char *)vsrc;
+    for (size_t i = 0; i < len; ++i)
+    {
+        *(dest++) = _hextable[src[i] >> 4];
+        *(dest++) = _hextable[src[i] & 0xf];
+    }
+    *dest = '\0';
+}
+
 /**
  * @description: Numeral to hexstring
  * @param num -> Numeral
@@ -189,3 +231,162 @@ cleanup:
 
 	return key;
 }
+
+/**
+ * @description: Whether peer of connected socket is on this host, loopback or unix domain
+ * @param sock -> Connected socket
+ * @return: Local peer or not
+ */
+bool is_local_peer(int sock)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(sock, reinterpret_cast<struct sockaddr *>(&addr), &addr_len) != 0)
+    {
+        return false;
+    }
+
+    if (addr.ss_family == AF_UNIX)
+    {
+        return true;
+    }
+    if (addr.ss_family == AF_INET)
+    {
+        const struct sockaddr_in *addr4 = reinterpret_cast<const struct sockaddr_in *>(&addr);
+        return (ntohl(addr4->sin_addr.s_addr) >> 24) == 127;
+    }
+    if (addr.ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *addr6 = reinterpret_cast<const struct sockaddr_in6 *>(&addr);
+        if (IN6_IS_ADDR_LOOPBACK(&addr6->sin6_addr))
+        {
+            return true;
+        }
+        return IN6_IS_ADDR_V4MAPPED(&addr6->sin6_addr) && addr6->sin6_addr.s6_addr[12] == 127;
+    }
+
+    return false;
+}
+
+/**
+ * @description: Create a listening unix domain socket, stale socket file left by last run is replaced
+ * @param path -> Socket file path
+ * @return: Listening socket, -1 if failed
+ */
+int create_unix_listener(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    // Never remove a file which is not a socket
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1)
+    {
+        return -1;
+    }
+
+    // Anyone may connect, peers are checked by their credentials after accept
+    if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0
+            || chmod(path, 0666) != 0
+            || listen(sock, SOMAXCONN) != 0)
+    {
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ * @description: Get credentials of unix domain socket peer
+ * @param sock -> Connected unix domain socket
+ * @param uid -> Peer's user id
+ * @param gid -> Peer's group id
+ * @return: Got or not
+ */
+bool get_peer_cred(int sock, uid_t *uid, gid_t *gid)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred_len != sizeof(cred))
+    {
+        return false;
+    }
+    *uid = cred.uid;
+    *gid = cred.gid;
+
+    return true;
+}
+
+/**
+ * @description: Parse comma separated id list like '0,1000'
+ * @param list -> Id list
+ * @param ids -> Parsed ids are appended to it
+ * @return: Valid list or not
+ */
+bool parse_id_list(const char *list, std::vector<uint32_t> &ids)
+{
+    const char *p = list;
+    while (*p != '\0')
+    {
+        char *end = NULL;
+        unsigned long id = strtoul(p, &end, 10);
+        if (end == p || id > UINT32_MAX || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        ids.push_back((uint32_t)id);
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return !ids.empty();
+}
+
+/**
+ * @description: Parse request deadline, which is Unix time in milliseconds like the offchain worker's timestamp
+ * @param value -> Header value
+ * @return: Deadline, 0 if absent or invalid
+ */
+uint64_t parse_deadline_ms(const char *value)
+{
+    char *end = NULL;
+    unsigned long long deadline_ms = strtoull(value, &end, 10);
+    if (end == value || *end != '\0' || *value == '-')
+    {
+        return 0;
+    }
+
+    return deadline_ms;
+}
+
+/**
+ * @description: Check whether request deadline has passed
+ * @param deadline_ms -> Deadline in Unix milliseconds, 0 for none
+ * @return: Passed or not
+ */
+bool is_deadline_passed(uint64_t deadline_ms)
+{
+    if (deadline_ms == 0)
+    {
+        return false;
+    }
+
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() >= deadline_ms;
+}
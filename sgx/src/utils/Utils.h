@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <string.h>
 #include <string>
+#include <vector>
 
 //#include <openssl/bio.h>
 //#include <openssl/evp.h>
@@ -20,6 +21,13 @@
 
 #include <sgx_key_exchange.h>
 
+// Header carrying client's deadline, work still queued after it is dropped
+#define REQUEST_DEADLINE_HEADER "X-Request-Deadline"
+// Largest request body taken, far beyond any /entryNetwork request
+#define REQUEST_MAX_BODY_SIZE (1024 * 1024)
+// Body memory taken at once for Content-Length, larger bodies grow as they arrive
+#define REQUEST_BODY_PREALLOC_SIZE (16 * 1024)
+
 static enum _error_type {
 	e_none,
 	e_crypto,
@@ -34,12 +42,20 @@ extern "C"
 
     int char_to_int(char input);
     uint8_t *hexstring_to_bytes(const char *src, size_t len);
+    size_t hexstring_to_buffer(const char *src, size_t len, uint8_t *dest);
     int from_hexstring(unsigned char *dest, const void *src, size_t len);
     void print_hexstring(const void *vsrc, size_t len);
     std::string hexstring(const void *vsrc, size_t len);
+    void hexstring_to_chars(const void *vsrc, size_t len, char *dest);
     std::string num_to_hexstring(size_t num);
     void remove_char(std::string &data, char c);
     EC_KEY *key_from_sgx_ec256 (sgx_ec256_public_t *k);
+    bool is_local_peer(int sock);
+    int create_unix_listener(const char *path);
+    bool get_peer_cred(int sock, uid_t *uid, gid_t *gid);
+    bool parse_id_list(const char *list, std::vector<uint32_t> &ids);
+    uint64_t parse_deadline_ms(const char *value);
+    bool is_deadline_passed(uint64_t deadline_ms);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,155 @@
+#include "TokenSigner.h"
+
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+std::mutex token_signer_mutex;
+
+TokenSigner *TokenSigner::token_signer = NULL;
+
+/**
+ * @description: single instance class function to get instance
+ * @return: token signer instance
+ */
+TokenSigner *TokenSigner::get_instance()
+{
+    if (TokenSigner::token_signer == NULL)
+    {
+        token_signer_mutex.lock();
+        if (TokenSigner::token_signer == NULL)
+        {
+            TokenSigner::token_signer = new TokenSigner();
+        }
+        token_signer_mutex.unlock();
+    }
+
+    return TokenSigner::token_signer;
+}
+
+/**
+ * @description: constructor
+ */
+TokenSigner::TokenSigner()
+{
+}
+
+/**
+ * @description: Read service secret, must be called before fork
+ * @param key_path -> File holding secret, shared by all service processes whose tokens are accepted by each other
+ * @return: Init status
+ */
+crust_status_t TokenSigner::init(const char *key_path)
+{
+    int fd = open(key_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return CRUST_OPEN_FILE_FAILED;
+    std::string key;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        key.append(buf, n);
+    close(fd);
+    if (n < 0)
+        return CRUST_OPEN_FILE_FAILED;
+    // A secret written by echo ends with a new line
+    while (!key.empty() && (key.back() == '\n' || key.back() == '\r'))
+        key.pop_back();
+    if (key.size() < VERIFY_TOKEN_KEY_MIN_SIZE)
+        return CRUST_INVALID_META_DATA;
+    this->key = key;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Whether tokens are issued and accepted
+ * @return: Enabled or not
+ */
+bool TokenSigner::is_enabled()
+{
+    return !this->key.empty();
+}
+
+/**
+ * @description: Get MAC of token
+ * @param evidence_digest -> Digest of quote, signature and account
+ * @param report_body -> Report body of quote
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param claims -> Version, expiry and quote verification result as carried by token
+ * @param mac -> HMAC-SHA256
+ */
+void TokenSigner::get_mac(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+        const uint8_t *claims, uint8_t *mac)
+{
+    unsigned int mac_len = 32;
+    HMAC_CTX *ctx = HMAC_CTX_new();
+    HMAC_Init_ex(ctx, this->key.data(), (int)this->key.size(), EVP_sha256(), NULL);
+    HMAC_Update(ctx, claims, 1 + 8 + 4);
+    HMAC_Update(ctx, evidence_digest, 32);
+    HMAC_Update(ctx, (const uint8_t *)&report_body->report_data, sizeof(report_body->report_data));
+    HMAC_Update(ctx, (const uint8_t *)&report_body->mr_enclave, sizeof(report_body->mr_enclave));
+    HMAC_Update(ctx, (const uint8_t *)account, account_len);
+    HMAC_Final(ctx, mac, &mac_len);
+    HMAC_CTX_free(ctx);
+}
+
+/**
+ * @description: Issue token for verified evidence
+ * @param evidence_digest -> Digest of quote, signature and account
+ * @param report_body -> Report body of quote
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param token -> Claims
+ * @param hex -> Token as hex, VERIFY_TOKEN_SIZE * 2 + 1 bytes
+ */
+void TokenSigner::sign(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+        const verify_token_t *token, char *hex)
+{
+    uint8_t buf[VERIFY_TOKEN_SIZE];
+    uint32_t qv_result = token->qv_result;
+    buf[0] = VERIFY_TOKEN_VERSION;
+    memcpy(buf + 1, &token->expires_at, 8);
+    memcpy(buf + 1 + 8, &qv_result, 4);
+    this->get_mac(evidence_digest, report_body, account, account_len, buf, buf + 1 + 8 + 4);
+    hexstring_to_chars(buf, sizeof(buf), hex);
+}
+
+/**
+ * @description: Check token against evidence it was issued for
+ * @param evidence_digest -> Digest of quote, signature and account
+ * @param report_body -> Report body of quote
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param hex -> Token as hex
+ * @param hex_len -> Token length
+ * @param token -> Claims, valid if token holds
+ * @return: Whether token was issued for this evidence with current secret and hasn't expired
+ */
+bool TokenSigner::check(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+        const char *hex, size_t hex_len, verify_token_t *token)
+{
+    uint8_t buf[VERIFY_TOKEN_SIZE];
+    if (hex_len != VERIFY_TOKEN_SIZE * 2 || hexstring_to_buffer(hex, hex_len, buf) != VERIFY_TOKEN_SIZE
+            || buf[0] != VERIFY_TOKEN_VERSION)
+        return false;
+    uint32_t qv_result;
+    memcpy(&token->expires_at, buf + 1, 8);
+    memcpy(&qv_result, buf + 1 + 8, 4);
+    token->qv_result = (sgx_ql_qv_result_t)qv_result;
+    if (token->expires_at <= time(NULL))
+        return false;
+
+    uint8_t mac[32];
+    this->get_mac(evidence_digest, report_body, account, account_len, buf, mac);
+
+    return CRYPTO_memcmp(mac, buf + 1 + 8 + 4, sizeof(mac)) == 0;
+}
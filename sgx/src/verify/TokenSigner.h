@@ -0,0 +1,51 @@
+#ifndef _CRUST_TOKEN_SIGNER_H_
+#define _CRUST_TOKEN_SIGNER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string>
+
+#include "sgx_qve_header.h"
+#include "sgx_report.h"
+
+#include "CrustStatus.h"
+
+#define VERIFY_TOKEN_VERSION 1
+// How long a token confirms its evidence, collateral changes within it are not seen by token holders
+#define VERIFY_TOKEN_TTL_S 600
+// Shortest service secret accepted
+#define VERIFY_TOKEN_KEY_MIN_SIZE 32
+// Version, expiry, quote verification result and HMAC-SHA256
+#define VERIFY_TOKEN_SIZE (1 + 8 + 4 + 32)
+
+// Claims a token carries, all covered by its MAC together with evidence digest
+typedef struct _verify_token_t
+{
+    int64_t expires_at;
+    sgx_ql_qv_result_t qv_result;
+} verify_token_t;
+
+// Stateless tokens for verified evidence: an HMAC keyed by a service secret over evidence digest,
+// identity, verdict and expiry. Any process holding the same secret confirms a token by one MAC,
+// whatever its caches hold.
+class TokenSigner
+{
+public:
+    static TokenSigner *token_signer;
+    static TokenSigner *get_instance();
+    crust_status_t init(const char *key_path);
+    bool is_enabled();
+    void sign(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+            const verify_token_t *token, char *hex);
+    bool check(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+            const char *hex, size_t hex_len, verify_token_t *token);
+
+private:
+    void get_mac(const uint8_t *evidence_digest, const sgx_report_body_t *report_body, const char *account, size_t account_len,
+            const uint8_t *claims, uint8_t *mac);
+    std::string key;
+    TokenSigner(void);
+};
+
+#endif /* !_CRUST_TOKEN_SIGNER_H_ */
@@ -0,0 +1,1155 @@
+#include "Verifier.h"
+
+#include "sgx_error.h"
+#include "sgx_quote_3.h"
+#include "sgx_dcap_quoteverify.h"
+#include "sgx_tcrypto.h"
+#include <sgx_ecp_types.h>
+
+#include "Log.h"
+#include "Metrics.h"
+#include "FairScheduler.h"
+#include "CollateralCache.h"
+#include "ResultCache.h"
+#include "NegativeCache.h"
+#include "ResultLog.h"
+#include "TokenSigner.h"
+#include "Policy.h"
+#include "IdentityRegistry.h"
+#include "Utils.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include <openssl/evp.h>
+
+// Maximum nesting of request json
+#define VERIFIER_JSON_MAX_DEPTH 64
+
+std::mutex verifier_mutex;
+
+Verifier *Verifier::verifier = NULL;
+
+static Log *p_log = Log::get_instance();
+
+typedef struct _entry_identity_t
+{
+    char *sig;
+    size_t sig_len;
+    char *quote;
+    size_t quote_len;
+    char *account;
+    size_t account_len;
+    // Raw number token, NULL if absent
+    char *id;
+    size_t id_len;
+    char *token;
+    size_t token_len;
+} entry_identity_t;
+
+// OpenSSL objects reused by current thread, building an EC_KEY from scratch costs about a hundred allocations
+struct ThreadEcKey
+{
+    EC_KEY *key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    BIGNUM *gx = BN_new();
+    BIGNUM *gy = BN_new();
+
+    ~ThreadEcKey()
+    {
+        EC_KEY_free(this->key);
+        BN_free(this->gx);
+        BN_free(this->gy);
+    }
+};
+
+static thread_local ThreadEcKey thread_ec_key;
+
+static crust_status_t skip_value(char *&p, char *end, int depth);
+
+/**
+ * @description: Skip json white spaces
+ * @param p -> Current position
+ * @param end -> End of data
+ */
+static void skip_ws(char *&p, char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+}
+
+/**
+ * @description: Scan json string and unescape it in place, unicode escapes are kept as they are
+ * @param p -> Current position, at the opening quote
+ * @param end -> End of data
+ * @param str -> Unescaped string, not NUL terminated
+ * @param str_len -> Unescaped string length
+ * @return: Scan status
+ */
+static crust_status_t scan_string(char *&p, char *end, char **str, size_t *str_len)
+{
+    char *dst = ++p;
+    *str = dst;
+    while (p < end && *p != '\"')
+    {
+        char c = *(p++);
+        if (c == '\\')
+        {
+            if (p == end)
+                return CRUST_JSON_STRING_ERROR;
+            switch (*(p++))
+            {
+            case '\"': c = '\"'; break;
+            case '\\': c = '\\'; break;
+            case '/': c = '/'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u':
+                if (end - p < 4)
+                    return CRUST_JSON_STRING_ERROR;
+                for (int i = 0; i < 4; i++)
+                {
+                    if (!isxdigit((unsigned char)p[i]))
+                        return CRUST_JSON_STRING_ERROR;
+                }
+                *(dst++) = '\\';
+                *(dst++) = 'u';
+                memmove(dst, p, 4);
+                dst += 4;
+                p += 4;
+                continue;
+            default:
+                c = '\\';
+                break;
+            }
+        }
+        *(dst++) = c;
+    }
+    if (p == end)
+        return CRUST_JSON_STRING_ERROR;
+    p++;
+    *str_len = dst - *str;
+
+    return CRUST_SUCCESS;
+}
+
+/**
+ * @description: Skip json object or array
+ * @param p -> Current position, at the opening bracket
+ * @param end -> End of data
+ * @param depth -> Current nesting depth
+ * @return: Skip status
+ */
+static crust_status_t skip_container(char *&p, char *end, int depth)
+{
+    bool is_object = *p == '{';
+    crust_status_t err = is_object ? CRUST_JSON_OBJECT_ERROR : CRUST_JSON_ARRAY_ERROR;
+    char close = is_object ? '}' : ']';
+    p++;
+    skip_ws(p, end);
+    if (p < end && *p == close)
+    {
+        p++;
+        return CRUST_SUCCESS;
+    }
+    while (true)
+    {
+        crust_status_t status = CRUST_SUCCESS;
+        if (is_object)
+        {
+            if ((status = skip_value(p, end, depth + 1)) != CRUST_SUCCESS)
+                return status;
+            skip_ws(p, end);
+            if (p == end || *p != ':')
+                return err;
+            p++;
+        }
+        if ((status = skip_value(p, end, depth + 1)) != CRUST_SUCCESS)
+            return status;
+        skip_ws(p, end);
+        if (p < end && *p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (p < end && *p == close)
+        {
+            p++;
+            return CRUST_SUCCESS;
+        }
+        return err;
+    }
+}
+
+/**
+ * @description: Skip any json value
+ * @param p -> Current position
+ * @param end -> End of data
+ * @param depth -> Current nesting depth
+ * @return: Skip status
+ */
+static crust_status_t skip_value(char *&p, char *end, int depth)
+{
+    if (depth > VERIFIER_JSON_MAX_DEPTH)
+        return CRUST_JSON_OBJECT_ERROR;
+
+    skip_ws(p, end);
+    if (p == end)
+        return CRUST_JSON_STARTING_ERROR;
+
+    char *str = NULL;
+    size_t str_len = 0;
+    switch (*p)
+    {
+    case '{':
+    case '[':
+        return skip_container(p, end, depth);
+    case '\"':
+        return scan_string(p, end, &str, &str_len);
+    case 't':
+    case 'f':
+    case 'n':
+    {
+        const char *literal = *p == 't' ? "true" : (*p == 'f' ? "false" : "null");
+        size_t literal_len = strlen(literal);
+        if ((size_t)(end - p) < literal_len || memcmp(p, literal, literal_len) != 0)
+            return *p == 'n' ? CRUST_JSON_NULL_ERROR : CRUST_JSON_BOOL_ERROR;
+        p += literal_len;
+        return CRUST_SUCCESS;
+    }
+    default:
+        if ((*p >= '0' && *p <= '9') || *p == '-')
+        {
+            p++;
+            while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-'))
+                p++;
+            return CRUST_SUCCESS;
+        }
+    }
+
+    return CRUST_JSON_STARTING_ERROR;
+}
+
+/**
+ * @description: Pick identity fields out of request body without building a json tree.
+ * Strings are unescaped in place, missing or non-string fields are left empty.
+ * @param body -> Request body
+ * @param body_len -> Request body length
+ * @param identity -> Picked fields pointing into body
+ * @return: Parse status
+ */
+static crust_status_t scan_identity(char *body, size_t body_len, entry_identity_t *identity)
+{
+    memset(identity, 0, sizeof(entry_identity_t));
+    char *p = body;
+    char *end = body + body_len;
+    skip_ws(p, end);
+    if (p == end)
+        return CRUST_SUCCESS;
+    if (*p != '{')
+        return skip_value(p, end, 0);
+
+    p++;
+    skip_ws(p, end);
+    if (p < end && *p == '}')
+        return CRUST_SUCCESS;
+    while (true)
+    {
+        crust_status_t status = CRUST_SUCCESS;
+        skip_ws(p, end);
+        char *key = NULL;
+        size_t key_len = 0;
+        if (p == end || *p != '\"')
+        {
+            if ((status = skip_value(p, end, 1)) != CRUST_SUCCESS)
+                return status;
+        }
+        else if ((status = scan_string(p, end, &key, &key_len)) != CRUST_SUCCESS)
+        {
+            return status;
+        }
+        skip_ws(p, end);
+        if (p == end || *p != ':')
+            return CRUST_JSON_OBJECT_ERROR;
+        p++;
+        skip_ws(p, end);
+
+        char **field = NULL;
+        size_t *field_len = NULL;
+        if (key_len == 3 && memcmp(key, "sig", 3) == 0)
+        {
+            field = &identity->sig;
+            field_len = &identity->sig_len;
+        }
+        else if (key_len == 5 && memcmp(key, "quote", 5) == 0)
+        {
+            field = &identity->quote;
+            field_len = &identity->quote_len;
+        }
+        else if (key_len == 7 && memcmp(key, "account", 7) == 0)
+        {
+            field = &identity->account;
+            field_len = &identity->account_len;
+        }
+        else if (key_len == 5 && memcmp(key, "token", 5) == 0)
+        {
+            field = &identity->token;
+            field_len = &identity->token_len;
+        }
+
+        if (field != NULL && p < end && *p == '\"')
+        {
+            status = scan_string(p, end, field, field_len);
+        }
+        else if (key_len == 2 && memcmp(key, "id", 2) == 0 && p < end && (*p == '-' || isdigit((unsigned char)*p)))
+        {
+            // Only integers are echoed, other tokens are skipped like unknown fields
+            char *id = p;
+            if ((status = skip_value(p, end, 1)) == CRUST_SUCCESS
+                    && std::all_of(id + 1, p, [](char c) { return isdigit((unsigned char)c); })
+                    && isdigit((unsigned char)p[-1]))
+            {
+                identity->id = id;
+                identity->id_len = p - id;
+            }
+        }
+        else
+        {
+            if (field != NULL)
+            {
+                *field = NULL;
+                *field_len = 0;
+            }
+            status = skip_value(p, end, 1);
+        }
+        if (status != CRUST_SUCCESS)
+            return status;
+
+        skip_ws(p, end);
+        if (p < end && *p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (p < end && *p == '}')
+            return CRUST_SUCCESS;
+        return CRUST_JSON_OBJECT_ERROR;
+    }
+}
+
+/**
+ * @description: Decode hex string into zero filled arena buffer
+ * @param arena -> Arena to allocate from
+ * @param hex -> Hex string
+ * @param hex_len -> Hex string length
+ * @param min_size -> Minimum buffer size
+ * @return: Decoded buffer, NULL if hex length is odd or out of memory
+ */
+static uint8_t *decode_hex(Arena *arena, const char *hex, size_t hex_len, size_t min_size)
+{
+    if (hex_len % 2 != 0)
+        return NULL;
+
+    size_t sz = std::max(hex_len / 2, min_size);
+    uint8_t *buf = (uint8_t *)arena->alloc(sz);
+    if (buf == NULL)
+        return NULL;
+    memset(buf, 0, sz);
+    hexstring_to_buffer(hex, hex_len, buf);
+
+    return buf;
+}
+
+/**
+ * @description: Load sgx public key into current thread's EC_KEY, same as key_from_sgx_ec256 without new objects
+ * @param k -> Sgx public key
+ * @return: Thread's EC_KEY, NULL if key is invalid
+ */
+static EC_KEY *load_ec256_key(sgx_ec256_public_t *k)
+{
+    ThreadEcKey &tk = thread_ec_key;
+    if (tk.key == NULL || tk.gx == NULL || tk.gy == NULL)
+        return NULL;
+
+    if (BN_lebin2bn((unsigned char *)k->gx, sizeof(k->gx), tk.gx) == NULL
+            || BN_lebin2bn((unsigned char *)k->gy, sizeof(k->gy), tk.gy) == NULL
+            || !EC_KEY_set_public_key_affine_coordinates(tk.key, tk.gx, tk.gy))
+        return NULL;
+
+    return tk.key;
+}
+
+/**
+ * @description: Log reason of quote verification failure
+ * @param dcap_ret -> Error code returned by sgx_qv_verify_quote
+ */
+static void log_verify_quote_error(quote3_error_t dcap_ret)
+{
+    switch (dcap_ret)
+    {
+    case SGX_QL_QUOTE_FORMAT_UNSUPPORTED:
+        p_log->err("The inputted quote format is not supported. Either because the header information is not supported or the quote is malformed in some way.\n");
+        break;
+    case SGX_QL_QUOTE_CERTIFICATION_DATA_UNSUPPORTED:
+        p_log->err("The quote verifier doesn’t support the certification data in the Quote. Currently, the Intel QVE only supported CertType = 5.\n");
+        break;
+    case SGX_QL_QE_REPORT_UNSUPPORTED_FORMAT:
+        p_log->err("The quote verifier doesn’t support the format of the application REPORT the Quote.\n");
+        break;
+    case SGX_QL_QE_REPORT_INVALID_SIGNATURE:
+        p_log->err("The signature over the QE Report is invalid.\n");
+        break;
+    case SGX_QL_PCK_CERT_UNSUPPORTED_FORMAT:
+        p_log->err("The format of the PCK Cert is unsupported.\n");
+        break;
+    case SGX_QL_PCK_CERT_CHAIN_ERROR:
+        p_log->err("There was an error verifying the PCK Cert signature chain including PCK Cert revocation.\n");
+        break;
+    case SGX_QL_TCBINFO_UNSUPPORTED_FORMAT:
+        p_log->err("The format of the TCBInfo structure is unsupported.\n");
+        break;
+    case SGX_QL_TCBINFO_CHAIN_ERROR:
+        p_log->err("There was an error verifying the TCBInfo signature chain including TCBInfo revocation.\n");
+        break;
+    case SGX_QL_TCBINFO_MISMATCH:
+        p_log->err("PCK Cert FMSPc does not match the TCBInfo FMSPc.\n");
+        break;
+    case SGX_QL_QEIDENTITY_UNSUPPORTED_FORMAT:
+        p_log->err("The format of the QEIdentity structure is unsupported.\n");
+        break;
+    case SGX_QL_QEIDENTITY_MISMATCH:
+        p_log->err("The Quote’s QE doesn’t match the inputted expected QEIdentity.\n");
+        break;
+    case SGX_QL_QEIDENTITY_CHAIN_ERROR:
+        p_log->err("There was an error verifying the QEIdentity signature chain including QEIdentity revocation.\n");
+        break;
+    case SGX_QL_ENCLAVE_LOAD_ERROR:
+        p_log->err("Unable to load the enclaves required to initialize the attestation key. error, loading infrastructure error or insufficient enclave memory.\n");
+        break;
+    case SGX_QL_ENCLAVE_LOST:
+        p_log->err("Could be due to file I/O. Enclave lost after power transition or used in child process created by linux:fork().\n");
+        break;
+    case SGX_QL_INVALID_REPORT:
+        p_log->err("Report MAC check failed on application report.\n");
+        break;
+    case SGX_QL_PLATFORM_LIB_UNAVAILABLE:
+        p_log->err("The Quote Library could not locate the platform quote provider library or one of its required APIs.\n");
+        break;
+    case SGX_QL_UNABLE_TO_GENERATE_REPORT:
+        p_log->err("The QVE was unable to generate its own report targeting the application enclave because there is an enclave compatibility issue.\n");
+        break;
+    case SGX_QL_NETWORK_ERROR:
+        p_log->err("Network error when retrieving PCK certs.\n");
+        break;
+    case SGX_QL_NO_QUOTE_COLLATERAL_DATA :
+        p_log->err("The Quote Library was available, but the quote library could not retrieve the data.\n");
+        break;
+    case SGX_QL_ERROR_QVL_QVE_MISMATCH:
+        p_log->err("Only returned when the quote verification library supports both the untrusted mode of verification and the QvE backed mode of verification. This error indicates that the 2 versions of the verification modes are different. Most caused by using a QvE that does not match the version of the DCAP installed.\n");
+        break;
+    case SGX_QL_ERROR_UNEXPECTED:
+        p_log->err("An unexpected internal error occurred.\n");
+        break;
+    case SGX_QL_UNKNOWN_MESSAGE_RESPONSE:
+        p_log->err("Unexpected error from the attestation infrastructure while retrieving the platform data.\n");
+        break;
+    case SGX_QL_ERROR_MESSAGE_PARSING_ERROR:
+        p_log->err("Generic message parsing error from the attestation infrastructure while retrieving the platform data.\n");
+        break;
+    case SGX_QL_PLATFORM_UNKNOWN:
+        p_log->err("This platform is an unrecognized SGX platform.\n");
+        break;
+    default:
+        p_log->err("undefined error: sgx_qv_verify_quote failed: 0x%04x\n", dcap_ret);
+    }
+}
+
+/**
+ * @description: Feed latency of quote library call to concurrency limiter and export its state
+ * @param dcap_ret -> Error code returned by sgx_qv_verify_quote
+ * @param latency_us -> Latency of the call
+ */
+static void record_quote_latency(quote3_error_t dcap_ret, uint64_t latency_us)
+{
+    // Only errors of collateral service or resources mean the library is called too much, not bad quotes
+    bool overloaded = false;
+    switch (dcap_ret)
+    {
+    case SGX_QL_ERROR_OUT_OF_MEMORY:
+    case SGX_QL_NETWORK_ERROR:
+    case SGX_QL_NO_QUOTE_COLLATERAL_DATA:
+    case SGX_QL_UNABLE_TO_GET_COLLATERAL:
+    case SGX_QL_SERVICE_UNAVAILABLE:
+    case SGX_QL_NETWORK_FAILURE:
+    case SGX_QL_SERVICE_TIMEOUT:
+    case SGX_QL_ERROR_BUSY:
+        overloaded = true;
+        break;
+    default:
+        break;
+    }
+
+    ConcurrencyLimiter *p_limiter = ConcurrencyLimiter::get_instance();
+    Metrics *p_metrics = Metrics::get_instance();
+    p_limiter->record(latency_us, overloaded);
+    p_metrics->set(METRIC_QVL_LIMIT, p_limiter->get_limit());
+    p_metrics->set(METRIC_QVL_LATENCY_TARGET_US, p_limiter->get_target_us());
+}
+
+/**
+ * @description: Reject quote whose verification result policy doesn't accept
+ * @param qv_result -> Quote verification result
+ * @param result -> Verification result
+ */
+static void reject_qv_result(sgx_ql_qv_result_t qv_result, verify_result_t *result)
+{
+    p_log->err("App: Verification result %x is not accepted by policy\n", qv_result);
+    Metrics::get_instance()->add(METRIC_POLICY_QV_RESULT_REJECTED_TOTAL);
+    result->qv_result = qv_result;
+    result->message = "TCB status is not accepted by policy!";
+    result->status_code = 403;
+}
+
+/**
+ * @description: Register identity of evidence whose result is accepted now
+ * @param evidence -> Decoded evidence
+ * @param qv_result -> Quote verification result
+ */
+static void register_identity(const verify_evidence_t *evidence, sgx_ql_qv_result_t qv_result)
+{
+    IdentityRegistry *p_identity_registry = IdentityRegistry::get_instance();
+    if (!p_identity_registry->is_enabled())
+        return;
+    const sgx_report_body_t *report_body = &((_sgx_quote3_t *)evidence->quote)->report_body;
+    p_identity_registry->put(reinterpret_cast<const uint8_t *>(&report_body->report_data),
+            reinterpret_cast<const uint8_t *>(&report_body->mr_enclave),
+            evidence->account, evidence->account_len, qv_result, time(NULL));
+}
+
+/**
+ * @description: Fill identity carried by evidence into result
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ */
+static void fill_identity(const verify_evidence_t *evidence, verify_result_t *result)
+{
+    _sgx_quote3_t *quote = (_sgx_quote3_t *)evidence->quote;
+    hexstring_to_chars(&quote->report_body.report_data, sizeof(sgx_report_data_t), result->pubkey);
+    hexstring_to_chars(&quote->report_body.mr_enclave, sizeof(sgx_measurement_t), result->mrenclave);
+    result->account = evidence->account;
+    result->account_len = evidence->account_len;
+}
+
+/**
+ * @description: Digest whole evidence, so that a rejected request replayed as is can be answered before any check
+ * @param evidence -> Decoded evidence, whose quote digest is set
+ */
+static void digest_evidence(verify_evidence_t *evidence)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(ctx, evidence->quote_digest, sizeof(evidence->quote_digest));
+    EVP_DigestUpdate(ctx, evidence->sig, sizeof(sgx_ec256_signature_t));
+    EVP_DigestUpdate(ctx, evidence->account, evidence->account_len);
+    EVP_DigestFinal_ex(ctx, evidence->evidence_digest, NULL);
+    EVP_MD_CTX_free(ctx);
+}
+
+/**
+ * @description: Keep rejection of evidence, quote stage rejections are kept by quote digest too so that the same quote
+ * sent with other accounts is not verified again
+ * @param evidence -> Decoded evidence
+ * @param type -> Kind of rejection
+ * @param result -> Verification result of the rejection
+ */
+static void record_rejection(const verify_evidence_t *evidence, negative_type_t type, const verify_result_t *result)
+{
+    NegativeCache *p_negative_cache = NegativeCache::get_instance();
+    result_digest_t digest;
+    memcpy(digest.data(), evidence->evidence_digest, digest.size());
+    p_negative_cache->put(digest, type, result->status_code, result->message, result->qv_result);
+    if (type != NEGATIVE_SIGNATURE)
+    {
+        memcpy(digest.data(), evidence->quote_digest, digest.size());
+        p_negative_cache->put(digest, type, result->status_code, result->message, result->qv_result);
+    }
+}
+
+/**
+ * @description: Fill result from a kept rejection
+ * @param digest -> Digest of quote or of whole evidence
+ * @param result -> Verification result
+ * @return: Whether a rejection is kept
+ */
+static bool load_rejection(const sgx_sha256_hash_t digest, verify_result_t *result)
+{
+    result_digest_t key;
+    memcpy(key.data(), digest, key.size());
+    negative_entry_t entry;
+    if (!NegativeCache::get_instance()->get(key, &entry))
+        return false;
+    result->status_code = entry.status_code;
+    result->message = entry.message;
+    result->qv_result = entry.qv_result;
+
+    return true;
+}
+
+/**
+ * @description: single instance class function to get instance
+ * @return: verifier instance
+ */
+Verifier *Verifier::get_instance()
+{
+    if (Verifier::verifier == NULL)
+    {
+        verifier_mutex.lock();
+        if (Verifier::verifier == NULL)
+        {
+            Verifier::verifier = new Verifier();
+        }
+        verifier_mutex.unlock();
+    }
+
+    return Verifier::verifier;
+}
+
+/**
+ * @description: constructor
+ */
+Verifier::Verifier()
+{
+}
+
+/**
+ * @description: Verify identity signature and quote in /entryNetwork request body.
+ * All memory is drawn from arena, body is modified in place and result may point into it.
+ * @param arena -> Arena of current request
+ * @param body -> Request body
+ * @param body_len -> Request body length
+ * @param result -> Verification result
+ * @param is_stale -> Whether nobody reads the result any more, checked once quote stage gets its turn
+ */
+void Verifier::verify(Arena *arena, char *body, size_t body_len, verify_result_t *result, const std::function<bool()> &is_stale)
+{
+    verify_evidence_t evidence;
+    if (!this->parse_request(arena, body, body_len, &evidence, result)
+            || !this->verify_policy(&evidence, result))
+        return;
+    if (!this->verify_token(&evidence, result)
+            && !this->verify_rejected(&evidence, result)
+            && this->verify_signature(arena, &evidence, result))
+    {
+        this->verify_quote_limited(arena, &evidence, result, is_stale);
+    }
+    this->issue_token(arena, &evidence, result);
+}
+
+/**
+ * @description: First stage of /entryNetwork verification, pick evidence out of request body and decode it
+ * @param arena -> Arena of current request
+ * @param body -> Request body, modified in place
+ * @param body_len -> Request body length
+ * @param evidence -> Evidence decoded into arena, account points into body
+ * @param result -> Verification result, which is initialized here
+ * @return: Whether to go on with next stage
+ */
+bool Verifier::parse_request(Arena *arena, char *body, size_t body_len, verify_evidence_t *evidence, verify_result_t *result)
+{
+    memset(result, 0, sizeof(verify_result_t));
+    result->status_code = 500;
+    result->qv_result = SGX_QL_QV_RESULT_UNSPECIFIED;
+
+    entry_identity_t identity;
+    crust_status_t crust_status = scan_identity(body, body_len, &identity);
+    result->id = identity.id;
+    result->id_len = identity.id_len;
+    if (CRUST_SUCCESS != crust_status)
+    {
+        p_log->err("Load ecdsa_identity failed! Error code:%x\n", crust_status);
+        result->message = "Load ecdsa_identity failed!";
+        result->status_code = 400;
+        return false;
+    }
+
+    uint8_t *p_sig = decode_hex(arena, identity.sig, identity.sig_len, sizeof(sgx_ec256_signature_t));
+    // Short quote is padded so that report body is always readable, quote library rejects it anyway
+    uint8_t *p_quote = decode_hex(arena, identity.quote, identity.quote_len, sizeof(sgx_quote3_t));
+    if (p_sig == NULL || p_quote == NULL)
+    {
+        result->message = "Unexpected error";
+        result->status_code = 400;
+        return false;
+    }
+    evidence->sig = p_sig;
+    evidence->quote = p_quote;
+    evidence->quote_sz = identity.quote_len / 2;
+    sgx_sha256_msg(p_quote, evidence->quote_sz, &evidence->quote_digest);
+    evidence->account = identity.account != NULL ? identity.account : "";
+    evidence->account_len = identity.account_len;
+    evidence->token = identity.token;
+    evidence->token_len = identity.token_len;
+    digest_evidence(evidence);
+
+    return true;
+}
+
+/**
+ * @description: First stage of binary evidence verification, copy evidence into arena.
+ * Callers may pass memory shared with untrusted processes, later stages only read the copy.
+ * @param arena -> Arena of current request
+ * @param sig -> Identity signature
+ * @param sig_len -> Signature length
+ * @param quote -> Quote
+ * @param quote_len -> Quote length
+ * @param account -> Account
+ * @param account_len -> Account length
+ * @param evidence -> Evidence copied into arena
+ * @param result -> Verification result, which is initialized here
+ * @return: Whether to go on with next stage
+ */
+bool Verifier::load_evidence(Arena *arena, const uint8_t *sig, size_t sig_len, const uint8_t *quote, size_t quote_len,
+        const char *account, size_t account_len, verify_evidence_t *evidence, verify_result_t *result)
+{
+    memset(result, 0, sizeof(verify_result_t));
+    result->status_code = 500;
+    result->qv_result = SGX_QL_QV_RESULT_UNSPECIFIED;
+
+    // Padded like decoded hex
+    size_t sig_sz = std::max(sig_len, sizeof(sgx_ec256_signature_t));
+    size_t quote_sz = std::max(quote_len, sizeof(sgx_quote3_t));
+    uint8_t *p_sig = (uint8_t *)arena->alloc(sig_sz);
+    uint8_t *p_quote = (uint8_t *)arena->alloc(quote_sz);
+    char *p_account = arena->strndup(account, account_len);
+    if (p_sig == NULL || p_quote == NULL || p_account == NULL)
+    {
+        result->message = "Unexpected error";
+        result->status_code = 400;
+        return false;
+    }
+    memset(p_sig, 0, sig_sz);
+    memcpy(p_sig, sig, sig_len);
+    memset(p_quote, 0, quote_sz);
+    memcpy(p_quote, quote, quote_len);
+
+    evidence->sig = p_sig;
+    evidence->quote = p_quote;
+    evidence->quote_sz = quote_len;
+    sgx_sha256_msg(p_quote, quote_len, &evidence->quote_digest);
+    evidence->account = p_account;
+    evidence->account_len = account_len;
+    evidence->token = NULL;
+    evidence->token_len = 0;
+    digest_evidence(evidence);
+
+    return true;
+}
+
+/**
+ * @description: Signature stage, check identity signature over quote and account
+ * @param arena -> Arena of current request
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result, identity is filled here
+ * @return: Whether to go on with next stage
+ */
+bool Verifier::verify_signature(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result)
+{
+    uint8_t *p_sig = evidence->sig;
+    uint8_t *p_quote = evidence->quote;
+    uint32_t quote_sz = evidence->quote_sz;
+    const char *account = evidence->account;
+    size_t account_len = evidence->account_len;
+    uint32_t sig_data_sz = quote_sz + account_len;
+    uint8_t *p_sig_data = (uint8_t *)arena->alloc(sig_data_sz + 1);
+    if (p_sig_data == NULL)
+    {
+        result->message = "Unexpected error";
+        result->status_code = 400;
+        return false;
+    }
+    memcpy(p_sig_data, p_quote, quote_sz);
+    memcpy(p_sig_data + quote_sz, account, account_len);
+    _sgx_quote3_t *quote = (_sgx_quote3_t *)p_quote;
+    uint8_t *p_pub_key = reinterpret_cast<uint8_t *>(&quote->report_body.report_data);
+    // Get return message
+    fill_identity(evidence, result);
+    // Verify signature
+    sgx_sha256_hash_t msg_hash;
+    sgx_sha256_msg(p_sig_data, sig_data_sz, &msg_hash);
+    EC_KEY *ec_pkey = load_ec256_key((sgx_ec256_public_t *)p_pub_key);
+    int ret = 0;
+    if (ec_pkey != NULL)
+    {
+        ret = ECDSA_verify(0, reinterpret_cast<const uint8_t *>(&msg_hash), sizeof(sgx_sha256_hash_t),
+                p_sig, sizeof(sgx_ec256_signature_t), ec_pkey);
+    }
+    if (1 != ret)
+    {
+        result->message = "Verify identity signature failed!";
+        result->status_code = 500;
+        record_rejection(evidence, NEGATIVE_SIGNATURE, result);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @description: Policy stage, check enclave of quote against policy ahead of all costly stages.
+ * Quote is not verified yet, so only enclaves policy refuses anyway are rejected here.
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ * @return: Whether to go on with next stage
+ */
+bool Verifier::verify_policy(const verify_evidence_t *evidence, verify_result_t *result)
+{
+    const sgx_report_body_t *report_body = &((_sgx_quote3_t *)evidence->quote)->report_body;
+    switch (Policy::get_instance()->check_enclave(report_body))
+    {
+    case POLICY_ACCEPT:
+        return true;
+    case POLICY_SVN_DENIED:
+        result->message = "Enclave ISV SVN is below policy!";
+        break;
+    case POLICY_ENCLAVE_DENIED:
+    default:
+        result->message = "Enclave is not allowed by policy!";
+        break;
+    }
+    result->status_code = 403;
+    Metrics::get_instance()->add(METRIC_POLICY_ENCLAVE_REJECTED_TOTAL);
+
+    return false;
+}
+
+/**
+ * @description: Answer evidence from token issued when it was verified before, ahead of all other stages.
+ * Token covers evidence digest and thereby signature, so neither signature nor quote is checked again.
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result, identity is filled if token holds
+ * @return: Whether token confirms evidence, invalid tokens are ignored
+ */
+bool Verifier::verify_token(const verify_evidence_t *evidence, verify_result_t *result)
+{
+    TokenSigner *p_token_signer = TokenSigner::get_instance();
+    if (evidence->token == NULL || !p_token_signer->is_enabled())
+        return false;
+
+    verify_token_t token;
+    const sgx_report_body_t *report_body = &((_sgx_quote3_t *)evidence->quote)->report_body;
+    if (!p_token_signer->check(evidence->evidence_digest, report_body, evidence->account, evidence->account_len,
+                evidence->token, evidence->token_len, &token))
+    {
+        Metrics::get_instance()->add(METRIC_VERIFY_TOKEN_INVALID_TOTAL);
+        return false;
+    }
+    // Issued by an instance with another policy, cached result or quote stage answers it
+    if (!Policy::get_instance()->accepts(token.qv_result))
+        return false;
+    fill_identity(evidence, result);
+    result->qv_result = token.qv_result;
+    result->status_code = 200;
+    result->token = evidence->token;
+    result->token_len = evidence->token_len;
+    register_identity(evidence, token.qv_result);
+    Metrics::get_instance()->add(METRIC_VERIFY_TOKEN_HIT_TOTAL);
+
+    return true;
+}
+
+/**
+ * @description: Issue token for evidence verified now, so that it is confirmed by a MAC when sent again.
+ * Tokens are not renewed by themselves, evidence is verified in full at least once per token lifetime.
+ * @param arena -> Arena of current request
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result, which gets token if it is accepted
+ */
+void Verifier::issue_token(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result)
+{
+    TokenSigner *p_token_signer = TokenSigner::get_instance();
+    if (result->status_code != 200 || result->token != NULL || !p_token_signer->is_enabled())
+        return;
+    char *hex = (char *)arena->alloc(VERIFY_TOKEN_SIZE * 2 + 1, 1);
+    if (hex == NULL)
+        return;
+
+    verify_token_t token;
+    token.expires_at = time(NULL) + VERIFY_TOKEN_TTL_S;
+    token.qv_result = result->qv_result;
+    const sgx_report_body_t *report_body = &((_sgx_quote3_t *)evidence->quote)->report_body;
+    p_token_signer->sign(evidence->evidence_digest, report_body, evidence->account, evidence->account_len, &token, hex);
+    result->token = hex;
+    result->token_len = VERIFY_TOKEN_SIZE * 2;
+    Metrics::get_instance()->add(METRIC_VERIFY_TOKEN_ISSUED_TOTAL);
+}
+
+/**
+ * @description: Answer evidence rejected before from negative cache, ahead of signature stage
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ * @return: Whether evidence is rejected again
+ */
+bool Verifier::verify_rejected(const verify_evidence_t *evidence, verify_result_t *result)
+{
+    return load_rejection(evidence->evidence_digest, result);
+}
+
+/**
+ * @description: Answer quote stage from result cache, which holds results of accepted quotes until their collateral changes or expires,
+ * or from negative cache, which holds rejected quotes for as long as their kind of rejection allows
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ * @return: Whether quote stage is answered
+ */
+bool Verifier::verify_cached(const verify_evidence_t *evidence, verify_result_t *result)
+{
+    if (load_rejection(evidence->quote_digest, result))
+        return true;
+
+    result_digest_t digest;
+    memcpy(digest.data(), evidence->quote_digest, digest.size());
+    sgx_ql_qv_result_t qv_result;
+    if (!ResultCache::get_instance()->get(digest, &qv_result))
+        return false;
+    // Shared and logged results may be accepted by processes with another policy
+    if (!Policy::get_instance()->accepts(qv_result))
+    {
+        reject_qv_result(qv_result, result);
+        return true;
+    }
+    result->qv_result = qv_result;
+    result->status_code = 200;
+    register_identity(evidence, qv_result);
+
+    return true;
+}
+
+/**
+ * @description: Quote stage in its account's turn of fair scheduler, like that of /entryNetwork over http, so an account
+ * can't take every concurrency limiter slot through other transports. Answered from result cache without a turn.
+ * @param arena -> Arena of current request
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ * @param is_stale -> Whether nobody reads the result any more, then it is dropped with 504 once its turn comes
+ */
+void Verifier::verify_quote_limited(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result,
+        const std::function<bool()> &is_stale)
+{
+    if (this->verify_cached(evidence, result))
+        return;
+
+    if (!FairScheduler::get_instance()->run(evidence->account, evidence->account_len, [&] {
+            if (!is_stale())
+            {
+                this->verify_quote(arena, evidence, result);
+                return;
+            }
+            Metrics::get_instance()->add(METRIC_CANCELLED_ACCOUNT_QUEUE_TOTAL);
+            result->message = "Request deadline passed!";
+            result->status_code = 504;
+        }))
+    {
+        Metrics::get_instance()->add(METRIC_ACCOUNT_REJECTED_TOTAL);
+        result->message = "Too many requests of this account!";
+        result->status_code = 429;
+    }
+}
+
+/**
+ * @description: Quote stage, check quote by DCAP quote verify library with cached collateral, which may block on fetching it.
+ * Callers hold a concurrency limiter slot, latency of the library call adjusts the limit.
+ * @param arena -> Arena of current request
+ * @param evidence -> Decoded evidence
+ * @param result -> Verification result
+ */
+void Verifier::verify_quote(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result)
+{
+    uint8_t *p_quote = evidence->quote;
+    uint32_t quote_sz = evidence->quote_sz;
+    uint32_t supplemental_data_size = 0;
+    uint8_t *p_supplemental_data = NULL;
+    quote3_error_t dcap_ret = sgx_qv_get_quote_supplemental_data_size(&supplemental_data_size);
+    if (dcap_ret == SGX_QL_SUCCESS && supplemental_data_size == sizeof(sgx_ql_qv_supplemental_t))
+    {
+        p_log->info("sgx_qv_get_quote_supplemental_data_size successfully returned.\n");
+        p_supplemental_data = (uint8_t *)arena->alloc(supplemental_data_size);
+        if (p_supplemental_data == NULL)
+            supplemental_data_size = 0;
+    }
+    else
+    {
+        p_log->err("sgx_qv_get_quote_supplemental_data_size failed: 0x%04x\n", dcap_ret);
+        supplemental_data_size = 0;
+    }
+
+    // Collateral is shared by quotes of the same platform kind, quote library fetches it itself if it is left empty
+    collateral_key_t collateral_key;
+    bool has_collateral_key = get_collateral_key(p_quote, quote_sz, &collateral_key);
+    std::shared_ptr<const sgx_ql_qve_collateral_t> collateral;
+    result_digest_t collateral_digest;
+    if (has_collateral_key && CRUST_SERVICE_UNAVAILABLE == CollateralCache::get_instance()->get(collateral_key, collateral, collateral_digest.data()))
+    {
+        result->message = "Collateral service unavailable!";
+        result->status_code = 503;
+        return;
+    }
+
+    //set current time. This is only for sample purposes, in production mode a trusted time should be used.
+    time_t current_time = time(NULL);
+    uint32_t collateral_expiration_status = 1;
+    sgx_ql_qv_result_t quote_verification_result = SGX_QL_QV_RESULT_UNSPECIFIED;
+
+    //call DCAP quote verify library for quote verification
+    //here you can choose 'trusted' or 'untrusted' quote verification by specifying parameter '&qve_report_info'
+    //if '&qve_report_info' is NOT NULL, this API will call Intel QvE to verify quote
+    //if '&qve_report_info' is NULL, this API will call 'untrusted quote verify lib' to verify quote, this mode doesn't rely on SGX capable system, but the results can not be cryptographically authenticated
+    auto start_time = std::chrono::steady_clock::now();
+    dcap_ret = sgx_qv_verify_quote(
+        p_quote, (uint32_t)quote_sz,
+        collateral.get(),
+        current_time,
+        &collateral_expiration_status,
+        &quote_verification_result,
+        NULL,
+        supplemental_data_size,
+        p_supplemental_data);
+    record_quote_latency(dcap_ret, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_time).count());
+    if (dcap_ret == SGX_QL_SUCCESS)
+    {
+        p_log->info("App: sgx_qv_verify_quote successfully returned.\n");
+    }
+    else
+    {
+        log_verify_quote_error(dcap_ret);
+        result->message = "Verify quote failed!";
+        result->status_code = 500;
+        // Only quotes the library can never accept are kept, errors of collateral service or resources may pass later
+        switch (dcap_ret)
+        {
+        case SGX_QL_QUOTE_FORMAT_UNSUPPORTED:
+        case SGX_QL_QUOTE_CERTIFICATION_DATA_UNSUPPORTED:
+        case SGX_QL_QE_REPORT_UNSUPPORTED_FORMAT:
+        case SGX_QL_QE_REPORT_INVALID_SIGNATURE:
+        case SGX_QL_PCK_CERT_UNSUPPORTED_FORMAT:
+            record_rejection(evidence, NEGATIVE_MALFORMED, result);
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+
+    //check verification result
+    result->qv_result = quote_verification_result;
+    switch (quote_verification_result)
+    {
+    case SGX_QL_QV_RESULT_OK:
+        p_log->info("App: Verification completed successfully.\n");
+        result->status_code = 200;
+        break;
+    case SGX_QL_QV_RESULT_CONFIG_NEEDED:
+    case SGX_QL_QV_RESULT_OUT_OF_DATE:
+    case SGX_QL_QV_RESULT_OUT_OF_DATE_CONFIG_NEEDED:
+    case SGX_QL_QV_RESULT_SW_HARDENING_NEEDED:
+    case SGX_QL_QV_RESULT_CONFIG_AND_SW_HARDENING_NEEDED:
+        if (!Policy::get_instance()->accepts(quote_verification_result))
+        {
+            reject_qv_result(quote_verification_result, result);
+            record_rejection(evidence, NEGATIVE_TERMINAL, result);
+            break;
+        }
+        p_log->info("App: Verify quote successfully in condition! Status code: %x\n", quote_verification_result);
+        result->status_code = 200;
+        break;
+    case SGX_QL_QV_RESULT_INVALID_SIGNATURE:
+    case SGX_QL_QV_RESULT_REVOKED:
+    case SGX_QL_QV_RESULT_UNSPECIFIED:
+    default:
+        p_log->err("App: Verification completed with Terminal result: %x\n", quote_verification_result);
+        result->message = "Verify quote failed!";
+        result->status_code = 500;
+        if (quote_verification_result == SGX_QL_QV_RESULT_REVOKED)
+            record_rejection(evidence, NEGATIVE_REVOKED, result);
+        else if (quote_verification_result == SGX_QL_QV_RESULT_INVALID_SIGNATURE)
+            record_rejection(evidence, NEGATIVE_MALFORMED, result);
+        else
+            record_rejection(evidence, NEGATIVE_TERMINAL, result);
+        break;
+    }
+
+    if (result->status_code == 200)
+        register_identity(evidence, quote_verification_result);
+
+    // Accepted result holds until collateral it was verified with changes or expires
+    if (result->status_code == 200 && collateral && p_supplemental_data != NULL)
+    {
+        result_digest_t digest;
+        memcpy(digest.data(), evidence->quote_digest, digest.size());
+        time_t expires_at = ((sgx_ql_qv_supplemental_t *)p_supplemental_data)->earliest_expiration_date;
+        ResultCache::get_instance()->put(digest, collateral_key, collateral_digest, quote_verification_result, expires_at);
+        ResultLog *p_result_log = ResultLog::get_instance();
+        if (p_result_log->is_enabled())
+        {
+            p_result_log->append(digest, collateral_key, collateral_digest, quote_verification_result, expires_at,
+                    &((_sgx_quote3_t *)p_quote)->report_body, evidence->account, evidence->account_len);
+        }
+    }
+}
+
+/**
+ * @description: Dump verification result as response body, the same as compacted output of json dump
+ * @param arena -> Arena to allocate from
+ * @param result -> Verification result
+ * @param len -> Body length
+ * @return: Response body, NULL if out of memory
+ */
+char *Verifier::dump_result(Arena *arena, const verify_result_t *result, size_t *len)
+{
+    size_t cap = 256 + result->account_len + sizeof(result->pubkey) + sizeof(result->mrenclave) + result->token_len;
+    if (result->message != NULL)
+        cap += strlen(result->message);
+    char *buf = (char *)arena->alloc(cap, 1);
+    if (buf == NULL)
+        return NULL;
+
+    if (result->status_code != 200)
+    {
+        *len = snprintf(buf, cap, "{  \"message\" : \"%s\",  \"status_code\" : %d}",
+                result->message, result->status_code);
+        return buf;
+    }
+
+    char *p = buf + sprintf(buf, "{  \"message\" : {    \"account\" : \"");
+    for (size_t i = 0; i < result->account_len; i++)
+    {
+        // Escaped by json dump, then backslashes and new lines are stripped from the whole body
+        char c = result->account[i];
+        switch (c)
+        {
+        case '\\': continue;
+        case '\b': c = 'b'; break;
+        case '\f': c = 'f'; break;
+        case '\n': c = 'n'; break;
+        case '\r': c = 'r'; break;
+        case '\t': c = 't'; break;
+        }
+        *(p++) = c;
+    }
+    p += snprintf(p, cap - (p - buf), "\",    \"mrenclave\" : \"%s\",    \"pubkey\" : \"%s\"  },  \"status_code\" : %d",
+            result->mrenclave, result->pubkey, result->status_code);
+    // Keys in json dump order
+    if (result->token != NULL)
+        p += snprintf(p, cap - (p - buf), ",  \"token\" : \"%.*s\"", (int)result->token_len, result->token);
+    *(p++) = '}';
+    *len = p - buf;
+
+    return buf;
+}
@@ -0,0 +1,79 @@
+#ifndef _CRUST_VERIFIER_H_
+#define _CRUST_VERIFIER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#include "sgx_report.h"
+#include "sgx_ql_quote.h"
+#include "sgx_qve_header.h"
+#include "sgx_tcrypto.h"
+
+#include "CrustStatus.h"
+#include "Arena.h"
+
+typedef struct _verify_result_t
+{
+    int status_code;
+    // Error message, NULL if verified
+    const char *message;
+    sgx_ql_qv_result_t qv_result;
+    // Identity, valid if verified
+    const char *account;
+    size_t account_len;
+    char pubkey[sizeof(sgx_report_data_t) * 2 + 1];
+    char mrenclave[sizeof(sgx_measurement_t) * 2 + 1];
+    // Request id echoed by streaming results, NULL if absent
+    const char *id;
+    size_t id_len;
+    // Token confirming verified evidence, NULL if none is issued
+    const char *token;
+    size_t token_len;
+} verify_result_t;
+
+// Decoded evidence, shared by verification stages
+typedef struct _verify_evidence_t
+{
+    // Padded to a whole sgx_ec256_signature_t
+    uint8_t *sig;
+    // Padded to a whole sgx_quote3_t
+    uint8_t *quote;
+    uint32_t quote_sz;
+    // Results of quote stage are cached by it
+    sgx_sha256_hash_t quote_digest;
+    // Rejections are kept by it, over quote digest, signature and account
+    sgx_sha256_hash_t evidence_digest;
+    const char *account;
+    size_t account_len;
+    // Token sent with evidence, NULL if absent
+    const char *token;
+    size_t token_len;
+} verify_evidence_t;
+
+class Verifier
+{
+public:
+    static Verifier *verifier;
+    static Verifier *get_instance();
+    void verify(Arena *arena, char *body, size_t body_len, verify_result_t *result, const std::function<bool()> &is_stale);
+    char *dump_result(Arena *arena, const verify_result_t *result, size_t *len);
+    // Stages of verify, and of binary evidence from shared memory, for callers which run them apart
+    bool parse_request(Arena *arena, char *body, size_t body_len, verify_evidence_t *evidence, verify_result_t *result);
+    bool load_evidence(Arena *arena, const uint8_t *sig, size_t sig_len, const uint8_t *quote, size_t quote_len,
+            const char *account, size_t account_len, verify_evidence_t *evidence, verify_result_t *result);
+    bool verify_policy(const verify_evidence_t *evidence, verify_result_t *result);
+    bool verify_token(const verify_evidence_t *evidence, verify_result_t *result);
+    bool verify_rejected(const verify_evidence_t *evidence, verify_result_t *result);
+    bool verify_signature(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result);
+    bool verify_cached(const verify_evidence_t *evidence, verify_result_t *result);
+    void verify_quote(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result);
+    void verify_quote_limited(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result,
+            const std::function<bool()> &is_stale);
+    void issue_token(Arena *arena, const verify_evidence_t *evidence, verify_result_t *result);
+
+private:
+    Verifier(void);
+};
+
+#endif /* !_CRUST_VERIFIER_H_ */
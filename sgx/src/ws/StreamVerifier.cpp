@@ -0,0 +1,241 @@
+#include "StreamVerifier.h"
+#include "Arena.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Verifier.h"
+#include "Utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+std::mutex stream_verifier_mutex;
+
+StreamVerifier *StreamVerifier::stream_verifier = NULL;
+
+static Log *p_log = Log::get_instance();
+
+/**
+ * @description: single instance class function to get instance
+ * @return: stream verifier instance
+ */
+StreamVerifier *StreamVerifier::get_instance()
+{
+    if (StreamVerifier::stream_verifier == NULL)
+    {
+        stream_verifier_mutex.lock();
+        if (StreamVerifier::stream_verifier == NULL)
+        {
+            StreamVerifier::stream_verifier = new StreamVerifier();
+        }
+        stream_verifier_mutex.unlock();
+    }
+
+    return StreamVerifier::stream_verifier;
+}
+
+/**
+ * @description: constructor
+ */
+StreamVerifier::StreamVerifier() : pool(STREAM_VERIFIER_THREAD_NUM)
+{
+    this->stopping = false;
+}
+
+/**
+ * @description: Stop all streaming connections, each one finishes its evidences in flight first
+ */
+void StreamVerifier::stop()
+{
+    this->stopping = true;
+}
+
+/**
+ * @description: Serve upgraded connection until client closes it. Every text message is an
+ * /entryNetwork body with an optional integer "id", results are sent back with the same id as soon
+ * as they are ready, so they may come out of order. At most window messages are verified at the
+ * same time, further ones are left unread in socket until a result is sent. Evidences still waiting once
+ * their timeout passed are answered with 504, those of a client gone are dropped.
+ * @param req -> Upgrade request, ?window=N asks for a smaller or bigger window, ?timeout=MS sets
+ * how long each message may wait for verification, no limit by default
+ * @param strm -> Connection stream
+ * @return: Always false, connection is closed afterwards
+ */
+bool StreamVerifier::serve(const httplib::Request &req, httplib::Stream &strm)
+{
+    if (!WebSocket::accept(req, strm))
+    {
+        return false;
+    }
+
+    size_t window = STREAM_VERIFIER_WINDOW;
+    if (req.has_param("window"))
+    {
+        long n = atol(req.get_param_value("window").c_str());
+        window = n < 1 ? 1 : std::min((size_t)n, (size_t)STREAM_VERIFIER_MAX_WINDOW);
+    }
+    uint64_t timeout_ms = 0;
+    if (req.has_param("timeout"))
+    {
+        long long n = atoll(req.get_param_value("timeout").c_str());
+        timeout_ms = n < 1 ? 0 : (uint64_t)n;
+    }
+
+    WebSocket ws(strm);
+    stream_conn_t conn;
+    conn.ws = &ws;
+    conn.in_flight = 0;
+    conn.gone = false;
+
+    char hello[64];
+    int hello_len = snprintf(hello, sizeof(hello), "{  \"window\" : %lu}", window);
+    ws.send_text(hello, hello_len);
+
+    std::string msg;
+    bool is_text = false;
+    uint16_t close_code = WS_CLOSE_GOING_AWAY;
+    auto last_active = std::chrono::steady_clock::now();
+    while (!this->stopping)
+    {
+        {
+            std::unique_lock<std::mutex> lock(conn.mutex);
+            if (conn.in_flight >= window)
+            {
+                conn.cond.wait_for(lock, std::chrono::milliseconds(STREAM_VERIFIER_POLL_MS));
+                continue;
+            }
+        }
+
+        ws_read_status_t status = ws.read_message(msg, &is_text);
+        if (status == WS_READ_IDLE)
+        {
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            if (conn.in_flight == 0 && std::chrono::steady_clock::now() - last_active
+                    > std::chrono::seconds(STREAM_VERIFIER_IDLE_TIMEOUT_S))
+            {
+                break;
+            }
+            continue;
+        }
+        if (status != WS_READ_MESSAGE)
+        {
+            // Results still reach a client which sent close frame, but not one whose connection ended
+            if (status != WS_READ_CLOSED)
+            {
+                std::lock_guard<std::mutex> lock(conn.mutex);
+                conn.gone = true;
+            }
+            close_code = WS_CLOSE_NORMAL;
+            break;
+        }
+        if (!is_text)
+        {
+            close_code = WS_CLOSE_UNSUPPORTED_DATA;
+            break;
+        }
+        last_active = std::chrono::steady_clock::now();
+        uint64_t deadline_ms = 0;
+        if (timeout_ms != 0)
+        {
+            deadline_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count() + timeout_ms;
+        }
+
+        // Body is copied into arena of its own, because verification unescapes it in place
+        Arena *arena = Arena::create();
+        char *body = arena != NULL ? arena->strndup(msg.data(), msg.size()) : NULL;
+        if (body == NULL)
+        {
+            if (arena != NULL)
+                Arena::release(arena);
+            close_code = WS_CLOSE_GOING_AWAY;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            conn.in_flight++;
+        }
+        size_t body_len = msg.size();
+        this->pool.submit([this, &conn, arena, body, body_len, deadline_ms] {
+            this->verify(&conn, arena, body, body_len, deadline_ms);
+        });
+    }
+
+    // Results in flight still go out before close frame
+    {
+        std::unique_lock<std::mutex> lock(conn.mutex);
+        conn.cond.wait(lock, [&conn] { return conn.in_flight == 0; });
+    }
+    ws.send_close(close_code);
+
+    return false;
+}
+
+/**
+ * @description: Verify one streamed evidence and send its result, runs on verification pool
+ * @param conn -> Connection of the evidence
+ * @param arena -> Arena holding body, released here
+ * @param body -> Request body
+ * @param body_len -> Request body length
+ * @param deadline_ms -> Deadline in Unix milliseconds, 0 for none
+ */
+void StreamVerifier::verify(stream_conn_t *conn, Arena *arena, char *body, size_t body_len, uint64_t deadline_ms)
+{
+    Metrics *p_metrics = Metrics::get_instance();
+    Verifier *p_verifier = Verifier::get_instance();
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto is_stale = [conn, deadline_ms] {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        return conn->gone || is_deadline_passed(deadline_ms);
+    };
+    verify_result_t result;
+    if (is_stale())
+    {
+        // Parsed only for its id, so that client can tell which evidence is dropped
+        verify_evidence_t evidence;
+        p_verifier->parse_request(arena, body, body_len, &evidence, &result);
+        p_metrics->add(METRIC_CANCELLED_STREAM_QUEUE_TOTAL);
+        result.message = "Request deadline passed!";
+        result.status_code = 504;
+    }
+    else
+    {
+        p_log->info("Dealing with new stream request...\n");
+        p_verifier->verify(arena, body, body_len, &result, is_stale);
+
+        p_metrics->add(METRIC_REQUEST_TOTAL);
+        p_metrics->add(METRIC_STREAM_REQUEST_TOTAL);
+        p_metrics->add(200 == result.status_code ? METRIC_VERIFY_SUCCESS : METRIC_VERIFY_FAILED);
+        p_metrics->add(METRIC_VERIFY_LATENCY_US, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time).count());
+    }
+
+    // Result is the /entryNetwork response body with id put in front
+    size_t resp_len = 0;
+    char *resp = p_verifier->dump_result(arena, &result, &resp_len);
+    char *frame = resp != NULL ? (char *)arena->alloc(resp_len + result.id_len + 16, 1) : NULL;
+    bool gone = false;
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        gone = conn->gone;
+    }
+    if (frame != NULL && !gone)
+    {
+        size_t frame_len = 0;
+        if (result.id != NULL)
+            frame_len = sprintf(frame, "{  \"id\" : %.*s,", (int)result.id_len, result.id);
+        else
+            frame_len = sprintf(frame, "{  \"id\" : null,");
+        memcpy(frame + frame_len, resp + 1, resp_len - 1);
+        frame_len += resp_len - 1;
+        conn->ws->send_text(frame, frame_len);
+    }
+    Arena::release(arena);
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    conn->in_flight--;
+    conn->cond.notify_all();
+}
@@ -0,0 +1,52 @@
+#ifndef _CRUST_STREAM_VERIFIER_H_
+#define _CRUST_STREAM_VERIFIER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "httplib.h"
+#include "WebSocket.h"
+#include "Scheduler.h"
+#include "Arena.h"
+
+// Evidences of one connection being verified at the same time, unless client asks for fewer
+#define STREAM_VERIFIER_WINDOW 32
+// Largest window a client may ask for with ?window=N
+#define STREAM_VERIFIER_MAX_WINDOW 256
+// Threads of each process verifying streamed evidences, shared by all connections
+#define STREAM_VERIFIER_THREAD_NUM 16
+// Connection with nothing in flight is closed after this long without a message
+#define STREAM_VERIFIER_IDLE_TIMEOUT_S 60
+// How often a reader blocked on a full window checks for stop
+#define STREAM_VERIFIER_POLL_MS 100
+
+// State of one streaming connection, shared by its reader and verification jobs
+typedef struct _stream_conn_t
+{
+    WebSocket *ws;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t in_flight;
+    // Connection ended or client broke protocol, its evidences not verified yet are dropped
+    bool gone;
+} stream_conn_t;
+
+class StreamVerifier
+{
+public:
+    static StreamVerifier *stream_verifier;
+    static StreamVerifier *get_instance();
+    bool serve(const httplib::Request &req, httplib::Stream &strm);
+    void stop();
+
+private:
+    void verify(stream_conn_t *conn, Arena *arena, char *body, size_t body_len, uint64_t deadline_ms);
+    BlockingPool pool;
+    std::atomic<bool> stopping;
+    StreamVerifier(void);
+};
+
+#endif /* !_CRUST_STREAM_VERIFIER_H_ */
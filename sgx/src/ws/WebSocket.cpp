@@ -0,0 +1,218 @@
+#include "WebSocket.h"
+
+#include <openssl/sha.h>
+#include <string.h>
+#include <strings.h>
+
+// Appended to client key when computing Sec-WebSocket-Accept
+#define WS_HANDSHAKE_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * @description: Answer opening handshake, a bad one is answered with 400
+ * @param req -> Upgrade request
+ * @param strm -> Connection stream
+ * @return: Upgraded or not
+ */
+bool WebSocket::accept(const httplib::Request &req, httplib::Stream &strm)
+{
+    std::string key = req.get_header_value("Sec-WebSocket-Key");
+    if (req.method != "GET"
+            || strcasecmp(req.get_header_value("Upgrade").c_str(), "websocket") != 0
+            || strcasestr(req.get_header_value("Connection").c_str(), "upgrade") == NULL
+            || req.get_header_value("Sec-WebSocket-Version") != "13"
+            || key.empty())
+    {
+        const char *resp = "HTTP/1.1 400 Bad Request\r\nSec-WebSocket-Version: 13\r\n"
+            "Content-Length: 0\r\nConnection: close\r\n\r\n";
+        strm.write(resp, strlen(resp));
+        return false;
+    }
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    key.append(WS_HANDSHAKE_GUID);
+    SHA1(reinterpret_cast<const unsigned char *>(key.data()), key.size(), digest);
+    std::string resp = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ";
+    resp.append(httplib::detail::base64_encode(std::string(reinterpret_cast<char *>(digest), sizeof(digest))));
+    resp.append("\r\n\r\n");
+
+    return strm.write(resp.data(), resp.size()) == static_cast<ssize_t>(resp.size());
+}
+
+/**
+ * @description: constructor
+ * @param strm -> Upgraded connection stream
+ */
+WebSocket::WebSocket(httplib::Stream &strm) : strm(strm)
+{
+    this->close_sent = false;
+}
+
+/**
+ * @description: Read exactly indicated bytes
+ * @param buf -> Buffer
+ * @param len -> Length
+ * @return: Read or not, false if peer went away or stalled for read timeout
+ */
+bool WebSocket::read_exact(char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = this->strm.read(buf, len);
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/**
+ * @description: Read next data message, answering ping frames on the way
+ * @param msg -> Message payload, unmasked
+ * @param is_text -> Whether message is text
+ * @return: Read status
+ */
+ws_read_status_t WebSocket::read_message(std::string &msg, bool *is_text)
+{
+    msg.clear();
+    bool in_message = false;
+    while (true)
+    {
+        // Only idle between messages, a stalled frame means a broken peer
+        if (!in_message && !this->strm.is_readable())
+            return WS_READ_IDLE;
+
+        uint8_t head[2];
+        if (!this->read_exact(reinterpret_cast<char *>(head), sizeof(head)))
+            return WS_READ_GONE;
+        bool fin = (head[0] & 0x80) != 0;
+        uint8_t opcode = head[0] & 0x0F;
+        bool masked = (head[1] & 0x80) != 0;
+        uint64_t len = head[1] & 0x7F;
+        bool is_control = (opcode & 0x08) != 0;
+        // Extensions are not negotiated, and clients must mask their frames
+        if ((head[0] & 0x70) != 0 || !masked || (is_control && (!fin || len > 125)))
+        {
+            this->send_close(WS_CLOSE_PROTOCOL_ERROR);
+            return WS_READ_ERROR;
+        }
+        if (len >= 126)
+        {
+            uint8_t ext[8];
+            size_t ext_len = len == 126 ? 2 : 8;
+            if (!this->read_exact(reinterpret_cast<char *>(ext), ext_len))
+                return WS_READ_GONE;
+            len = 0;
+            for (size_t i = 0; i < ext_len; i++)
+                len = (len << 8) | ext[i];
+        }
+        uint8_t mask[4];
+        if (!this->read_exact(reinterpret_cast<char *>(mask), sizeof(mask)))
+            return WS_READ_GONE;
+
+        if (is_control)
+        {
+            char payload[125];
+            if (!this->read_exact(payload, len))
+                return WS_READ_GONE;
+            for (size_t i = 0; i < len; i++)
+                payload[i] ^= mask[i & 3];
+            if (opcode == WS_OPCODE_CLOSE)
+                return WS_READ_CLOSED;
+            if (opcode == WS_OPCODE_PING)
+                this->send_frame(WS_OPCODE_PONG, payload, len);
+            continue;
+        }
+
+        if ((opcode == WS_OPCODE_CONTINUATION) != in_message
+                || (opcode != WS_OPCODE_CONTINUATION && opcode != WS_OPCODE_TEXT && opcode != WS_OPCODE_BINARY))
+        {
+            this->send_close(WS_CLOSE_PROTOCOL_ERROR);
+            return WS_READ_ERROR;
+        }
+        if (len > WS_MESSAGE_MAX_SIZE - msg.size())
+        {
+            this->send_close(WS_CLOSE_TOO_BIG);
+            return WS_READ_ERROR;
+        }
+        if (!in_message)
+        {
+            *is_text = opcode == WS_OPCODE_TEXT;
+            in_message = true;
+        }
+
+        size_t off = msg.size();
+        msg.resize(off + len);
+        char *payload = &msg[off];
+        if (!this->read_exact(payload, len))
+            return WS_READ_GONE;
+        for (size_t i = 0; i < len; i++)
+            payload[i] ^= mask[i & 3];
+        if (fin)
+            return WS_READ_MESSAGE;
+    }
+}
+
+/**
+ * @description: Send one text message in a single frame
+ * @param data -> Message
+ * @param len -> Message length
+ * @return: Sent or not
+ */
+bool WebSocket::send_text(const char *data, size_t len)
+{
+    return this->send_frame(WS_OPCODE_TEXT, data, len);
+}
+
+/**
+ * @description: Send close frame, nothing is sent after it
+ * @param code -> Close code
+ * @return: Sent or not
+ */
+bool WebSocket::send_close(uint16_t code)
+{
+    char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+    return this->send_frame(WS_OPCODE_CLOSE, payload, sizeof(payload));
+}
+
+/**
+ * @description: Send unmasked frame, head and payload go out in one write
+ * @param opcode -> Frame opcode
+ * @param data -> Payload
+ * @param len -> Payload length
+ * @return: Sent or not
+ */
+bool WebSocket::send_frame(uint8_t opcode, const char *data, size_t len)
+{
+    char head[10];
+    size_t head_len = 2;
+    head[0] = static_cast<char>(0x80 | opcode);
+    if (len < 126)
+    {
+        head[1] = static_cast<char>(len);
+    }
+    else if (len <= 0xFFFF)
+    {
+        head[1] = 126;
+        head[2] = static_cast<char>(len >> 8);
+        head[3] = static_cast<char>(len & 0xFF);
+        head_len = 4;
+    }
+    else
+    {
+        head[1] = 127;
+        for (size_t i = 0; i < 8; i++)
+            head[2 + i] = static_cast<char>((uint64_t)len >> (56 - i * 8));
+        head_len = 10;
+    }
+
+    std::lock_guard<std::mutex> lock(this->write_mutex);
+    if (this->close_sent)
+        return false;
+    if (opcode == WS_OPCODE_CLOSE)
+        this->close_sent = true;
+
+    return this->strm.write_gathered(head, head_len, data, len);
+}
@@ -0,0 +1,60 @@
+#ifndef _CRUST_WEB_SOCKET_H_
+#define _CRUST_WEB_SOCKET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <string>
+
+#include "httplib.h"
+
+// Frame opcodes of RFC 6455
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+// Close codes of RFC 6455
+#define WS_CLOSE_NORMAL 1000
+#define WS_CLOSE_GOING_AWAY 1001
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_UNSUPPORTED_DATA 1003
+#define WS_CLOSE_TOO_BIG 1009
+// Largest message taken from a peer, a few quotes in hex fit in it
+#define WS_MESSAGE_MAX_SIZE (1024 * 1024)
+
+enum ws_read_status_t
+{
+    // A whole data message is read
+    WS_READ_MESSAGE,
+    // Nothing arrived within read timeout, connection is fine
+    WS_READ_IDLE,
+    // Peer sent close frame, caller answers with close once its messages are out
+    WS_READ_CLOSED,
+    // Connection ended or failed, nothing reaches peer any more
+    WS_READ_GONE,
+    // Peer broke protocol, close frame with the reason is sent already
+    WS_READ_ERROR,
+};
+
+// Server side of a WebSocket connection on top of an upgraded http stream.
+// Reads happen on one thread, writes may come from any thread.
+class WebSocket
+{
+public:
+    static bool accept(const httplib::Request &req, httplib::Stream &strm);
+    WebSocket(httplib::Stream &strm);
+    ws_read_status_t read_message(std::string &msg, bool *is_text);
+    bool send_text(const char *data, size_t len);
+    bool send_close(uint16_t code);
+
+private:
+    bool read_exact(char *buf, size_t len);
+    bool send_frame(uint8_t opcode, const char *data, size_t len);
+    httplib::Stream &strm;
+    std::mutex write_mutex;
+    bool close_sent;
+};
+
+#endif /* !_CRUST_WEB_SOCKET_H_ */